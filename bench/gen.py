@@ -0,0 +1,339 @@
+#!/usr/bin/env python3
+
+# A synthetic translation unit for measuring compile throughput, as big as
+# asked: a slice of libc-style declarations, many globals and string
+# literals, and thousands of functions with deep block nesting, long
+# expression chains, big switches and calls between them. The same
+# arguments always give the same file.
+#
+# It sticks to what dcc compiles: no typedefs (so the libc declarations are
+# spelled out rather than #included), no casts, no floating point, no
+# bitwise operators.
+#
+#   python3 bench/gen.py [--functions N] [--seed S] [-o file.c]
+
+import argparse
+import random
+import sys
+
+# what libc's headers declare, minus the typedefs
+LIBC = '''
+struct _IO_FILE;
+struct tm {
+    int tm_sec;
+    int tm_min;
+    int tm_hour;
+    int tm_mday;
+    int tm_mon;
+    int tm_year;
+    int tm_wday;
+    int tm_yday;
+    int tm_isdst;
+    long tm_gmtoff;
+    const char *tm_zone;
+};
+struct timespec {
+    long tv_sec;
+    long tv_nsec;
+};
+struct div {
+    int quot;
+    int rem;
+};
+struct ldiv {
+    long quot;
+    long rem;
+};
+
+extern struct _IO_FILE *stdin;
+extern struct _IO_FILE *stdout;
+extern struct _IO_FILE *stderr;
+
+int printf(const char *format, ...);
+int fprintf(struct _IO_FILE *stream, const char *format, ...);
+int sprintf(char *str, const char *format, ...);
+int snprintf(char *str, unsigned long size, const char *format, ...);
+int puts(const char *s);
+int fputs(const char *s, struct _IO_FILE *stream);
+int putchar(int c);
+int fputc(int c, struct _IO_FILE *stream);
+int getchar();
+int fgetc(struct _IO_FILE *stream);
+char *fgets(char *s, int size, struct _IO_FILE *stream);
+struct _IO_FILE *fopen(const char *pathname, const char *mode);
+int fclose(struct _IO_FILE *stream);
+int fflush(struct _IO_FILE *stream);
+unsigned long fread(void *ptr, unsigned long size, unsigned long nmemb, struct _IO_FILE *stream);
+unsigned long fwrite(const void *ptr, unsigned long size, unsigned long nmemb, struct _IO_FILE *stream);
+int fseek(struct _IO_FILE *stream, long offset, int whence);
+long ftell(struct _IO_FILE *stream);
+void rewind(struct _IO_FILE *stream);
+int remove(const char *pathname);
+int rename(const char *oldpath, const char *newpath);
+void perror(const char *s);
+
+void *malloc(unsigned long size);
+void *calloc(unsigned long nmemb, unsigned long size);
+void *realloc(void *ptr, unsigned long size);
+void free(void *ptr);
+void abort();
+void exit(int status);
+int atexit(void (*function)());
+char *getenv(const char *name);
+int setenv(const char *name, const char *value, int overwrite);
+int system(const char *command);
+int atoi(const char *nptr);
+long atol(const char *nptr);
+long strtol(const char *nptr, char **endptr, int base);
+unsigned long strtoul(const char *nptr, char **endptr, int base);
+long long strtoll(const char *nptr, char **endptr, int base);
+unsigned long long strtoull(const char *nptr, char **endptr, int base);
+int rand();
+void srand(unsigned int seed);
+int abs(int j);
+long labs(long j);
+struct div div(int numerator, int denominator);
+struct ldiv ldiv(long numerator, long denominator);
+void qsort(void *base, unsigned long nmemb, unsigned long size, int (*compar)(const void *a, const void *b));
+void *bsearch(const void *key, const void *base, unsigned long nmemb, unsigned long size, int (*compar)(const void *a, const void *b));
+
+void *memcpy(void *dest, const void *src, unsigned long n);
+void *memmove(void *dest, const void *src, unsigned long n);
+void *memset(void *s, int c, unsigned long n);
+int memcmp(const void *s1, const void *s2, unsigned long n);
+void *memchr(const void *s, int c, unsigned long n);
+char *strcpy(char *dest, const char *src);
+char *strncpy(char *dest, const char *src, unsigned long n);
+char *strcat(char *dest, const char *src);
+char *strncat(char *dest, const char *src, unsigned long n);
+int strcmp(const char *s1, const char *s2);
+int strncmp(const char *s1, const char *s2, unsigned long n);
+char *strchr(const char *s, int c);
+char *strrchr(const char *s, int c);
+char *strstr(const char *haystack, const char *needle);
+unsigned long strlen(const char *s);
+unsigned long strspn(const char *s, const char *accept);
+unsigned long strcspn(const char *s, const char *reject);
+char *strpbrk(const char *s, const char *accept);
+char *strtok(char *str, const char *delim);
+char *strtok_r(char *str, const char *delim, char **saveptr);
+char *strdup(const char *s);
+char *strerror(int errnum);
+
+int isalnum(int c);
+int isalpha(int c);
+int isdigit(int c);
+int islower(int c);
+int isupper(int c);
+int isspace(int c);
+int isxdigit(int c);
+int tolower(int c);
+int toupper(int c);
+
+long time(long *tloc);
+struct tm *localtime(const long *timep);
+struct tm *gmtime(const long *timep);
+long mktime(struct tm *tm);
+unsigned long strftime(char *s, unsigned long max, const char *format, const struct tm *tm);
+int clock_gettime(int clockid, struct timespec *tp);
+int nanosleep(const struct timespec *req, struct timespec *rem);
+
+int open(const char *pathname, int flags, ...);
+int close(int fd);
+long read(int fd, void *buf, unsigned long count);
+long write(int fd, const void *buf, unsigned long count);
+long lseek(int fd, long offset, int whence);
+int unlink(const char *pathname);
+int getpid();
+int fork();
+int pipe(int *pipefd);
+int dup2(int oldfd, int newfd);
+unsigned int sleep(unsigned int seconds);
+'''
+
+WORDS = ['alpha', 'bravo', 'charlie', 'delta', 'echo', 'foxtrot', 'golf', 'hotel',
+         'india', 'juliet', 'kilo', 'lima', 'mike', 'november', 'oscar', 'papa']
+
+class Gen:
+    def __init__(self, functions, seed):
+        self.n = functions
+        self.r = random.Random(seed)
+        self.out = []
+
+    def emit(self, s=''):
+        self.out.append(s)
+
+    def string(self):
+        return ' '.join(self.r.choice(WORDS) for _ in range(self.r.randint(2, 8)))
+
+    # a chain of terms over the variables in vs, each op chosen at random
+    def chain(self, vs, terms):
+        e = self.r.choice(vs)
+        for _ in range(terms):
+            op = self.r.choice(['+', '-', '*', '+', '-', '<', '=='])
+            t = self.r.choice(vs + [str(self.r.randint(1, 99))])
+            e = f'({e} {op} {t})' if self.r.random() < 0.3 else f'{e} {op} {t}'
+        return e
+
+    def globals(self):
+        self.emit('struct rec {')
+        self.emit('    int key;')
+        self.emit('    long value;')
+        self.emit('    const char *name;')
+        self.emit('    struct rec *next;')
+        self.emit('};')
+        self.emit()
+        for i in range(self.n // 4):
+            self.emit(f'int g_int_{i};')
+            self.emit(f'long g_arr_{i}[{self.r.randint(4, 64)}];')
+            self.emit(f'char *g_str_{i} = "{self.string()} {i}";')
+            self.emit(f'struct rec g_rec_{i};')
+        self.emit()
+
+    def g(self, kind):
+        return f'g_{kind}_{self.r.randrange(self.n // 4)}'
+
+    # deep nesting: loops in conditionals in loops
+    def nested(self, i, depth):
+        self.emit(f'long f{i}(long n) {{')
+        self.emit('    long s;')
+        for d in range(depth):
+            self.emit(f'    long i{d};')
+        self.emit('    s = 0;')
+        ind = '    '
+        for d in range(depth):
+            v = f'i{d}'
+            if d % 3 == 0:
+                self.emit(f'{ind}for ({v} = 0; {v} < n; {v}++) {{')
+            elif d % 3 == 1:
+                self.emit(f'{ind}if ((s + {v}) % {d + 2} != 0) {{')
+                self.emit(f'{ind}    {v} = s % 4;')
+                self.emit(f'{ind}    while ({v} < {d}) {{')
+                ind += '    '
+            else:
+                self.emit(f'{ind}{v} = n - {d};')
+                self.emit(f'{ind}do {{')
+            ind += '    '
+            self.emit(f'{ind}s = s + {self.chain(["s", "n", v], 4)};')
+            self.emit(f'{ind}{self.g("int")} += s % 8;')
+        for d in reversed(range(depth)):
+            v = f'i{d}'
+            if d % 3 == 2:
+                self.emit(f'{ind}{v}--;')
+            elif d % 3 == 1:
+                self.emit(f'{ind}{v}++;')
+            ind = ind[:-4]
+            if d % 3 == 0:
+                self.emit(f'{ind}}}')
+            elif d % 3 == 1:
+                ind = ind[:-4]
+                self.emit(f'{ind}    }}')
+                self.emit(f'{ind}}}')
+            else:
+                self.emit(f'{ind}}} while ({v} > n);')
+        self.emit('    return s;')
+        self.emit('}')
+
+    def expression(self, i):
+        self.emit(f'long f{i}(long a, long b, long c) {{')
+        self.emit('    long x;')
+        self.emit('    long y;')
+        self.emit(f'    x = {self.chain(["a", "b", "c"], self.r.randint(20, 60))};')
+        self.emit(f'    y = {self.chain(["a", "b", "c", "x"], self.r.randint(20, 60))};')
+        self.emit(f'    {self.g("arr")}[x % 4] = y;')
+        self.emit('    return x - y;')
+        self.emit('}')
+
+    def switch(self, i):
+        cases = self.r.randint(32, 128)
+        self.emit(f'int f{i}(int v) {{')
+        self.emit('    int r;')
+        self.emit('    r = 0;')
+        self.emit(f'    switch (v % {cases}) {{')
+        for c in range(cases):
+            self.emit(f'        case {c}:')
+            if self.r.random() < 0.3:
+                self.emit(f'            r = r + strlen("{self.string()}");')
+            else:
+                self.emit(f'            r = {self.chain(["v", "r"], 3)};')
+            if self.r.random() < 0.8:
+                self.emit('            break;')
+        self.emit('        default:')
+        self.emit('            r = -1;')
+        self.emit('    }')
+        self.emit('    return r;')
+        self.emit('}')
+
+    def strings(self, i):
+        self.emit(f'int f{i}(char *buf) {{')
+        self.emit('    int n;')
+        self.emit(f'    n = strlen({self.g("str")});')
+        for _ in range(self.r.randint(4, 16)):
+            self.emit(f'    if (strcmp(buf, "{self.string()}") == 0)')
+            self.emit(f'        n = n + strlen("{self.string()}");')
+        self.emit(f'    {self.g("rec")}.name = "{self.string()}";')
+        self.emit(f'    {self.g("rec")}.key = n;')
+        self.emit('    return n;')
+        self.emit('}')
+
+    def calls(self, i, kinds):
+        self.emit(f'long f{i}(long a) {{')
+        self.emit('    long t;')
+        self.emit('    t = a;')
+        for j in self.r.sample(range(i), min(i, 8)):
+            if kinds[j] == 'nested':
+                self.emit(f'    t = t + f{j}(a % 4);')
+            elif kinds[j] == 'expression':
+                self.emit(f'    t = t + f{j}(t, a, {j});')
+            elif kinds[j] == 'switch':
+                self.emit(f'    t = t + f{j}(a + {j});')
+            elif kinds[j] == 'strings':
+                self.emit(f'    t = t + f{j}({self.g("str")});')
+            else:
+                self.emit(f'    t = t + f{j}(a - 1);')
+        self.emit('    return t;')
+        self.emit('}')
+
+    def generate(self):
+        self.emit(f'// generated by bench/gen.py --functions {self.n}')
+        self.emit(LIBC)
+        self.globals()
+
+        kinds = []
+        for i in range(self.n):
+            kind = self.r.choice(['nested', 'expression', 'switch', 'strings', 'calls'] if i else ['expression'])
+            kinds.append(kind)
+            if kind == 'nested':
+                self.nested(i, self.r.randint(4, 12))
+            elif kind == 'expression':
+                self.expression(i)
+            elif kind == 'switch':
+                self.switch(i)
+            elif kind == 'strings':
+                self.strings(i)
+            else:
+                self.calls(i, kinds)
+            self.emit()
+
+        self.emit('int main() {')
+        self.emit('    return 0;')
+        self.emit('}')
+
+        return '\n'.join(self.out) + '\n'
+
+def generate(functions, seed=1):
+    return Gen(functions, seed).generate()
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--functions', type=int, default=2000, help='how many (default: 2000)')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('-o', dest='out', help='write here instead of stdout')
+    args = parser.parse_args()
+
+    text = generate(args.functions, args.seed)
+    if args.out:
+        with open(args.out, 'w') as f:
+            f.write(text)
+    else:
+        sys.stdout.write(text)
@@ -0,0 +1,15 @@
+// Recursion: the call sequence, and little else.
+
+int printf();
+int fib(int n);
+
+int fib(int n) {
+    if (n < 2)
+        return n;
+    return fib(n - 1) + fib(n - 2);
+}
+
+int main() {
+    printf("%d\n", fib(35));
+    return 0;
+}
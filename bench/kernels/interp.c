@@ -0,0 +1,118 @@
+// A switch-heavy interpreter: a little stack machine running a counting loop.
+
+int printf();
+
+int program[64];
+long stack[64];
+
+// runs code until it halts (op 10), returning variable 1
+long run(int *code) {
+    int pc;
+    int sp;
+    long vars[4];
+
+    pc = 0;
+    sp = 0;
+    vars[0] = 0;
+    vars[1] = 0;
+    vars[2] = 0;
+    vars[3] = 0;
+
+    while (code[pc] != 10) {
+        switch (code[pc]) {
+            case 0:     // push immediate
+                stack[sp] = code[pc + 1];
+                sp++;
+                pc += 2;
+                break;
+            case 1:     // load
+                stack[sp] = vars[code[pc + 1]];
+                sp++;
+                pc += 2;
+                break;
+            case 2:     // store
+                sp--;
+                vars[code[pc + 1]] = stack[sp];
+                pc += 2;
+                break;
+            case 3:     // add
+                sp--;
+                stack[sp - 1] = stack[sp - 1] + stack[sp];
+                pc++;
+                break;
+            case 4:     // sub
+                sp--;
+                stack[sp - 1] = stack[sp - 1] - stack[sp];
+                pc++;
+                break;
+            case 5:     // mul
+                sp--;
+                stack[sp - 1] = stack[sp - 1] * stack[sp];
+                pc++;
+                break;
+            case 6:     // mod
+                sp--;
+                stack[sp - 1] = stack[sp - 1] % stack[sp];
+                pc++;
+                break;
+            case 7:     // less than
+                sp--;
+                stack[sp - 1] = stack[sp - 1] < stack[sp];
+                pc++;
+                break;
+            case 8:     // jump if zero
+                sp--;
+                if (!stack[sp])
+                    pc = code[pc + 1];
+                else
+                    pc += 2;
+                break;
+            case 9:     // jump
+                pc = code[pc + 1];
+                break;
+        }
+    }
+
+    return vars[1];
+}
+
+int emit(int at, int op, int arg) {
+    program[at] = op;
+    program[at + 1] = arg;
+    return at + 2;
+}
+
+int main() {
+    int at;
+    int loop;
+    int patch;
+
+    // for (i = 0; i < 5000000; i++) sum = (sum + i * 3) % 1000003;
+    at = 0;
+    at = emit(at, 0, 0);
+    at = emit(at, 2, 0);
+    loop = at;
+    at = emit(at, 1, 0);
+    at = emit(at, 0, 5000000);
+    program[at++] = 7;
+    patch = at;
+    at = emit(at, 8, 0);
+    at = emit(at, 1, 1);
+    at = emit(at, 1, 0);
+    at = emit(at, 0, 3);
+    program[at++] = 5;
+    program[at++] = 3;
+    at = emit(at, 0, 1000003);
+    program[at++] = 6;
+    at = emit(at, 2, 1);
+    at = emit(at, 1, 0);
+    at = emit(at, 0, 1);
+    program[at++] = 3;
+    at = emit(at, 2, 0);
+    at = emit(at, 9, loop);
+    program[patch + 1] = at;
+    program[at] = 10;
+
+    printf("%ld\n", run(program));
+    return 0;
+}
@@ -0,0 +1,55 @@
+// Pointer chasing: walking a linked list laid out in a scrambled order.
+
+int printf();
+
+struct node {
+    struct node *next;
+    long value;
+};
+
+struct node nodes[200000];
+int order[200000];
+
+int main() {
+    int n;
+    int i;
+    int j;
+    int t;
+    long seed;
+    long sum;
+    int round;
+    struct node *p;
+
+    n = 200000;
+    for (i = 0; i < n; i++)
+        order[i] = i;
+
+    // shuffle, so consecutive nodes are far apart in memory
+    seed = 12345;
+    for (i = n - 1; i > 0; i--) {
+        seed = (seed * 1103515245 + 12345) % 2147483648;
+        j = seed % (i + 1);
+        t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+
+    for (i = 0; i < n - 1; i++) {
+        nodes[order[i]].next = &nodes[order[i + 1]];
+        nodes[order[i]].value = i % 1000;
+    }
+    nodes[order[n - 1]].next = 0;
+    nodes[order[n - 1]].value = 1;
+
+    sum = 0;
+    for (round = 0; round < 100; round++) {
+        p = &nodes[order[0]];
+        while (p) {
+            sum += p->value;
+            p = p->next;
+        }
+    }
+
+    printf("%ld\n", sum);
+    return 0;
+}
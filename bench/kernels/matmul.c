@@ -0,0 +1,47 @@
+// Nested loops: integer matrix multiplication, with the matrices in flat arrays.
+
+int printf();
+
+long a[40000];
+long b[40000];
+long c[40000];
+
+void multiply(long *x, long *y, long *z, int n) {
+    int i;
+    int j;
+    int k;
+    long sum;
+
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < n; j++) {
+            sum = 0;
+            for (k = 0; k < n; k++)
+                sum += x[i * n + k] * y[k * n + j];
+            z[i * n + j] = sum % 1000;
+        }
+    }
+}
+
+int main() {
+    int n;
+    int i;
+    int round;
+    long total;
+
+    n = 200;
+    for (i = 0; i < n * n; i++) {
+        a[i] = i % 17;
+        b[i] = i % 13;
+    }
+
+    for (round = 0; round < 5; round++) {
+        multiply(a, b, c, n);
+        multiply(c, b, a, n);
+    }
+
+    total = 0;
+    for (i = 0; i < n * n; i++)
+        total += a[i];
+    printf("%ld\n", total);
+    return 0;
+}
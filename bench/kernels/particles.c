@@ -0,0 +1,57 @@
+// Arrays of structs: stepping a set of particles bouncing around a box.
+
+int printf();
+
+struct particle {
+    int x;
+    int y;
+    int dx;
+    int dy;
+    int bounces;
+};
+
+struct particle particles[10000];
+
+void step(struct particle *p, int n) {
+    int i;
+    for (i = 0; i < n; i++) {
+        p[i].x = p[i].x + p[i].dx;
+        p[i].y = p[i].y + p[i].dy;
+        if (p[i].x < 0 || p[i].x >= 100000) {
+            p[i].dx = -p[i].dx;
+            p[i].x = p[i].x + p[i].dx;
+            p[i].bounces = p[i].bounces + 1;
+        }
+        if (p[i].y < 0 || p[i].y >= 100000) {
+            p[i].dy = -p[i].dy;
+            p[i].y = p[i].y + p[i].dy;
+            p[i].bounces = p[i].bounces + 1;
+        }
+    }
+}
+
+int main() {
+    int n;
+    int i;
+    int t;
+    long total;
+
+    n = 10000;
+    for (i = 0; i < n; i++) {
+        particles[i].x = i * 7919 % 100000;
+        particles[i].y = i * 104729 % 100000;
+        particles[i].dx = i % 97 - 48;
+        particles[i].dy = i % 89 - 44;
+        particles[i].bounces = 0;
+    }
+
+    for (t = 0; t < 2000; t++)
+        step(particles, n);
+
+    total = 0;
+    for (i = 0; i < n; i++)
+        total += particles[i].bounces + particles[i].x + particles[i].y;
+
+    printf("%ld\n", total);
+    return 0;
+}
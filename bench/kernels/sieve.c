@@ -0,0 +1,38 @@
+// Loops over an array: the sieve of Eratosthenes, run again and again.
+
+int printf();
+
+char composite[1000000];
+
+int sieve(int n) {
+    int i;
+    int j;
+    int count;
+
+    i = 0;
+    while (i < n) {
+        composite[i] = 0;
+        i++;
+    }
+
+    count = 0;
+    for (i = 2; i < n; i++) {
+        if (!composite[i]) {
+            count++;
+            for (j = i + i; j < n; j += i)
+                composite[j] = 1;
+        }
+    }
+    return count;
+}
+
+int main() {
+    int round;
+    long total;
+
+    total = 0;
+    for (round = 0; round < 40; round++)
+        total += sieve(1000000);
+    printf("%ld\n", total);
+    return 0;
+}
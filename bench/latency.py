@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+
+# Per-invocation latency: compiling with a fresh dcc each time (cold) against
+# going through dcc --client to a running dcc --server.
+#
+#   python3 bench/latency.py [--runs N] [dcc options...]
+
+import argparse
+import os, sys
+import signal
+import statistics
+import subprocess
+import tempfile
+import time
+
+os.chdir(sys.path[0])
+
+DCC = os.path.abspath('../dcc')
+INPUTS = ['../test/cases/003.add.c', '../test/cases/007.forloop.c', '../test/cases/008.multifunc.c']
+CONFIGS = [
+    ('llvm, -c', ['-c']),
+    ('native, -c', ['-fbackend=native', '-c']),
+    ('native, linked', ['-fbackend=native']),
+]
+
+parser = argparse.ArgumentParser()
+parser.add_argument('--runs', type=int, default=20, help='compiles per measurement (default: 20)')
+parser.add_argument('flags', nargs='*', help='extra dcc options, for every compile')
+args = parser.parse_args()
+
+tmp = tempfile.mkdtemp(prefix='dcc-latency-')
+sock = os.path.join(tmp, 'dcc.sock')
+out = os.path.join(tmp, 'out')
+
+def run(cmd):
+    start = time.perf_counter()
+    subprocess.run(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL, check=True)
+    return time.perf_counter() - start
+
+def measure(prefix, flags, src):
+    run(prefix + flags + args.flags + ['-o', out, src]) # warm the page cache
+    return [run(prefix + flags + args.flags + ['-o', out, src]) for _ in range(args.runs)]
+
+server = subprocess.Popen([DCC, '--server', sock], stderr=subprocess.DEVNULL)
+while not os.path.exists(sock):
+    time.sleep(0.01)
+
+print(f"{'':<40}{'cold':>18}{'server':>18}")
+print(f"{'input, configuration':<40}{'median':>9}{'min':>9}{'median':>9}{'min':>9}{'saved':>9}")
+
+try:
+    for src in INPUTS:
+        for name, flags in CONFIGS:
+            cold = measure([DCC], flags, src)
+            warm = measure([DCC, '--client', sock], flags, src)
+
+            cm, wm = statistics.median(cold), statistics.median(warm)
+            print(f"{os.path.basename(src) + ', ' + name:<40}"
+                  f"{cm * 1e3:>7.2f}ms{min(cold) * 1e3:>7.2f}ms"
+                  f"{wm * 1e3:>7.2f}ms{min(warm) * 1e3:>7.2f}ms"
+                  f"{(cm - wm) / cm * 100:>8.1f}%")
+finally:
+    server.send_signal(signal.SIGTERM)
+    server.wait()
+    subprocess.run(['rm', '-rf', tmp])
@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+
+# How fast dcc's code runs: every kernel in bench/kernels/ built with dcc
+# (through LLVM and with the native backend) and with gcc (and clang, if
+# there is one) at -O0 and -O2, run several times each. Reports the median
+# runtimes as ratios to the reference compiler, and instruction counts when
+# perf stat works here. Every build of a kernel must print the same thing.
+# Results go to bench/results/runtime.json.
+#
+#   python3 bench/runtime.py [--runs N] [--ref CONFIG] [kernel...]
+
+import argparse
+import json
+import math
+import os, sys
+import platform
+import shutil
+import statistics
+import subprocess
+import tempfile
+import time
+
+os.chdir(sys.path[0])
+
+DCC = os.path.abspath('../dcc')
+KERNELS = 'kernels'
+RESULTS = 'results'
+
+CONFIGS = [
+    ('dcc', [DCC]),
+    ('dcc native', [DCC, '-fbackend=native']),
+    ('gcc -O0', ['gcc', '-O0', '-w']),
+    ('gcc -O2', ['gcc', '-O2', '-w']),
+]
+if shutil.which('clang'):
+    CONFIGS += [
+        ('clang -O0', ['clang', '-O0', '-w']),
+        ('clang -O2', ['clang', '-O2', '-w']),
+    ]
+
+parser = argparse.ArgumentParser()
+parser.add_argument('--runs', type=int, default=5, help='runs per build; the median is kept (default: 5)')
+parser.add_argument('--ref', default='gcc -O2', help='the configuration the others are compared with (default: gcc -O2)')
+parser.add_argument('kernels', nargs='*', help='kernels to run (default: all of them)')
+args = parser.parse_args()
+
+names = [c[0] for c in CONFIGS]
+if args.ref not in names:
+    sys.exit(f"no configuration '{args.ref}' (there are: {', '.join(names)})")
+
+kernels = args.kernels or sorted(f[:-2] for f in os.listdir(KERNELS) if f.endswith('.c'))
+
+# user-space instructions retired, if perf is there and allowed to count them
+def perf_works():
+    if not shutil.which('perf'):
+        return False
+    p = subprocess.run(['perf', 'stat', '-x,', '-e', 'instructions:u', 'true'],
+                       stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+    return p.returncode == 0 and 'not supported' not in p.stderr and '<not counted>' not in p.stderr
+
+def instructions(exe):
+    p = subprocess.run(['perf', 'stat', '-x,', '-e', 'instructions:u', exe],
+                       stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+    for line in p.stderr.splitlines():
+        fields = line.split(',')
+        if len(fields) > 2 and fields[2].startswith('instructions') and fields[0].isdigit():
+            return int(fields[0])
+    return None
+
+def build(cmd, src, exe):
+    p = subprocess.run(cmd + ['-o', exe, src], stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+    if p.returncode:
+        sys.exit(f'{" ".join(cmd)} {src} failed:\n{p.stderr}')
+
+def run(exe):
+    start = time.perf_counter()
+    p = subprocess.run([exe], stdout=subprocess.PIPE, text=True)
+    elapsed = time.perf_counter() - start
+    if p.returncode:
+        sys.exit(f'{exe} exited with {p.returncode}')
+    return elapsed, p.stdout
+
+counting = perf_works()
+results = {
+    'date': time.strftime('%Y-%m-%d %H:%M:%S'),
+    'host': platform.node(),
+    'runs': args.runs,
+    'ref': args.ref,
+    'kernels': {},
+}
+
+tmp = tempfile.mkdtemp(prefix='dcc-runtime-')
+try:
+    print(f"median of {args.runs} runs; ratios are to {args.ref}"
+          + ('' if counting else '; no instruction counts (perf stat isn\'t available)'))
+    print(f"{'kernel':<12}" + ''.join(f'{n:>19}' for n in names))
+
+    for k in kernels:
+        src = os.path.join(KERNELS, k + '.c')
+        per = {}
+        for i, (name, cmd) in enumerate(CONFIGS):
+            exe = os.path.join(tmp, f'{k}_{i}')
+            build(cmd, src, exe)
+
+            _, expect = run(exe) # warm up, and keep the output to check the others against
+            times = []
+            for _ in range(args.runs):
+                elapsed, out = run(exe)
+                if out != expect:
+                    sys.exit(f'{k} built with {name} printed {out!r}, then {expect!r}')
+                times.append(elapsed)
+
+            per[name] = {
+                'median': statistics.median(times),
+                'min': min(times),
+                'output': expect,
+                'instructions': instructions(exe) if counting else None,
+            }
+
+        for name, r in per.items():
+            if r['output'] != per[args.ref]['output']:
+                sys.exit(f"{k} built with {name} printed {r['output']!r}, but with {args.ref} {per[args.ref]['output']!r}")
+            r['ratio'] = r['median'] / per[args.ref]['median']
+
+        results['kernels'][k] = per
+        print(f'{k:<12}' + ''.join(f"{per[n]['median'] * 1e3:>10.1f}ms {per[n]['ratio']:5.2f}x" for n in names))
+        if counting:
+            print(f"{'':<12}" + ''.join(f"{(per[n]['instructions'] or 0) / 1e6:>10.1f}M instrs" for n in names))
+finally:
+    subprocess.run(['rm', '-rf', tmp])
+
+# the geometric mean of the ratios, so no one kernel dominates
+results['geomean'] = {n: math.exp(statistics.mean(math.log(per[n]['ratio']) for per in results['kernels'].values()))
+                      for n in names}
+print(f"{'geomean':<12}" + ''.join(f"{results['geomean'][n]:>18.2f}x" for n in names))
+
+os.makedirs(RESULTS, exist_ok=True)
+with open(os.path.join(RESULTS, 'runtime.json'), 'w') as f:
+    json.dump(results, f, indent=2)
@@ -0,0 +1,174 @@
+#!/usr/bin/env python3
+
+# Compile throughput on a big synthetic translation unit (see gen.py): dcc's
+# lines per second, the time in each of its phases (-ftime-report) and its
+# peak RSS (-fmem-report), for each code generator. Results go to
+# bench/results/latest.json and are compared against
+# bench/results/baseline.json, if there is one; a throughput or memory
+# regression beyond the tolerance fails the run.
+#
+#   python3 bench/throughput.py [--functions N] [--runs N] [--tolerance PCT]
+#                               [--save-baseline] [dcc options...]
+
+import argparse
+import json
+import os, sys
+import platform
+import re
+import statistics
+import subprocess
+import tempfile
+import time
+
+os.chdir(sys.path[0])
+sys.dont_write_bytecode = True
+
+import gen
+
+DCC = os.path.abspath('../dcc')
+RESULTS = 'results'
+LATEST = os.path.join(RESULTS, 'latest.json')
+BASELINE = os.path.join(RESULTS, 'baseline.json')
+
+# what's measured is dcc itself, so nothing goes through llc or the assembler
+CONFIGS = [
+    ('llvm IR', ['-S']),
+    ('native asm', ['-fbackend=native', '-S']),
+]
+
+parser = argparse.ArgumentParser()
+parser.add_argument('--functions', type=int, default=2000, help='size of the input (default: 2000)')
+parser.add_argument('--runs', type=int, default=3, help='compiles per configuration; medians are kept (default: 3)')
+parser.add_argument('--tolerance', type=float, default=10, help='percent worse than the baseline that counts as a regression (default: 10)')
+parser.add_argument('--save-baseline', action='store_true', help='keep these results as the baseline')
+parser.add_argument('flags', nargs='*', help='extra dcc options, for every compile')
+args = parser.parse_args()
+
+# the tables -ftime-report and -fmem-report print
+PHASE = re.compile(r'^(\S.*?)\s+([\d.]+)s\s+([\d.]+)s\s+[\d.]+%\s+\d+$')
+STAGE = re.compile(r'^(\S+)\s+[\d.]+s\s+[\d.]+s\s+([\d.]+)s\s+(\d+)KB$')
+ALLOCS = re.compile(r'^total\s+(\d+)\s+(\d+)$')
+
+def compile_once(src, out, flags):
+    cmd = [DCC, '-ftime-report', '-fmem-report'] + flags + args.flags + ['-o', out, src]
+    start = time.perf_counter()
+    p = subprocess.run(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+    wall = time.perf_counter() - start
+    if p.returncode:
+        sys.exit(f'{" ".join(cmd)} failed:\n{p.stderr}')
+
+    run = {'wall': wall, 'phases': {}}
+    for line in p.stderr.splitlines():
+        if (m := PHASE.match(line)) and m[1] != 'total':
+            run['phases'][m[1]] = {'wall': float(m[2]), 'cpu': float(m[3])}
+        elif (m := STAGE.match(line)) and m[1] == 'compile':
+            run['compile_cpu'] = float(m[2])
+            run['rss_kb'] = int(m[3])
+        elif m := ALLOCS.match(line):
+            run['allocations'] = int(m[1])
+            run['allocated_bytes'] = int(m[2])
+
+    # the compiler's own time, without the preprocessor's
+    run['compile_wall'] = sum(p['wall'] for p in run['phases'].values())
+    return run
+
+def measure(src, lines, flags):
+    out = os.path.join(tmp, 'out')
+    runs = [compile_once(src, out, flags) for _ in range(args.runs)]
+    med = lambda f: statistics.median(f(r) for r in runs)
+
+    compile_wall = med(lambda r: r['compile_wall'])
+    return {
+        'wall': med(lambda r: r['wall']),
+        'compile_wall': compile_wall,
+        'compile_cpu': med(lambda r: r['compile_cpu']),
+        'lines_per_sec': lines / compile_wall if compile_wall else 0,
+        'rss_kb': max(r['rss_kb'] for r in runs),
+        'allocations': runs[0]['allocations'],
+        'allocated_bytes': runs[0]['allocated_bytes'],
+        'phases': {name: {k: med(lambda r: r['phases'].get(name, {}).get(k, 0)) for k in ('wall', 'cpu')}
+                   for name in runs[0]['phases']},
+    }
+
+def git_head():
+    try:
+        return subprocess.run(['git', 'rev-parse', '--short', 'HEAD'], capture_output=True,
+                              text=True, check=True).stdout.strip()
+    except (OSError, subprocess.CalledProcessError):
+        return None
+
+def change(new, old):
+    return (new - old) / old * 100 if old else 0
+
+# prints the comparison, returning the regressions
+def compare(results, baseline):
+    if baseline['input'] != results['input']:
+        print(f"\nbaseline was for {baseline['input']}, not {results['input']}; not comparing")
+        return []
+
+    regressions = []
+    print(f"\nagainst the baseline ({baseline.get('commit') or 'unknown commit'}, {baseline['date']}):")
+    for name, r in results['configs'].items():
+        b = baseline['configs'].get(name)
+        if not b:
+            continue
+
+        speed = change(r['lines_per_sec'], b['lines_per_sec'])
+        rss = change(r['rss_kb'], b['rss_kb'])
+        print(f"  {name:<14} lines/s {speed:+7.1f}%   peak RSS {rss:+7.1f}%")
+        for phase, p in r['phases'].items():
+            bp = b['phases'].get(phase)
+            if bp and bp['wall'] >= 0.01:
+                print(f"    {phase:<16} {p['wall']:7.3f}s  {change(p['wall'], bp['wall']):+7.1f}%")
+
+        if speed < -args.tolerance:
+            regressions.append(f'{name}: {-speed:.1f}% fewer lines/s')
+        if rss > args.tolerance:
+            regressions.append(f'{name}: {rss:.1f}% more peak RSS')
+
+    return regressions
+
+tmp = tempfile.mkdtemp(prefix='dcc-bench-')
+try:
+    src = os.path.join(tmp, 'bench.c')
+    text = gen.generate(args.functions)
+    with open(src, 'w') as f:
+        f.write(text)
+    lines = text.count('\n')
+
+    results = {
+        'commit': git_head(),
+        'date': time.strftime('%Y-%m-%d %H:%M:%S'),
+        'host': platform.node(),
+        'input': {'functions': args.functions, 'lines': lines, 'bytes': len(text), 'flags': args.flags},
+        'configs': {},
+    }
+
+    print(f"{args.functions} functions, {lines} lines, {len(text) / 1e6:.1f} MB; median of {args.runs}")
+    print(f"{'configuration':<16}{'lines/s':>10}{'compile':>10}{'cpu':>10}{'peak RSS':>12}{'allocated':>12}")
+    for name, flags in CONFIGS:
+        r = measure(src, lines, flags)
+        results['configs'][name] = r
+        print(f"{name:<16}{r['lines_per_sec']:>10.0f}{r['compile_wall']:>9.3f}s{r['compile_cpu']:>9.3f}s"
+              f"{r['rss_kb'] / 1024:>10.1f}MB{r['allocated_bytes'] / 2**20:>10.1f}MB")
+        for phase, p in r['phases'].items():
+            print(f"    {phase:<16}{p['wall']:>8.3f}s{p['cpu']:>9.3f}s")
+finally:
+    subprocess.run(['rm', '-rf', tmp])
+
+os.makedirs(RESULTS, exist_ok=True)
+with open(LATEST, 'w') as f:
+    json.dump(results, f, indent=2)
+
+if args.save_baseline:
+    with open(BASELINE, 'w') as f:
+        json.dump(results, f, indent=2)
+    print(f'\nsaved as the baseline (bench/{BASELINE})')
+elif os.path.exists(BASELINE):
+    with open(BASELINE) as f:
+        regressions = compare(results, json.load(f))
+    if regressions:
+        print('\nregressions beyond ' + f'{args.tolerance:g}%:\n  ' + '\n  '.join(regressions))
+        sys.exit(1)
+else:
+    print(f'\nno baseline to compare against; --save-baseline keeps these results as one')
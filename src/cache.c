@@ -0,0 +1,592 @@
+/*
+ * cache.c
+ *
+ * The cache directory holds one file per entry, named for its key, and a
+ * stats file:
+ *
+ *   <32 hex digits>   dcc-cache <key digest> <diagnostics length>\n<diagnostics><output>
+ *   stats             hits, misses, evictions, and the size of all entries
+ *
+ * The key digest is the SHA-256 of the whole key, and an entry's name is the
+ * start of it. An entry only counts as a hit if its digest is the key's, so
+ * two keys that share a name can't get each other's output.
+ *
+ * Entries are written under a temporary name and renamed into place, so
+ * readers only ever see whole ones. A hit touches its entry, which makes
+ * mtime order LRU order. The stats file is only changed under flock(), which
+ * also keeps two processes from evicting at the same time.
+ */
+#include "cache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "util.h"
+
+#define CACHE_SIZE_DEFAULT (1024LL * 1024 * 1024)
+#define ENTRY_MAGIC "dcc-cache"
+
+// how far under the cap eviction goes, so it doesn't happen on every store
+#define EVICT_TO(cap) ((cap) / 10 * 9)
+
+static const char *cache_dir(void) {
+    const char *dir = getenv("DCC_CACHE_DIR");
+    return dir && *dir ? dir : NULL;
+}
+
+bool cache_enabled(void) {
+    return cache_dir();
+}
+
+static char *cache_path(const char *name) {
+    const char *dir = cache_dir();
+    char *path = safe_malloc(strlen(dir) + strlen(name) + 2);
+    sprintf(path, "%s/%s", dir, name);
+    return path;
+}
+
+// an entry's name is the first half of its key's digest
+static char *entry_path(const char *digest) {
+    char name[33];
+    memcpy(name, digest, 32);
+    name[32] = '\0';
+    return cache_path(name);
+}
+
+// read entry's header, if it's an entry for digest
+static bool entry_header(FILE *entry, const char *digest, size_t *diag_len) {
+    char got[65];
+    return entry && fscanf(entry, ENTRY_MAGIC " %64s %zu", got, diag_len) == 2 &&
+           !strcmp(got, digest) && fgetc(entry) == '\n';
+}
+
+static long long cache_cap(void) {
+    const char *v = getenv("DCC_CACHE_SIZE");
+    if (!v || !*v)
+        return CACHE_SIZE_DEFAULT;
+
+    char *end;
+    long long n = strtoll(v, &end, 10);
+    switch (*end) {
+        case 'K': case 'k': n <<= 10; end++; break;
+        case 'M': case 'm': n <<= 20; end++; break;
+        case 'G': case 'g': n <<= 30; end++; break;
+    }
+
+    if (*end || n <= 0)
+        RED_ERROR("Invalid DCC_CACHE_SIZE '%s'", v);
+
+    return n;
+}
+
+char *cache_tool_id(const char *name) {
+    const char *path = getenv("PATH");
+    char *id = NULL;
+
+    for (const char *p = path; p && !id; ) {
+        const char *colon = strchr(p, ':');
+        int n = colon ? (int)(colon - p) : (int)strlen(p);
+
+        char *cand = safe_malloc(n + strlen(name) + 3);
+        sprintf(cand, "%.*s/%s", n ? n : 1, n ? p : ".", name);
+
+        struct stat st;
+        if (!stat(cand, &st) && S_ISREG(st.st_mode) && !access(cand, X_OK)) {
+            id = safe_malloc(strlen(cand) + strlen(name) + 48);
+            sprintf(id, "%s %s %lld %lld", name, cand, (long long)st.st_mtime, (long long)st.st_size);
+        }
+
+        free(cand);
+        p = colon ? colon + 1 : NULL;
+    }
+
+    if (!id) {
+        id = safe_malloc(strlen(name) + 1);
+        strcpy(id, name);
+    }
+
+    return id;
+}
+
+static uint32_t rotr32(uint32_t x, int r) {
+    return (x >> r) | (x << (32 - r));
+}
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static void sha256_block(uint32_t h[8], const unsigned char *p) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++)
+        w[i] = (uint32_t)p[i * 4] << 24 | (uint32_t)p[i * 4 + 1] << 16 | (uint32_t)p[i * 4 + 2] << 8 | p[i * 4 + 3];
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = k + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        uint32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        k = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+    h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+}
+
+// SHA-256 of data, as 64 hex digits: a key's digest, which entries are checked against
+static void sha256_hex(const unsigned char *data, size_t len, char out[65]) {
+    uint32_t h[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+
+    size_t i = 0;
+    for (; len - i >= 64; i += 64)
+        sha256_block(h, data + i);
+
+    // the rest, a 1 bit, zeros and the length in bits, in one or two blocks
+    unsigned char tail[128] = {0};
+    size_t rest = len - i;
+    memcpy(tail, data + i, rest);
+    tail[rest] = 0x80;
+
+    size_t n = rest < 56 ? 64 : 128;
+    uint64_t bits = (uint64_t)len * 8;
+    for (int j = 0; j < 8; j++)
+        tail[n - 1 - j] = (unsigned char)(bits >> (j * 8));
+
+    sha256_block(h, tail);
+    if (n == 128)
+        sha256_block(h, tail + 64);
+
+    for (int j = 0; j < 8; j++)
+        sprintf(out + j * 8, "%08x", h[j]);
+}
+
+// a rebuilt dcc shouldn't get its predecessor's outputs
+static void self_id(char self[64]) {
+    *self = '\0';
+#ifdef __linux__
+    struct stat exe;
+    if (!stat("/proc/self/exe", &exe))
+        sprintf(self, "%lld %lld", (long long)exe.st_mtime, (long long)exe.st_size);
+#endif
+}
+
+void cache_key(struct cache_key *k, FILE *in, const char *config) {
+    char self[64];
+    self_id(self);
+
+    long start = ftell(in);
+    struct stat st;
+    if (start < 0 || fstat(fileno(in), &st))
+        RED_ERROR("Error reading preprocessor output: %s", strerror(errno));
+
+    size_t head = strlen(self) + 1 + strlen(config) + 1;
+    size_t len = st.st_size > start ? (size_t)(st.st_size - start) : 0;
+
+    unsigned char *buf = safe_malloc(head + len + 1);
+    memcpy(buf, self, strlen(self) + 1);
+    memcpy(buf + strlen(self) + 1, config, strlen(config) + 1);
+
+    len = fread(buf + head, 1, len, in);
+    if (ferror(in) || fseek(in, start, SEEK_SET))
+        RED_ERROR("Error reading preprocessor output: %s", strerror(errno));
+
+    sha256_hex(buf, head + len, k->digest);
+    free(buf);
+}
+
+struct stats {
+    long long hits, misses, evictions;
+    long long size;
+    long long fn_hits, fn_misses;
+};
+
+// function entries looked up and stored since cache_fn_done()
+static struct {
+    long long hits, misses;
+    long long size;
+} fn_tally;
+
+// open the stats file and lock it, reading what's there; -1 if we can't
+static int stats_lock(struct stats *s) {
+    *s = (struct stats){0};
+    mkdir(cache_dir(), 0777); // if it's not there yet
+
+    char *path = cache_path("stats");
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    free(path);
+
+    if (fd < 0)
+        return -1;
+
+    while (flock(fd, LOCK_EX) && errno == EINTR)
+        ;
+
+    char buf[256];
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (n > 0) {
+        buf[n] = '\0';
+        sscanf(buf, "hits %lld misses %lld evictions %lld size %lld fn-hits %lld fn-misses %lld",
+               &s->hits, &s->misses, &s->evictions, &s->size, &s->fn_hits, &s->fn_misses);
+    }
+
+    return fd;
+}
+
+static void stats_unlock(int fd, const struct stats *s) {
+    char buf[256];
+    int n = snprintf(buf, sizeof(buf), "hits %lld\nmisses %lld\nevictions %lld\nsize %lld\nfn-hits %lld\nfn-misses %lld\n",
+                     s->hits, s->misses, s->evictions, s->size, s->fn_hits, s->fn_misses);
+
+    if (!ftruncate(fd, 0) && pwrite(fd, buf, n, 0) != n)
+        eprintf("dcc: error updating cache stats: %s\n", strerror(errno));
+
+    close(fd); // and the lock with it
+}
+
+// append everything in fd from off on to out
+static bool append_fd(FILE *out, int fd, off_t off) {
+    char buf[64 * 1024];
+    ssize_t n;
+
+    while ((n = pread(fd, buf, sizeof(buf), off)) > 0) {
+        if (fwrite(buf, 1, n, out) != (size_t)n)
+            return false;
+        off += n;
+    }
+
+    return n == 0;
+}
+
+// the rest of entry, after its diagnostics, into out_file
+static bool copy_output(FILE *entry, const char *out_file) {
+    FILE *out = fopen(out_file, "w");
+    if (!out)
+        return false;
+
+    char buf[64 * 1024];
+    size_t n;
+    bool ok = true;
+    while (ok && (n = fread(buf, 1, sizeof(buf), entry)) > 0)
+        ok = fwrite(buf, 1, n, out) == n;
+
+    ok = !fclose(out) && ok && !ferror(entry);
+    return ok;
+}
+
+bool cache_fetch(const struct cache_key *k, const char *out_file) {
+    char *path = entry_path(k->digest);
+    FILE *entry = fopen(path, "r");
+
+    size_t diag_len;
+    char *diag = NULL;
+    bool hit = entry_header(entry, k->digest, &diag_len);
+
+    if (hit) {
+        diag = safe_malloc(diag_len + 1);
+        hit = fread(diag, 1, diag_len, entry) == diag_len && copy_output(entry, out_file);
+    }
+
+    if (hit) {
+        fwrite(diag, 1, diag_len, stderr);
+        utimes(path, NULL); // most recently used now
+    }
+
+    if (entry)
+        fclose(entry);
+    free(diag);
+    free(path);
+
+    struct stats s;
+    int fd = stats_lock(&s);
+    if (fd >= 0) {
+        if (hit)
+            s.hits++;
+        else
+            s.misses++;
+        stats_unlock(fd, &s);
+    }
+
+    return hit;
+}
+
+struct entry {
+    char name[33];
+    time_t used;
+    long long size;
+};
+
+static int entry_cmp(const void *a, const void *b) {
+    const struct entry *x = a, *y = b;
+    return (x->used > y->used) - (x->used < y->used);
+}
+
+// what's in the cache, oldest first
+static struct entry *list_entries(size_t *n, long long *total) {
+    struct entry *entries = NULL;
+    size_t cap = 0;
+
+    *n = 0;
+    *total = 0;
+
+    DIR *d = opendir(cache_dir());
+    if (!d)
+        return NULL;
+
+    struct dirent *e;
+    while ((e = readdir(d))) {
+        if (strlen(e->d_name) != 32 || strspn(e->d_name, "0123456789abcdef") != 32)
+            continue; // stats, or someone's temporary
+
+        char *path = cache_path(e->d_name);
+        struct stat st;
+        bool ok = !stat(path, &st);
+        free(path);
+
+        if (!ok)
+            continue; // evicted under us
+
+        if (*n == cap) {
+            cap = cap ? cap * 2 : 256;
+            entries = safe_realloc(entries, cap * sizeof(struct entry));
+        }
+
+        struct entry *en = &entries[(*n)++];
+        strcpy(en->name, e->d_name);
+        en->used = st.st_mtime;
+        en->size = st.st_size;
+        *total += st.st_size;
+    }
+
+    closedir(d);
+
+    if (*n)
+        qsort(entries, *n, sizeof(struct entry), entry_cmp);
+
+    return entries;
+}
+
+// with the stats locked: drop the least recently used entries until we fit again
+static void evict(struct stats *s, long long cap) {
+    size_t n;
+    long long total;
+    struct entry *entries = list_entries(&n, &total);
+
+    for (size_t i = 0; i < n && total > EVICT_TO(cap); i++) {
+        char *path = cache_path(entries[i].name);
+        if (!unlink(path)) {
+            total -= entries[i].size;
+            s->evictions++;
+        }
+        free(path);
+    }
+
+    s->size = total;
+    free(entries);
+}
+
+void cache_store(const struct cache_key *k, const char *out_file, FILE *diag) {
+    mkdir(cache_dir(), 0777); // if it's not there yet
+
+    char *path = entry_path(k->digest);
+    char *tmp = safe_malloc(strlen(path) + 32);
+    sprintf(tmp, "%s.tmp.%ld", path, (long)getpid());
+
+    struct stat diag_st, st, old;
+    int src = open(out_file, O_RDONLY | O_CLOEXEC);
+    FILE *out = src >= 0 && !fstat(fileno(diag), &diag_st) ? fopen(tmp, "w") : NULL;
+
+    bool ok = false;
+    if (out) {
+        fprintf(out, ENTRY_MAGIC " %s %lld\n", k->digest, (long long)diag_st.st_size);
+        ok = append_fd(out, fileno(diag), 0) && append_fd(out, src, 0);
+        ok = !fclose(out) && ok;
+    }
+
+    if (src >= 0)
+        close(src);
+
+    // what we replace, if anything, stops counting towards the size
+    bool replaced = false;
+    if (ok) {
+        ok = !stat(tmp, &st);
+        replaced = ok && !stat(path, &old);
+        ok = ok && !rename(tmp, path);
+    }
+    if (!ok)
+        unlink(tmp);
+
+    free(tmp);
+    free(path);
+
+    if (!ok)
+        return;
+
+    struct stats s;
+    int fd = stats_lock(&s);
+    if (fd < 0)
+        return;
+
+    long long cap = cache_cap();
+    s.size += st.st_size - (replaced ? old.st_size : 0);
+    if (s.size > cap)
+        evict(&s, cap);
+
+    stats_unlock(fd, &s);
+}
+
+// a function's entry is named for its key, and which dcc made it
+static char *fn_entry_path(const void *key, size_t key_len, char digest[65]) {
+    char self[64];
+    self_id(self);
+
+    size_t head = strlen(self) + sizeof("fn");
+    unsigned char *buf = safe_malloc(head + key_len);
+    memcpy(buf, self, strlen(self));
+    memcpy(buf + strlen(self), "fn", sizeof("fn"));
+    memcpy(buf + head, key, key_len);
+
+    sha256_hex(buf, head + key_len, digest);
+    free(buf);
+
+    return entry_path(digest);
+}
+
+char *cache_fn_fetch(void *ctx, const void *key, size_t key_len, size_t *len) {
+    (void)ctx;
+
+    char digest[65];
+    char *path = fn_entry_path(key, key_len, digest);
+    FILE *entry = fopen(path, "r");
+
+    size_t diag_len;
+    struct stat st;
+    char *data = NULL;
+
+    // function entries have nothing to say; the compiler won't store them if they do
+    if (entry_header(entry, digest, &diag_len) && !diag_len &&
+        !fstat(fileno(entry), &st) && st.st_size >= ftell(entry)) {
+        *len = (size_t)(st.st_size - ftell(entry));
+        data = safe_malloc(*len ? *len : 1);
+
+        if (fread(data, 1, *len, entry) == *len) {
+            utimes(path, NULL);
+        } else {
+            free(data);
+            data = NULL;
+        }
+    }
+
+    if (entry)
+        fclose(entry);
+    free(path);
+
+    if (data)
+        fn_tally.hits++;
+    else
+        fn_tally.misses++;
+
+    return data;
+}
+
+void cache_fn_store(void *ctx, const void *key, size_t key_len, const char *data, size_t len) {
+    (void)ctx;
+    mkdir(cache_dir(), 0777); // if it's not there yet
+
+    char digest[65];
+    char *path = fn_entry_path(key, key_len, digest);
+    char *tmp = safe_malloc(strlen(path) + 32);
+    sprintf(tmp, "%s.tmp.%ld", path, (long)getpid());
+
+    FILE *out = fopen(tmp, "w");
+    struct stat st, old;
+
+    bool ok = false, replaced = false;
+    if (out) {
+        fprintf(out, ENTRY_MAGIC " %s 0\n", digest);
+        ok = fwrite(data, 1, len, out) == len;
+        ok = !fclose(out) && ok && !stat(tmp, &st);
+        replaced = ok && !stat(path, &old);
+        ok = ok && !rename(tmp, path);
+    }
+
+    if (ok)
+        fn_tally.size += st.st_size - (replaced ? old.st_size : 0);
+    else
+        unlink(tmp);
+
+    free(tmp);
+    free(path);
+}
+
+void cache_fn_done(void) {
+    if (!fn_tally.hits && !fn_tally.misses)
+        return;
+
+    struct stats s;
+    int fd = stats_lock(&s);
+    if (fd >= 0) {
+        long long cap = cache_cap();
+
+        s.fn_hits += fn_tally.hits;
+        s.fn_misses += fn_tally.misses;
+        s.size += fn_tally.size;
+        if (s.size > cap)
+            evict(&s, cap);
+
+        stats_unlock(fd, &s);
+    }
+
+    fn_tally.hits = fn_tally.misses = fn_tally.size = 0;
+}
+
+void cache_print_stats(void) {
+    if (!cache_enabled()) {
+        printf("No cache: DCC_CACHE_DIR isn't set\n");
+        return;
+    }
+
+    struct stats s;
+    int fd = stats_lock(&s);
+
+    size_t n;
+    long long total;
+    free(list_entries(&n, &total));
+
+    long long lookups = s.hits + s.misses;
+    printf("cache directory   %s\n", cache_dir());
+    printf("hits              %lld\n", s.hits);
+    printf("misses            %lld\n", s.misses);
+    printf("hit rate          %.1f%%\n", lookups ? 100.0 * s.hits / lookups : 0.0);
+    printf("function hits     %lld\n", s.fn_hits);
+    printf("function misses   %lld\n", s.fn_misses);
+    printf("evictions         %lld\n", s.evictions);
+    printf("entries           %zu\n", n);
+    printf("size              %.1f MiB of %.1f MiB\n", total / 1048576.0, cache_cap() / 1048576.0);
+
+    if (fd >= 0) {
+        s.size = total; // while we're here
+        stats_unlock(fd, &s);
+    }
+}
@@ -0,0 +1,51 @@
+/*
+ * cache.h
+ *
+ * The compilation cache. With $DCC_CACHE_DIR set, each unit's output (the
+ * object, IR or assembly) is kept there under a hash of its preprocessed
+ * input and everything else that decides it; compiling the same thing again
+ * just copies it out, along with whatever the compile had to say.
+ *
+ * When a unit does have to be compiled, its functions are looked up one by
+ * one, and only the ones that changed are compiled again.
+ *
+ * $DCC_CACHE_SIZE caps the cache (bytes, or with a K, M or G suffix; 1G by
+ * default), and the least recently used entries go first. Any number of dcc
+ * processes can share one cache.
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+struct cache_key {
+    char digest[65]; // SHA-256 of everything that decides the output, in hex
+};
+
+bool cache_enabled(void);
+
+// "name path mtime size" for the program name would run, "name" if there's none
+char *cache_tool_id(const char *name);
+
+// the key for the rest of in (which is left where it was) compiled under config
+void cache_key(struct cache_key *k, FILE *in, const char *config);
+
+// if k is cached: write its output to out_file, replay its diagnostics and return true
+bool cache_fetch(const struct cache_key *k, const char *out_file);
+
+// keep out_file as k's output, and all of diag as what the compile said
+void cache_store(const struct cache_key *k, const char *out_file, FILE *diag);
+
+// the same for single functions, as a dcc_fn_store (see dcc.h), keyed however the compiler likes
+char *cache_fn_fetch(void *ctx, const void *key, size_t key_len, size_t *len);
+void cache_fn_store(void *ctx, const void *key, size_t key_len, const char *data, size_t len);
+
+// count the function entries fetched and stored since the last call in the stats
+void cache_fn_done(void);
+
+// dcc --cache-stats
+void cache_print_stats(void);
+
+#endif
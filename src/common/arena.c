@@ -0,0 +1,115 @@
+/*
+ * arena.c
+ *
+ * Bump-pointer region allocator. Small objects (astn, quads, st_entry, BBs)
+ * come from here instead of one calloc() each.
+ */
+#include "arena.h"
+
+#include <stdarg.h>
+#include <stdalign.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "util.h"
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+#define ARENA_ALIGN alignof(max_align_t)
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;
+    size_t off;
+    alignas(max_align_t) unsigned char data[];
+};
+
+void arena_init(struct arena *a, const char *name) {
+    *a = (struct arena){
+        .name = name,
+    };
+}
+
+static struct arena_chunk *arena_new_chunk(struct arena *a, size_t min) {
+    size_t size = min > ARENA_CHUNK_SIZE ? min : ARENA_CHUNK_SIZE;
+
+    struct arena_chunk *c = safe_malloc(sizeof(struct arena_chunk) + size);
+    c->next = a->head;
+    c->size = size;
+    c->off = 0;
+
+    a->head = c;
+    a->reserved += size;
+    a->chunks++;
+
+    return c;
+}
+
+/*
+ * Allocate size zeroed bytes from the arena.
+ */
+void *arena_alloc(struct arena *a, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    struct arena_chunk *c = a->head;
+    if (!c || c->size - c->off < size)
+        c = arena_new_chunk(a, size);
+
+    void *m = c->data + c->off;
+    c->off += size;
+
+    a->used += size;
+    if (a->used > a->peak)
+        a->peak = a->used;
+
+    memset(m, 0, size);
+    return m;
+}
+
+char *arena_strdup(struct arena *a, const char *s) {
+    size_t len = strlen(s) + 1;
+    char *d = arena_alloc(a, len);
+    memcpy(d, s, len);
+    return d;
+}
+
+char *arena_sprintf(struct arena *a, const char *fmt, ...) {
+    va_list ap;
+
+    va_start(ap, fmt);
+    int len = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+
+    if (len < 0)
+        die("Bad format string passed to arena_sprintf");
+
+    char *d = arena_alloc(a, len + 1);
+
+    va_start(ap, fmt);
+    vsnprintf(d, len + 1, fmt, ap);
+    va_end(ap);
+
+    return d;
+}
+
+/*
+ * Give all of the arena's memory back. The arena can be reused afterwards;
+ * the high-water mark is kept.
+ */
+void arena_release(struct arena *a) {
+    struct arena_chunk *c = a->head;
+    while (c) {
+        struct arena_chunk *next = c->next;
+        free(c);
+        c = next;
+    }
+
+    a->head = NULL;
+    a->used = 0;
+    a->reserved = 0;
+    a->chunks = 0;
+}
+
+void arena_report(const struct arena *a, FILE *f) {
+    fprintf(f, "arena %-12s peak %10zu bytes, in use %10zu bytes, %u chunk(s)\n",
+            a->name, a->peak, a->used, a->chunks);
+}
@@ -0,0 +1,42 @@
+/*
+ * arena.h
+ *
+ * Bump-pointer region allocator.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+struct arena_chunk;
+
+/*
+ * An arena hands out zeroed memory by bumping a pointer through large chunks.
+ * Nothing allocated from an arena is ever freed individually - the whole arena
+ * goes away at once with arena_release().
+ */
+struct arena {
+    const char *name;
+    struct arena_chunk *head;
+
+    size_t used;        // bytes handed out since the last release
+    size_t reserved;    // bytes held in chunks right now
+    size_t peak;        // high-water mark of used, survives release
+    unsigned chunks;
+};
+
+// each compilation has a translation unit arena, tu_arena (see compilation.h),
+// for everything that lives until we're done
+
+void arena_init(struct arena *a, const char *name);
+void *arena_alloc(struct arena *a, size_t size);
+char *arena_strdup(struct arena *a, const char *s);
+char *arena_sprintf(struct arena *a, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+void arena_release(struct arena *a);
+
+void arena_report(const struct arena *a, FILE *f);
+
+#endif
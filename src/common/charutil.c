@@ -44,7 +44,9 @@ long long int parse_char(char* str, size_t* i, int* type) {
 }
 
 void emit_char(unsigned char c, FILE *f) {
-    fprintf(f, "%s", get_char_esc(c));
+    char *esc = get_char_esc(c);
+    fprintf(f, "%s", esc);
+    free(esc);
 }
 
 char* get_char_esc(unsigned char c) {
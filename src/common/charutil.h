@@ -9,7 +9,7 @@
 // pointer to i - pointer to new current pos in string
 long long int parse_char(char* str, size_t* i, int* type);
 
-// print single char in escape-seq format
+// print single char in escape-seq format; get_char_*esc() return malloc()ed strings
 char* get_char_esc(unsigned char c);
 void emit_char(unsigned char c, FILE* f);
 char* get_char_hexesc(unsigned char c);
@@ -2,14 +2,12 @@
 
 #include <stdbool.h>
 
+#include "compilation.h"
+
 // Convenience
 
-static enum debug_levels {
-    DEBUG_INFO,
-    DEBUG_VERBOSE,
-    DEBUG_DEBUG,
-    DEBUG_NONE
-} global_debug_level;
+// per compilation, so pragmas in one input don't leak into another
+#define global_debug_level (dcc_cc->debug_level)
 
 void debug_setlevel_INFO(void) { global_debug_level = DEBUG_INFO; }
 void debug_setlevel_VERBOSE(void) { global_debug_level = DEBUG_VERBOSE; }
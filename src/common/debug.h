@@ -3,6 +3,13 @@
 
 #include <stdbool.h>
 
+enum debug_levels {
+    DEBUG_INFO,
+    DEBUG_VERBOSE,
+    DEBUG_DEBUG,
+    DEBUG_NONE
+};
+
 void debug_setlevel_INFO(void);
 void debug_setlevel_VERBOSE(void);
 void debug_setlevel_DEBUG(void);
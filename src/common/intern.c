@@ -0,0 +1,100 @@
+/*
+ * intern.c
+ *
+ * Open-addressed hash set of unique strings. The strings themselves live in
+ * the translation unit arena and are never freed or modified.
+ *
+ * The set belongs to the current compilation (see compilation.h).
+ */
+#include "intern.h"
+
+#include <string.h>
+
+#include "arena.h"
+#include "compilation.h"
+#include "memstat.h"
+#include "util.h"
+
+#define INTERN_INITIAL 1024 // power of two
+
+#define interned (dcc_cc->interned)
+
+static unsigned intern_hash(const char *s, size_t len) {
+    unsigned h = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void intern_grow(void) {
+    struct intern_slot *old = interned.slots;
+    unsigned old_cap = interned.cap;
+
+    interned.cap = old_cap ? old_cap * 2 : INTERN_INITIAL;
+    interned.slots = safe_calloc(interned.cap, sizeof(struct intern_slot));
+    mem_note(MEM_STRINGS, interned.cap * sizeof(struct intern_slot));
+
+    unsigned mask = interned.cap - 1;
+    for (unsigned i = 0; i < old_cap; i++) {
+        if (!old[i].s)
+            continue;
+
+        unsigned j = old[i].hash & mask;
+        while (interned.slots[j].s)
+            j = (j + 1) & mask;
+
+        interned.slots[j] = old[i];
+    }
+
+    free(old);
+}
+
+/*
+ * Return the canonical copy of the first len bytes of s.
+ */
+const char *intern_n(const char *s, size_t len) {
+    interned.lookups++;
+
+    if ((interned.count + 1) * 4 > interned.cap * 3)
+        intern_grow();
+
+    unsigned hash = intern_hash(s, len);
+    unsigned mask = interned.cap - 1;
+    unsigned i = hash & mask;
+
+    while (interned.slots[i].s) {
+        struct intern_slot *e = &interned.slots[i];
+        if (e->hash == hash && e->len == len && !memcmp(e->s, s, len))
+            return e->s;
+        i = (i + 1) & mask;
+    }
+
+    char *copy = arena_alloc(&tu_arena, len + 1);
+    mem_note(MEM_STRINGS, len + 1);
+    memcpy(copy, s, len);
+
+    interned.slots[i] = (struct intern_slot){
+        .s = copy,
+        .len = len,
+        .hash = hash,
+    };
+    interned.count++;
+
+    return copy;
+}
+
+const char *intern(const char *s) {
+    return intern_n(s, strlen(s));
+}
+
+void intern_report(FILE *f) {
+    fprintf(f, "intern: %u unique strings from %lu lookups\n",
+            interned.count, interned.lookups);
+}
+
+void intern_free(struct intern_table *t) {
+    free(t->slots);
+    *t = (struct intern_table){0};
+}
@@ -0,0 +1,34 @@
+/*
+ * intern.h
+ *
+ * String interning. Identifiers and filenames are interned as they're lexed,
+ * so any two equal names share one canonical, immutable string and can be
+ * compared by pointer.
+ */
+
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+struct intern_slot {
+    const char *s;
+    size_t len;
+    unsigned hash;
+};
+
+// one per compilation; the strings themselves live in its arena
+struct intern_table {
+    struct intern_slot *slots;
+    unsigned cap, count;
+    unsigned long lookups;
+};
+
+const char *intern(const char *s);
+const char *intern_n(const char *s, size_t len);
+
+void intern_report(FILE *f);
+void intern_free(struct intern_table *t);
+
+#endif
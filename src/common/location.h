@@ -1,8 +1,9 @@
 #ifndef LOCATION_H
 #define LOCATION_H
 
+// filenames are interned, so locations can compare them by pointer
 typedef struct YYLTYPE {
-    char* filename;
+    const char* filename;
     unsigned lineno;
 } YYLTYPE;
 
@@ -10,11 +11,12 @@ typedef struct YYLTYPE {
 
 // attribute needed to shut gcc up, but in general
 // this probably shouldn't be in this header
-static char* __attribute__((unused)) fnamestdin = "<stdin>";
+static const char* __attribute__((unused)) fnamestdin = "<stdin>";
 
 #define YYLTYPE YYLTYPE
+// locations come from the lexer's position; cc is yyparse()'s compilation
 #define YYLLOC_DEFAULT(current, blah2, blah3) do { \
-    (current) = context; \
+    (current) = cc->loc; \
     if (!(current).filename) (current).filename = fnamestdin; \
 } while(0);
 
@@ -0,0 +1,104 @@
+/*
+ * memstat.c
+ *
+ * Allocation counts by category (see memstat.h).
+ */
+#include "memstat.h"
+
+#include <sys/resource.h>
+
+#include "compilation.h"
+#include "ir_util.h"
+
+#define mem (dcc_cc->mem)
+
+static const char *const kind_names[MEM_KINDS] = {
+    [MEM_ASTN]      = "astn",
+    [MEM_QUADS]     = "quads",
+    [MEM_VALUES]    = "value tables",
+    [MEM_BBS]       = "BBs",
+    [MEM_ST_ENTRY]  = "st_entry",
+    [MEM_SYMTABS]   = "symtabs",
+    [MEM_TYPES]     = "types",
+    [MEM_STRINGS]   = "strings",
+    [MEM_PRINTER]   = "printer",
+    [MEM_ASSEMBLER] = "assembler",
+    [MEM_FNCACHE]   = "function cache",
+    [MEM_PASSES]    = "passes",
+};
+
+void mem_start(void) {
+    mem = (struct mem_stats){
+        .on = true,
+    };
+}
+
+void mem_note(enum mem_kind kind, size_t bytes) {
+    if (!dcc_cc || !mem.on)
+        return;
+
+    mem.kinds[kind].count++;
+    mem.kinds[kind].bytes += bytes;
+}
+
+void mem_note_astn(enum astn_types type) {
+    if (!dcc_cc || !mem.on)
+        return;
+
+    mem.astn[type].count++;
+    mem.astn[type].bytes += sizeof(struct astn);
+    mem_note(MEM_ASTN, sizeof(struct astn));
+}
+
+static void report_line(FILE *f, const char *name, const struct mem_count *c, size_t total) {
+    fprintf(f, "%-22s %10lu %12zu  %5.1f%%\n", name, c->count, c->bytes,
+            total ? (double)c->bytes / total * 100 : 0.0);
+}
+
+void mem_report(FILE *f) {
+    size_t total = 0;
+    unsigned long count = 0;
+    for (int k = 0; k < MEM_KINDS; k++) {
+        total += mem.kinds[k].bytes;
+        count += mem.kinds[k].count;
+    }
+
+    fprintf(f, "allocations                 count        bytes\n");
+    for (int k = 0; k < MEM_KINDS; k++) {
+        if (!mem.kinds[k].count)
+            continue;
+
+        report_line(f, kind_names[k], &mem.kinds[k], total);
+
+        // the nodes by kind, biggest first
+        if (k == MEM_ASTN) {
+            bool shown[ASTN_KIND_MAX] = {0};
+            for (;;) {
+                int most = -1;
+                for (int t = 0; t < ASTN_KIND_MAX; t++)
+                    if (!shown[t] && mem.astn[t].count && (most < 0 || mem.astn[t].bytes > mem.astn[most].bytes))
+                        most = t;
+                if (most < 0)
+                    break;
+
+                char name[32];
+                snprintf(name, sizeof(name), "  %s", astn_type_str(most));
+                report_line(f, name, &mem.astn[most], total);
+                shown[most] = true;
+            }
+        }
+    }
+    fprintf(f, "%-22s %10lu %12zu\n", "total", count, total);
+
+    ir_arena_report(f);
+
+    // ru_maxrss is in kilobytes, except on macOS
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+    long rss_kb = ru.ru_maxrss / 1024;
+#else
+    long rss_kb = ru.ru_maxrss;
+#endif
+    fprintf(f, "peak RSS %ld KB (the whole process)\n", rss_kb);
+}
@@ -0,0 +1,58 @@
+/*
+ * memstat.h
+ *
+ * What a compilation's memory goes on (-fmem-report). Everywhere the
+ * compiler allocates - from an arena or with safe_malloc() and friends - it
+ * notes the bytes under a category, and AST nodes under their kind as well.
+ * A growing array counts every size it grows to, so the totals are what was
+ * asked for over the whole compilation; the arenas' high-water marks and the
+ * peak RSS in mem_report() are what it took at once.
+ *
+ * Nothing's counted unless the compilation asked for it.
+ */
+
+#ifndef MEMSTAT_H
+#define MEMSTAT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "ast.h"
+
+enum mem_kind {
+    MEM_ASTN,           // AST nodes, and the IR operands that are astns too
+    MEM_QUADS,
+    MEM_VALUES,         // the quads' value tables
+    MEM_BBS,            // basic blocks and function block lists
+    MEM_ST_ENTRY,
+    MEM_SYMTABS,        // scopes and their hash tables
+    MEM_TYPES,          // the type table
+    MEM_STRINGS,        // interned names, string literals, generated names
+    MEM_PRINTER,        // the backends' temporaries and output buffers
+    MEM_ASSEMBLER,      // the integrated assembler and object writer
+    MEM_FNCACHE,        // keys and captured output (see ir_fncache.h)
+    MEM_PASSES,         // what the passes over the quads keep: CFG, dominators, ...
+    MEM_KINDS
+};
+
+struct mem_count {
+    unsigned long count;
+    size_t bytes;
+};
+
+// one per compilation
+struct mem_stats {
+    bool on;
+    struct mem_count kinds[MEM_KINDS];
+    struct mem_count astn[ASTN_KIND_MAX];
+};
+
+void mem_start(void);
+
+void mem_note(enum mem_kind kind, size_t bytes);
+void mem_note_astn(enum astn_types type);
+
+void mem_report(FILE *f);
+
+#endif
@@ -0,0 +1,150 @@
+/*
+ * outbuf.c
+ *
+ * Buffered output sink. The buffer starts small and grows up to
+ * OUTBUF_FLUSH_AT; past that it's written out rather than grown, so a
+ * typical module goes out in one write() and a huge one doesn't pile up
+ * in memory.
+ */
+#include "outbuf.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "memstat.h"
+#include "util.h"
+
+#define OUTBUF_INITIAL (64 * 1024)
+#define OUTBUF_FLUSH_AT (1024 * 1024)
+
+void outbuf_init(struct outbuf *o, int fd) {
+    *o = (struct outbuf){
+        .fd = fd,
+        .mirror_fd = -1,
+    };
+}
+
+/*
+ * Hand flushed bytes to sink(ctx, ...) rather than writing them anywhere. The
+ * chunks split wherever the buffer happened to fill up, not on any boundary.
+ */
+void outbuf_init_sink(struct outbuf *o, void (*sink)(void *ctx, const char *s, size_t n), void *ctx) {
+    *o = (struct outbuf){
+        .fd = -1,
+        .sink = sink,
+        .sink_ctx = ctx,
+        .mirror_fd = -1,
+    };
+}
+
+/*
+ * Also send everything that's flushed from here on to fd.
+ */
+void outbuf_mirror(struct outbuf *o, int fd) {
+    o->mirror_fd = fd;
+}
+
+static void write_all(int fd, const char *s, size_t n) {
+    while (n) {
+        ssize_t w = write(fd, s, n);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+
+            RED_ERROR("Error writing output: %s", strerror(errno));
+        }
+
+        s += w;
+        n -= (size_t)w;
+    }
+}
+
+void outbuf_flush(struct outbuf *o) {
+    if (!o->len)
+        return;
+
+    if (o->sink)
+        o->sink(o->sink_ctx, o->buf, o->len);
+    else
+        write_all(o->fd, o->buf, o->len);
+
+    if (o->mirror_fd >= 0)
+        write_all(o->mirror_fd, o->buf, o->len);
+
+    o->written += o->len;
+    o->len = 0;
+}
+
+/*
+ * Make room for at least n more bytes, by flushing or growing.
+ */
+void outbuf_reserve(struct outbuf *o, size_t n) {
+    if (o->cap - o->len >= n)
+        return;
+
+    if (o->len + n > OUTBUF_FLUSH_AT)
+        outbuf_flush(o);
+
+    if (o->cap - o->len >= n)
+        return;
+
+    size_t cap = o->cap ? o->cap : OUTBUF_INITIAL;
+    while (cap - o->len < n)
+        cap *= 2;
+
+    o->buf = safe_realloc(o->buf, cap);
+    mem_note(MEM_PRINTER, cap);
+    o->cap = cap;
+}
+
+void outbuf_free(struct outbuf *o) {
+    free(o->buf);
+    o->buf = NULL;
+    o->len = o->cap = 0;
+}
+
+void outbuf_write(struct outbuf *o, const char *s, size_t n) {
+    if (!n)
+        return;
+
+    outbuf_reserve(o, n);
+    memcpy(o->buf + o->len, s, n);
+    o->len += n;
+}
+
+void outbuf_puts(struct outbuf *o, const char *s) {
+    outbuf_write(o, s, strlen(s));
+}
+
+void outbuf_uint(struct outbuf *o, unsigned long long v) {
+    char tmp[20];
+    size_t i = sizeof(tmp);
+
+    do {
+        tmp[--i] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+
+    outbuf_write(o, tmp + i, sizeof(tmp) - i);
+}
+
+void outbuf_int(struct outbuf *o, long long v) {
+    if (v < 0) {
+        outbuf_putc(o, '-');
+        outbuf_uint(o, -(unsigned long long)v);
+    } else {
+        outbuf_uint(o, (unsigned long long)v);
+    }
+}
+
+/*
+ * Two uppercase hex digits, e.g. for \XX escapes.
+ */
+void outbuf_hex2(struct outbuf *o, unsigned char c) {
+    static const char digits[] = "0123456789ABCDEF";
+
+    outbuf_reserve(o, 2);
+    o->buf[o->len++] = digits[c >> 4];
+    o->buf[o->len++] = digits[c & 0xF];
+}
@@ -0,0 +1,47 @@
+/*
+ * outbuf.h
+ *
+ * Buffered output sink. Text is formatted straight into one large buffer and
+ * handed to the kernel with a single write() when it fills up or is flushed -
+ * or, for a sink set up with outbuf_init_sink(), to a function instead.
+ */
+
+#ifndef OUTBUF_H
+#define OUTBUF_H
+
+#include <stddef.h>
+
+struct outbuf {
+    int fd;             // where flushed bytes go
+    void (*sink)(void *ctx, const char *s, size_t n); // or this, instead of fd
+    void *sink_ctx;
+    int mirror_fd;      // optional second destination, -1 for none
+
+    char *buf;
+    size_t len;
+    size_t cap;
+
+    size_t written;     // total bytes flushed so far
+};
+
+void outbuf_init(struct outbuf *o, int fd);
+void outbuf_init_sink(struct outbuf *o, void (*sink)(void *ctx, const char *s, size_t n), void *ctx);
+void outbuf_mirror(struct outbuf *o, int fd);
+void outbuf_reserve(struct outbuf *o, size_t n);
+void outbuf_flush(struct outbuf *o);
+void outbuf_free(struct outbuf *o);
+
+void outbuf_write(struct outbuf *o, const char *s, size_t n);
+void outbuf_puts(struct outbuf *o, const char *s);
+void outbuf_int(struct outbuf *o, long long v);
+void outbuf_uint(struct outbuf *o, unsigned long long v);
+void outbuf_hex2(struct outbuf *o, unsigned char c);
+
+static inline void outbuf_putc(struct outbuf *o, char c) {
+    if (o->len == o->cap)
+        outbuf_reserve(o, 1);
+
+    o->buf[o->len++] = c;
+}
+
+#endif
@@ -32,6 +32,7 @@ struct number {
     };
     enum int_types aux_type;
     bool is_signed;
+    bool is_decimal; // as the lexer saw it - the type can depend on it (6.4.4.1)
 };
 
 struct strlit {
@@ -0,0 +1,142 @@
+/*
+ * timer.c
+ *
+ * Per-phase timing and trace spans (see timer.h).
+ */
+#include "timer.h"
+
+#include <time.h>
+#include <unistd.h>
+
+#include "compilation.h"
+#include "util.h"
+
+#define timing (dcc_cc->timer)
+
+static const char *const phase_names[TIMER_PHASES] = {
+    [TIMER_PARSE]    = "parse",
+    [TIMER_SYMBOLS]  = "symbols",
+    [TIMER_FNCACHE]  = "function cache",
+    [TIMER_QUADS]    = "quads",
+    [TIMER_PASSES]   = "passes",
+    [TIMER_OUTPUT]   = "output",
+    [TIMER_CODEGEN]  = "LLVM codegen",
+    [TIMER_ASSEMBLE] = "assembler",
+};
+
+double timer_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// this thread's, since a process may be running several compilations
+static double cpu_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// charge the time since the last switch to the running phase
+static double charge(void) {
+    double wall = timer_now(), cpu = cpu_now();
+    enum timer_phase p = timing.stack[timing.depth - 1].phase;
+
+    timing.wall[p] += wall - timing.last_wall;
+    timing.cpu[p] += cpu - timing.last_cpu;
+    timing.last_wall = wall;
+    timing.last_cpu = cpu;
+
+    return wall;
+}
+
+void timer_start(FILE *trace) {
+    timing = (struct timer){
+        .on = true,
+        .trace = trace,
+        .last_wall = timer_now(),
+        .last_cpu = cpu_now(),
+    };
+
+    timing.stack[timing.depth++] = (struct timer_frame){
+        .phase = TIMER_PARSE,
+        .span = "compile",
+        .start = timing.last_wall,
+    };
+    timing.entered[TIMER_PARSE]++;
+}
+
+void timer_push(enum timer_phase phase, const char *span) {
+    if (!timing.on)
+        return;
+
+    struct timer_frame *top = &timing.stack[timing.depth - 1];
+    if (top->phase == phase && !span) {
+        top->again++;
+        return;
+    }
+
+    if (timing.depth == (int)(sizeof(timing.stack) / sizeof(timing.stack[0])))
+        die("timer_push: phases nested too deep");
+
+    timing.stack[timing.depth++] = (struct timer_frame){
+        .phase = phase,
+        .span = span,
+        .start = charge(),
+    };
+    timing.entered[phase]++;
+}
+
+double timer_pop(void) {
+    if (!timing.on)
+        return 0;
+
+    struct timer_frame *top = &timing.stack[timing.depth - 1];
+    if (top->again) {
+        top->again--;
+        return 0;
+    }
+
+    double end = charge();
+
+    if (top->span && timing.trace) {
+        fprintf(timing.trace, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d},\n",
+                top->span, phase_names[top->phase], top->start * 1e6, (end - top->start) * 1e6,
+                (int)getpid(), (int)getpid());
+    }
+
+    if (timing.depth > 1)
+        timing.depth--;
+
+    return end - top->start;
+}
+
+void timer_stop(void) {
+    if (!timing.on)
+        return;
+
+    // anything still pushed (there shouldn't be) ends here too
+    while (timing.depth > 1)
+        timer_pop();
+    timer_pop();
+
+    timing.on = false;
+}
+
+void timer_report(FILE *f) {
+    double wall = 0, cpu = 0;
+    for (int p = 0; p < TIMER_PHASES; p++) {
+        wall += timing.wall[p];
+        cpu += timing.cpu[p];
+    }
+
+    fprintf(f, "phase                wall       cpu    wall%%    entered\n");
+    for (int p = 0; p < TIMER_PHASES; p++) {
+        if (!timing.entered[p])
+            continue;
+
+        fprintf(f, "%-16s %7.3fs  %7.3fs  %6.1f%%  %9lu\n", phase_names[p], timing.wall[p], timing.cpu[p],
+                wall ? timing.wall[p] / wall * 100 : 0.0, timing.entered[p]);
+    }
+    fprintf(f, "%-16s %7.3fs  %7.3fs\n", "total", wall, cpu);
+}
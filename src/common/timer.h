@@ -0,0 +1,73 @@
+/*
+ * timer.h
+ *
+ * Where a compilation's time goes. The compiler is always in exactly one
+ * phase; timer_push() enters another until the matching timer_pop(), and
+ * every phase is charged only for the time spent in it, not in the phases it
+ * pushed. timer_report() (-ftime-report) prints the wall clock and CPU time
+ * of each phase.
+ *
+ * A push can also name a span, which is written out as a Chrome trace event
+ * (-ftime-trace) when it's popped - one for each function's quads, and one
+ * for its output, so the slow functions in a unit show up in Perfetto.
+ *
+ * Nothing's measured unless the compilation asked for it (-ftime-report,
+ * -ftime-trace, or -fpass-stats, which takes each pass's time from its span).
+ */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+enum timer_phase {
+    TIMER_PARSE,        // lexing, parsing and whatever isn't below
+    TIMER_SYMBOLS,      // declaring symbols (lookups are too quick to time, and stay with their callers)
+    TIMER_FNCACHE,      // keying, fetching and storing functions (see ir_fncache.h)
+    TIMER_QUADS,        // gen_fn()
+    TIMER_PASSES,       // the passes over each function's quads (see ir_pass.h)
+    TIMER_OUTPUT,       // printing the IR or assembly, or building the LLVM module
+    TIMER_CODEGEN,      // LLVM's codegen, for DCC_OUTPUT_OBJ
+    TIMER_ASSEMBLE,     // the integrated assembler, for DCC_OUTPUT_ELF
+    TIMER_PHASES
+};
+
+struct timer_frame {
+    enum timer_phase phase;
+    const char *span;   // the trace event's name, or NULL for none
+    double start;       // when it was pushed, for the span
+    unsigned again;     // pushes of the same phase without a span, folded into this one
+};
+
+// one per compilation
+struct timer {
+    bool on;
+    FILE *trace;        // where the spans go, or NULL
+
+    double wall[TIMER_PHASES], cpu[TIMER_PHASES];
+    unsigned long entered[TIMER_PHASES];
+
+    double last_wall, last_cpu; // when the running phase was last charged
+    struct timer_frame stack[16];
+    int depth;
+};
+
+// a monotonic wall clock, in seconds
+double timer_now(void);
+
+// start timing the compilation on this thread, in TIMER_PARSE, tracing to trace if not NULL
+void timer_start(FILE *trace);
+
+// span must be a plain name (an identifier, say); it goes into the JSON as is
+void timer_push(enum timer_phase phase, const char *span);
+
+// the wall time since the matching push, if that was a push of its own (with
+// a span, or of another phase); 0 if it was folded in, or nothing's measured
+double timer_pop(void);
+
+// the compilation's done: charge what's left, and end its span
+void timer_stop(void);
+void timer_report(FILE *f);
+
+#endif
@@ -10,7 +10,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-#include "main.h"
+#include "compilation.h"
 #include "yak.ascii.h"
 
 /* 
@@ -44,7 +44,9 @@ void *safe_realloc(void* old, size_t size) {
 
 
 /*
- * Die with backtrace, for internal errors
+ * Die with backtrace, for internal errors - which unsupported input gets
+ * to as well, so inside a compilation only that one fails (see dcc_fail()),
+ * and the backtrace is for -v. Outside of one, the process goes.
  *
  * backtrace() depends on glibc
  * some of this might fail depending on how much damage we did,
@@ -57,6 +59,11 @@ _Noreturn __attribute__((noreturn)) void die(const char* msg) {
 
     eprintf("%s\n", yak);
 
+    if (dcc_cc && !dcc_cc->opts.debug) {
+        eprintf("Compilation failed :(\n");
+        dcc_fail(-6);
+    }
+
     // #ifdef __GLIBC__
     eprintf("Trying to print backtrace:\n------------------------------\n");
     if (dcc_is_host_darwin()) {
@@ -72,5 +79,8 @@ _Noreturn __attribute__((noreturn)) void die(const char* msg) {
     }
     // #endif
 
+    if (dcc_cc)
+        dcc_fail(-6);
+
     abort();
 }
@@ -15,7 +15,7 @@
     eprintf(__VA_ARGS__);                   \
     eprintf(RESET "\n");                    \
     eprintf("\nCompilation failed :(\n");   \
-    exit(-1);                                       \
+    dcc_fail(-1);                                   \
 } while(0);
 
 void *safe_malloc(size_t size);
@@ -23,4 +23,7 @@ void *safe_calloc(size_t num, size_t size);
 void *safe_realloc(void* old, size_t size);
 _Noreturn __attribute((noreturn)) void die(const char* msg);
 
+// give up on the current compilation (or the process, outside of one)
+_Noreturn void dcc_fail(int status);
+
 #endif
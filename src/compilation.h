@@ -0,0 +1,93 @@
+/*
+ * compilation.h
+ *
+ * Everything one translation unit needs while it's being compiled. Nothing
+ * about a compilation lives in a global, so any number of them can run in one
+ * process, one per thread.
+ *
+ * The parser and lexer are handed their compilation explicitly. The rest of
+ * the compiler reaches it through dcc_cc, which points at the compilation
+ * running on this thread, and the macros below, which keep the old names for
+ * what used to be globals.
+ */
+
+#ifndef COMPILATION_H
+#define COMPILATION_H
+
+#include <setjmp.h>
+#include <stdbool.h>
+
+#include "arena.h"
+#include "dcc.h"
+#include "debug.h"
+#include "intern.h"
+#include "ir_fncache.h"
+#include "ir_pass.h"
+#include "ir_state.h"
+#include "location.h"
+#include "memstat.h"
+#include "outbuf.h"
+#include "symtab.h"
+#include "timer.h"
+#include "typetab.h"
+
+struct dcc_compilation {
+    struct dcc_options opts;
+
+    // lexer
+    void *scanner;
+    YYLTYPE loc;            // where the lexer is right now
+
+    // memory
+    struct arena tu;
+    struct arena *node_arena;
+
+    struct intern_table interned;
+    struct typetab typetab;
+
+    // symbol table
+    symtab file_scope;
+    symtab *scope;
+    struct st_counters st_counters;
+
+    // quads
+    struct BB root_bb;
+    struct BBL root_bbl;
+    struct ir_state ir;
+    struct fncache fncache;
+
+    // output
+    struct outbuf ir_out;   // the output, on its way to opts.out_fd
+    struct outbuf *print_out;
+    struct llvm_module *llvm; // what the IR is built into instead, for DCC_OUTPUT_OBJ
+    struct outbuf asm_text; // for DCC_OUTPUT_ELF, the assembly on its way into...
+    struct x86_asm *as;     // ...the integrated assembler, which writes to ir_out
+
+    // diagnostics
+    enum debug_levels debug_level;
+    int ast_print_depth;
+    unsigned warnings;      // printed so far
+    struct timer timer;     // for opts.time_report and opts.time_trace
+    struct mem_stats mem;   // for opts.mem_report
+    struct pass_stats pass_stats[PASSES]; // for opts.pass_stats
+
+    // dcc_fail() unwinds to here
+    jmp_buf fail;
+    int status;
+};
+
+extern _Thread_local struct dcc_compilation *dcc_cc;
+
+#define tu_arena        (dcc_cc->tu)
+#define astn_arena      (dcc_cc->node_arena)
+#define root_symtab     (dcc_cc->file_scope)
+#define current_scope   (dcc_cc->scope)
+#define st_stats        (dcc_cc->st_counters)
+#define irst            (dcc_cc->ir)
+
+void dcc_fn_done(sym fn);
+void dcc_parse_done(void);
+
+bool dcc_is_host_darwin(void);
+
+#endif
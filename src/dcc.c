@@ -0,0 +1,294 @@
+/*
+ * dcc.c
+ *
+ * Setting up, running and tearing down a compilation. The driver in main.c
+ * and anyone embedding dcc both come through here.
+ */
+#include "dcc.h"
+
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "compilation.h"
+#include "intern.h"
+#include "ir.h"
+#include "ir_cf.h"
+#include "ir_fncache.h"
+#include "ir_llvm.h"
+#include "ir_pass.h"
+#include "ir_print.h"
+#include "ir_util.h"
+#include "lexer.h"
+#include "memstat.h"
+#include "outbuf.h"
+#include "parser.tab.h"
+#include "symtab_util.h"
+#include "timer.h"
+#include "typetab.h"
+#include "util.h"
+#include "x86_64.h"
+#include "x86_64_as.h"
+
+_Thread_local struct dcc_compilation *dcc_cc;
+
+// the integrated assembler, as asm_text's sink
+static void feed_assembler(void *ctx, const char *s, size_t n) {
+    timer_push(TIMER_ASSEMBLE, NULL);
+    x86_asm_feed(ctx, s, n);
+    timer_pop();
+}
+
+static struct dcc_compilation *compilation_alloc(const struct dcc_options *opts) {
+    struct dcc_compilation *cc = safe_calloc(1, sizeof(struct dcc_compilation));
+
+    cc->opts = *opts;
+    cc->loc.lineno = 1;
+
+    arena_init(&cc->tu, "tu");
+    cc->node_arena = &cc->tu;
+
+    cc->file_scope = (symtab){
+        .scope_type = SCOPE_FILE, // context must be set with %initial-action
+    };
+    cc->scope = &cc->file_scope;
+
+    cc->root_bbl.me = &cc->root_bb;
+    cc->ir = (struct ir_state){
+        .root_bbl = &cc->root_bbl,
+        .current_bbl = &cc->root_bbl,
+        .bb = &cc->root_bb,
+    };
+
+    outbuf_init(&cc->ir_out, opts->out_fd);
+    if (opts->mirror_fd >= 0 && opts->output != DCC_OUTPUT_OBJ)
+        outbuf_mirror(&cc->ir_out, opts->mirror_fd);
+
+#ifdef DCC_LLVM_API
+    if (opts->output == DCC_OUTPUT_OBJ)
+        cc->llvm = llvm_module_new();
+#endif
+
+    if (opts->output == DCC_OUTPUT_ELF) {
+        cc->as = x86_asm_new();
+        outbuf_init_sink(&cc->asm_text, feed_assembler, cc->as);
+        if (opts->mirror_fd >= 0)
+            outbuf_mirror(&cc->asm_text, opts->mirror_fd);
+    }
+
+    switch (opts->debug) {
+        case 0: // the default
+        case 1:
+            cc->debug_level = DEBUG_INFO;
+            break;
+        case 2:
+            cc->debug_level = DEBUG_VERBOSE;
+            break;
+        case 3:
+        default:
+            cc->debug_level = DEBUG_DEBUG;
+    }
+
+    return cc;
+}
+
+static void compilation_free(struct dcc_compilation *cc) {
+    if (cc->scanner)
+        lexer_close(cc->scanner);
+
+    // we may have given up halfway through a function
+    if (cc->ir.current_bbl != &cc->root_bbl)
+        arena_release(&cc->ir.current_bbl->arena);
+
+#ifdef DCC_LLVM_API
+    if (cc->llvm)
+        llvm_module_free(cc->llvm);
+#endif
+
+    if (cc->as)
+        x86_asm_free(cc->as);
+
+    fncache_free(&cc->fncache);
+    outbuf_free(&cc->asm_text);
+    outbuf_free(&cc->ir_out);
+    intern_free(&cc->interned);
+    typetab_free(&cc->typetab);
+    arena_release(&cc->tu);
+
+    free(cc);
+}
+
+/*
+ * Parse (and so compile) everything the scanner has, then clean up after
+ * ourselves however that went.
+ */
+static int compile(struct dcc_compilation *cc) {
+    dcc_cc = cc;
+
+    if (cc->opts.time_report || cc->opts.time_trace || cc->opts.pass_stats)
+        timer_start(cc->opts.time_trace);
+    if (cc->opts.mem_report)
+        mem_start();
+
+    if (!setjmp(cc->fail)) {
+#ifndef DCC_LLVM_API
+        if (cc->opts.output == DCC_OUTPUT_OBJ)
+            RED_ERROR("This dcc was built without the LLVM API backend (scons llvm=1)");
+#endif
+
+        if (yyparse(cc->scanner, cc)) // <- entry to the rest of the compiler
+            RED_ERROR("\n");
+
+        timer_stop();
+        if (cc->opts.time_report)
+            timer_report(stderr);
+        if (cc->opts.mem_report)
+            mem_report(stderr);
+        if (cc->opts.pass_stats)
+            pass_stats_report(stderr);
+
+        if (cc->opts.debug) {
+            ir_arena_report(stderr);
+            st_report(stderr);
+            intern_report(stderr);
+            typetab_report(stderr);
+        }
+    }
+
+    int status = cc->status;
+
+    compilation_free(cc);
+    dcc_cc = NULL;
+
+    return status;
+}
+
+int dcc_compile_buffer(const char *src, size_t len, const struct dcc_options *opts) {
+    struct dcc_compilation *cc = compilation_alloc(opts);
+    cc->scanner = lexer_open_buffer(cc, src, len);
+
+    return compile(cc);
+}
+
+int dcc_compile_file(FILE *in, const struct dcc_options *opts) {
+    struct dcc_compilation *cc = compilation_alloc(opts);
+    cc->scanner = lexer_open_file(cc, in);
+
+    return compile(cc);
+}
+
+/*
+ * Give up on the compilation running on this thread. Everything it allocated
+ * is released on the way out; the status is what dcc_compile_*() returns.
+ */
+_Noreturn void dcc_fail(int status) {
+    if (!dcc_cc)
+        exit(status);
+
+    dcc_cc->status = status ? status : -1;
+    longjmp(dcc_cc->fail, 1);
+}
+
+// called by the parser with each function definition, once it's been parsed
+void dcc_fn_done(sym fn) {
+    struct outbuf *o = NULL;
+
+    // the globals declared since the last function go out ahead of it, so
+    // whatever comes after is the function's own (see ir_fncache.h)
+    timer_push(TIMER_OUTPUT, NULL);
+    switch (dcc_cc->opts.output) {
+        case DCC_OUTPUT_IR:
+            o = &dcc_cc->ir_out;
+            quads_dump_pending(o);
+            break;
+        case DCC_OUTPUT_OBJ:
+            break;
+        case DCC_OUTPUT_ASM:
+            o = &dcc_cc->ir_out;
+            quads_asm_pending(o);
+            break;
+        case DCC_OUTPUT_ELF:
+            o = &dcc_cc->asm_text;
+            quads_asm_pending(o);
+            break;
+    }
+    timer_pop();
+
+    timer_push(TIMER_FNCACHE, NULL);
+    bool cached = o && fncache_fetch(fn, o);
+    timer_pop();
+    if (cached)
+        return;
+
+    timer_push(TIMER_QUADS, fn->ident);
+    gen_fn(fn);
+    timer_pop();
+
+    passes_run();
+
+    timer_push(TIMER_OUTPUT, fn->ident);
+    switch (dcc_cc->opts.output) {
+        case DCC_OUTPUT_IR:
+            quads_dump_fn(fncache_out(o));
+            break;
+        case DCC_OUTPUT_OBJ:
+#ifdef DCC_LLVM_API
+            quads_build_fn(dcc_cc->llvm);
+#endif
+            break;
+        case DCC_OUTPUT_ASM:
+        case DCC_OUTPUT_ELF:
+            quads_asm_fn(fncache_out(o));
+            break;
+    }
+    timer_pop();
+
+    timer_push(TIMER_FNCACHE, NULL);
+    if (o)
+        fncache_store(o);
+    timer_pop();
+
+    bbl_release();
+}
+
+// called by the parser once the whole translation unit is in
+void dcc_parse_done(void) {
+    if (dcc_cc->opts.debug)
+        fprintf(stderr, "Parse done!\n");
+
+    timer_push(TIMER_OUTPUT, "globals");
+    switch (dcc_cc->opts.output) {
+        case DCC_OUTPUT_IR:
+            quads_dump_root(&dcc_cc->ir_out);
+            break;
+        case DCC_OUTPUT_OBJ:
+#ifdef DCC_LLVM_API
+            quads_build_root(dcc_cc->llvm);
+            timer_push(TIMER_CODEGEN, "codegen");
+            llvm_module_emit(dcc_cc->llvm, &dcc_cc->ir_out, dcc_cc->opts.mirror_fd);
+            timer_pop();
+#endif
+            break;
+        case DCC_OUTPUT_ASM:
+            quads_asm_root(&dcc_cc->ir_out);
+            break;
+        case DCC_OUTPUT_ELF:
+            quads_asm_root(&dcc_cc->asm_text);
+            outbuf_flush(&dcc_cc->asm_text);
+            timer_push(TIMER_ASSEMBLE, "assemble");
+            x86_asm_finish(dcc_cc->as, &dcc_cc->ir_out);
+            timer_pop();
+            break;
+    }
+
+    outbuf_flush(&dcc_cc->ir_out);
+    timer_pop();
+}
+
+bool dcc_is_host_darwin(void) {
+#ifdef __APPLE__
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,63 @@
+/*
+ * dcc.h
+ *
+ * Library interface. Compiles one preprocessed translation unit to LLVM IR
+ * (or an object file, or assembly - see dcc_output) without going through the
+ * driver in main.c.
+ *
+ * Every call gets its own compilation context (see compilation.h), so several
+ * threads may compile independent inputs at the same time. Diagnostics still
+ * go to stderr.
+ */
+
+#ifndef DCC_H
+#define DCC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+enum dcc_output {
+    DCC_OUTPUT_IR,      // LLVM IR, as text
+    DCC_OUTPUT_OBJ,     // an object file, through the LLVM API; needs dcc built with llvm=1
+    DCC_OUTPUT_ASM,     // x86-64 assembly, from the native backend
+    DCC_OUTPUT_ELF,     // an ELF object, from the native backend and the integrated assembler
+};
+
+/*
+ * Somewhere to keep compiled functions from one compilation to the next, so
+ * a function that hasn't changed isn't compiled again (see ir_fncache.h).
+ * Keys are key_len bytes, not strings. fetch returns a malloc()ed copy of
+ * what was stored under key, with its length in *len, or NULL if there's
+ * nothing.
+ */
+struct dcc_fn_store {
+    void *ctx;
+    char *(*fetch)(void *ctx, const void *key, size_t key_len, size_t *len);
+    void (*store)(void *ctx, const void *key, size_t key_len, const char *data, size_t len);
+};
+
+struct dcc_options {
+    int debug;          // like -v: 0 for none, 1 = INFO (plus usage reports), 2 = VERBOSE, 3 = DEBUG
+    enum dcc_output output;
+    int out_fd;         // where the output goes
+    int mirror_fd;      // also copy it here (the LLVM module, for objects), -1 for none
+    const struct dcc_fn_store *fn_store; // NULL to compile every function; not used for DCC_OUTPUT_OBJ
+    bool time_report;   // print the time spent in each phase to stderr (see timer.h)
+    bool mem_report;    // print what memory went on to stderr (see memstat.h)
+    int opt_level;      // -O: which passes run over each function (see ir_pass.h)
+    bool pass_stats;    // print what each pass did to stderr
+    const char *dump_after; // print each function to stderr after the pass with this name, or NULL
+    FILE *time_trace;   // append Chrome trace events for the phases and functions here, each
+                        // followed by a comma (so callers can collect several), or NULL
+};
+
+/*
+ * Both return 0 on success, or the nonzero status the driver would have
+ * exited with. The input must already be preprocessed; line markers are
+ * honoured for diagnostics.
+ */
+int dcc_compile_buffer(const char *src, size_t len, const struct dcc_options *opts);
+int dcc_compile_file(FILE *in, const struct dcc_options *opts);
+
+#endif
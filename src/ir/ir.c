@@ -11,20 +11,14 @@
 
 #include "ast.h"
 #include "ast_print.h"
+#include "compilation.h"
+#include "const_expr.h"
+#include "memstat.h"
 #include "parser.tab.h"
 #include "symtab.h"
 #include "types.h"
 #include "util.h"
 
-static struct BB root_bb = {0};
-static struct BBL root_bbl = {.me = &root_bb};
-
-struct ir_state irst = {
-    .root_bbl = &root_bbl,
-    .current_bbl = &root_bbl,
-    .bb = &root_bb,
-};
-
 astn gen_fncall(astn a, astn target) {
     astn arg = a->Fncall.args;
     astn arg_rval = NULL;
@@ -177,6 +171,10 @@ static astn _gen_rvalue(astn a, astn target) {
 }
 
 astn gen_rvalue(astn a, astn target) {
+    // the grammar folded what it parsed; this is for what gen_* makes itself
+    if (a->type == ASTN_BINOP || a->type == ASTN_UNOP || a->type == ASTN_TERN)
+        a = const_fold(a);
+
     astn r = _gen_rvalue(a, target);
     return r;
 }
@@ -305,6 +303,17 @@ void gen_quads(astn a) {
 
 // Allocate a qtemp for given anon thing, and add it to the list to define later
 astn gen_anon(astn a) {
+    char *name = arena_sprintf(&tu_arena, ".strlit.%s.%d", irst.fn->ident, irst.fn_uniq++);
+    mem_note(MEM_STRINGS, strlen(name) + 1);
+
+    return gen_anon_named(a, name);
+}
+
+// The same, with the name already picked; name must outlive the function
+astn gen_anon_named(astn a, char *name) {
+    // the global outlives the function that mentions it
+    BB save = bb_jumproot();
+
     astn qtype = qtype_alloc(IR_ptr);
     astn qtemp = qtemp_alloc(-1, qtype);
 
@@ -320,16 +329,14 @@ astn gen_anon(astn a) {
             dtype = dtype_alloc(i8_type, t_ARRAY);
             dtype->Type.derived.size = simple_constant_alloc(a->Strlit.strlit.len + 1); // +1 for \0
             qtemp->Qtemp.global = a;
-            asprintf(&qtemp->Qtemp.name, ".strlit.%s.%d", irst.fn->ident, irst.uniq++);
+            qtemp->Qtemp.name = name;
 
             if (irst.anons)
                 list_append(qtemp, irst.anons);
             else
                 irst.anons = list_alloc(qtemp);
 
-            BB save = bb_jumproot();
             emit(IR_OP_DEFGLOBAL, qtemp, a, NULL);
-            bb_active(save);
 
             break;
 
@@ -339,9 +346,37 @@ astn gen_anon(astn a) {
 
     qtype->Qtype.derived_type = dtype;
 
+    bb_active(save);
+
     return qtemp;
 }
 
+// e's initializer (see const_static_init()): a number of e's IR type, or the string's global
+static astn static_init(sym e, const char *ident) {
+    if (e->init_is_str) {
+        astn s = astn_alloc(ASTN_STRLIT);
+        s->Strlit.strlit = e->strinit;
+
+        char *name = arena_sprintf(&tu_arena, ".strlit.%s", ident + (*ident == '.'));
+        mem_note(MEM_STRINGS, strlen(name) + 1);
+
+        return gen_anon_named(s, name);
+    }
+
+    ir_type_E t = ir_type(get_qtype(e->type));
+    if (t == IR_ptr)
+        return NULL; // a null pointer, which is all zeros like no initializer at all
+
+    struct number v = e->numinit;
+    if (t == IR_i1)
+        v.integer = v.integer != 0; // 6.3.1.2
+
+    astn n = astn_alloc(ASTN_NUM);
+    n->Num.number = v;
+    const_convert(&n->Num.number, (unsigned)ir_type_size[t] * 8, type_is_signed(t));
+    return n;
+}
+
 void gen_global_named(sym e, const char *ident) {
     astn qtype;
     if (ir_type_matches(symptr_alloc(e), IR_fn))
@@ -357,9 +392,11 @@ void gen_global_named(sym e, const char *ident) {
     qtemp->Qtemp.global = symptr_alloc(e);
     e->ptr_qtemp = qtemp;
 
-    qtemp->Qtemp.name = strdup(ident);
+    qtemp->Qtemp.name = arena_strdup(&tu_arena, ident);
+    mem_note(MEM_STRINGS, strlen(ident) + 1);
 
-    emit(IR_OP_DEFGLOBAL, qtemp, NULL, NULL);
+    astn init = e->has_init ? static_init(e, ident) : NULL;
+    emit(IR_OP_DEFGLOBAL, qtemp, init, NULL);
 }
 
 void gen_global(sym e) {
@@ -375,22 +412,16 @@ static void gen_local(sym n) {
 
         emit(IR_OP_ALLOCA, qtemp, NULL, NULL);
     } else if (n->entry_type == STE_VAR && n->storspec == SS_STATIC) {
-        char *name;
-        asprintf(&name, ".localstatic.%s.%s.%d", irst.fn->ident, n->ident, irst.uniq++);
-
-        BB save = irst.bb;
-        irst.bb = &root_bb;
+        char *name = arena_sprintf(&tu_arena, ".localstatic.%s.%s.%d", irst.fn->ident, n->ident, irst.fn_uniq++);
+        mem_note(MEM_STRINGS, strlen(name) + 1);
 
+        BB save = bb_jumproot();
         gen_global_named(n, name);
-
-        irst.bb = save;
+        bb_active(save);
     } else if (n->type->Type.derived.type == t_FN) {
-        char *name;
-        asprintf(&name, "%s", n->ident);
-
         BB save = bb_jumproot();
-        gen_global_named(n, name);
-        irst.bb = save;
+        gen_global_named(n, n->ident);
+        bb_active(save);
     }
 }
 
@@ -411,8 +442,12 @@ void gen_fn(sym e) {
     irst.fn = e;
 
     irst.tempno = 0; // reset
+    irst.fn_uniq = 0;
     // irst.bb->bbno = 0;
 
+    // everything from here on is allocated in the function's arena
+    irst.bb = bbl_push();
+
     // generate parameters
     astn p = e->param_list;
     while (p) {
@@ -433,7 +468,6 @@ void gen_fn(sym e) {
         p = list_next(p);
     }
 
-    irst.bb = bbl_push();
     irst.tempno++;
 
     // generate parameters - memory
@@ -492,18 +526,22 @@ void gen_fn(sym e) {
         a = list_next(a);
     }
 
-    // check return - should check non-main too
+    // falling off the end returns 0 - for main that's what C says, and for
+    // anything else using the value is undefined, but the block still needs
+    // a terminator (like the empty one after a switch whose cases all return)
     const_quad const last = last_in_bb(irst.bb);
     if (!last || last->op != IR_OP_RETURN) {
-        if (!strcmp(irst.fn->ident, "main")) {
-            emit(IR_OP_RETURN, NULL, gen_rvalue(simple_constant_alloc(0), NULL), NULL);
-        }
+        astn ret = get_active_fn_target();
 
-        if (ir_type_matches(get_active_fn_target(), IR_void)) {
+        if (ir_type_matches(ret, IR_void)) {
             emit(IR_OP_RETURN, NULL, NULL, NULL);
+        } else {
+            astn zero = make_type_compat_with(gen_rvalue(simple_constant_alloc(0), NULL), ret);
+            emit(IR_OP_RETURN, NULL, zero, NULL);
         }
     }
 
+    ir_note_fn_arena();
     bbl_pop_to_root();
 }
 
@@ -13,7 +13,9 @@ astn gen_rvalue(astn a, astn target);
 void gen_quads(astn a);
 
 astn gen_anon(astn a);
+astn gen_anon_named(astn a, char *name);
 void gen_global(sym e);
+void gen_global_named(sym e, const char *ident);
 void gen_fn(sym e);
 
 #endif
@@ -4,6 +4,7 @@
 #include "ir_types.h"
 #include "ir_util.h"
 #include "parser.tab.h"
+#include "typetab.h"
 
 
 // 6.2.5.18 - Integer and floating types are collectively called arithmetic types.
@@ -101,8 +102,11 @@ astn gen_pointer_subtraction(astn ptr, astn i, astn target) {
         i_ext = convert_integer_type(i, IR_PTR_INT_TYPE);
         i_ext_neg = do_negate(i_ext);
     } else {
-        i->Num.number.integer = -i->Num.number.integer;
-        i_ext = i;
+        // a new number: i may be in the value table already
+        i_ext = astn_alloc(ASTN_NUM);
+        i_ext->context = i->context;
+        i_ext->Num.number = i->Num.number;
+        i_ext->Num.number.integer = -i->Num.number.integer;
         i_ext_neg = i_ext;
     }
 
@@ -195,8 +199,8 @@ astn gen_sub_rvalue(astn a, astn target) {
             qerrorl(a, "Cannot subtract incompatible pointer types");
 
         // convert both to int
-        astn i_l = ptr_to_int(l, qtype_alloc(IR_PTR_INT_TYPE));
-        astn i_r = ptr_to_int(r, qtype_alloc(IR_PTR_INT_TYPE));
+        astn i_l = ptr_to_int(l, qtype_get(IR_PTR_INT_TYPE, NULL));
+        astn i_r = ptr_to_int(r, qtype_get(IR_PTR_INT_TYPE, NULL));
 
         // subtract
         astn b = binop_alloc('-', i_l, i_r);
@@ -7,7 +7,12 @@
 #include "ir_types.h"
 #include "ir_util.h"
 
+#include <string.h>
+
+#include "compilation.h"
+#include "memstat.h"
 #include "parser.tab.h"
+#include "typetab.h"
 
 BB bb_link(BB new) {
     new->fn = irst.fn;
@@ -20,15 +25,15 @@ BB bb_link(BB new) {
 }
 
 BB bb_alloc(void) {
-    BB new = safe_calloc(1, sizeof(struct BB));
+    BB new = ir_alloc(sizeof(struct BB));
+    mem_note(MEM_BBS, sizeof(struct BB));
     return new;
 }
 
 BB bb_nolink(const char *s) {
     BB new = bb_alloc();
-    char *ss;
-    asprintf(&ss, "%s.%d", s, irst.uniq++);
-    new->name = ss;
+    new->name = arena_sprintf(&irst.current_bbl->arena, "%s.%d", s, irst.fn_uniq++);
+    mem_note(MEM_STRINGS, strlen(new->name) + 1);
 
     return new;
 }
@@ -39,21 +44,25 @@ BB bb_named(const char* s) {
 
 BB bb_active(BB bb) {
     irst.bb = bb;
+    astn_arena = ir_arena();
     return bb;
 }
 
 BB bb_jumproot(void) {
     BB save = irst.bb;
-    irst.bb = irst.root_bbl->me;
+    bb_active(irst.root_bbl->me);
 
     return save;
 }
 
 BB bbl_push(void) {
-    BBL new = safe_calloc(1, sizeof(struct BBL));
+    BBL new = arena_alloc(&tu_arena, sizeof(struct BBL));
+    mem_note(MEM_BBS, sizeof(struct BBL));
     if (irst.bb != irst.root_bbl->me)
         die("bbl_push should only be called to start a new function.");
 
+    arena_init(&new->arena, irst.fn->ident);
+
     irst.current_bbl->next = new;
     irst.current_bbl = new;
 
@@ -73,10 +82,32 @@ BB bbl_push(void) {
 }
 
 void bbl_pop_to_root(void) {
-    irst.bb = irst.root_bbl->me;
+    bb_active(irst.root_bbl->me);
     irst.bb_head = irst.bb;
 }
 
+/*
+ * Throw away the function we just finished, once it has been printed.
+ * Its quads, blocks and temps all live in its arena; anything that has to
+ * outlive it was emitted under the root block instead.
+ */
+void bbl_release(void) {
+    BBL done = irst.current_bbl;
+    if (done == irst.root_bbl || irst.bb != irst.root_bbl->me)
+        die("bbl_release should only be called after finishing a function.");
+
+    // only the root is ever left on the chain
+    irst.root_bbl->next = NULL;
+    irst.current_bbl = irst.root_bbl;
+
+    irst.fn->param_list_q = NULL;
+
+    // everything the function needed from the root went out ahead of it
+    irst.root_flushed = irst.root_bbl->me->nquads;
+
+    arena_release(&done->arena);
+}
+
 astn wrap_bb(BB bb) {
     astn a = astn_alloc(ASTN_QBB);
     a->Qbb.bb = bb;
@@ -144,7 +175,7 @@ astn gen_equality_eq(astn a, astn b, astn target) {
 
     prepare_equality(a, b, &a_conv, &b_conv);
 
-    target = qprepare_target(target, qtype_alloc(IR_i1));
+    target = qprepare_target(target, qtype_get(IR_i1, NULL));
     emit(IR_OP_CMPEQ, target, a_conv, b_conv);
 
     return target;
@@ -156,7 +187,7 @@ astn gen_equality_ne(astn a, astn b, astn target) {
 
     prepare_equality(a, b, &a_conv, &b_conv);
 
-    target = qprepare_target(target, qtype_alloc(IR_i1));
+    target = qprepare_target(target, qtype_get(IR_i1, NULL));
     emit(IR_OP_CMPNE, target, a_conv, b_conv);
 
     return target;
@@ -172,7 +203,7 @@ astn gen_relational(astn a, astn b, int op, astn target) {
 
     prepare_relational(a, b, &a_conv, &b_conv);
 
-    target = qprepare_target(target, qtype_alloc(IR_i1));
+    target = qprepare_target(target, qtype_get(IR_i1, NULL));
 
     switch (op) {
         case '<':
@@ -230,7 +261,7 @@ void uncond_branch(BB bb) {
 astn gen_ternary(astn tern, astn target) {
     struct astn_tern *t = &tern->Tern;
 
-    BB thb = bb_named(".tern.then");
+    BB thb = bb_nolink(".tern.then");
     BB elsb = bb_nolink(".tern.else");
     BB thconv = bb_nolink(".tern.thconv");
     BB elsconv = bb_nolink(".tern.elsconv");
@@ -302,7 +333,15 @@ void gen_switch(astn swnode) {
     BB end = bb_nolink(".switch.end");
     BB def = bb_nolink(".switch.def");
 
-    emit(IR_OP_SWITCHBEGIN, wrap_bb(end), c, NULL);
+    // no match goes to the default label, if there is one
+    BB nomatch = end;
+    for (astn ca = sw->body; ca; ca = list_next(ca)) {
+        astn n = list_data(ca);
+        if (n->type == ASTN_CASE && !n->Case.case_expr)
+            nomatch = def;
+    }
+
+    emit(IR_OP_SWITCHBEGIN, wrap_bb(nomatch), c, NULL);
 
     astn ca = sw->body;
     while (ca) {
@@ -347,11 +386,6 @@ void gen_switch(astn swnode) {
 
         ca = list_next(ca);
 
-        BB next = end;
-        if (ca && list_data(ca)->Case.bb) {
-            next = list_data(ca)->Case.bb->Qbb.bb;
-        }
-
         bb_active(n->Case.bb->Qbb.bb);
         bb_link(n->Case.bb->Qbb.bb);
         irst.brk = end;
@@ -359,6 +393,16 @@ void gen_switch(astn swnode) {
         if (s)
             gen_quads(s);
 
+        // the statements up to the next label belong to this case too
+        while (ca && list_data(ca)->type != ASTN_CASE) {
+            gen_quads(list_data(ca));
+            ca = list_next(ca);
+        }
+
+        BB next = end;
+        if (ca)
+            next = list_data(ca)->Case.bb->Qbb.bb;
+
         uncond_branch(next);
     }
 
@@ -8,6 +8,8 @@ BB bb_active(BB bb);
 BB bb_jumproot(void);
 BB bbl_push(void);
 void bbl_pop_to_root(void);
+void bbl_release(void);
+astn wrap_bb(BB bb);
 
 void uncond_branch(BB bb);
 
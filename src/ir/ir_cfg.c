@@ -0,0 +1,318 @@
+/*
+ * ir_cfg.c
+ *
+ * Building the CFG of a function's quads (see ir_cfg.h).
+ */
+#include "ir_cfg.h"
+
+#include <string.h>
+
+#include "ir_cf.h"
+#include "ir_state.h"
+#include "ir_util.h"
+
+#include "memstat.h"
+#include "util.h"
+
+static void *cfg_alloc(size_t size) {
+    mem_note(MEM_PASSES, size);
+    return ir_alloc(size);
+}
+
+static bool is_terminator(ir_op_E op) {
+    return op == IR_OP_BR || op == IR_OP_CONDBR || op == IR_OP_RETURN || op == IR_OP_SWITCHEND;
+}
+
+// anything after the first terminator can't run
+static void trim(BB bb) {
+    for (unsigned i = 0; i < bb->nquads; i++) {
+        if (is_terminator(bb->quads[i].op)) {
+            bb->nquads = i + 1;
+            return;
+        }
+    }
+}
+
+static void edge(const struct qtab *t, qval to, BB *out, unsigned *n) {
+    astn a = qa(t, to);
+    ast_check(a, ASTN_QBB, "");
+
+    if (out)
+        out[*n] = a->Qbb.bb;
+    (*n)++;
+}
+
+/*
+ * The blocks bb's terminator can go to, into out if it isn't NULL. Returns
+ * how many there are.
+ */
+static unsigned successors(const struct qtab *t, const_BB bb, BB *out) {
+    unsigned n = 0;
+    if (!bb->nquads)
+        return 0;
+
+    const_quad last = &bb->quads[bb->nquads - 1];
+    switch (last->op) {
+        case IR_OP_BR:
+            edge(t, last->target, out, &n);
+            break;
+
+        case IR_OP_CONDBR:
+            edge(t, last->src1, out, &n);
+            edge(t, last->src2, out, &n);
+            break;
+
+        case IR_OP_SWITCHEND:;
+            unsigned i = bb->nquads - 1;
+            while (i > 0 && bb->quads[i - 1].op == IR_OP_SWITCHCASE)
+                i--;
+
+            if (i == 0 || bb->quads[i - 1].op != IR_OP_SWITCHBEGIN)
+                die("Switch cases without a switch.");
+
+            edge(t, bb->quads[i - 1].target, out, &n);
+            for (; i < bb->nquads - 1; i++)
+                edge(t, bb->quads[i].src1, out, &n);
+            break;
+
+        default:
+            break; // returns, or falls off the end of the function
+    }
+
+    return n;
+}
+
+#define NONE ((unsigned)-1)
+
+/*
+ * Number the blocks reachable from the entry in reverse postorder, into
+ * c->rpo. The rest get NONE; returns how many were reached.
+ */
+static unsigned order_blocks(struct cfg *c, unsigned nblocks) {
+    struct {
+        BB bb;
+        unsigned next;  // the successor to go down next
+    } *stack = cfg_alloc(nblocks * sizeof(*stack));
+    BB *post = cfg_alloc(nblocks * sizeof(BB));
+
+    // until they're numbered below, anything but NONE means seen
+    for (BB bb = c->entry; bb; bb = bb->next)
+        bb->rpo = NONE;
+
+    unsigned sp = 0, npost = 0;
+    c->entry->rpo = 0;
+    stack[sp++].bb = c->entry;
+
+    while (sp) {
+        BB bb = stack[sp - 1].bb;
+
+        if (stack[sp - 1].next < bb->nsuccs) {
+            BB succ = bb->succs[stack[sp - 1].next++];
+            if (succ->rpo == NONE) {
+                succ->rpo = 0;
+                stack[sp].bb = succ;
+                stack[sp++].next = 0;
+            }
+        } else {
+            post[npost++] = bb;
+            sp--;
+        }
+    }
+
+    c->rpo = cfg_alloc(npost * sizeof(BB));
+    for (unsigned k = 0; k < npost; k++) {
+        BB bb = post[npost - 1 - k];
+        bb->rpo = k;
+        c->rpo[k] = bb;
+    }
+
+    c->nblocks = npost;
+    return npost;
+}
+
+// the edges, after unlinking the blocks nothing reaches
+static void find_edges(struct cfg *c) {
+    const struct qtab *t = &irst.current_bbl->tab;
+
+    for (;;) {
+        unsigned n = 0;
+        for (BB bb = c->entry; bb; bb = bb->next, n++) {
+            trim(bb);
+
+            bb->nsuccs = successors(t, bb, NULL);
+            bb->succs = cfg_alloc((bb->nsuccs ? bb->nsuccs : 1) * sizeof(BB));
+            successors(t, bb, bb->succs);
+        }
+
+        if (order_blocks(c, n) == n)
+            break;
+
+        for (BB bb = c->entry->next; bb; bb = bb->next) {
+            if (bb->rpo != NONE)
+                continue;
+
+            bb->prev->next = bb->next;
+            if (bb->next)
+                bb->next->prev = bb->prev;
+        }
+    }
+
+    for (BB bb = c->entry; bb; bb = bb->next) {
+        bb->npreds = 0;
+        bb->nkids = 0;
+        bb->idom = NULL;
+        bb->loop = NULL;
+    }
+
+    for (BB bb = c->entry; bb; bb = bb->next)
+        for (unsigned k = 0; k < bb->nsuccs; k++)
+            bb->succs[k]->npreds++;
+
+    for (BB bb = c->entry; bb; bb = bb->next) {
+        bb->preds = cfg_alloc((bb->npreds ? bb->npreds : 1) * sizeof(BB));
+        bb->npreds = 0;
+    }
+
+    for (BB bb = c->entry; bb; bb = bb->next)
+        for (unsigned k = 0; k < bb->nsuccs; k++)
+            bb->succs[k]->preds[bb->succs[k]->npreds++] = bb;
+}
+
+static BB intersect(BB a, BB b) {
+    while (a != b) {
+        while (a->rpo > b->rpo)
+            a = a->idom;
+        while (b->rpo > a->rpo)
+            b = b->idom;
+    }
+
+    return a;
+}
+
+static void dominators(struct cfg *c) {
+    c->entry->idom = c->entry;
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        for (unsigned k = 1; k < c->nblocks; k++) {
+            BB bb = c->rpo[k];
+            BB idom = NULL;
+
+            for (unsigned p = 0; p < bb->npreds; p++) {
+                BB pred = bb->preds[p];
+                if (pred->idom)
+                    idom = idom ? intersect(pred, idom) : pred;
+            }
+
+            if (bb->idom != idom) {
+                bb->idom = idom;
+                changed = true;
+            }
+        }
+    }
+
+    for (unsigned k = 1; k < c->nblocks; k++)
+        c->rpo[k]->idom->nkids++;
+
+    for (unsigned k = 0; k < c->nblocks; k++) {
+        BB bb = c->rpo[k];
+        bb->kids = cfg_alloc((bb->nkids ? bb->nkids : 1) * sizeof(BB));
+        bb->nkids = 0;
+    }
+
+    for (unsigned k = 1; k < c->nblocks; k++) {
+        BB parent = c->rpo[k]->idom;
+        parent->kids[parent->nkids++] = c->rpo[k];
+    }
+}
+
+bool cfg_dominates(const_BB a, const_BB b) {
+    while (b != a && b->idom != b)
+        b = b->idom;
+
+    return a == b;
+}
+
+/*
+ * Natural loops: a header with back edges to it (from blocks it
+ * dominates), and everything that gets to one of those without going
+ * through the header. Outer headers come first in reverse postorder, so
+ * each loop finds what it's nested in as the innermost one its header is
+ * already in, and the blocks end up in their innermost loop.
+ */
+static void loops(struct cfg *c) {
+    BB *work = cfg_alloc(c->nblocks * sizeof(BB));
+    unsigned *seen = cfg_alloc(c->nblocks * sizeof(unsigned));
+
+    c->loops = cfg_alloc(c->nblocks * sizeof(struct loop *));
+
+    for (unsigned k = 0; k < c->nblocks; k++) {
+        BB header = c->rpo[k];
+        struct loop *l = NULL;
+
+        for (unsigned p = 0; p < header->npreds; p++) {
+            BB latch = header->preds[p];
+            if (!cfg_dominates(header, latch))
+                continue;
+
+            if (!l) {
+                l = cfg_alloc(sizeof(struct loop));
+                l->header = header;
+                l->parent = header->loop;
+                l->depth = l->parent ? l->parent->depth + 1 : 1;
+                l->blocks = work; // for now
+                seen[header->rpo] = k + 1;
+                l->blocks[l->nblocks++] = header;
+            }
+
+            if (seen[latch->rpo] != k + 1) {
+                seen[latch->rpo] = k + 1;
+                l->blocks[l->nblocks++] = latch;
+            }
+        }
+
+        if (!l)
+            continue;
+
+        // up from the latches to the header
+        for (unsigned i = 1; i < l->nblocks; i++) {
+            BB bb = l->blocks[i];
+            for (unsigned p = 0; p < bb->npreds; p++) {
+                BB pred = bb->preds[p];
+                if (seen[pred->rpo] != k + 1) {
+                    seen[pred->rpo] = k + 1;
+                    l->blocks[l->nblocks++] = pred;
+                }
+            }
+        }
+
+        l->blocks = cfg_alloc(l->nblocks * sizeof(BB));
+        memcpy(l->blocks, work, l->nblocks * sizeof(BB));
+
+        for (unsigned i = 0; i < l->nblocks; i++)
+            l->blocks[i]->loop = l;
+
+        c->loops[c->nloops++] = l;
+    }
+}
+
+struct cfg *cfg_build(void) {
+    BBL bbl = irst.current_bbl;
+    if (bbl == irst.root_bbl)
+        die("cfg_build called without a function.");
+
+    BB save = irst.bb;
+    bb_active(bbl->me); // so it's allocated with the function
+
+    struct cfg *c = cfg_alloc(sizeof(struct cfg));
+    c->entry = bbl->me;
+
+    find_edges(c);
+    dominators(c);
+    loops(c);
+
+    bb_active(save);
+    return c;
+}
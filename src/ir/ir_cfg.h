@@ -0,0 +1,48 @@
+/*
+ * ir_cfg.h
+ *
+ * The control flow graph of the function gen_fn() just finished, for passes
+ * over its quads. The edges come from each block's terminator: BR, CONDBR,
+ * or a switch (SWITCHBEGIN's default and each SWITCHCASE). A block that
+ * doesn't end in one returns, or falls off the end of the function.
+ *
+ * Building it also drops what can never run - quads after a block's first
+ * terminator, and blocks the entry can't reach - so the edges, the
+ * reverse postorder, the dominator tree (Cooper, Harvey and Kennedy's "A
+ * Simple, Fast Dominance Algorithm") and the loop nesting forest cover the
+ * whole function. The loops are natural loops, one for each header that
+ * back edges go to; the quad generator only makes reducible control flow.
+ *
+ * It lives in the function's arena and stays right until a pass changes
+ * the edges; build it again after that.
+ */
+
+#ifndef IR_CFG_H
+#define IR_CFG_H
+
+#include <stdbool.h>
+
+#include "ir_core.h"
+
+struct loop {
+    BB header;
+    struct loop *parent;    // the loop it's nested in, NULL for an outermost loop
+    unsigned depth;         // 1 for an outermost loop
+    BB *blocks;             // the header first, then the rest, nested loops' included
+    unsigned nblocks;
+};
+
+struct cfg {
+    BB entry;
+    BB *rpo;                // every block, in reverse postorder (bb->rpo indexes it)
+    unsigned nblocks;
+    struct loop **loops;    // every loop, each after the ones it's nested in
+    unsigned nloops;
+};
+
+// of the function gen_fn() just finished
+struct cfg *cfg_build(void);
+
+bool cfg_dominates(const_BB a, const_BB b);
+
+#endif
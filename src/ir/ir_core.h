@@ -1,32 +1,65 @@
 #ifndef IR_CORE_H
 #define IR_CORE_H
 
+#include "arena.h"
 #include "ast.h"
 #include "symtab.h"
 #include "ir_defs.h"
 
 struct astn_list;
-struct quad {
-    struct quad *prev;
-    struct quad *next;
 
+// quads are stored by value in their block's array; see qtab for operands
+struct quad {
     ir_op_E op;
 
-    astn target;
-    astn src1;
-    astn src2;
-    astn src3;
+    qval target;
+    qval src1;
+    qval src2;
+    qval src3;
 };
 
 typedef struct quad *quad;
 typedef const struct quad *const_quad;
 
+/*
+ * Per-function value table. Every operand astn a function's quads use is
+ * stored here once, and quads refer to it by qval: temps and blocks keep
+ * their handle, and constants (by type and value), globals (by node) and
+ * the functions called (by symbol) are found through index, so each is in
+ * the table once however often it's used. types has the IR type of each temp, constant and global, for walks
+ * that only need that.
+ */
+struct qtab {
+    astn *vals;
+    unsigned char *types; // ir_type_E
+    unsigned count;
+    unsigned cap;
+
+    qval *index; // open addressing, index_cap a power of 2
+    unsigned nindex;
+    unsigned index_cap;
+};
+
 struct BB {
-    quad first;
-    quad current;
+    quad quads;
+    unsigned nquads;
+    unsigned cap;
+
+    qval handle; // of its ASTN_QBB, once something branches here
 
     const char *name;
 
+    // its place in the CFG, once cfg_build() has run (see ir_cfg.h)
+    struct BB **succs;      // one for each edge out: a switch can go to a block more than once
+    unsigned nsuccs;
+    struct BB **preds;      // likewise, one for each edge in
+    unsigned npreds;
+    unsigned rpo;           // reverse postorder number, from 0 for the entry
+    struct BB *idom;        // immediate dominator; the entry's is itself
+    struct BB **kids;       // the blocks it immediately dominates
+    unsigned nkids;
+    struct loop *loop;      // the innermost loop it's in, NULL for none
+
     struct BB *prev;
     struct BB *next;
 
@@ -36,9 +69,13 @@ struct BB {
 typedef struct BB *BB;
 typedef const struct BB *const_BB;
 
+// one BBL per function; quads and blocks of the function live in its arena
 struct BBL {
     BB me;
     struct BBL *next;
+
+    struct qtab tab;
+    struct arena arena;
 };
 
 typedef struct BBL *BBL;
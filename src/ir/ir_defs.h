@@ -2,6 +2,7 @@
 #define IR_DEFS_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 typedef enum {
     IR_OP_UNKNOWN = 0,
@@ -14,6 +15,7 @@ typedef enum {
     IR_OP_STORE,
     IR_OP_RETURN,
     IR_OP_GEP,
+    IR_OP_PHI,
 
     IR_OP_FNCALL,
     IR_OP_BR,
@@ -79,6 +81,7 @@ static const char *ir_op_str[IR_OP_COUNT] = {
     [IR_OP_STORE] = "store",
     [IR_OP_RETURN] = "ret",
     [IR_OP_GEP] = "getelementptr",
+    [IR_OP_PHI] = "phi",
 
     [IR_OP_FNCALL] = "call",
     [IR_OP_BR] = "br",
@@ -125,4 +128,27 @@ static size_t ir_type_size[IR_TYPE_COUNT] = {
 
 #define IR_PTR_INT_TYPE IR_i64
 
+/*
+ * Quad operands are 32-bit handles into the owning function's value table:
+ * the top bits say what kind of value it is, the rest is the table index.
+ * Handle 0 means "no operand".
+ */
+typedef uint32_t qval;
+
+typedef enum {
+    QV_NONE = 0,
+    QV_TEMP,        // function-local qtemp
+    QV_CONST,       // ASTN_NUM
+    QV_BB,          // ASTN_QBB
+    QV_GLOBAL,      // named qtemp - globals, struct types
+    QV_OTHER,       // anything else (lists, types, literals)
+} qv_kind_E;
+
+#define QV_KIND_SHIFT 28
+#define QV_INDEX_MASK ((1u << QV_KIND_SHIFT) - 1)
+
+#define QV_MAKE(kind, index) (((qval)(kind) << QV_KIND_SHIFT) | (qval)(index))
+#define QV_KIND(v) ((qv_kind_E)((v) >> QV_KIND_SHIFT))
+#define QV_INDEX(v) ((v) & QV_INDEX_MASK)
+
 #endif
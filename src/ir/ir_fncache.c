@@ -0,0 +1,653 @@
+/*
+ * ir_fncache.c
+ *
+ * The key is a serialization of the function: its own symbol, its parameters
+ * and locals in the order gen_fn() allocates them, and its body, with each
+ * symbol and struct tag written out in full the first time it comes up and by
+ * number after that. The key is only handed to the store, which hashes it
+ * however it likes.
+ *
+ * An entry is
+ *
+ *   dcc-fn <number of records>\n
+ *   s <ref>\n                            the struct type of the ref'th symbol
+ *   g <ref> <name>\n                     a global for the ref'th symbol
+ *   c <length> <name>\n<bytes>\n         a string literal
+ *   <the function's text>
+ *
+ * with one record for each quad the function added to the root block, in
+ * order, so that putting them back hands out the same struct numbers.
+ */
+#include "ir_fncache.h"
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ir.h"
+#include "ir_state.h"
+#include "ir_types.h"
+#include "ir_util.h"
+
+#include "ast.h"
+#include "compilation.h"
+#include "dcc.h"
+#include "memstat.h"
+#include "symtab.h"
+#include "util.h"
+
+#define ENTRY_MAGIC "dcc-fn"
+#define KEY_VERSION "dcc-fn 4"
+
+#define fc (dcc_cc->fncache)
+
+static void buf_add(struct fncache_buf *b, const void *s, size_t n) {
+    if (b->len + n > b->cap) {
+        b->cap = (b->len + n) * 2;
+        b->p = safe_realloc(b->p, b->cap);
+        mem_note(MEM_FNCACHE, b->cap);
+    }
+
+    memcpy(b->p + b->len, s, n);
+    b->len += n;
+}
+
+static void buf_printf(struct fncache_buf *b, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void buf_printf(struct fncache_buf *b, const char *fmt, ...) {
+    char line[128];
+    va_list ap;
+
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+
+    if (n < 0 || (size_t)n >= sizeof(line))
+        die("Record too long in the function cache");
+
+    buf_add(b, line, (size_t)n);
+}
+
+static unsigned hash_ptr(const void *p) {
+    uintptr_t v = (uintptr_t)p;
+    v ^= v >> 17;
+    return (unsigned)(v * 0x9e3779b97f4a7c15u >> 32);
+}
+
+static bool ref_find(const void *ptr, unsigned *i) {
+    if (!fc.slots_cap)
+        return false;
+
+    for (unsigned h = hash_ptr(ptr) & (fc.slots_cap - 1); fc.slots[h]; h = (h + 1) & (fc.slots_cap - 1)) {
+        if (fc.refs[fc.slots[h] - 1].ptr == ptr) {
+            *i = fc.slots[h] - 1;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void ref_slot(unsigned i) {
+    unsigned h = hash_ptr(fc.refs[i].ptr) & (fc.slots_cap - 1);
+    while (fc.slots[h])
+        h = (h + 1) & (fc.slots_cap - 1);
+
+    fc.slots[h] = i + 1;
+}
+
+static void ref_add(const void *ptr, sym e, astn type) {
+    if (fc.nrefs == fc.refs_cap) {
+        fc.refs_cap = fc.refs_cap ? fc.refs_cap * 2 : 64;
+        fc.refs = safe_realloc(fc.refs, fc.refs_cap * sizeof(struct fncache_ref));
+        mem_note(MEM_FNCACHE, fc.refs_cap * sizeof(struct fncache_ref));
+    }
+
+    // keep the table at most half full
+    if ((fc.nrefs + 1) * 2 > fc.slots_cap) {
+        free(fc.slots);
+        fc.slots_cap = fc.slots_cap ? fc.slots_cap * 2 : 128;
+        fc.slots = safe_calloc(fc.slots_cap, sizeof(unsigned));
+        mem_note(MEM_FNCACHE, fc.slots_cap * sizeof(unsigned));
+
+        for (unsigned i = 0; i < fc.nrefs; i++)
+            ref_slot(i);
+    }
+
+    fc.refs[fc.nrefs] = (struct fncache_ref){.ptr = ptr, .e = e, .type = type};
+    ref_slot(fc.nrefs++);
+}
+
+static void key_u64(unsigned long long v) {
+    buf_add(&fc.key, &v, sizeof(v));
+}
+
+static void key_str(const char *s) {
+    if (!s) {
+        key_u64(UINT64_MAX);
+        return;
+    }
+
+    key_u64(strlen(s));
+    buf_add(&fc.key, s, strlen(s));
+}
+
+static void key_node(astn a);
+static void key_type(astn t);
+
+static void key_struct(astn t) {
+    sym s = t->Type.tagtype.symbol;
+
+    unsigned i;
+    if (ref_find(s, &i)) {
+        key_u64(i);
+        return;
+    }
+
+    ref_add(s, NULL, t);
+    key_str(s->ident);
+    key_u64(t->Type.tagtype.type);
+    key_u64(s->is_union);
+
+    // the name its struct type got, which is what we print
+    if (s->qptr) {
+        key_str(s->qptr->Qtemp.name);
+    } else {
+        key_str(NULL);
+        fc.unemitted = true;
+    }
+
+    if (!s->members) {
+        key_str(NULL);
+        return;
+    }
+
+    for (sym m = s->members->first; m; m = m->next) {
+        key_str(m->ident);
+        key_u64((unsigned long long)m->struct_offset);
+        key_type(m->type);
+    }
+    key_str(NULL);
+}
+
+static void key_type(astn t) {
+    if (!t) {
+        key_u64(ASTN_KIND_UNDEF);
+        return;
+    }
+
+    if (t->type != ASTN_TYPE) {
+        fc.on = false;
+        return;
+    }
+
+    key_u64(ASTN_TYPE);
+    key_u64(t->Type.is_const | t->Type.is_volatile << 1 | t->Type.is_restrict << 2 |
+            t->Type.is_atomic << 3 | t->Type.is_derived << 4 | t->Type.is_tagtype << 5);
+
+    if (t->Type.is_derived) {
+        key_u64(t->Type.derived.type);
+
+        if (t->Type.derived.type == t_FN) {
+            for (astn p = t->Type.derived.param_list; p; p = list_next(p)) {
+                astn a = list_data(p);
+                if (a->type == ASTN_ELLIPSIS)
+                    key_u64(ASTN_ELLIPSIS);
+                else
+                    key_type(a->Declrec.e->type);
+            }
+            key_u64(ASTN_KIND_MAX);
+        } else {
+            key_node(t->Type.derived.size);
+        }
+
+        key_type(t->Type.derived.target);
+    } else if (t->Type.is_tagtype) {
+        key_struct(t);
+    } else {
+        key_u64(t->Type.scalar.type);
+        key_u64(t->Type.scalar.is_unsigned);
+    }
+}
+
+static void key_sym(sym e) {
+    unsigned i;
+    if (ref_find(e, &i)) {
+        key_u64(i);
+        return;
+    }
+
+    ref_add(e, e, NULL);
+    key_str(e->ident);
+    key_u64(e->scope ? e->scope->scope_type : SCOPE_UNDEF);
+    key_u64(e->entry_type);
+    key_u64(e->storspec);
+    key_u64(e->linkage);
+    key_u64(e->is_param | e->variadic << 1);
+    key_type(e->type);
+
+    // sccp reads a const object's initializer (see ir_sccp.h)
+    if (e->type && e->type->type == ASTN_TYPE && e->type->Type.is_const && e->has_init && !e->init_is_str)
+        key_u64(e->numinit.integer);
+}
+
+static void key_node(astn a) {
+    if (!fc.on)
+        return;
+
+    if (!a || a->type == ASTN_TYPE) {
+        key_type(a);
+        return;
+    }
+
+    key_u64(a->type);
+
+    switch (a->type) {
+        case ASTN_NUM:;
+            const struct number *n = &a->Num.number;
+            key_u64(n->aux_type);
+            key_u64(n->is_signed);
+
+            if (n->aux_type >= s_REAL) {
+                char real[64];
+                snprintf(real, sizeof(real), "%La", n->real);
+                key_str(real);
+            } else {
+                key_u64(n->integer);
+            }
+            break;
+
+        case ASTN_IDENT:
+            key_str(a->Ident.ident);
+            break;
+
+        case ASTN_STRLIT:
+            key_u64(a->Strlit.strlit.len);
+            buf_add(&fc.key, a->Strlit.strlit.str, a->Strlit.strlit.len);
+            break;
+
+        case ASTN_ASSIGN:
+            key_node(a->Assign.left);
+            key_node(a->Assign.right);
+            break;
+
+        case ASTN_CASSIGN:
+            key_u64((unsigned)a->Cassign.op);
+            key_node(a->Cassign.left);
+            key_node(a->Cassign.right);
+            break;
+
+        case ASTN_BINOP:
+            key_u64((unsigned)a->Binop.op);
+            key_node(a->Binop.left);
+            key_node(a->Binop.right);
+            break;
+
+        case ASTN_FNCALL:
+            key_u64((unsigned)a->Fncall.argcount);
+            key_node(a->Fncall.fn);
+            key_node(a->Fncall.args);
+            break;
+
+        case ASTN_SELECT:
+            key_node(a->Select.parent);
+            key_node(a->Select.member);
+            break;
+
+        case ASTN_UNOP:
+            key_u64((unsigned)a->Unop.op);
+            key_node(a->Unop.target);
+            break;
+
+        case ASTN_SIZEOF:
+            key_node(a->Sizeof.target);
+            break;
+
+        case ASTN_TERN:
+            key_node(a->Tern.cond);
+            key_node(a->Tern.t_then);
+            key_node(a->Tern.t_else);
+            break;
+
+        case ASTN_LIST:
+            for (; a; a = list_next(a))
+                key_node(list_data(a));
+            key_u64(ASTN_KIND_MAX);
+            break;
+
+        case ASTN_DECLREC:
+            key_sym(a->Declrec.e);
+            key_node(a->Declrec.init);
+            break;
+
+        case ASTN_SYMPTR:
+            key_sym(a->Symptr.e);
+            break;
+
+        case ASTN_IFELSE:
+            key_node(a->Ifelse.condition_s);
+            key_node(a->Ifelse.then_s);
+            key_node(a->Ifelse.else_s);
+            break;
+
+        case ASTN_SWITCH:
+            key_node(a->Switch.condition);
+            key_node(a->Switch.body);
+            break;
+
+        case ASTN_WHILELOOP:
+            key_u64(a->Whileloop.is_dowhile);
+            key_node(a->Whileloop.condition);
+            key_node(a->Whileloop.body);
+            break;
+
+        case ASTN_FORLOOP:
+            key_node(a->Forloop.init);
+            key_node(a->Forloop.condition);
+            key_node(a->Forloop.oneach);
+            key_node(a->Forloop.body);
+            break;
+
+        case ASTN_GOTO:
+            key_node(a->Goto.ident);
+            break;
+
+        case ASTN_RETURN:
+            key_node(a->Return.ret);
+            break;
+
+        case ASTN_LABEL:
+            key_node(a->Label.ident);
+            key_node(a->Label.statement);
+            break;
+
+        case ASTN_CASE:
+            key_node(a->Case.case_expr);
+            key_node(a->Case.statement);
+            break;
+
+        case ASTN_BREAK:
+        case ASTN_CONTINUE:
+        case ASTN_ELLIPSIS:
+        case ASTN_NOOP:
+            break;
+
+        default: // nothing the parser leaves in a function body, so don't guess
+            fc.on = false;
+    }
+}
+
+// the key for fn, in fc.key; fc.on is cleared if fn can't be cached
+static void make_key(sym fn) {
+    fc.key.len = 0;
+    fc.nrefs = 0;
+    fc.unemitted = false;
+    if (fc.slots)
+        memset(fc.slots, 0, fc.slots_cap * sizeof(unsigned));
+
+    key_str(KEY_VERSION);
+    key_u64(dcc_cc->opts.output == DCC_OUTPUT_IR); // otherwise, assembly
+    key_u64(dcc_is_host_darwin());
+    key_u64((unsigned long long)dcc_cc->opts.opt_level);
+
+    key_sym(fn);
+
+    // the same walks as gen_fn(), so locals are numbered the way they're allocated
+    for (astn p = fn->param_list; p; p = list_next(p)) {
+        astn a = list_data(p);
+        if (a->type == ASTN_ELLIPSIS)
+            key_u64(ASTN_ELLIPSIS);
+        else
+            key_sym(a->Declrec.e);
+    }
+
+    for (astn l = fn->fn_scope->all_syms; l; l = list_next(l))
+        key_sym(list_data(l)->Declrec.e);
+
+    key_node(fn->body);
+
+    // the struct types it puts out are numbered from here
+    if (fc.unemitted)
+        key_u64((unsigned)irst.uniq);
+}
+
+// an entry, as it's read back
+struct reader {
+    const char *p, *end;
+};
+
+static bool read_num(struct reader *r, char sep, size_t *v) {
+    char *end;
+    if (r->p == r->end || *r->p < '0' || *r->p > '9')
+        return false;
+
+    unsigned long long n = strtoull(r->p, &end, 10);
+    if (end >= r->end || *end != sep)
+        return false;
+
+    *v = (size_t)n;
+    r->p = end + 1;
+    return true;
+}
+
+static bool read_name(struct reader *r, const char **s, size_t *n) {
+    const char *nl = memchr(r->p, '\n', (size_t)(r->end - r->p));
+    if (!nl || nl == r->p)
+        return false;
+
+    *s = r->p;
+    *n = (size_t)(nl - r->p);
+    r->p = nl + 1;
+    return true;
+}
+
+/*
+ * Go through an entry's records, checking them against what we know of the
+ * function; with apply, put the globals they describe back in the root.
+ */
+static bool replay_records(struct reader *r, bool apply) {
+    size_t count;
+    if ((size_t)(r->end - r->p) < sizeof(ENTRY_MAGIC) ||
+        memcmp(r->p, ENTRY_MAGIC " ", sizeof(ENTRY_MAGIC)))
+        return false;
+
+    r->p += sizeof(ENTRY_MAGIC);
+    if (!read_num(r, '\n', &count))
+        return false;
+
+    for (size_t i = 0; i < count; i++) {
+        if (r->end - r->p < 2 || r->p[1] != ' ')
+            return false;
+
+        char kind = *r->p;
+        r->p += 2;
+
+        size_t n;
+        const char *name;
+        size_t name_len;
+
+        switch (kind) {
+            case 's':
+                if (!read_num(r, '\n', &n) || n >= fc.nrefs || !fc.refs[n].type ||
+                    fc.refs[n].type->Type.tagtype.symbol->qptr)
+                    return false;
+
+                if (apply)
+                    get_qtype(fc.refs[n].type);
+                break;
+
+            case 'g':
+                if (!read_num(r, ' ', &n) || n >= fc.nrefs || !fc.refs[n].e ||
+                    !read_name(r, &name, &name_len))
+                    return false;
+
+                if (apply) {
+                    gen_global_named(fc.refs[n].e, arena_sprintf(&tu_arena, "%.*s", (int)name_len, name));
+                    mem_note(MEM_STRINGS, name_len + 1);
+                }
+                break;
+
+            case 'c':
+                if (!read_num(r, ' ', &n) || !read_name(r, &name, &name_len) ||
+                    (size_t)(r->end - r->p) <= n || r->p[n] != '\n')
+                    return false;
+
+                if (apply) {
+                    astn s = astn_alloc(ASTN_STRLIT);
+                    s->Strlit.strlit.str = arena_alloc(&tu_arena, n + 1);
+                    s->Strlit.strlit.len = n;
+                    memcpy(s->Strlit.strlit.str, r->p, n);
+
+                    gen_anon_named(s, arena_sprintf(&tu_arena, "%.*s", (int)name_len, name));
+                    mem_note(MEM_STRINGS, n + 1 + name_len + 1);
+                }
+
+                r->p += n + 1;
+                break;
+
+            default:
+                return false;
+        }
+    }
+
+    return true;
+}
+
+// describe what the function added to the root; false if we can't
+static bool write_records(struct fncache_buf *b) {
+    const struct qtab *t = &irst.root_bbl->tab;
+    BB root = irst.root_bbl->me;
+
+    buf_printf(b, ENTRY_MAGIC " %u\n", root->nquads - fc.root_start);
+
+    for (unsigned i = fc.root_start; i < root->nquads; i++) {
+        const_quad q = &root->quads[i];
+        astn target = qa(t, q->target);
+        unsigned ref;
+
+        if (q->op != IR_OP_DEFGLOBAL)
+            return false;
+
+        if (target->type == ASTN_TYPE) {
+            if (!ref_find(target->Type.tagtype.symbol, &ref))
+                return false;
+
+            buf_printf(b, "s %u\n", ref);
+        } else if (target->type == ASTN_QTEMP && target->Qtemp.global) {
+            astn g = target->Qtemp.global;
+
+            if (g->type == ASTN_STRLIT) {
+                buf_printf(b, "c %zu ", g->Strlit.strlit.len);
+                buf_add(b, target->Qtemp.name, strlen(target->Qtemp.name));
+                buf_add(b, "\n", 1);
+                buf_add(b, g->Strlit.strlit.str, g->Strlit.strlit.len);
+                buf_add(b, "\n", 1);
+            } else if (g->type == ASTN_SYMPTR && ref_find(g->Symptr.e, &ref) && fc.refs[ref].e) {
+                buf_printf(b, "g %u ", ref);
+                buf_add(b, target->Qtemp.name, strlen(target->Qtemp.name));
+                buf_add(b, "\n", 1);
+            } else {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Called with each function definition, before it's generated, once
+ * everything ahead of it is out. If it's cached, its text goes to o and
+ * that's the function done; otherwise what it prints should go through
+ * fncache_out(), and fncache_store() afterwards.
+ */
+bool fncache_fetch(sym fn, struct outbuf *o) {
+    const struct dcc_fn_store *store = dcc_cc->opts.fn_store;
+
+    fc.on = store && dcc_cc->opts.output != DCC_OUTPUT_OBJ;
+    if (!fc.on)
+        return false;
+
+    make_key(fn);
+    if (!fc.on)
+        return false;
+
+    fc.root_start = irst.root_bbl->me->nquads;
+    fc.warnings = dcc_cc->warnings;
+
+    size_t len;
+    char *entry = store->fetch(store->ctx, fc.key.p, fc.key.len, &len);
+    if (!entry)
+        return false;
+
+    struct reader r = {entry, entry + len};
+    bool hit = replay_records(&r, false);
+
+    if (hit) {
+        r.p = entry;
+        replay_records(&r, true);
+        outbuf_write(o, r.p, (size_t)(r.end - r.p));
+
+        // as if it had been generated and released
+        irst.fn = fn;
+        irst.root_flushed = irst.root_bbl->me->nquads;
+        fc.on = false;
+    }
+
+    free(entry);
+    return hit;
+}
+
+static void capture(void *ctx, const char *s, size_t n) {
+    buf_add(ctx, s, n);
+}
+
+// where to print the function, given where it's going
+struct outbuf *fncache_out(struct outbuf *o) {
+    if (!fc.on)
+        return o;
+
+    if (!fc.capture.sink)
+        outbuf_init_sink(&fc.capture, capture, &fc.text);
+
+    fc.text.len = 0;
+    return &fc.capture;
+}
+
+// pass on what was printed for the function to o, keeping a copy
+void fncache_store(struct outbuf *o) {
+    if (!fc.on)
+        return;
+
+    fc.on = false;
+
+    outbuf_flush(&fc.capture);
+    outbuf_write(o, fc.text.p, fc.text.len);
+
+    // what it had to say wouldn't be said again
+    if (dcc_cc->warnings != fc.warnings)
+        return;
+
+    struct fncache_buf entry = {0};
+    if (write_records(&entry)) {
+        buf_add(&entry, fc.text.p, fc.text.len);
+
+        const struct dcc_fn_store *store = dcc_cc->opts.fn_store;
+        store->store(store->ctx, fc.key.p, fc.key.len, entry.p, entry.len);
+    }
+
+    free(entry.p);
+}
+
+void fncache_free(struct fncache *c) {
+    outbuf_free(&c->capture);
+    free(c->key.p);
+    free(c->text.p);
+    free(c->refs);
+    free(c->slots);
+}
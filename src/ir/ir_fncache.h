@@ -0,0 +1,63 @@
+/*
+ * ir_fncache.h
+ *
+ * Function definitions that come out the same as last time aren't compiled
+ * again. Each one is keyed on its AST, the names and types of everything it
+ * refers to (struct layouts included), and the little translation unit state
+ * its output depends on. If the embedder's store (dcc_options.fn_store) has
+ * something under that key, the function's text goes straight into the
+ * output and the globals it would have added to the root block (string
+ * literals, static locals, struct types, block scope declarations) are added
+ * again, so the rest of the unit can't tell the difference. Otherwise it's
+ * compiled as usual, and what's printed for it is captured and stored.
+ *
+ * Only the text outputs are cached: IR, and the native backend's assembly
+ * (which the integrated assembler still assembles).
+ */
+
+#ifndef IR_FNCACHE_H
+#define IR_FNCACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "outbuf.h"
+#include "symtab.h"
+
+struct fncache_buf {
+    char *p;
+    size_t len, cap;
+};
+
+// a symbol or struct tag the key mentions, numbered in the order it did
+struct fncache_ref {
+    const void *ptr;
+    sym e;          // a variable or function
+    astn type;      // or a struct type
+};
+
+struct fncache {
+    bool on;                    // the current function is being cached
+
+    struct fncache_buf key;
+    bool unemitted;             // the key mentions a struct whose type isn't out yet
+
+    struct fncache_ref *refs;
+    unsigned nrefs, refs_cap;
+    unsigned *slots;            // refs by ptr, open addressed; index + 1, 0 for none
+    unsigned slots_cap;
+
+    unsigned root_start;        // the first root quad the function added
+    unsigned warnings;          // dcc_cc->warnings when it started
+
+    struct fncache_buf text;    // what's been printed for it
+    struct outbuf capture;      // ...which goes through here
+};
+
+bool fncache_fetch(sym fn, struct outbuf *o);
+struct outbuf *fncache_out(struct outbuf *o);
+void fncache_store(struct outbuf *o);
+
+void fncache_free(struct fncache *c);
+
+#endif
@@ -0,0 +1,662 @@
+/*
+ * ir_llvm.c
+ *
+ * In-process backend: the quads are built straight into an LLVM module
+ * through the LLVM C API, and LLVM's target machine writes the object file.
+ * It's the same IR ir_print.c prints, without the round trip through text,
+ * llc and the assembler. Only built with `scons llvm=1`.
+ *
+ * The quads only know "ptr", so every pointer is an i8* here and gets cast to
+ * the right pointer type where it's used. Under opaque pointers the casts are
+ * no-ops.
+ */
+#include "ir_llvm.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#include <llvm-c/Analysis.h>
+#include <llvm-c/Core.h>
+#include <llvm-c/Target.h>
+#include <llvm-c/TargetMachine.h>
+
+#include "ir.h"
+#include "ir_state.h"
+#include "ir_types.h"
+#include "ir_util.h"
+
+#include "ast.h"
+#include "compilation.h"
+#include "memstat.h"
+#include "symtab.h"
+#include "util.h"
+
+struct llvm_module {
+    LLVMContextRef ctx;
+    LLVMModuleRef mod;
+    LLVMBuilderRef b;
+
+    // the function being built
+    LLVMValueRef fn;
+    LLVMValueRef *temps;        // by tempno
+    unsigned ntemps;
+    LLVMBasicBlockRef *blocks;  // by the index of the block's handle
+    LLVMValueRef sw;            // the switch cases are going into
+};
+
+static const LLVMOpcode binop_opcode[IR_OP_COUNT] = {
+    [IR_OP_ADD] = LLVMAdd,
+    [IR_OP_SUB] = LLVMSub,
+    [IR_OP_MUL] = LLVMMul,
+    [IR_OP_SDIV] = LLVMSDiv,
+    [IR_OP_UDIV] = LLVMUDiv,
+    [IR_OP_SMOD] = LLVMSRem,
+    [IR_OP_UMOD] = LLVMURem,
+};
+
+static const LLVMIntPredicate cmp_predicate[IR_OP_COUNT] = {
+    [IR_OP_CMPEQ] = LLVMIntEQ,
+    [IR_OP_CMPNE] = LLVMIntNE,
+    [IR_OP_CMPLT] = LLVMIntSLT,
+    [IR_OP_CMPLTEQ] = LLVMIntSLE,
+};
+
+static LLVMTypeRef ptr_type(struct llvm_module *m) {
+    return LLVMPointerType(LLVMInt8TypeInContext(m->ctx), 0);
+}
+
+static LLVMTypeRef struct_type(struct llvm_module *m, const char *name) {
+    LLVMTypeRef t = LLVMGetTypeByName2(m->ctx, name);
+    return t ? t : LLVMStructCreateNamed(m->ctx, name);
+}
+
+/*
+ * The LLVM type for a, which is anything get_qtype() takes. Functions aren't
+ * handled here - see fn_type().
+ */
+static LLVMTypeRef lltype(struct llvm_module *m, astn a) {
+    astn q = get_qtype(a);
+    ir_type_E t = ir_type(q);
+
+    switch (t) {
+        case IR_void:
+            return LLVMVoidTypeInContext(m->ctx);
+
+        case IR_ptr:
+            return ptr_type(m);
+
+        case IR_i1:
+            return LLVMInt1TypeInContext(m->ctx);
+
+        case IR_arr:;
+            astn arr = ir_dtype(q);
+            return LLVMArrayType(lltype(m, arr->Type.derived.target),
+                                 (unsigned)arr->Type.derived.size->Num.number.integer);
+
+        case IR_struct:
+            return struct_type(m, ir_dtype(q)->Type.tagtype.symbol->qptr->Qtemp.name);
+
+        default:
+            if (is_integer(q))
+                return LLVMIntTypeInContext(m->ctx, (unsigned)ir_type_size[t] * 8);
+
+            qunimpl(a, "No LLVM type for this :(");
+    }
+}
+
+/*
+ * Function type returning ret, taking the values in params (a list, which
+ * may end in an ellipsis).
+ */
+static LLVMTypeRef fn_type(struct llvm_module *m, astn ret, astn params) {
+    unsigned n = 0;
+    for (astn p = params; p && list_data(p); p = list_next(p))
+        n++;
+
+    LLVMTypeRef *types = arena_alloc(&tu_arena, (n ? n : 1) * sizeof(LLVMTypeRef));
+    mem_note(MEM_PRINTER, (n ? n : 1) * sizeof(LLVMTypeRef));
+    unsigned count = 0;
+    bool variadic = false;
+
+    for (astn p = params; p && list_data(p); p = list_next(p)) {
+        if (list_data(p)->type == ASTN_ELLIPSIS)
+            variadic = true;
+        else
+            types[count++] = lltype(m, list_data(p));
+    }
+
+    return LLVMFunctionType(lltype(m, ret), types, count, variadic);
+}
+
+/*
+ * The function called name, declaring it with type fty if we haven't seen
+ * it yet. Calls don't care what it was declared as; see build_call().
+ */
+static LLVMValueRef fn_ref(struct llvm_module *m, const char *name, LLVMTypeRef fty) {
+    LLVMValueRef f = LLVMGetNamedFunction(m->mod, name);
+    return f ? f : LLVMAddFunction(m->mod, name, fty);
+}
+
+static LLVMValueRef global_ref(struct llvm_module *m, const char *name, LLVMTypeRef ty) {
+    LLVMValueRef g = LLVMGetNamedGlobal(m->mod, name);
+    if (!g)
+        g = LLVMAddGlobal(m->mod, ty, name);
+
+    return LLVMConstBitCast(g, ptr_type(m));
+}
+
+static LLVMValueRef value_as(struct llvm_module *m, astn a, LLVMTypeRef want);
+
+static LLVMValueRef value(struct llvm_module *m, astn a) {
+    return value_as(m, a, NULL);
+}
+
+/*
+ * The LLVM value for operand a. Constants don't carry the type they're used
+ * at (the textual IR gets it from the instruction), so that's given as want;
+ * everything else already has its own.
+ */
+static LLVMValueRef value_as(struct llvm_module *m, astn a, LLVMTypeRef want) {
+    if (!a) die("gave null astn to the LLVM backend?");
+
+    switch (a->type) {
+        case ASTN_LIST:
+            return value_as(m, list_data(a), want);
+
+        case ASTN_NUM:;
+            LLVMTypeRef ty = want ? want : lltype(m, a);
+            unsigned long long n = a->Num.number.integer;
+
+            if (LLVMGetTypeKind(ty) == LLVMPointerTypeKind)
+                return LLVMConstIntToPtr(LLVMConstInt(LLVMInt64TypeInContext(m->ctx), n, false), ty);
+
+            return LLVMConstInt(ty, n, false);
+
+        case ASTN_QTEMP:
+            if (a->Qtemp.name)
+                return global_ref(m, a->Qtemp.name, lltype(m, ir_dtype(a)));
+
+            if (a->Qtemp.tempno >= m->ntemps || !m->temps[a->Qtemp.tempno])
+                qunimpl(a, "Temp used before it was defined!");
+
+            return m->temps[a->Qtemp.tempno];
+
+        case ASTN_SYMPTR:
+            return global_ref(m, a->Symptr.e->ident, lltype(m, a->Symptr.e->type));
+
+        case ASTN_DECLREC:
+            return global_ref(m, a->Declrec.e->ident, lltype(m, a->Declrec.e->type));
+
+        case ASTN_STRLIT:
+            return LLVMConstStringInContext(m->ctx, a->Strlit.strlit.str, (unsigned)a->Strlit.strlit.len, false);
+
+        default:
+            qunimpl(a, "Unable to get LLVM value for astn :(");
+    }
+}
+
+// pointer value p, as a pointer to ty
+static LLVMValueRef address(struct llvm_module *m, astn p, LLVMTypeRef ty) {
+    return LLVMBuildBitCast(m->b, value(m, p), LLVMPointerType(ty, 0), "");
+}
+
+static void set_temp(struct llvm_module *m, astn target, LLVMValueRef v) {
+    ast_check(target, ASTN_QTEMP, "");
+
+    if (target->Qtemp.tempno >= m->ntemps)
+        qunimpl(target, "Temp out of range!");
+
+    m->temps[target->Qtemp.tempno] = v;
+}
+
+static LLVMBasicBlockRef block(struct llvm_module *m, astn a) {
+    ast_check(a, ASTN_QBB, "");
+    return m->blocks[QV_INDEX(a->Qbb.bb->handle)];
+}
+
+static void build_call(struct llvm_module *m, astn target, astn fn, astn args) {
+    ast_check(fn, ASTN_SYMPTR, "");
+
+    unsigned n = 0;
+    for (astn a = args; a && list_data(a); a = list_next(a))
+        n++;
+
+    LLVMValueRef *argv = arena_alloc(&irst.current_bbl->arena, (n ? n : 1) * sizeof(LLVMValueRef));
+    LLVMTypeRef *types = arena_alloc(&irst.current_bbl->arena, (n ? n : 1) * sizeof(LLVMTypeRef));
+    mem_note(MEM_PRINTER, (n ? n : 1) * (sizeof(LLVMValueRef) + sizeof(LLVMTypeRef)));
+
+    n = 0;
+    for (astn a = args; a && list_data(a); a = list_next(a)) {
+        argv[n] = value(m, list_data(a));
+        types[n] = LLVMTypeOf(argv[n]);
+        n++;
+    }
+
+    // called the way the arguments say, like the textual IR does
+    LLVMTypeRef ret = lltype(m, ir_dtype(fn)->Type.derived.target);
+    LLVMTypeRef fty = LLVMFunctionType(ret, types, n, false);
+
+    LLVMValueRef f = fn_ref(m, fn->Symptr.e->ident, fty);
+    LLVMValueRef callee = LLVMConstBitCast(f, LLVMPointerType(fty, 0));
+
+    LLVMValueRef v = LLVMBuildCall2(m->b, fty, callee, argv, n, "");
+
+    if (LLVMGetTypeKind(ret) != LLVMVoidTypeKind)
+        set_temp(m, target, v);
+}
+
+static void build_quad(struct llvm_module *m, const struct qtab *t, const_quad q) {
+    astn target = qa(t, q->target);
+    astn src1 = qa(t, q->src1);
+    astn src2 = qa(t, q->src2);
+    astn src3 = qa(t, q->src3);
+
+    LLVMBuilderRef b = m->b;
+    LLVMTypeRef ty;
+    LLVMValueRef v;
+
+    // anything after a terminator starts a new, unreachable, block - same as
+    // it does when llc reads the textual IR
+    LLVMBasicBlockRef cur = LLVMGetInsertBlock(b);
+    if (q->op != IR_OP_SWITCHCASE && q->op != IR_OP_SWITCHEND && LLVMGetBasicBlockTerminator(cur)) {
+        LLVMBasicBlockRef next = LLVMAppendBasicBlockInContext(m->ctx, m->fn, "");
+        LLVMMoveBasicBlockAfter(next, cur);
+        LLVMPositionBuilderAtEnd(b, next);
+    }
+
+    switch (q->op) {
+        case IR_OP_ALLOCA:
+            v = LLVMBuildAlloca(b, lltype(m, ir_dtype(target)), "");
+            set_temp(m, target, LLVMBuildBitCast(b, v, ptr_type(m), ""));
+            break;
+
+        case IR_OP_RETURN:
+            if (!src1)
+                LLVMBuildRetVoid(b);
+            else
+                LLVMBuildRet(b, value_as(m, src1, LLVMGetReturnType(LLVMGlobalGetValueType(m->fn))));
+            break;
+
+        case IR_OP_LOAD:
+            ty = lltype(m, target);
+            set_temp(m, target, LLVMBuildLoad2(b, ty, address(m, src1, ty), ""));
+            break;
+
+        case IR_OP_STORE:
+            ty = lltype(m, ir_dtype(target));
+            LLVMBuildStore(b, value_as(m, src1, ty), address(m, target, ty));
+            break;
+
+        case IR_OP_ADD:
+        case IR_OP_SUB:
+        case IR_OP_MUL:
+        case IR_OP_SDIV:
+        case IR_OP_UDIV:
+        case IR_OP_SMOD:
+        case IR_OP_UMOD:
+            ty = lltype(m, target);
+            set_temp(m, target, LLVMBuildBinOp(b, binop_opcode[q->op], value_as(m, src1, ty), value_as(m, src2, ty), ""));
+            break;
+
+        case IR_OP_GEP:;
+            LLVMValueRef idx[2] = {value(m, src2), src3 ? value(m, src3) : NULL};
+
+            ty = lltype(m, ir_dtype(src1));
+            v = LLVMBuildGEP2(b, ty, address(m, src1, ty), idx, src3 ? 2 : 1, "");
+            set_temp(m, target, LLVMBuildBitCast(b, v, ptr_type(m), ""));
+            break;
+
+        case IR_OP_SEXT:
+            set_temp(m, target, LLVMBuildSExt(b, value(m, src1), lltype(m, target), ""));
+            break;
+
+        case IR_OP_ZEXT:
+            set_temp(m, target, LLVMBuildZExt(b, value(m, src1), lltype(m, target), ""));
+            break;
+
+        case IR_OP_TRUNC:
+            set_temp(m, target, LLVMBuildTrunc(b, value(m, src1), lltype(m, target), ""));
+            break;
+
+        case IR_OP_INTTOPTR:
+            set_temp(m, target, LLVMBuildIntToPtr(b, value(m, src1), ptr_type(m), ""));
+            break;
+
+        case IR_OP_PTRTOINT:
+            set_temp(m, target, LLVMBuildPtrToInt(b, value(m, src1), lltype(m, target), ""));
+            break;
+
+        case IR_OP_FNCALL:
+            build_call(m, target, src1, src2);
+            break;
+
+        case IR_OP_PHI: // incoming values come later, once every block has been built
+            set_temp(m, target, LLVMBuildPhi(b, lltype(m, target), ""));
+            break;
+
+        case IR_OP_BR:
+            LLVMBuildBr(b, block(m, target));
+            break;
+
+        case IR_OP_CONDBR:
+            LLVMBuildCondBr(b, value(m, target), block(m, src1), block(m, src2));
+            break;
+
+        case IR_OP_CMPEQ:
+        case IR_OP_CMPNE:
+        case IR_OP_CMPLT:
+        case IR_OP_CMPLTEQ:
+            v = value(m, src1);
+            set_temp(m, target, LLVMBuildICmp(b, cmp_predicate[q->op], v, value_as(m, src2, LLVMTypeOf(v)), ""));
+            break;
+
+        case IR_OP_SWITCHBEGIN:
+            m->sw = LLVMBuildSwitch(b, value(m, src1), block(m, target), 0);
+            break;
+
+        case IR_OP_SWITCHCASE:
+            if (!m->sw)
+                die("Switch case outside of a switch.");
+
+            LLVMAddCase(m->sw, value_as(m, target, LLVMTypeOf(LLVMGetOperand(m->sw, 0))), block(m, src1));
+            break;
+
+        case IR_OP_SWITCHEND:
+            m->sw = NULL;
+            break;
+
+        default:
+            die("Unhandled quad in the LLVM backend");
+    }
+}
+
+// a phi's values, from the blocks they come from
+static void add_incoming(struct llvm_module *m, const struct qtab *t, const_quad q) {
+    LLVMValueRef phi = value(m, qa(t, q->target));
+    astn from = qa(t, q->src2);
+
+    for (astn val = qa(t, q->src1); val; val = list_next(val), from = list_next(from)) {
+        LLVMValueRef v = value_as(m, list_data(val), LLVMTypeOf(phi));
+        LLVMBasicBlockRef bb = block(m, list_data(from));
+        LLVMAddIncoming(phi, &v, &bb, 1);
+    }
+}
+
+static void build_global(struct llvm_module *m, const struct qtab *t, const_quad q) {
+    if (q->op != IR_OP_DEFGLOBAL)
+        die("Unexpected quad at file scope in the LLVM backend");
+
+    astn target = qa(t, q->target);
+    astn src1 = qa(t, q->src1);
+
+    if (ir_type_matches(target, IR_fn)) {
+        ast_check(target->Qtemp.global, ASTN_SYMPTR, "");
+
+        sym fn = target->Qtemp.global->Symptr.e;
+        if (fn->fn_defined)
+            return;
+
+        if (fn->linkage == L_INTERNAL)
+            qerrorl(fn->type, "static function never defined");
+
+        fn_ref(m, target->Qtemp.name, fn_type(m, ir_dtype(target)->Type.derived.target, NULL));
+    } else if (ir_type_matches(target, IR_struct)) {
+        sym s = ir_dtype(target)->Type.tagtype.symbol;
+
+        unsigned n = 0;
+        for (sym mem = s->members->first; mem; mem = mem->next)
+            n++;
+
+        LLVMTypeRef *members = arena_alloc(&tu_arena, (n ? n : 1) * sizeof(LLVMTypeRef));
+        mem_note(MEM_PRINTER, (n ? n : 1) * sizeof(LLVMTypeRef));
+
+        n = 0;
+        for (sym mem = s->members->first; mem; mem = mem->next)
+            members[n++] = lltype(m, mem->type);
+
+        LLVMStructSetBody(struct_type(m, s->qptr->Qtemp.name), members, n, false);
+    } else {
+        LLVMTypeRef ty = lltype(m, ir_dtype(target));
+
+        global_ref(m, target->Qtemp.name, ty);
+        LLVMValueRef g = LLVMGetNamedGlobal(m->mod, target->Qtemp.name);
+
+        LLVMSetInitializer(g, src1 ? value_as(m, src1, ty) : LLVMConstNull(ty));
+
+        if (target->Qtemp.global->type == ASTN_STRLIT) {
+            LLVMSetLinkage(g, LLVMPrivateLinkage);
+            LLVMSetGlobalConstant(g, true);
+        } else if (*target->Qtemp.name == '.') {
+            LLVMSetLinkage(g, LLVMPrivateLinkage);
+        }
+    }
+}
+
+static bool quad_is_fn_decl(const struct qtab *t, const_quad q) {
+    return q->op == IR_OP_DEFGLOBAL && ir_type_matches(qa(t, q->target), IR_fn);
+}
+
+// the same order quads_dump_root_pending() prints them in
+static void quads_build_root_pending(struct llvm_module *m, bool decls) {
+    const struct qtab *t = &irst.root_bbl->tab;
+    BB root = irst.root_bbl->me;
+
+    for (unsigned i = irst.root_flushed; i < root->nquads; i++) {
+        struct quad g = root->quads[i];
+        if (!quad_is_fn_decl(t, &g))
+            build_global(m, t, &g);
+    }
+
+    if (!decls)
+        return;
+
+    for (unsigned i = 0; i < root->nquads; i++) {
+        struct quad g = root->quads[i];
+        if (quad_is_fn_decl(t, &g))
+            build_global(m, t, &g);
+    }
+}
+
+/*
+ * Define the function we just finished generating. If something called it
+ * before it was defined, it was declared with the caller's idea of its type;
+ * that declaration is swapped out for the real thing.
+ */
+static LLVMValueRef define_fn(struct llvm_module *m, sym fn) {
+    LLVMTypeRef fty = fn_type(m, fn->type->Type.derived.target, fn->param_list_q);
+
+    LLVMValueRef f = LLVMGetNamedFunction(m->mod, fn->ident);
+    if (!f)
+        return LLVMAddFunction(m->mod, fn->ident, fty);
+
+    if (LLVMGlobalGetValueType(f) == fty)
+        return f;
+
+    LLVMSetValueName2(f, "", 0);
+    LLVMValueRef real = LLVMAddFunction(m->mod, fn->ident, fty);
+    LLVMReplaceAllUsesWith(f, LLVMConstBitCast(real, LLVMTypeOf(f)));
+    LLVMDeleteFunction(f);
+
+    return real;
+}
+
+/*
+ * Build the function we just finished generating into the module. Like
+ * quads_dump_fn(), this runs once per function, before it's thrown away.
+ */
+void quads_build_fn(struct llvm_module *m) {
+    BBL bbl = irst.current_bbl;
+    if (bbl == irst.root_bbl)
+        die("quads_build_fn called without a function.");
+
+    struct arena *save = astn_arena;
+    astn_arena = &bbl->arena;
+
+    quads_build_root_pending(m, false);
+
+    BB first = bbl->me;
+    m->fn = define_fn(m, first->fn);
+
+    m->ntemps = (unsigned)irst.tempno + 1;
+    m->temps = arena_alloc(&bbl->arena, m->ntemps * sizeof(LLVMValueRef));
+    m->blocks = arena_alloc(&bbl->arena, (bbl->tab.count ? bbl->tab.count : 1) * sizeof(LLVMBasicBlockRef));
+    mem_note(MEM_PRINTER, m->ntemps * sizeof(LLVMValueRef) + (bbl->tab.count ? bbl->tab.count : 1) * sizeof(LLVMBasicBlockRef));
+
+    unsigned i = 0;
+    for (astn p = first->fn->param_list_q; p; p = list_next(p)) {
+        astn e = list_data(p);
+        if (e->type != ASTN_ELLIPSIS)
+            set_temp(m, e, LLVMGetParam(m->fn, i++));
+    }
+
+    // every label, up front, so branches can go forward
+    unsigned nbbs = 0;
+    for (BB bb = first; bb; bb = bb->next)
+        nbbs++;
+
+    LLVMBasicBlockRef *starts = arena_alloc(&bbl->arena, nbbs * sizeof(LLVMBasicBlockRef));
+    mem_note(MEM_PRINTER, nbbs * sizeof(LLVMBasicBlockRef));
+
+    i = 0;
+    for (BB bb = first; bb; bb = bb->next, i++) {
+        if (bb != first && !bb->name)
+            continue; // carries on in the block before it
+
+        starts[i] = LLVMAppendBasicBlockInContext(m->ctx, m->fn, bb->name ? bb->name : "");
+        if (bb->handle)
+            m->blocks[QV_INDEX(bb->handle)] = starts[i];
+    }
+
+    i = 0;
+    for (BB bb = first; bb; bb = bb->next, i++) {
+        if (starts[i])
+            LLVMPositionBuilderAtEnd(m->b, starts[i]);
+
+        for (unsigned n = 0; n < bb->nquads; n++)
+            build_quad(m, &bbl->tab, &bb->quads[n]);
+    }
+
+    for (BB bb = first; bb; bb = bb->next)
+        for (unsigned n = 0; n < bb->nquads; n++)
+            if (bb->quads[n].op == IR_OP_PHI)
+                add_incoming(m, &bbl->tab, &bb->quads[n]);
+
+    m->fn = NULL;
+    m->temps = NULL;
+    m->blocks = NULL;
+    m->sw = NULL;
+
+    astn_arena = save;
+}
+
+/*
+ * Build what's left of the root block, and the function declarations.
+ */
+void quads_build_root(struct llvm_module *m) {
+    quads_build_root_pending(m, true);
+}
+
+static pthread_once_t targets_once = PTHREAD_ONCE_INIT;
+
+static void init_targets(void) {
+    LLVMInitializeX86TargetInfo();
+    LLVMInitializeX86Target();
+    LLVMInitializeX86TargetMC();
+    LLVMInitializeX86AsmPrinter();
+}
+
+/*
+ * The host's triple, but always for x86-64 - like llc --march x86-64.
+ */
+static char *target_triple(void) {
+    char *host = LLVMGetDefaultTargetTriple();
+    const char *rest = strchr(host, '-');
+
+    char *triple = arena_sprintf(&tu_arena, "x86_64%s", rest ? rest : "-unknown-linux-gnu");
+    LLVMDisposeMessage(host);
+
+    return triple;
+}
+
+struct llvm_module *llvm_module_new(void) {
+    pthread_once(&targets_once, init_targets);
+
+    struct llvm_module *m = safe_calloc(1, sizeof(struct llvm_module));
+
+    m->ctx = LLVMContextCreate();
+    m->mod = LLVMModuleCreateWithNameInContext("dcc", m->ctx);
+    m->b = LLVMCreateBuilderInContext(m->ctx);
+
+    return m;
+}
+
+void llvm_module_free(struct llvm_module *m) {
+    LLVMDisposeBuilder(m->b);
+    LLVMDisposeModule(m->mod);
+    LLVMContextDispose(m->ctx);
+
+    free(m);
+}
+
+// LLVM's messages are its own to free, so copy them out before we bail
+static _Noreturn void llvm_error(const char *what, char *msg) {
+    const char *copy = arena_strdup(&tu_arena, msg ? msg : "");
+    LLVMDisposeMessage(msg);
+
+    RED_ERROR("%s:\n%s", what, copy);
+    die("unreachable");
+}
+
+/*
+ * Write the finished module to obj as an object file, with the same settings
+ * the llc pipeline uses (PIC, default codegen optimization). If mirror_fd
+ * isn't -1, the module is printed there as well.
+ */
+void llvm_module_emit(struct llvm_module *m, struct outbuf *obj, int mirror_fd) {
+    char *msg = NULL;
+
+    const char *triple = target_triple();
+    LLVMTargetRef target;
+    if (LLVMGetTargetFromTriple(triple, &target, &msg))
+        llvm_error("LLVM doesn't know our target", msg);
+
+    LLVMTargetMachineRef tm = LLVMCreateTargetMachine(target, triple, "generic", "",
+                                                      LLVMCodeGenLevelDefault,
+                                                      LLVMRelocPIC,
+                                                      LLVMCodeModelDefault);
+
+    LLVMTargetDataRef layout = LLVMCreateTargetDataLayout(tm);
+    LLVMSetModuleDataLayout(m->mod, layout);
+    LLVMDisposeTargetData(layout);
+    LLVMSetTarget(m->mod, triple);
+
+    if (mirror_fd >= 0) {
+        char *text = LLVMPrintModuleToString(m->mod);
+        struct outbuf mirror;
+
+        outbuf_init(&mirror, mirror_fd);
+        outbuf_puts(&mirror, text);
+        outbuf_flush(&mirror);
+        outbuf_free(&mirror);
+
+        LLVMDisposeMessage(text);
+    }
+
+    if (LLVMVerifyModule(m->mod, LLVMReturnStatusAction, &msg)) {
+        LLVMDisposeTargetMachine(tm);
+        llvm_error("LLVM rejected the module", msg);
+    }
+    LLVMDisposeMessage(msg);
+
+    LLVMMemoryBufferRef buf;
+    if (LLVMTargetMachineEmitToMemoryBuffer(tm, m->mod, LLVMObjectFile, &msg, &buf)) {
+        LLVMDisposeTargetMachine(tm);
+        llvm_error("Error generating object code", msg);
+    }
+
+    outbuf_write(obj, LLVMGetBufferStart(buf), LLVMGetBufferSize(buf));
+    outbuf_flush(obj);
+
+    LLVMDisposeMemoryBuffer(buf);
+    LLVMDisposeTargetMachine(tm);
+}
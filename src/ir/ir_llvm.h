@@ -0,0 +1,17 @@
+#ifndef IR_LLVM_H
+#define IR_LLVM_H
+
+#include "outbuf.h"
+
+// only built with the LLVM API backend (scons llvm=1, DCC_LLVM_API)
+struct llvm_module;
+
+struct llvm_module *llvm_module_new(void);
+void llvm_module_free(struct llvm_module *m);
+
+void quads_build_fn(struct llvm_module *m);
+void quads_build_root(struct llvm_module *m);
+
+void llvm_module_emit(struct llvm_module *m, struct outbuf *obj, int mirror_fd);
+
+#endif
@@ -0,0 +1,158 @@
+/*
+ * ir_pass.c
+ *
+ * Running the passes over each function (see ir_pass.h).
+ */
+#include "ir_pass.h"
+
+#include <string.h>
+
+#include "ir_print.h"
+#include "ir_sccp.h"
+#include "ir_ssa.h"
+#include "ir_state.h"
+#include "ir_util.h"
+
+#include "compilation.h"
+#include "memstat.h"
+#include "timer.h"
+#include "util.h"
+
+static const struct pass {
+    const char *name;   // for -fdump-after and -fpass-stats
+    void (*run)(void);
+} passes[PASSES] = {
+    [PASS_MEM2REG] = {"mem2reg", ssa_mem2reg},
+    [PASS_SCCP] = {"sccp", sccp_propagate},
+};
+
+static const enum pass_id o1[] = {PASS_MEM2REG};
+static const enum pass_id o2[] = {PASS_MEM2REG, PASS_SCCP};
+
+static const struct pipeline {
+    const enum pass_id *passes;
+    unsigned count;
+} pipelines[OPT_LEVEL_MAX + 1] = {
+    [0] = {NULL, 0},
+    [1] = {o1, sizeof(o1) / sizeof(o1[0])},
+    [2] = {o2, sizeof(o2) / sizeof(o2[0])},
+};
+
+bool pass_exists(const char *name) {
+    for (int p = 0; p < PASSES; p++)
+        if (!strcmp(passes[p].name, name))
+            return true;
+
+    return false;
+}
+
+bool quad_defines(const_quad q) {
+    switch (q->op) {
+        case IR_OP_STORE:
+        case IR_OP_BR:
+        case IR_OP_CONDBR:
+        case IR_OP_SWITCHBEGIN:
+        case IR_OP_SWITCHCASE:
+        case IR_OP_SWITCHEND:
+        case IR_OP_RETURN:
+        case IR_OP_DEFGLOBAL:
+            return false;
+        default:
+            return q->target != QV_NONE;
+    }
+}
+
+/*
+ * The parameters keep their numbers; everything else is numbered in order
+ * from there. Views of a temp (see convert_to_ptr()) share its number, so
+ * it's mapped, and every temp is in the table once to have it changed.
+ */
+void pass_renumber(void) {
+    const struct qtab *t = &irst.current_bbl->tab;
+    BB first = irst.current_bbl->me;
+
+    unsigned old = (unsigned)irst.tempno;
+    unsigned *map = ir_alloc((old ? old : 1) * sizeof(unsigned));
+    mem_note(MEM_PASSES, (old ? old : 1) * sizeof(unsigned));
+    for (unsigned i = 0; i < old; i++)
+        map[i] = i;
+
+    unsigned n = 0;
+    for (astn p = first->fn->param_list_q; p; p = list_next(p))
+        n += list_data(p)->type == ASTN_QTEMP;
+
+    for (BB bb = first; bb; bb = bb->next) {
+        for (unsigned k = 0; k < bb->nquads; k++) {
+            const_quad q = &bb->quads[k];
+            if (quad_defines(q))
+                map[qa(t, q->target)->Qtemp.tempno] = n++;
+        }
+    }
+
+    for (unsigned i = 1; i < t->count; i++) {
+        astn a = t->vals[i];
+        if (a->type == ASTN_QTEMP && !a->Qtemp.name && a->Qtemp.tempno < old)
+            a->Qtemp.tempno = map[a->Qtemp.tempno];
+    }
+
+    irst.tempno = n;
+}
+
+static unsigned long count_quads(void) {
+    unsigned long n = 0;
+    for (BB bb = irst.current_bbl->me; bb; bb = bb->next)
+        n += bb->nquads;
+
+    return n;
+}
+
+void passes_run(void) {
+    const struct dcc_options *opts = &dcc_cc->opts;
+
+    int level = opts->opt_level;
+    if (level < 0)
+        level = 0;
+    if (level > OPT_LEVEL_MAX)
+        level = OPT_LEVEL_MAX;
+
+    const struct pipeline *pl = &pipelines[level];
+    for (unsigned i = 0; i < pl->count; i++) {
+        const struct pass *p = &passes[pl->passes[i]];
+        struct pass_stats *st = &dcc_cc->pass_stats[pl->passes[i]];
+
+        unsigned long before = 0;
+        if (opts->pass_stats)
+            before = count_quads();
+
+        timer_push(TIMER_PASSES, p->name);
+        p->run();
+        double wall = timer_pop();
+
+        if (opts->pass_stats) {
+            unsigned long after = count_quads();
+
+            st->runs++;
+            st->wall += wall;
+            if (after < before)
+                st->removed += before - after;
+            else
+                st->added += after - before;
+        }
+
+        if (opts->dump_after && !strcmp(opts->dump_after, p->name)) {
+            fprintf(stderr, "; after %s\n", p->name);
+            quads_eprint_fn();
+        }
+    }
+}
+
+void pass_stats_report(FILE *f) {
+    fprintf(f, "pass              runs       wall    removed      added\n");
+    for (int p = 0; p < PASSES; p++) {
+        const struct pass_stats *st = &dcc_cc->pass_stats[p];
+        if (!st->runs)
+            continue;
+
+        fprintf(f, "%-12s %9lu  %8.3fs %10lu %10lu\n", passes[p].name, st->runs, st->wall, st->removed, st->added);
+    }
+}
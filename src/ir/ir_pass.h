@@ -0,0 +1,57 @@
+/*
+ * ir_pass.h
+ *
+ * The passes over a function's quads, and the pipelines the -O levels run
+ * them in. dcc_fn_done() runs the pipeline on each function between
+ * gen_fn() and its output:
+ *
+ *   -O0    nothing: the quads as gen_fn() wrote them
+ *   -O1    mem2reg (the default)
+ *   -O2    mem2reg, then sccp
+ *
+ * A pass works on irst.current_bbl, and leaves it something both backends
+ * and the textual IR can take: each block ending in at most one terminator,
+ * with the temps numbered in order. To add one, give it an id and an entry
+ * in ir_pass.c's table, and put it in the pipelines it belongs in.
+ *
+ * -fpass-stats reports how many functions each pass ran on, the time it
+ * took and the quads it removed and added; -fdump-after=pass prints each
+ * function to stderr after that pass has run on it.
+ */
+
+#ifndef IR_PASS_H
+#define IR_PASS_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "ir_core.h"
+
+enum pass_id {
+    PASS_MEM2REG,       // promoting locals to temps (see ir_ssa.h)
+    PASS_SCCP,          // constant propagation, and the branches it decides (see ir_sccp.h)
+    PASSES
+};
+
+struct pass_stats {
+    unsigned long runs;
+    double wall;
+    unsigned long removed, added;   // quads, over all the functions
+};
+
+#define OPT_LEVEL_MAX 2
+
+bool pass_exists(const char *name);
+
+// whether q gives its target a value
+bool quad_defines(const_quad q);
+
+// number the function's temps in order again, after a pass took some out
+void pass_renumber(void);
+
+// the pipeline for the compilation's -O level, on the function gen_fn() just finished
+void passes_run(void);
+
+void pass_stats_report(FILE *f);
+
+#endif
@@ -1,70 +1,123 @@
 #include "ir_print.h"
 
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+
 #include "ir.h"
 #include "ir_state.h" // to be removed
 #include "ir_types.h"
 #include "ir_util.h"
 
 #include "ast.h"
-#include "charutil.h"
+#include "compilation.h"
 #include "symtab.h"
 
-static FILE *f;
-
-#define qprintf(...)   \
-    {                       \
-        FILE *o;            \
-        if (f) o = f;       \
-        else o = stderr;    \
-                            \
-        fprintf(o, __VA_ARGS__); \
+// the sink we're printing into right now
+#define out (dcc_cc->print_out)
+
+static void qword(astn a);
+static void qwordt(astn a);
+
+/*
+ * Minimal printf for quads, formatting straight into the output buffer:
+ *   %w  astn operand          %t  astn operand, preceded by its type
+ *   %s  C string              %d  int
+ *   %b  basic block name      %%  literal %
+ */
+static void qprintf(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+
+    const char *run = fmt;
+    for (const char *c = fmt; *c; c++) {
+        if (*c != '%')
+            continue;
+
+        outbuf_write(out, run, (size_t)(c - run));
+        run = c + 2;
+
+        switch (*++c) {
+            case 'w':
+                qword(va_arg(ap, astn));
+                break;
+            case 't':
+                qwordt(va_arg(ap, astn));
+                break;
+            case 's':
+                outbuf_puts(out, va_arg(ap, const char *));
+                break;
+            case 'd':
+                outbuf_int(out, va_arg(ap, int));
+                break;
+            case 'b':
+                outbuf_puts(out, va_arg(ap, BB)->name);
+                break;
+            case '%':
+                outbuf_putc(out, '%');
+                break;
+            default:
+                die("Bad directive in qprintf");
+        }
     }
 
+    outbuf_write(out, run, strlen(run));
+    va_end(ap);
+}
+
 void quad_print_blankline(void) {
     qprintf("\n");
 }
 
-const char *qonewordt(astn a) {
-    char *ret;
+static void qwordt(astn a) {
     if (ir_type_matches(a, IR_fn))
-        asprintf(&ret, "%s %s", qoneword(ir_dtype(a)->Type.derived.target), qoneword(a));
+        qword(ir_dtype(a)->Type.derived.target);
     else
-        asprintf(&ret, "%s %s", qoneword(get_qtype(a)), qoneword(a));
-    return ret;
+        qword(get_qtype(a));
+
+    outbuf_putc(out, ' ');
+    qword(a);
 }
 
-const char *qoneword(astn a) {
-    char *ret;
+static void qword_strlit(astn a) {
+    outbuf_puts(out, "c\"");
+
+    for (size_t i = 0; i < a->Strlit.strlit.len; i++) {
+        unsigned char c = (unsigned char)a->Strlit.strlit.str[i];
 
+        if (c != '"' && c != '\\' && c >= 32 && c <= 126) {
+            outbuf_putc(out, (char)c);
+        } else {
+            outbuf_putc(out, '\\');
+            outbuf_hex2(out, c);
+        }
+    }
+
+    outbuf_puts(out, "\\00\"");
+}
+
+static void qword(astn a) {
     if (!a) die("gave null astn to quad_print?");
 
     switch (a->type) {
         case ASTN_LIST:
-            a = list_data(a);
-            return qoneword(a);
+            qword(list_data(a));
+            break;
 
         case ASTN_QTEMP:
             if (a->Qtemp.name && ir_type_matches(a, IR_struct)) {
-                asprintf(&ret, "%%%s", a->Qtemp.name);
+                qprintf("%%%s", a->Qtemp.name);
             } else if (a->Qtemp.name) {
-                asprintf(&ret, "@%s", a->Qtemp.name);
+                qprintf("@%s", a->Qtemp.name);
             } else {
                 if (a->Qtemp.tempno < 0)
                     qunimpl(a, "Tried to print a negative qtemp number!");
-                asprintf(&ret, "%%%d", a->Qtemp.tempno);
+                qprintf("%%%d", a->Qtemp.tempno);
             }
             break;
 
         case ASTN_STRLIT:
-            asprintf(&ret, "c\"");
-
-            for (size_t i = 0; i < a->Strlit.strlit.len; i++) {
-                char * old_ret = ret;
-                asprintf(&ret, "%s%s", ret, get_char_hexesc(a->Strlit.strlit.str[i]));
-                free(old_ret);
-            }
-
-            asprintf(&ret, "%s\\00\"", ret);
+            qword_strlit(a);
             break;
 
         case ASTN_QTYPE:
@@ -76,144 +129,176 @@ const char *qoneword(astn a) {
                 if (!a->Qtype.derived_type->Type.derived.target)
                     die("Expected array to have target.");
 
-                asprintf(&ret, "[%s x %s]", qoneword(ir_dtype(a)->Type.derived.size), qoneword(get_qtype(ir_dtype(a)->Type.derived.target)));
+                qprintf("[%w x %w]", ir_dtype(a)->Type.derived.size, get_qtype(ir_dtype(a)->Type.derived.target));
             } else if (ir_type_matches(a, IR_struct)) {
                 ast_check(ir_dtype(a), ASTN_TYPE, "");
-                return qoneword(ir_dtype(a)->Type.tagtype.symbol->qptr);
+                qword(ir_dtype(a)->Type.tagtype.symbol->qptr);
             } else {
-                asprintf(&ret, "%s", ir_type_str[ir_type(a)]);
+                outbuf_puts(out, ir_type_str[ir_type(a)]);
             }
             break;
 
-        case ASTN_NUM: // needs work for correctness, print numbers as intended
-            asprintf(&ret, "%d", (int)a->Num.number.integer);
+        case ASTN_NUM: // as the signed value of its width, which LLVM takes for either signedness
+            if (ir_type_size[ir_type(a)] == 8)
+                outbuf_int(out, (long long)a->Num.number.integer);
+            else
+                outbuf_int(out, (int)a->Num.number.integer);
             break;
 
         case ASTN_TYPE:
-            return qoneword(get_qtype(a));
+            qword(get_qtype(a));
+            break;
 
         case ASTN_SYMPTR:
-            asprintf(&ret, "@%s", a->Symptr.e->ident);
+            qprintf("@%s", a->Symptr.e->ident);
             break;
 
         case ASTN_DECLREC:
-            asprintf(&ret, "@%s", a->Declrec.e->ident);
+            qprintf("@%s", a->Declrec.e->ident);
             break;
 
         case ASTN_QBB:
-            asprintf(&ret, "%%%s", a->Qbb.bb->name);
+            qprintf("%%%b", a->Qbb.bb);
             break;
 
         case ASTN_QTYPECONTAINER:
-            return qoneword(a->Qtypecontainer.qtype);
+            qword(a->Qtypecontainer.qtype);
+            break;
 
         default:
             qunimpl(a, "Unable to get oneword for astn :(");
-            return 0;
     }
+}
+
+/*
+ * Print a single operand to stderr, for AST dumps.
+ */
+void qoneword_eprint(astn a) {
+    struct outbuf *save = out;
+    struct outbuf e;
+
+    outbuf_init(&e, STDERR_FILENO);
+    out = &e;
+
+    qword(a);
+    outbuf_flush(&e);
 
-    return ret;
+    outbuf_free(&e);
+    out = save;
 }
 
-void quad_print(quad first) {
+/*
+ * A quad with its operands looked up, so the printer can keep talking in
+ * astns.
+ */
+struct quad_view {
+    ir_op_E op;
+
+    astn target;
+    astn src1;
+    astn src2;
+    astn src3;
+};
+
+static void quad_print_view(const struct quad_view *first) {
     switch (first->op) {
         case IR_OP_UNKNOWN: die("IR op is UNKNOWN"); break;
 
         case IR_OP_ALLOCA:
-            qprintf("    %s = alloca %s\n",
-                    qoneword(first->target),
-                    qoneword(ir_dtype(first->target)));
+            qprintf("    %w = alloca %w\n",
+                    first->target,
+                    ir_dtype(first->target));
             break;
 
         case IR_OP_RETURN:
             if (!first->src1) {
                 qprintf("    ret void\n");
             } else {
-                qprintf("    ret i32 %s\n",
-                        qoneword(first->src1));
+                qprintf("    ret %t\n",
+                        first->src1);
             }
             break;
 
         case IR_OP_LOAD:
-            qprintf("    %s = load %s, %s\n",
-                    qoneword(first->target),
-                    qoneword(get_qtype(first->target)),
-                    qonewordt(first->src1));
+            qprintf("    %w = load %w, %t\n",
+                    first->target,
+                    get_qtype(first->target),
+                    first->src1);
             break;
 
         case IR_OP_STORE:
             ast_check(first->target, ASTN_QTEMP, "");
-            qprintf("    store %s %s, %s\n",
-                    qoneword(get_qtype(ir_dtype(first->target))),
-                    qoneword(first->src1),
-                    qonewordt(first->target));
+            qprintf("    store %w %w, %t\n",
+                    get_qtype(ir_dtype(first->target)),
+                    first->src1,
+                    first->target);
             break;
 
         case IR_OP_ADD:
-            qprintf("    %s = add %s %s, %s\n",
-                    qoneword(first->target),
-                    qoneword(qtype_alloc(ir_type(first->target))),
-                    qoneword(first->src1),
-                    qoneword(first->src2));
+            qprintf("    %w = add %s %w, %w\n",
+                    first->target,
+                    ir_type_str[ir_type(first->target)],
+                    first->src1,
+                    first->src2);
             break;
 
         case IR_OP_SUB:
-            qprintf("    %s = sub %s %s, %s\n",
-                    qoneword(first->target),
-                    qoneword(qtype_alloc(ir_type(first->target))),
-                    qoneword(first->src1),
-                    qoneword(first->src2));
+            qprintf("    %w = sub %s %w, %w\n",
+                    first->target,
+                    ir_type_str[ir_type(first->target)],
+                    first->src1,
+                    first->src2);
             break;
 
         case IR_OP_MUL:
-            qprintf("    %s = mul %s %s, %s\n",
-                    qoneword(first->target),
-                    qoneword(qtype_alloc(ir_type(first->target))),
-                    qoneword(first->src1),
-                    qoneword(first->src2));
+            qprintf("    %w = mul %s %w, %w\n",
+                    first->target,
+                    ir_type_str[ir_type(first->target)],
+                    first->src1,
+                    first->src2);
             break;
 
         case IR_OP_SDIV:
-            qprintf("    %s = sdiv %s %s, %s\n",
-                    qoneword(first->target),
-                    qoneword(qtype_alloc(ir_type(first->target))),
-                    qoneword(first->src1),
-                    qoneword(first->src2));
+            qprintf("    %w = sdiv %s %w, %w\n",
+                    first->target,
+                    ir_type_str[ir_type(first->target)],
+                    first->src1,
+                    first->src2);
             break;
 
         case IR_OP_UDIV:
-            qprintf("    %s = udiv %s %s, %s\n",
-                    qoneword(first->target),
-                    qoneword(qtype_alloc(ir_type(first->target))),
-                    qoneword(first->src1),
-                    qoneword(first->src2));
+            qprintf("    %w = udiv %s %w, %w\n",
+                    first->target,
+                    ir_type_str[ir_type(first->target)],
+                    first->src1,
+                    first->src2);
             break;
 
         case IR_OP_SMOD:
-            qprintf("    %s = srem %s %s, %s\n",
-                    qoneword(first->target),
-                    qoneword(qtype_alloc(ir_type(first->target))),
-                    qoneword(first->src1),
-                    qoneword(first->src2));
+            qprintf("    %w = srem %s %w, %w\n",
+                    first->target,
+                    ir_type_str[ir_type(first->target)],
+                    first->src1,
+                    first->src2);
             break;
 
         case IR_OP_UMOD:
-            qprintf("    %s = urem %s %s, %s\n",
-                    qoneword(first->target),
-                    qoneword(qtype_alloc(ir_type(first->target))),
-                    qoneword(first->src1),
-                    qoneword(first->src2));
+            qprintf("    %w = urem %s %w, %w\n",
+                    first->target,
+                    ir_type_str[ir_type(first->target)],
+                    first->src1,
+                    first->src2);
             break;
 
         case IR_OP_GEP:
-            qprintf("    %s = getelementptr %s, %s, %s",
-                    qoneword(first->target),
-                    qoneword(ir_dtype(first->src1)),
-                    qonewordt(first->src1),
-                    qonewordt(first->src2));
+            qprintf("    %w = getelementptr %w, %t, %t",
+                    first->target,
+                    ir_dtype(first->src1),
+                    first->src1,
+                    first->src2);
 
             if (first->src3)
-                qprintf(", %s", qonewordt(first->src3));
+                qprintf(", %t", first->src3);
 
             qprintf("\n");
 
@@ -229,12 +314,12 @@ void quad_print(quad first) {
                 if (fn->linkage == L_INTERNAL)
                     qerrorl(fn->type, "static function never defined");
 
-                qprintf("declare %s(", qonewordt(first->target));
+                qprintf("declare %t(", first->target);
 
                 astn param = fn->param_list_q;
 
                 while (param) {
-                    qprintf("%s", qonewordt(list_data(param)));
+                    qprintf("%t", list_data(param));
 
                     param = list_next(param);
 
@@ -243,12 +328,12 @@ void quad_print(quad first) {
 
                 qprintf(")\n");
             } else if (ir_type_matches(first->target, IR_struct)) {
-                qprintf("%s = type { ",
-                        qoneword(first->target));
+                qprintf("%w = type { ",
+                        first->target);
 
                 sym m = ir_dtype(first->target)->Type.tagtype.symbol->members->first;
                 while (m) {
-                    qprintf("%s", qoneword(get_qtype(m->type)));
+                    qprintf("%w", get_qtype(m->type));
                     m = m->next;
 
                     if (m)
@@ -257,7 +342,7 @@ void quad_print(quad first) {
 
                 qprintf(" }\n");
             } else {
-                qprintf("%s = ", qoneword(first->target));
+                qprintf("%w = ", first->target);
 
                 if (first->target->Qtemp.global->type == ASTN_STRLIT) {
                     qprintf("private constant ");
@@ -267,10 +352,10 @@ void quad_print(quad first) {
                     qprintf("global ");
                 }
 
-                qprintf("%s ", qoneword(ir_dtype(first->target)));
+                qprintf("%w ", ir_dtype(first->target));
 
                 if (first->src1) {
-                    qprintf("%s", qoneword(first->src1));
+                    qprintf("%w", first->src1);
                 }
                 else {
                     qprintf("zeroinitializer");
@@ -281,58 +366,58 @@ void quad_print(quad first) {
             break;
 
         case IR_OP_SEXT:
-            qprintf("    %s = sext %s to %s\n",
-                    qoneword(first->target),
-                    qonewordt(first->src1),
-                    qoneword(qtype_alloc(ir_type(first->target))));
+            qprintf("    %w = sext %t to %s\n",
+                    first->target,
+                    first->src1,
+                    ir_type_str[ir_type(first->target)]);
             break;
 
         case IR_OP_ZEXT:
-            qprintf("    %s = zext %s to %s\n",
-                    qoneword(first->target),
-                    qonewordt(first->src1),
-                    qoneword(qtype_alloc(ir_type(first->target))));
+            qprintf("    %w = zext %t to %s\n",
+                    first->target,
+                    first->src1,
+                    ir_type_str[ir_type(first->target)]);
             break;
 
         case IR_OP_TRUNC:
-            qprintf("    %s = trunc %s to %s\n",
-                    qoneword(first->target),
-                    qonewordt(first->src1),
-                    qoneword(get_qtype(first->target)));
+            qprintf("    %w = trunc %t to %w\n",
+                    first->target,
+                    first->src1,
+                    get_qtype(first->target));
 
             break;
 
         case IR_OP_INTTOPTR:
-            qprintf("    %s = inttoptr %s to %s\n",
-                    qoneword(first->target),
-                    qonewordt(first->src1),
-                    qoneword(qtype_alloc(ir_type(first->target))));
+            qprintf("    %w = inttoptr %t to %s\n",
+                    first->target,
+                    first->src1,
+                    ir_type_str[ir_type(first->target)]);
 
             break;
 
         case IR_OP_PTRTOINT:
-            qprintf("    %s = ptrtoint %s to %s\n",
-                    qoneword(first->target),
-                    qonewordt(first->src1),
-                    qoneword(qtype_alloc(ir_type(first->target))));
+            qprintf("    %w = ptrtoint %t to %s\n",
+                    first->target,
+                    first->src1,
+                    ir_type_str[ir_type(first->target)]);
 
             break;
 
         case IR_OP_FNCALL:;
             ir_type_E fn_ret = ir_type(ir_dtype(first->src1)->Type.derived.target);
             if (fn_ret == IR_void) {
-                qprintf("    call %s(",
-                        qonewordt(first->src1));
+                qprintf("    call %t(",
+                        first->src1);
             } else {
-                qprintf("    %s = call %s(",
-                        qoneword(first->target),
-                        qonewordt(first->src1));
+                qprintf("    %w = call %t(",
+                        first->target,
+                        first->src1);
             }
 
             astn arg = first->src2;
 
             while (arg && list_data(arg)) {
-                qprintf("%s", qonewordt(list_data(arg)));
+                qprintf("%t", list_data(arg));
                 arg = list_next(arg);
                 if (arg && list_data(arg))
                     qprintf(", ");
@@ -342,57 +427,76 @@ void quad_print(quad first) {
 
             break;
 
+        case IR_OP_PHI:;
+            qprintf("    %w = phi %w ",
+                    first->target,
+                    get_qtype(first->target));
+
+            astn val = first->src1, from = first->src2;
+
+            while (val) {
+                qprintf("[ %w, %%%b ]", list_data(val), list_data(from)->Qbb.bb);
+                val = list_next(val);
+                from = list_next(from);
+                if (val)
+                    qprintf(", ");
+            }
+
+            qprintf("\n");
+
+            break;
+
         case IR_OP_BR: // unconditional branch
             ast_check(first->target, ASTN_QBB, "");
-            qprintf("    br label %%%s\n", first->target->Qbb.bb->name);
+            qprintf("    br label %%%b\n", first->target->Qbb.bb);
             break;
 
         case IR_OP_CONDBR:
-            qprintf("    br %s, label %%%s, label %%%s\n",
-                    qonewordt(first->target),
-                    first->src1->Qbb.bb->name,
-                    first->src2->Qbb.bb->name);
+            qprintf("    br %t, label %%%b, label %%%b\n",
+                    first->target,
+                    first->src1->Qbb.bb,
+                    first->src2->Qbb.bb);
             break;
 
         case IR_OP_CMPEQ:
-            qprintf("    %s = icmp eq %s, %s\n",
-                    qoneword(first->target),
-                    qonewordt(first->src1),
-                    qoneword(first->src2));
+            qprintf("    %w = icmp eq %t, %w\n",
+                    first->target,
+                    first->src1,
+                    first->src2);
             break;
 
         case IR_OP_CMPNE:
-            qprintf("    %s = icmp ne %s, %s\n",
-                    qoneword(first->target),
-                    qonewordt(first->src1),
-                    qoneword(first->src2));
+            qprintf("    %w = icmp ne %t, %w\n",
+                    first->target,
+                    first->src1,
+                    first->src2);
             break;
 
         case IR_OP_CMPLT:
-            qprintf("    %s = icmp slt %s, %s\n",
-                    qoneword(first->target),
-                    qonewordt(first->src1),
-                    qoneword(first->src2));
+            qprintf("    %w = icmp slt %t, %w\n",
+                    first->target,
+                    first->src1,
+                    first->src2);
             break;
 
         case IR_OP_CMPLTEQ:
-            qprintf("   %s = icmp sle %s, %s\n",
-                    qoneword(first->target),
-                    qonewordt(first->src1),
-                    qoneword(first->src2));
+            qprintf("   %w = icmp sle %t, %w\n",
+                    first->target,
+                    first->src1,
+                    first->src2);
             break;
 
         case IR_OP_SWITCHBEGIN:
-            qprintf("    switch %s, %s [\n",
-                    qonewordt(first->src1),
-                    qonewordt(first->target));
+            qprintf("    switch %t, %t [\n",
+                    first->src1,
+                    first->target);
 
             break;
 
         case IR_OP_SWITCHCASE:
-            qprintf("        %s, %s\n",
-                    qonewordt(first->target),
-                    qonewordt(first->src1));
+            qprintf("        %t, %t\n",
+                    first->target,
+                    first->src1);
             break;
 
         case IR_OP_SWITCHEND:
@@ -404,51 +508,153 @@ void quad_print(quad first) {
     }
 }
 
-void quads_dump_llvm(FILE *o) {
-    f = o;
+void quad_print(const struct qtab *t, const_quad q) {
+    const struct quad_view v = {
+        .op = q->op,
+        .target = qa(t, q->target),
+        .src1 = qa(t, q->src1),
+        .src2 = qa(t, q->src2),
+        .src3 = qa(t, q->src3),
+    };
 
-    // generate anons
+    quad_print_view(&v);
+}
 
+static bool quad_is_fn_decl(const struct qtab *t, const_quad q) {
+    return q->op == IR_OP_DEFGLOBAL && ir_type_matches(qa(t, q->target), IR_fn);
+}
 
-    BBL bbl = irst.root_bbl;
-    while (bbl) {           // for each function
-        BB bb = bbl->me;    // for each basic block
-        if (bbl != irst.root_bbl) {
-            qprintf("define %s(", qonewordt(symptr_alloc(bb->fn)));
-            astn p = bb->fn->param_list_q;
+/*
+ * Print root quads after the last flush. Function declarations are held back
+ * until the end (decls), since a later definition would clash with them.
+ * Printing can emit struct types into the root, so the block is re-read on
+ * each step.
+ */
+static void quads_dump_root_pending(bool decls) {
+    const struct qtab *t = &irst.root_bbl->tab;
+    BB root = irst.root_bbl->me;
+
+    for (unsigned i = irst.root_flushed; i < root->nquads; i++) {
+        struct quad g = root->quads[i];
+        if (!quad_is_fn_decl(t, &g))
+            quad_print(t, &g);
+    }
 
-            while (p) {
-                astn e = list_data(p);
+    if (!decls)
+        return;
 
-                if (e->type == ASTN_ELLIPSIS)
-                    qprintf("...")
-                else
-                    qprintf("%s", qonewordt(e));
+    for (unsigned i = 0; i < root->nquads; i++) {
+        struct quad g = root->quads[i];
+        if (quad_is_fn_decl(t, &g))
+            quad_print(t, &g);
+    }
+}
 
-                p = list_next(p);
-                if (p)
-                    qprintf(", ");
-            }
+/*
+ * Print what the declarations since the last function added to the root, so
+ * that whatever the next function adds starts on a clean slate.
+ */
+void quads_dump_pending(struct outbuf *o) {
+    out = o;
 
-            qprintf(") {\n");
-        }
+    quads_dump_root_pending(false);
+    irst.root_flushed = irst.root_bbl->me->nquads;
+}
 
-        while (bb) {        // for each quad
-            if (bb->name)
-                qprintf("%s:\n", bb->name);
+static void quads_dump_bbs(const struct qtab *t, BB bb) {
+    while (bb) {        // for each quad
+        if (bb->name)
+            qprintf("%b:\n", bb);
 
-            quad g = bb->first;
-            while (g) {
-                quad_print(g);
-                g = g->next;
-            }
+        for (unsigned i = 0; i < bb->nquads; i++)
+            quad_print(t, &bb->quads[i]);
 
-            bb = bb->next;
-        }
+        bb = bb->next;
+    }
+}
+static void dump_fn(BBL bbl) {
+    BB bb = bbl->me;
+    qprintf("define %t(", symptr_alloc(bb->fn));
+    astn p = bb->fn->param_list_q;
+
+    while (p) {
+        astn e = list_data(p);
+
+        if (e->type == ASTN_ELLIPSIS)
+            qprintf("...");
+        else
+            qprintf("%t", e);
+
+        p = list_next(p);
+        if (p)
+            qprintf(", ");
+    }
 
-        if (bbl != irst.root_bbl)
-            qprintf("}\n");
+    qprintf(") {\n");
 
-        bbl = bbl->next;
-    }
+    quads_dump_bbs(&bbl->tab, bb);
+
+    qprintf("}\n");
+}
+
+/*
+ * Print the function we just finished generating. Functions are printed (and
+ * then thrown away) one at a time as the parser hands them to us, so only one
+ * function's IR is ever held in memory.
+ */
+void quads_dump_fn(struct outbuf *o) {
+    out = o;
+
+    BBL bbl = irst.current_bbl;
+    if (bbl == irst.root_bbl)
+        die("quads_dump_fn called without a function.");
+
+    // whatever printing allocates goes away with the function
+    struct arena *save = astn_arena;
+    astn_arena = &bbl->arena;
+
+    // struct types have to be defined before anything allocas them
+    quads_dump_root_pending(false);
+
+    dump_fn(bbl);
+
+    astn_arena = save;
+}
+
+/*
+ * Print the function to stderr as it is right now, for -fdump-after. Only
+ * the function: what it needs from the root still goes out with the output.
+ */
+void quads_eprint_fn(void) {
+    BBL bbl = irst.current_bbl;
+    if (bbl == irst.root_bbl)
+        die("quads_eprint_fn called without a function.");
+
+    struct outbuf *save_out = out;
+    struct outbuf e;
+
+    outbuf_init(&e, STDERR_FILENO);
+    out = &e;
+
+    struct arena *save = astn_arena;
+    astn_arena = &bbl->arena;
+
+    dump_fn(bbl);
+
+    astn_arena = save;
+
+    outbuf_flush(&e);
+    outbuf_free(&e);
+    out = save_out;
+}
+
+/*
+ * Print what's left of the root block, and the function declarations. This
+ * goes last, since we only know which functions were never defined once the
+ * whole translation unit has been seen.
+ */
+void quads_dump_root(struct outbuf *o) {
+    out = o;
+
+    quads_dump_root_pending(true);
 }
@@ -3,11 +3,14 @@
 
 #include "ast.h"
 #include "ir.h"
+#include "outbuf.h"
 
-const char *qonewordt(astn a);
-const char *qoneword(astn a);
-void quad_print(quad first);
+void qoneword_eprint(astn a);
+void quad_print(const struct qtab *t, const_quad q);
 void quad_print_blankline(void);
-void quads_dump_llvm(FILE *o);
+void quads_dump_pending(struct outbuf *o);
+void quads_dump_fn(struct outbuf *o);
+void quads_eprint_fn(void);
+void quads_dump_root(struct outbuf *o);
 
 #endif
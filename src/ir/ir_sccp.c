@@ -0,0 +1,668 @@
+/*
+ * ir_sccp.c
+ *
+ * Sparse conditional constant propagation over a function's quads (see
+ * ir_sccp.h).
+ */
+#include "ir_sccp.h"
+
+#include "ir_cf.h"
+#include "ir_cfg.h"
+#include "ir_pass.h"
+#include "ir_state.h"
+#include "ir_types.h"
+#include "ir_util.h"
+
+#include "ast.h"
+#include "const_expr.h"
+#include "memstat.h"
+#include "util.h"
+
+// what's known about a temp's value; it only ever goes down the list
+enum level {
+    UNKNOWN,        // nothing that gives it a value has run yet
+    CONSTANT,
+    VARYING,
+};
+
+struct value {
+    enum level level;
+    unsigned long long bits;    // a constant's, zero above its width
+};
+
+static const struct value varying = {VARYING, 0};
+
+// a quad that reads a temp
+struct use {
+    quad q;
+    unsigned b;
+    struct use *next;
+};
+
+// what we keep for a block, by its reverse postorder number
+struct block {
+    BB bb;
+    bool reached;           // an edge that runs goes to it, or it's the entry
+    bool visited;           // its quads have been through visit()
+    bool *taken;            // for each edge out, whether it runs
+};
+
+struct sccp {
+    struct qtab *t;
+
+    struct block *b;
+    unsigned nb;
+
+    struct value *val;      // by tempno
+    quad *def;              // by tempno: the quad giving it its value, if there is one
+    struct use **uses;      // by tempno
+    unsigned ntemps;
+
+    unsigned *blocks;       // the reached blocks, in the order they were
+    unsigned nblocks, nvisited;
+    unsigned *temps;        // temps whose value went down, for their uses to look at again
+    unsigned ntemps_work;
+
+    astn *num;              // by tempno: the number a constant is
+    bool *needed;           // by tempno: a constant with no number, that something still uses
+    unsigned *work, nwork;  // needed ones whose quads haven't had their operands replaced
+};
+
+static void *pass_alloc(size_t size) {
+    mem_note(MEM_PASSES, size);
+    return ir_alloc(size);
+}
+
+static bool is_temp(const struct sccp *s, astn a) {
+    return a && a->type == ASTN_QTEMP && !a->Qtemp.name && a->Qtemp.tempno < s->ntemps;
+}
+
+// the width of integer type t, 0 if it isn't one
+static unsigned type_width(ir_type_E t) {
+    if (t == IR_i1)
+        return 1;
+
+    if (t > IR_TYPE_INTEGER_MIN && t < IR_TYPE_INTEGER_MAX)
+        return ir_type_size[t] * 8;
+
+    return 0;
+}
+
+static unsigned width(astn a) {
+    return type_width(ir_type(a));
+}
+
+// the same for an operand, from the value table
+static unsigned qv_width(const struct sccp *s, qval v) {
+    return type_width(qv_type(s->t, v));
+}
+
+static unsigned long long cut(unsigned long long v, unsigned w) {
+    return w < 64 ? v & ((1ull << w) - 1) : v;
+}
+
+static long long sign_extend(unsigned long long v, unsigned w) {
+    if (w < 64 && v >> (w - 1))
+        v |= ~0ull << w;
+
+    return (long long)v;
+}
+
+static struct value known(unsigned long long v, unsigned w) {
+    return (struct value){CONSTANT, cut(v, w)};
+}
+
+static struct value meet(struct value a, struct value b) {
+    if (a.level == UNKNOWN)
+        return b;
+    if (b.level == UNKNOWN)
+        return a;
+
+    if (a.level == CONSTANT && b.level == CONSTANT && a.bits == b.bits)
+        return a;
+
+    return varying;
+}
+
+static struct value value_of(const struct sccp *s, astn a) {
+    if (is_temp(s, a))
+        return s->val[a->Qtemp.tempno];
+
+    unsigned w;
+    if (a && a->type == ASTN_NUM && (w = width(a)))
+        return known(a->Num.number.integer, w);
+
+    return varying; // parameters, globals, addresses
+}
+
+static struct value operand(const struct sccp *s, qval v) {
+    return value_of(s, qa(s->t, v));
+}
+
+/*
+ * The arithmetic at width w, as it'd run; what's undefined (dividing by
+ * zero, the most negative value by -1) is left to run, as varying.
+ */
+static struct value binary(ir_op_E op, struct value l, struct value r, unsigned w) {
+    if (!w || l.level == VARYING || r.level == VARYING)
+        return varying;
+
+    if (l.level == UNKNOWN || r.level == UNKNOWN)
+        return (struct value){UNKNOWN, 0};
+
+    unsigned long long x = l.bits, y = r.bits;
+    long long sx = sign_extend(x, w), sy = sign_extend(y, w);
+    bool overflows = sy == -1 && x == 1ull << (w - 1);
+
+    switch (op) {
+        case IR_OP_ADD:     return known(x + y, w);
+        case IR_OP_SUB:     return known(x - y, w);
+        case IR_OP_MUL:     return known(x * y, w);
+
+        case IR_OP_SDIV:    return !y || overflows ? varying : known((unsigned long long)(sx / sy), w);
+        case IR_OP_SMOD:    return !y || overflows ? varying : known((unsigned long long)(sx % sy), w);
+        case IR_OP_UDIV:    return !y ? varying : known(x / y, w);
+        case IR_OP_UMOD:    return !y ? varying : known(x % y, w);
+
+        // the comparisons are signed, as the backends do them
+        case IR_OP_CMPEQ:   return known(x == y, 1);
+        case IR_OP_CMPNE:   return known(x != y, 1);
+        case IR_OP_CMPLT:   return known(sx < sy, 1);
+        case IR_OP_CMPLTEQ: return known(sx <= sy, 1);
+
+        default:            return varying;
+    }
+}
+
+static struct value conversion(const struct sccp *s, const_quad q, unsigned w) {
+    struct value v = operand(s, q->src1);
+    unsigned from = qv_width(s, q->src1);
+
+    if (v.level != CONSTANT || !from)
+        return v.level == UNKNOWN ? v : varying;
+
+    if (q->op == IR_OP_SEXT)
+        return known((unsigned long long)sign_extend(v.bits, from), w);
+
+    return known(v.bits, w); // zero extending, or truncating
+}
+
+static bool taken(const struct sccp *s, const_BB from, const_BB to) {
+    const struct block *f = &s->b[from->rpo];
+    for (unsigned k = 0; k < from->nsuccs; k++)
+        if (from->succs[k] == to && f->taken[k])
+            return true;
+
+    return false;
+}
+
+// what comes in on the edges that run
+static struct value phi(const struct sccp *s, unsigned b, const_quad q) {
+    const_BB bb = s->b[b].bb;
+    struct value v = {UNKNOWN, 0};
+
+    astn from = qa(s->t, q->src2);
+    for (astn val = qa(s->t, q->src1); val; val = list_next(val), from = list_next(from))
+        if (taken(s, list_data(from)->Qbb.bb, bb))
+            v = meet(v, value_of(s, list_data(val)));
+
+    return v;
+}
+
+// a const object with static storage only ever holds its initializer
+static struct value load(const struct sccp *s, const_quad q, unsigned w) {
+    astn addr = qa(s->t, q->src1);
+    if (addr->type != ASTN_QTEMP || !addr->Qtemp.name || !addr->Qtemp.global ||
+        addr->Qtemp.global->type != ASTN_SYMPTR)
+        return varying;
+
+    sym e = addr->Qtemp.global->Symptr.e;
+    astn t = e->type;
+    if (!t->Type.is_const || t->Type.is_volatile || !e->has_init || e->init_is_str ||
+        ir_type(get_qtype(t)) != ir_type(qa(s->t, q->target)))
+        return varying;
+
+    if (w == 1)
+        return known(e->numinit.integer != 0, 1);
+
+    return known(e->numinit.integer, w);
+}
+
+static struct value eval(const struct sccp *s, unsigned b, const_quad q) {
+    unsigned w = qv_width(s, q->target);
+    if (!w)
+        return varying; // pointers
+
+    switch (q->op) {
+        case IR_OP_ADD:
+        case IR_OP_SUB:
+        case IR_OP_MUL:
+        case IR_OP_SDIV:
+        case IR_OP_UDIV:
+        case IR_OP_SMOD:
+        case IR_OP_UMOD:
+            return binary(q->op, operand(s, q->src1), operand(s, q->src2), w);
+
+        case IR_OP_CMPEQ:
+        case IR_OP_CMPNE:
+        case IR_OP_CMPLT:
+        case IR_OP_CMPLTEQ:
+            return binary(q->op, operand(s, q->src1), operand(s, q->src2), qv_width(s, q->src1));
+
+        case IR_OP_SEXT:
+        case IR_OP_ZEXT:
+        case IR_OP_TRUNC:
+            return conversion(s, q, w);
+
+        case IR_OP_PHI:
+            return phi(s, b, q);
+
+        case IR_OP_LOAD:
+            return load(s, q, w);
+
+        default:
+            return varying; // calls, and the rest of what goes through memory
+    }
+}
+
+static void lower(struct sccp *s, astn target, struct value v) {
+    struct value *cur = &s->val[target->Qtemp.tempno];
+    struct value m = meet(*cur, v);
+    if (m.level == cur->level && m.bits == cur->bits)
+        return;
+
+    // down at most twice, so there's room for it
+    *cur = m;
+    s->temps[s->ntemps_work++] = target->Qtemp.tempno;
+}
+
+static void visit(struct sccp *s, unsigned b, const_quad q);
+
+static void take(struct sccp *s, unsigned b, unsigned k) {
+    struct block *from = &s->b[b];
+    if (from->taken[k])
+        return;
+
+    from->taken[k] = true;
+
+    BB to = from->bb->succs[k];
+    struct block *t = &s->b[to->rpo];
+    if (!t->reached) {
+        t->reached = true;
+        s->blocks[s->nblocks++] = to->rpo;
+        return;
+    }
+
+    // another way in, so its phis might meet another value
+    if (t->visited)
+        for (unsigned i = 0; i < to->nquads && to->quads[i].op == IR_OP_PHI; i++)
+            visit(s, to->rpo, &to->quads[i]);
+}
+
+static unsigned switch_begin(const_BB bb) {
+    unsigned i = bb->nquads - 1;
+    while (bb->quads[i].op != IR_OP_SWITCHBEGIN)
+        i--;
+
+    return i;
+}
+
+// the edge a switch on c goes down: to its case (edge 1 is the first), or the default (0)
+static unsigned switch_edge(const struct sccp *s, const_BB bb, unsigned begin, struct value c) {
+    for (unsigned i = begin + 1; bb->quads[i].op == IR_OP_SWITCHCASE; i++)
+        if (operand(s, bb->quads[i].target).bits == c.bits)
+            return i - begin;
+
+    return 0;
+}
+
+/*
+ * The edges out of block b that run. A condition is never unknown here -
+ * it's worked out before the branch, in a block that's been through
+ * already - but if it were, taking every edge would still be right.
+ */
+static void branch(struct sccp *s, unsigned b) {
+    const_BB bb = s->b[b].bb;
+    if (!bb->nquads)
+        return;
+
+    const_quad last = &bb->quads[bb->nquads - 1];
+    struct value c;
+
+    switch (last->op) {
+        case IR_OP_BR:
+            take(s, b, 0);
+            break;
+
+        case IR_OP_CONDBR:
+            c = operand(s, last->target);
+            if (c.level == CONSTANT) {
+                take(s, b, c.bits ? 0 : 1);
+            } else {
+                take(s, b, 0);
+                take(s, b, 1);
+            }
+            break;
+
+        case IR_OP_SWITCHEND:;
+            unsigned begin = switch_begin(bb);
+            c = operand(s, bb->quads[begin].src1);
+            if (c.level == CONSTANT) {
+                take(s, b, switch_edge(s, bb, begin, c));
+            } else {
+                for (unsigned k = 0; k < bb->nsuccs; k++)
+                    take(s, b, k);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void visit(struct sccp *s, unsigned b, const_quad q) {
+    switch (q->op) {
+        case IR_OP_BR:
+        case IR_OP_CONDBR:
+        case IR_OP_SWITCHBEGIN:
+            branch(s, b);
+            break;
+
+        default:
+            if (quad_defines(q) && is_temp(s, qa(s->t, q->target)))
+                lower(s, qa(s->t, q->target), eval(s, b, q));
+            break;
+    }
+}
+
+static void add_use(struct sccp *s, unsigned b, quad q, astn a) {
+    if (!is_temp(s, a))
+        return;
+
+    struct use *u = pass_alloc(sizeof(struct use));
+    *u = (struct use){q, b, s->uses[a->Qtemp.tempno]};
+    s->uses[a->Qtemp.tempno] = u;
+}
+
+static void note_use(struct sccp *s, unsigned b, quad q, qval val) {
+    astn a = qa(s->t, val);
+    if (a && a->type == ASTN_LIST) {
+        for (astn l = a; l; l = list_next(l))
+            add_use(s, b, q, list_data(l));
+    } else {
+        add_use(s, b, q, a);
+    }
+}
+
+static void find_uses(struct sccp *s) {
+    s->ntemps = (unsigned)irst.tempno;
+    unsigned n = s->ntemps ? s->ntemps : 1;
+
+    s->val = pass_alloc(n * sizeof(struct value));
+    s->def = pass_alloc(n * sizeof(quad));
+    s->uses = pass_alloc(n * sizeof(struct use *));
+    s->temps = pass_alloc(2 * n * sizeof(unsigned));
+    s->blocks = pass_alloc(s->nb * sizeof(unsigned));
+
+    // parameters, and whatever else nothing here defines, could be anything
+    for (unsigned i = 0; i < s->ntemps; i++)
+        s->val[i] = varying;
+
+    for (unsigned i = 0; i < s->nb; i++) {
+        BB bb = s->b[i].bb;
+        s->b[i].taken = pass_alloc((bb->nsuccs ? bb->nsuccs : 1) * sizeof(bool));
+
+        for (unsigned k = 0; k < bb->nquads; k++) {
+            quad q = &bb->quads[k];
+            astn target = qa(s->t, q->target);
+
+            if (quad_defines(q) && is_temp(s, target)) {
+                s->def[target->Qtemp.tempno] = q;
+                s->val[target->Qtemp.tempno].level = UNKNOWN;
+            } else {
+                note_use(s, i, q, q->target);
+            }
+
+            note_use(s, i, q, q->src1);
+            note_use(s, i, q, q->src2);
+            note_use(s, i, q, q->src3);
+        }
+    }
+}
+
+static void propagate(struct sccp *s) {
+    s->b[0].reached = true;
+    s->blocks[s->nblocks++] = 0;
+
+    while (s->nvisited < s->nblocks || s->ntemps_work) {
+        while (s->ntemps_work) {
+            unsigned n = s->temps[--s->ntemps_work];
+            for (const struct use *u = s->uses[n]; u; u = u->next)
+                if (s->b[u->b].visited)
+                    visit(s, u->b, u->q);
+        }
+
+        if (s->nvisited < s->nblocks) {
+            unsigned b = s->blocks[s->nvisited++];
+            BB bb = s->b[b].bb;
+
+            s->b[b].visited = true;
+            for (unsigned k = 0; k < bb->nquads; k++)
+                visit(s, b, &bb->quads[k]);
+        }
+    }
+}
+
+// a branch on a constant only ever goes one way
+static void fold_branches(struct sccp *s) {
+    for (unsigned i = 0; i < s->nb; i++) {
+        BB bb = s->b[i].bb;
+        if (!s->b[i].reached || !bb->nquads)
+            continue;
+
+        quad last = &bb->quads[bb->nquads - 1];
+        struct value c;
+
+        if (last->op == IR_OP_CONDBR) {
+            c = operand(s, last->target);
+            if (c.level == CONSTANT)
+                *last = (struct quad){.op = IR_OP_BR, .target = c.bits ? last->src1 : last->src2};
+        } else if (last->op == IR_OP_SWITCHEND) {
+            unsigned begin = switch_begin(bb);
+            c = operand(s, bb->quads[begin].src1);
+            if (c.level != CONSTANT)
+                continue;
+
+            unsigned k = switch_edge(s, bb, begin, c);
+            qval to = k ? bb->quads[begin + k].src1 : bb->quads[begin].target;
+
+            bb->quads[begin] = (struct quad){.op = IR_OP_BR, .target = to};
+            bb->nquads = begin + 1;
+        }
+    }
+}
+
+// a constant temp is a number, if its type has them
+static astn number(const struct sccp *s, unsigned n) {
+    astn target = qa(s->t, s->def[n]->target);
+    ir_type_E t = ir_type(target);
+    unsigned w = width(target);
+    if (t == IR_i1 || (w != 8 && w != 32 && w != 64))
+        return NULL;
+
+    astn num = simple_constant_alloc(0);
+    num->Num.number.integer = s->val[n].bits;
+    const_convert(&num->Num.number, w, type_is_signed(t));
+    return num;
+}
+
+static bool is_constant(const struct sccp *s, astn a) {
+    return is_temp(s, a) && s->val[a->Qtemp.tempno].level == CONSTANT && s->def[a->Qtemp.tempno];
+}
+
+// what a constant becomes: its number, or itself, with its quad needed
+static astn substitute_one(struct sccp *s, astn a) {
+    if (!is_constant(s, a))
+        return a;
+
+    unsigned n = a->Qtemp.tempno;
+    if (s->num[n])
+        return s->num[n];
+
+    if (!s->needed[n]) {
+        s->needed[n] = true;
+        s->work[s->nwork++] = n;
+    }
+
+    return a;
+}
+
+static qval substitute(struct sccp *s, qval val) {
+    astn a = qa(s->t, val);
+    if (a && a->type == ASTN_LIST) {
+        for (astn l = a; l; l = list_next(l))
+            l->List.me = substitute_one(s, list_data(l));
+        return val;
+    }
+
+    astn r = substitute_one(s, a);
+    return r == a ? val : qval_of(s->t, r);
+}
+
+static void substitute_operands(struct sccp *s, quad q) {
+    if (!quad_defines(q))
+        q->target = substitute(s, q->target);
+
+    q->src1 = substitute(s, q->src1);
+    q->src2 = substitute(s, q->src2);
+    q->src3 = substitute(s, q->src3);
+}
+
+/*
+ * Every use of a constant gets its number, and the quads defining them go;
+ * the ones with no number (see number()) stay if they're still used, with
+ * whatever they use.
+ */
+static void replace_constants(struct sccp *s) {
+    unsigned n = s->ntemps ? s->ntemps : 1;
+    s->num = pass_alloc(n * sizeof(astn));
+    s->needed = pass_alloc(n * sizeof(bool));
+    s->work = pass_alloc(n * sizeof(unsigned));
+
+    for (unsigned i = 0; i < s->ntemps; i++)
+        if (s->val[i].level == CONSTANT && s->def[i])
+            s->num[i] = number(s, i);
+
+    for (unsigned i = 0; i < s->nb; i++) {
+        BB bb = s->b[i].bb;
+        if (!s->b[i].reached)
+            continue;
+
+        for (unsigned k = 0; k < bb->nquads; k++) {
+            quad q = &bb->quads[k];
+            if (!quad_defines(q) || !is_constant(s, qa(s->t, q->target)))
+                substitute_operands(s, q);
+        }
+    }
+
+    while (s->nwork)
+        substitute_operands(s, s->def[s->work[--s->nwork]]);
+
+    for (unsigned i = 0; i < s->ntemps; i++)
+        if (s->val[i].level == CONSTANT && s->def[i] && !s->needed[i])
+            s->def[i]->op = IR_OP_UNKNOWN;
+
+    for (unsigned i = 0; i < s->nb; i++) {
+        BB bb = s->b[i].bb;
+        unsigned nq = 0;
+
+        for (unsigned k = 0; k < bb->nquads; k++)
+            if (bb->quads[k].op != IR_OP_UNKNOWN)
+                bb->quads[nq++] = bb->quads[k];
+
+        bb->nquads = nq;
+    }
+}
+
+// the number of edges from -> to
+static unsigned edges(const_BB from, const_BB to) {
+    unsigned n = 0;
+    for (unsigned k = 0; k < from->nsuccs; k++)
+        n += from->succs[k] == to;
+
+    return n;
+}
+
+// a phi only has entries for the edges into its block that are left
+static void prune_phis(struct sccp *s, const struct cfg *c) {
+    for (unsigned i = 0; i < c->nblocks; i++) {
+        BB bb = c->rpo[i];
+
+        for (unsigned k = 0; k < bb->nquads && bb->quads[k].op == IR_OP_PHI; k++) {
+            quad q = &bb->quads[k];
+
+            unsigned entries = 0;
+            for (astn val = qa(s->t, q->src1); val; val = list_next(val))
+                entries++;
+
+            if (entries == bb->npreds)
+                continue; // one for each edge still
+
+            astn vals = NULL, vals_tail = NULL, from = NULL, from_tail = NULL;
+            astn f = qa(s->t, q->src2);
+            for (astn val = qa(s->t, q->src1); val; val = list_next(val), f = list_next(f)) {
+                BB pred = list_data(f)->Qbb.bb;
+
+                unsigned kept = 0;
+                for (astn g = from; g; g = list_next(g))
+                    kept += list_data(g)->Qbb.bb == pred;
+
+                if (pred->rpo >= c->nblocks || c->rpo[pred->rpo] != pred || kept >= edges(pred, bb))
+                    continue; // gone
+
+                if (!vals) {
+                    vals = vals_tail = list_alloc(list_data(val));
+                    from = from_tail = list_alloc(list_data(f));
+                } else {
+                    vals_tail = list_append(list_data(val), vals_tail);
+                    from_tail = list_append(list_data(f), from_tail);
+                }
+            }
+
+            q->src1 = qval_of(s->t, vals);
+            q->src2 = qval_of(s->t, from);
+        }
+    }
+}
+
+void sccp_propagate(void) {
+    BBL bbl = irst.current_bbl;
+    if (bbl == irst.root_bbl)
+        die("sccp outside of a function.");
+
+    BB save = irst.bb;
+    bb_active(bbl->me); // so what we allocate goes with the function
+
+    struct cfg *cfg = cfg_build();
+    struct sccp s = {
+        .t = &bbl->tab,
+        .nb = cfg->nblocks,
+        .b = pass_alloc(cfg->nblocks * sizeof(struct block)),
+    };
+
+    for (unsigned i = 0; i < s.nb; i++)
+        s.b[i].bb = cfg->rpo[i];
+
+    find_uses(&s);
+    propagate(&s);
+
+    fold_branches(&s);
+    replace_constants(&s);
+
+    // which drops the blocks nothing goes to any more
+    prune_phis(&s, cfg_build());
+
+    pass_renumber();
+
+    bb_active(save);
+}
@@ -0,0 +1,31 @@
+/*
+ * ir_sccp.h
+ *
+ * Sparse conditional constant propagation (Wegman and Zadeck), on the SSA
+ * temps mem2reg leaves. Every temp starts out unknown; going down from the
+ * entry, only along the edges a branch can actually take, each quad's
+ * value is worked out from its operands' - a constant, or varying - until
+ * nothing changes. A phi only meets the values coming in on edges that
+ * run, so a constant that goes around a loop stays one.
+ *
+ * Constants come from number operands, the arithmetic, comparisons and
+ * conversions on them, and loads of a const object with static storage
+ * and an integer initializer (modifying one is undefined), so `if (DEBUG)`
+ * on a `static const int DEBUG = 0` goes. The locals whose address isn't
+ * taken are already temps by now, so what's stored to them comes along.
+ * Dividing by zero and the like is left to happen at run time.
+ *
+ * Then a CONDBR on a constant becomes a BR, and so does a switch on one;
+ * the blocks no branch goes to any more are deleted, with their phi
+ * entries. A temp with a constant value is replaced by it and the quad
+ * defining it goes, unless there's no number of its type (i1, i16,
+ * pointers) and something still uses it.
+ */
+
+#ifndef IR_SCCP_H
+#define IR_SCCP_H
+
+// on the function gen_fn() just finished
+void sccp_propagate(void);
+
+#endif
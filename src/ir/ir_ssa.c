@@ -0,0 +1,636 @@
+/*
+ * ir_ssa.c
+ *
+ * mem2reg over a function's quads (see ir_ssa.h).
+ */
+#include "ir_ssa.h"
+
+#include <string.h>
+
+#include "ir_cf.h"
+#include "ir_cfg.h"
+#include "ir_pass.h"
+#include "ir_state.h"
+#include "ir_types.h"
+#include "ir_util.h"
+
+#include "ast.h"
+#include "memstat.h"
+#include "util.h"
+
+// a phi for a local, placed at the start of a block
+struct phi {
+    unsigned var;
+    astn target;
+    astn *vals;             // one for each of the block's predecessors
+    unsigned npred;
+    bool gone;              // it always had the same value, which replaced it
+    bool live;
+    struct phi *next;
+    struct phi *work;       // the next one to look at, for mark_live_phis()
+};
+
+// what we keep for a block, by its reverse postorder number
+struct block {
+    BB bb;
+    unsigned *df, ndf, df_cap;  // its dominance frontier
+    struct phi *phis;
+};
+
+// a local that might be promoted
+struct var {
+    astn addr;              // its alloca
+    astn qtype;             // what it holds
+    bool escapes;           // its address is used for more than loading and storing
+    astn cur;               // the value reaching the quad being renamed, NULL if none has yet
+    astn zero;              // its value before anything's stored to it, once it's needed
+    unsigned *defs, ndefs, defs_cap;    // the blocks that store to it
+};
+
+struct undo {
+    struct var *v;
+    astn was;
+};
+
+struct ssa {
+    struct qtab *t;
+
+    struct block *b;
+    unsigned nb;
+
+    struct var *v;
+    unsigned nv;
+    unsigned *var_of;       // by tempno: the index + 1 of the local it's the alloca of, 0 for none
+    unsigned nvar_of;
+
+    astn *repl;             // by tempno: what a load or a phi we're getting rid of became
+    unsigned nrepl;
+    struct phi **phi_of;    // by tempno
+
+    struct undo *undo;
+    unsigned nundo, undo_cap;
+
+    struct quad *zeros;     // defining the zeroes there's no literal for, at the top of the entry block
+    unsigned nzeros, zeros_cap;
+};
+
+static void *pass_alloc(size_t size) {
+    mem_note(MEM_PASSES, size);
+    return ir_alloc(size);
+}
+
+// append x to the array at *a, which has *n entries and room for *cap
+static void push(unsigned **a, unsigned *n, unsigned *cap, unsigned x) {
+    if (*n == *cap) {
+        unsigned c = *cap ? *cap * 2 : 4;
+        unsigned *grown = pass_alloc(c * sizeof(unsigned));
+
+        if (*n)
+            memcpy(grown, *a, *n * sizeof(unsigned));
+
+        *a = grown;
+        *cap = c;
+    }
+
+    (*a)[(*n)++] = x;
+}
+
+/*
+ * Dominance frontiers, by walking up the dominator tree from each join's
+ * predecessors (Cooper, Harvey and Kennedy again).
+ */
+static void frontiers(struct ssa *s) {
+    for (unsigned i = 0; i < s->nb; i++) {
+        const_BB bb = s->b[i].bb;
+        if (bb->npreds < 2)
+            continue;
+
+        for (unsigned p = 0; p < bb->npreds; p++) {
+            for (const_BB r = bb->preds[p]; r != bb->idom; r = r->idom) {
+                struct block *runner = &s->b[r->rpo];
+                if (runner->ndf && runner->df[runner->ndf - 1] == i)
+                    break; // been up here already, for another predecessor
+
+                push(&runner->df, &runner->ndf, &runner->df_cap, i);
+            }
+        }
+    }
+}
+
+// the local a is the alloca of, if it's one we're promoting
+static struct var *var_for(const struct ssa *s, astn a) {
+    if (!a || a->type != ASTN_QTEMP || a->Qtemp.name || a->Qtemp.tempno >= s->nvar_of)
+        return NULL;
+
+    unsigned i = s->var_of[a->Qtemp.tempno];
+    if (!i || s->v[i - 1].escapes)
+        return NULL;
+
+    return &s->v[i - 1];
+}
+
+/*
+ * Only loads from a local (src1) and stores to it (target) leave it
+ * promotable; anything else that mentions its alloca - a store of the
+ * address itself, a GEP, a call, a load through a view of it at another
+ * type (see convert_to_ptr()) - means it has to stay in memory.
+ */
+static void note_use(struct ssa *s, unsigned b, const_quad q, int slot, qval val) {
+    astn a = qa(s->t, val);
+    if (!a)
+        return;
+
+    if (a->type == ASTN_LIST) {
+        for (astn l = a; l; l = list_next(l)) {
+            struct var *v = var_for(s, list_data(l));
+            if (v)
+                v->escapes = true;
+        }
+        return;
+    }
+
+    struct var *v = var_for(s, a);
+    if (!v)
+        return;
+
+    if (a != v->addr && q->op != IR_OP_ALLOCA) {
+        v->escapes = true;
+    } else if (q->op == IR_OP_STORE && slot == 0) {
+        if (!v->ndefs || v->defs[v->ndefs - 1] != b)
+            push(&v->defs, &v->ndefs, &v->defs_cap, b);
+    } else if (!(q->op == IR_OP_LOAD && slot == 1) && !(q->op == IR_OP_ALLOCA && slot == 0)) {
+        v->escapes = true;
+    }
+}
+
+// the scalar locals, and which of them we can promote
+static void find_vars(struct ssa *s) {
+    s->nvar_of = (unsigned)irst.tempno;
+    s->var_of = pass_alloc((s->nvar_of ? s->nvar_of : 1) * sizeof(unsigned));
+
+    unsigned n = 0;
+    for (unsigned i = 0; i < s->nb; i++) {
+        BB bb = s->b[i].bb;
+        for (unsigned k = 0; k < bb->nquads; k++)
+            n += bb->quads[k].op == IR_OP_ALLOCA;
+    }
+
+    s->v = pass_alloc((n ? n : 1) * sizeof(struct var));
+
+    for (unsigned i = 0; i < s->nb; i++) {
+        BB bb = s->b[i].bb;
+        for (unsigned k = 0; k < bb->nquads; k++) {
+            const_quad q = &bb->quads[k];
+            if (q->op != IR_OP_ALLOCA)
+                continue;
+
+            astn addr = qa(s->t, q->target);
+            astn qtype = get_qtype(ir_dtype(addr));
+            if (!is_integer(qtype) && !ir_type_matches(qtype, IR_ptr))
+                continue;
+
+            s->v[s->nv] = (struct var){
+                .addr = addr,
+                .qtype = qtype,
+            };
+            s->var_of[addr->Qtemp.tempno] = ++s->nv;
+        }
+    }
+
+    for (unsigned i = 0; i < s->nb; i++) {
+        BB bb = s->b[i].bb;
+        for (unsigned k = 0; k < bb->nquads; k++) {
+            const_quad q = &bb->quads[k];
+            note_use(s, i, q, 0, q->target);
+            note_use(s, i, q, 1, q->src1);
+            note_use(s, i, q, 2, q->src2);
+            note_use(s, i, q, 3, q->src3);
+        }
+    }
+}
+
+// phis on the iterated dominance frontier of each local's stores
+static void place_phis(struct ssa *s) {
+    unsigned *has_phi = pass_alloc(s->nb * sizeof(unsigned));
+    unsigned *queued = pass_alloc(s->nb * sizeof(unsigned));
+    unsigned *work = NULL, nwork = 0, work_cap = 0;
+
+    for (unsigned x = 0; x < s->nv; x++) {
+        struct var *v = &s->v[x];
+        if (v->escapes)
+            continue;
+
+        for (unsigned d = 0; d < v->ndefs; d++) {
+            queued[v->defs[d]] = x + 1;
+            push(&work, &nwork, &work_cap, v->defs[d]);
+        }
+
+        while (nwork) {
+            const struct block *from = &s->b[work[--nwork]];
+
+            for (unsigned f = 0; f < from->ndf; f++) {
+                unsigned y = from->df[f];
+                struct block *b = &s->b[y];
+                if (has_phi[y] == x + 1)
+                    continue;
+
+                has_phi[y] = x + 1;
+
+                struct phi *p = pass_alloc(sizeof(struct phi));
+                p->var = x;
+                p->target = new_qtemp(v->qtype);
+                p->npred = b->bb->npreds;
+                p->vals = pass_alloc((p->npred ? p->npred : 1) * sizeof(astn));
+                p->next = b->phis;
+                b->phis = p;
+
+                if (queued[y] != x + 1) {
+                    queued[y] = x + 1;
+                    push(&work, &nwork, &work_cap, y);
+                }
+            }
+        }
+    }
+}
+
+// what a became, following whatever replaced it
+static astn resolve(const struct ssa *s, astn a) {
+    while (a && a->type == ASTN_QTEMP && !a->Qtemp.name && a->Qtemp.tempno < s->nrepl && s->repl[a->Qtemp.tempno])
+        a = s->repl[a->Qtemp.tempno];
+
+    return a;
+}
+
+static void zero_quad(struct ssa *s, ir_op_E op, astn target, astn src1, astn src2) {
+    if (s->nzeros == s->zeros_cap) {
+        unsigned cap = s->zeros_cap ? s->zeros_cap * 2 : 4;
+        struct quad *grown = pass_alloc(cap * sizeof(struct quad));
+
+        if (s->nzeros)
+            memcpy(grown, s->zeros, s->nzeros * sizeof(struct quad));
+
+        s->zeros = grown;
+        s->zeros_cap = cap;
+    }
+
+    s->zeros[s->nzeros++] = (struct quad){
+        .op = op,
+        .target = qval_of(s->t, target),
+        .src1 = qval_of(s->t, src1),
+        .src2 = qval_of(s->t, src2),
+    };
+}
+
+// v's value before anything's been stored to it
+static astn zero_of(struct ssa *s, struct var *v) {
+    if (v->zero)
+        return v->zero;
+
+    ir_type_E t = ir_type(v->qtype);
+    astn z = simple_constant_alloc(0);
+    z->Num.number.is_signed = is_integer(v->qtype) && type_is_signed(t);
+
+    switch (t) {
+        case IR_i32:
+        case IR_u32:
+            v->zero = z;
+            break;
+
+        case IR_i64:
+        case IR_u64:
+            z->Num.number.aux_type = s_LONG;
+            v->zero = z;
+            break;
+
+        case IR_i8:
+        case IR_u8:
+            z->Num.number.aux_type = s_CHARLIT;
+            v->zero = z;
+            break;
+
+        default:
+            // no literal of that type (pointers, shorts), so make one
+            v->zero = new_qtemp(v->qtype);
+            z->Num.number.is_signed = true;
+
+            if (t == IR_ptr)
+                zero_quad(s, IR_OP_INTTOPTR, v->zero, z, NULL);
+            else
+                zero_quad(s, IR_OP_ADD, v->zero, z, z);
+            break;
+    }
+
+    return v->zero;
+}
+
+static astn reaching(struct ssa *s, struct var *v) {
+    return v->cur ? v->cur : zero_of(s, v);
+}
+
+static void set_cur(struct ssa *s, struct var *v, astn val) {
+    if (s->nundo == s->undo_cap) {
+        unsigned cap = s->undo_cap ? s->undo_cap * 2 : 64;
+        struct undo *grown = pass_alloc(cap * sizeof(struct undo));
+
+        if (s->nundo)
+            memcpy(grown, s->undo, s->nundo * sizeof(struct undo));
+
+        s->undo = grown;
+        s->undo_cap = cap;
+    }
+
+    s->undo[s->nundo++] = (struct undo){v, v->cur};
+    v->cur = val;
+}
+
+/*
+ * Walk down the dominator tree from block i, replacing each load from a
+ * local with the value stored to it last, and filling in what the phis of
+ * the blocks we go on to get from here. The loads, stores and allocas go.
+ */
+static void rename_block(struct ssa *s, unsigned i) {
+    const struct block *b = &s->b[i];
+    unsigned mark = s->nundo;
+
+    for (struct phi *p = b->phis; p; p = p->next)
+        set_cur(s, &s->v[p->var], p->target);
+
+    BB bb = b->bb;
+    for (unsigned k = 0; k < bb->nquads; k++) {
+        quad q = &bb->quads[k];
+        struct var *v;
+
+        switch (q->op) {
+            case IR_OP_ALLOCA:
+                if (var_for(s, qa(s->t, q->target)))
+                    q->op = IR_OP_UNKNOWN;
+                break;
+
+            case IR_OP_LOAD:
+                v = var_for(s, qa(s->t, q->src1));
+                if (v) {
+                    s->repl[qa(s->t, q->target)->Qtemp.tempno] = reaching(s, v);
+                    q->op = IR_OP_UNKNOWN;
+                }
+                break;
+
+            case IR_OP_STORE:
+                v = var_for(s, qa(s->t, q->target));
+                if (v) {
+                    set_cur(s, v, resolve(s, qa(s->t, q->src1)));
+                    q->op = IR_OP_UNKNOWN;
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    for (unsigned e = 0; e < bb->nsuccs; e++) {
+        const_BB to = bb->succs[e];
+
+        for (struct phi *p = s->b[to->rpo].phis; p; p = p->next)
+            for (unsigned k = 0; k < to->npreds; k++)
+                if (to->preds[k] == bb)
+                    p->vals[k] = reaching(s, &s->v[p->var]);
+    }
+
+    for (unsigned k = 0; k < bb->nkids; k++)
+        rename_block(s, bb->kids[k]->rpo);
+
+    while (s->nundo > mark) {
+        s->nundo--;
+        s->undo[s->nundo].v->cur = s->undo[s->nundo].was;
+    }
+}
+
+static bool same_value(astn a, astn b) {
+    if (a == b)
+        return true;
+
+    return a->type == ASTN_NUM && b->type == ASTN_NUM &&
+           a->Num.number.integer == b->Num.number.integer && ir_type(a) == ir_type(b);
+}
+
+// a phi whose every value is the same one (or itself) is just that value
+static void drop_trivial_phis(struct ssa *s) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        for (unsigned i = 0; i < s->nb; i++) {
+            for (struct phi *p = s->b[i].phis; p; p = p->next) {
+                if (p->gone)
+                    continue;
+
+                astn only = NULL;
+                bool trivial = true;
+                for (unsigned k = 0; k < p->npred && trivial; k++) {
+                    astn val = resolve(s, p->vals[k]);
+                    if (val == p->target)
+                        continue;
+
+                    if (!only)
+                        only = val;
+                    else if (!same_value(only, val))
+                        trivial = false;
+                }
+
+                if (!trivial)
+                    continue;
+
+                // with nothing but itself, it's in a loop nothing enters
+                s->repl[p->target->Qtemp.tempno] = only ? only : zero_of(s, &s->v[p->var]);
+                p->gone = true;
+                changed = true;
+            }
+        }
+    }
+}
+
+static void mark_live(struct ssa *s, astn a, struct phi **work) {
+    a = resolve(s, a);
+    if (!a || a->type != ASTN_QTEMP || a->Qtemp.name || a->Qtemp.tempno >= s->nrepl)
+        return;
+
+    struct phi *p = s->phi_of[a->Qtemp.tempno];
+    if (p && !p->live) {
+        p->live = true;
+        p->work = *work;
+        *work = p;
+    }
+}
+
+static void mark_live_operand(struct ssa *s, qval val, struct phi **work) {
+    astn a = qa(s->t, val);
+    if (a && a->type == ASTN_LIST) {
+        for (astn l = a; l; l = list_next(l))
+            mark_live(s, list_data(l), work);
+    } else {
+        mark_live(s, a, work);
+    }
+}
+
+// the phis something other than a dead phi uses
+static void mark_live_phis(struct ssa *s) {
+    s->phi_of = pass_alloc(s->nrepl * sizeof(struct phi *));
+    for (unsigned i = 0; i < s->nb; i++)
+        for (struct phi *p = s->b[i].phis; p; p = p->next)
+            if (!p->gone)
+                s->phi_of[p->target->Qtemp.tempno] = p;
+
+    struct phi *work = NULL;
+    for (unsigned i = 0; i < s->nb; i++) {
+        BB bb = s->b[i].bb;
+        for (unsigned k = 0; k < bb->nquads; k++) {
+            const_quad q = &bb->quads[k];
+            if (q->op == IR_OP_UNKNOWN)
+                continue;
+
+            mark_live_operand(s, q->target, &work);
+            mark_live_operand(s, q->src1, &work);
+            mark_live_operand(s, q->src2, &work);
+            mark_live_operand(s, q->src3, &work);
+        }
+    }
+
+    while (work) {
+        struct phi *p = work;
+        work = p->work;
+
+        for (unsigned k = 0; k < p->npred; k++)
+            mark_live(s, p->vals[k], &work);
+    }
+}
+
+static qval rewrite(struct ssa *s, qval val) {
+    astn a = qa(s->t, val);
+    if (!a)
+        return val;
+
+    if (a->type == ASTN_LIST) {
+        for (astn l = a; l; l = list_next(l)) {
+            l->List.me = resolve(s, list_data(l));
+            if (l->List.me && l->List.me->type == ASTN_QTEMP)
+                qval_of(s->t, l->List.me); // so renumber() finds it
+        }
+        return val;
+    }
+
+    astn r = resolve(s, a);
+    if (r == a)
+        return val;
+
+    // a view of a pointer at another type stays one (see convert_to_ptr())
+    if (a->type == ASTN_QTEMP && r->type == ASTN_QTEMP && !r->Qtemp.name &&
+        a->Qtemp.qtype != r->Qtemp.qtype && ir_type_matches(a, IR_ptr)) {
+        astn view = astn_alloc(ASTN_QTEMP);
+        *view = *r;
+        view->Qtemp.qtype = a->Qtemp.qtype;
+        view->Qtemp.handle = QV_NONE;
+        r = view;
+    }
+
+    return qval_of(s->t, r);
+}
+
+// the live phis as IR_OP_PHI quads, then what's left of each block, with the operands renamed
+static void rebuild(struct ssa *s) {
+    for (unsigned i = 0; i < s->nb; i++) {
+        const struct block *b = &s->b[i];
+        BB bb = b->bb;
+
+        unsigned n = i == 0 ? s->nzeros : 0;
+        for (struct phi *p = b->phis; p; p = p->next)
+            n += p->live && !p->gone;
+        for (unsigned k = 0; k < bb->nquads; k++)
+            n += bb->quads[k].op != IR_OP_UNKNOWN;
+
+        quad quads = ir_alloc((n ? n : 1) * sizeof(struct quad));
+        mem_note(MEM_QUADS, (n ? n : 1) * sizeof(struct quad));
+        unsigned nq = 0;
+
+        if (i == 0)
+            for (unsigned k = 0; k < s->nzeros; k++)
+                quads[nq++] = s->zeros[k];
+
+        for (struct phi *p = b->phis; p; p = p->next) {
+            if (!p->live || p->gone)
+                continue;
+
+            astn vals = NULL, vals_tail = NULL, from = NULL, from_tail = NULL;
+            for (unsigned k = 0; k < bb->npreds; k++) {
+                astn pred = wrap_bb(bb->preds[k]);
+                qval_of(s->t, pred); // so it has a handle, and a number if it's the entry
+
+                if (!vals) {
+                    vals = vals_tail = list_alloc(resolve(s, p->vals[k]));
+                    from = from_tail = list_alloc(pred);
+                } else {
+                    vals_tail = list_append(resolve(s, p->vals[k]), vals_tail);
+                    from_tail = list_append(pred, from_tail);
+                }
+            }
+
+            quads[nq++] = (struct quad){
+                .op = IR_OP_PHI,
+                .target = qval_of(s->t, p->target),
+                .src1 = qval_of(s->t, vals),
+                .src2 = qval_of(s->t, from),
+            };
+        }
+
+        for (unsigned k = 0; k < bb->nquads; k++) {
+            struct quad q = bb->quads[k];
+            if (q.op == IR_OP_UNKNOWN)
+                continue;
+
+            q.target = rewrite(s, q.target);
+            q.src1 = rewrite(s, q.src1);
+            q.src2 = rewrite(s, q.src2);
+            q.src3 = rewrite(s, q.src3);
+            quads[nq++] = q;
+        }
+
+        bb->quads = quads;
+        bb->nquads = nq;
+        bb->cap = n ? n : 1;
+    }
+}
+
+void ssa_mem2reg(void) {
+    BBL bbl = irst.current_bbl;
+    if (bbl == irst.root_bbl)
+        die("mem2reg outside of a function.");
+
+    BB save = irst.bb;
+    bb_active(bbl->me); // so what we allocate goes with the function
+
+    struct cfg *cfg = cfg_build();
+    struct ssa s = {
+        .t = &bbl->tab,
+        .nb = cfg->nblocks,
+        .b = pass_alloc(cfg->nblocks * sizeof(struct block)),
+    };
+
+    for (unsigned i = 0; i < s.nb; i++)
+        s.b[i].bb = cfg->rpo[i];
+
+    frontiers(&s);
+    find_vars(&s);
+    place_phis(&s);
+
+    s.nrepl = (unsigned)irst.tempno;
+    s.repl = pass_alloc((s.nrepl ? s.nrepl : 1) * sizeof(astn));
+
+    rename_block(&s, 0);
+    drop_trivial_phis(&s);
+    mark_live_phis(&s);
+    rebuild(&s);
+
+    bbl->me->name = "entry";
+    pass_renumber();
+
+    bb_active(save);
+}
@@ -0,0 +1,27 @@
+/*
+ * ir_ssa.h
+ *
+ * Promoting locals to SSA values (mem2reg). gen_fn() gives every local and
+ * parameter an alloca and goes through memory for each read and write; this
+ * rewrites the function just generated so that the scalar locals whose
+ * address is never taken - the ones that are only ever loaded from and
+ * stored to - live in temps instead, with IR_OP_PHI quads where control flow
+ * joins. It's the usual construction (Cytron et al.): phis go on the iterated
+ * dominance frontiers of the stores, then a walk down the dominator tree
+ * renames each load to the value that reaches it. Phis that turn out to pick
+ * the same value from every side, or that nothing uses, are dropped again.
+ *
+ * It works on the function's CFG (see ir_cfg.h), which throws away quads
+ * after a block's terminator and blocks nothing can reach. Then the entry
+ * block is named (phis refer to it), and the temps are renumbered in order,
+ * as the textual IR wants them. A local read before anything is stored to
+ * it reads as zero.
+ */
+
+#ifndef IR_SSA_H
+#define IR_SSA_H
+
+// on the function gen_fn() just finished
+void ssa_mem2reg(void);
+
+#endif
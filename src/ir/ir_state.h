@@ -26,16 +26,32 @@ struct ir_state {
     // current BB
     BB bb;
 
+    // number of root quads already printed ahead of a function
+    unsigned root_flushed;
+
     // total number of qtemps
     int tempno;
 
     // list of anonymous lvalues to declare at end
     struct astn *anons;
 
-    // uniqueness counter
+    // uniqueness counter, for names that have to be unique in the whole unit
     int uniq;
+
+    // and for names within the current function (its blocks, string literals
+    // and static locals), which start over with each one so that a function
+    // comes out the same whatever came before it
+    int fn_uniq;
+
+    // function arena statistics, for -v
+    struct {
+        unsigned count;
+        size_t total;
+        size_t peak;
+        const char *peak_fn;
+    } fn_arenas;
 };
 
-extern struct ir_state irst;
+// each compilation has one, irst (see compilation.h)
 
 #endif
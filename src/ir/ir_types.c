@@ -2,9 +2,17 @@
 
 #include "ir.h"
 #include "ir_arithmetic.h"
+#include "ir_cf.h"
 #include "ir_state.h"
 #include "ir_util.h"
 
+#include <string.h>
+
+#include "compilation.h"
+#include "const_expr.h"
+#include "memstat.h"
+#include "typetab.h"
+
 bool is_integer(astn a) {
     if (a->type != ASTN_QTYPE)
         return is_integer(get_qtype(a));
@@ -44,20 +52,18 @@ bool ir_type_matches(astn a, ir_type_E t) {
 astn emit_struct_def(astn t) {
     ast_check(t, ASTN_TYPE, "");
 
-    BB save = irst.bb;
-    irst.bb = irst.root_bbl->me;
+    BB save = bb_jumproot();
 
     astn target = qtemp_alloc(-1, qtype_alloc(IR_struct));
     target->Qtemp.qtype->Qtype.derived_type = t;
     t->Type.tagtype.symbol->qptr = target;
 
-    char *name;
-    asprintf(&name, "struct.%s.%d", t->Type.tagtype.symbol->ident, irst.uniq++);
-    target->Qtemp.name = name;
+    target->Qtemp.name = arena_sprintf(&tu_arena, "struct.%s.%d", t->Type.tagtype.symbol->ident, irst.uniq++);
+    mem_note(MEM_STRINGS, strlen(target->Qtemp.name) + 1);
 
     emit(IR_OP_DEFGLOBAL, t, NULL, NULL);
 
-    irst.bb = save;
+    bb_active(save);
 
     return target;
 }
@@ -93,7 +99,7 @@ astn get_qtype(astn t) {
                     qunimpl(t, "Unsupported number literal int_type in IR:(");
             }
 
-            return qtype_alloc(ret);
+            return qtype_get(ret, NULL);
 
         case ASTN_SYMPTR:;
             return get_qtype(t->Symptr.e->type);
@@ -102,6 +108,10 @@ astn get_qtype(astn t) {
             return get_qtype(t->Declrec.e->type);
 
         case ASTN_TYPE:
+            t = type_intern(t);
+            if (t->Type.info && t->Type.info->qtype)
+                return t->Type.info->qtype;
+
             if (t->Type.is_derived) {
                 switch (t->Type.derived.type) {
                     case t_PTR:
@@ -155,8 +165,9 @@ astn get_qtype(astn t) {
                         qunimpl(t, "Unsupported type in IR :(");
                 }
             }
-            astn q = qtype_alloc(ret);
-            q->Qtype.derived_type = ret_der;
+            astn q = qtype_get(ret, ret_der);
+            if (t->Type.info)
+                t->Type.info->qtype = q;
             return q;
 
         case ASTN_QTEMP:
@@ -189,10 +200,14 @@ astn get_qtype(astn t) {
                 case ASTN_UNOP:;
                     n = get_qtype(utarget); // recurse and get end
 
-                    if (ir_dtype(n)->Type.is_derived)
-                        n->Qtype.derived_type = get_qtype(ir_dtype(n)->Type.derived.target);
-                    else // not derived!
+                    if (ir_dtype(n)->Type.is_derived) {
+                        // n may be shared, so don't touch it
+                        astn d = qtype_alloc(ir_type(n));
+                        d->Qtype.derived_type = get_qtype(ir_dtype(n)->Type.derived.target);
+                        n = d;
+                    } else { // not derived!
                         n = get_qtype(ir_dtype(n));
+                    }
                     return n;
 
                 default:
@@ -203,13 +218,10 @@ astn get_qtype(astn t) {
             qunimpl(t, "Tried to get type of binop!");
 
         case ASTN_FNCALL:
-            n = qtype_alloc(IR_fn);
-            n->Qtype.derived_type = t->Fncall.fn->Symptr.e->type->Type.derived.target;
-            return n;
+            return qtype_get(IR_fn, t->Fncall.fn->Symptr.e->type->Type.derived.target);
 
         case ASTN_QBB:
-            n = qtype_alloc(IR_label);
-            return n;
+            return qtype_get(IR_label, NULL);
 
         case ASTN_QTYPECONTAINER:
             return get_qtype(t->Qtypecontainer.qtype);
@@ -220,7 +232,7 @@ astn get_qtype(astn t) {
 }
 
 bool type_is_signed(ir_type_E t) {
-    static bool _type_is_signed[IR_TYPE_INTEGER_MAX] = {
+    static const bool _type_is_signed[IR_TYPE_INTEGER_MAX] = {
         [IR_i1] = false,
         [IR_u8] = false,
         [IR_i8] = true,
@@ -269,7 +281,7 @@ astn ptr_to_int(astn a, astn kind) {
     if (!is_integer(kind))
         qunimpl(kind, "Passed non-integer kind to ptr_to_int!");
 
-    astn irt = qtype_alloc(ir_type(kind));
+    astn irt = qtype_get(ir_type(kind), NULL);
     astn target = qprepare_target(NULL, irt);
 
     emit(IR_OP_PTRTOINT, target, a, NULL);
@@ -286,6 +298,7 @@ astn convert_to_ptr(astn a, astn kind) {
         astn q = astn_alloc(ASTN_QTEMP); // about to overwrite
         *q = *a;
         q->Qtemp.qtype = get_qtype(kind);
+        q->Qtemp.handle = QV_NONE; // a different view, so a different value
 
         return q;
     }
@@ -293,7 +306,7 @@ astn convert_to_ptr(astn a, astn kind) {
     if (is_integer(a)) {
         astn rval = gen_rvalue(a, NULL);
 
-        astn ptr = qprepare_target(NULL, qtype_alloc(IR_ptr));
+        astn ptr = qprepare_target(NULL, qtype_get(IR_ptr, NULL));
         ptr->Qtype.derived_type = ir_dtype(kind);
 
         emit(IR_OP_INTTOPTR, ptr, rval, NULL);
@@ -311,6 +324,16 @@ astn convert_integer_type(astn a, ir_type_E t) {
     if (a_type == t)
         return a;
 
+    // a constant is converted here, unless it's to a type no number has
+    size_t bits = ir_type_size[t] * 8;
+    if (a->type == ASTN_NUM && t != IR_i1 && (bits == 8 || bits == 32 || bits == 64)) {
+        astn n = astn_alloc(ASTN_NUM);
+        n->context = a->context;
+        n->Num.number = a->Num.number;
+        const_convert(&n->Num.number, (unsigned)bits, type_is_signed(t));
+        return n;
+    }
+
     bool a_is_signed = type_is_signed(a_type);
 
     if (a_is_signed && (a_type - t) == 1) // iN to uN
@@ -319,7 +342,7 @@ astn convert_integer_type(astn a, ir_type_E t) {
     if (!a_is_signed && (t - a_type) == 1) // uN to iN
         return a;
 
-    astn new_t = qtype_alloc(t);
+    astn new_t = qtype_get(t, NULL);
     astn target = qprepare_target(NULL, new_t);
 
     if (t > a_type) {
@@ -412,10 +435,10 @@ astn get_arithmetic_conversions_type(astn a, astn b) {
     if (!is_integer(a) || !is_integer(b))
         die("Not arithmetic!");
 
-    astn ap = qtype_alloc(get_integer_promotions_type(a));
-    astn bp = qtype_alloc(get_integer_promotions_type(b));
+    astn ap = qtype_get(get_integer_promotions_type(a), NULL);
+    astn bp = qtype_get(get_integer_promotions_type(b), NULL);
 
-    return qtype_alloc(get_integer_conversions_type(ap, bp));
+    return qtype_get(get_integer_conversions_type(ap, bp), NULL);
 }
 
 // The Sneaky Integer Promotions
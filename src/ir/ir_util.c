@@ -1,7 +1,58 @@
 #include "ir_util.h"
 
+#include "arena.h"
 #include "ir.h"
 #include "ir_state.h"
+#include "ir_types.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "compilation.h"
+#include "memstat.h"
+
+/**
+ * The arena IR memory should come from right now. Anything hanging off the
+ * root block (globals, declarations) lives as long as the translation unit;
+ * everything else belongs to the current function and is released once the
+ * function has been printed.
+ */
+struct arena *ir_arena(void) {
+    if (irst.bb == irst.root_bbl->me || irst.current_bbl == irst.root_bbl)
+        return &tu_arena;
+
+    return &irst.current_bbl->arena;
+}
+
+/**
+ * Allocate zeroed IR memory from ir_arena().
+ */
+void *ir_alloc(size_t size) {
+    return arena_alloc(ir_arena(), size);
+}
+
+/**
+ * Record the current function's arena usage once we're done generating it.
+ */
+void ir_note_fn_arena(void) {
+    const struct arena *a = &irst.current_bbl->arena;
+
+    irst.fn_arenas.count++;
+    irst.fn_arenas.total += a->peak;
+
+    if (a->peak > irst.fn_arenas.peak) {
+        irst.fn_arenas.peak = a->peak;
+        irst.fn_arenas.peak_fn = a->name;
+    }
+}
+
+void ir_arena_report(FILE *f) {
+    arena_report(&tu_arena, f);
+    fprintf(f, "arena %-12s peak %10zu bytes (in %s), total %zu bytes over %u function(s)\n",
+            "fn", irst.fn_arenas.peak,
+            irst.fn_arenas.peak_fn ? irst.fn_arenas.peak_fn : "-",
+            irst.fn_arenas.total, irst.fn_arenas.count);
+}
 
 /**
  * Allocate and return a new qtemp.
@@ -29,36 +80,213 @@ astn qprepare_target(astn target, astn qtype) {
  * Get last quad in basic block.
  */
 quad last_in_bb(BB b) {
-    quad q = b->current;
-    if (!q) return NULL;
+    if (!b->nquads) return NULL;
 
-    while (q->next) q = q->next;
+    return &b->quads[b->nquads - 1];
+}
 
-    return q;
+/**
+ * The value table quads emitted right now refer into.
+ */
+struct qtab *ir_qtab(void) {
+    if (irst.bb == irst.root_bbl->me || irst.current_bbl == irst.root_bbl)
+        return &irst.root_bbl->tab;
+
+    return &irst.current_bbl->tab;
+}
+
+static bool is_int_num(astn a) {
+    return a->type == ASTN_NUM && a->Num.number.aux_type != s_UNDEF && a->Num.number.aux_type < s_REAL;
+}
+
+static qval qtab_add(struct qtab *t, qv_kind_E kind, astn a) {
+    if (t->count == t->cap) {
+        unsigned cap = t->cap ? t->cap * 2 : 64;
+        astn *vals = arena_alloc(ir_arena(), cap * sizeof(astn));
+        unsigned char *types = arena_alloc(ir_arena(), cap);
+        mem_note(MEM_VALUES, cap * (sizeof(astn) + 1));
+
+        if (t->count) {
+            memcpy(vals, t->vals, t->count * sizeof(astn));
+            memcpy(types, t->types, t->count);
+        }
+
+        t->vals = vals;
+        t->types = types;
+        t->cap = cap;
+    }
+
+    // index 0 is never handed out, so that a zero qval means no operand
+    if (!t->count)
+        t->vals[t->count++] = NULL;
+
+    if (t->count > QV_INDEX_MASK)
+        die("Too many values in one function.");
+
+    t->vals[t->count] = a;
+    bool typed = kind == QV_TEMP || kind == QV_GLOBAL || (kind == QV_CONST && is_int_num(a));
+    t->types[t->count] = typed ? ir_type(a) : IR_TYPE_UNDEF;
+    return QV_MAKE(kind, t->count++);
+}
+
+static unsigned long long key_hash(astn a) {
+    unsigned long long h = (uintptr_t)a;
+    if (a->type == ASTN_SYMPTR)
+        h = (uintptr_t)a->Symptr.e;
+    else if (a->type == ASTN_NUM)
+        h = a->Num.number.integer ^ (unsigned long long)a->Num.number.aux_type << 56 ^
+            (unsigned long long)a->Num.number.is_signed << 63;
+
+    h *= 0x9e3779b97f4a7c15ull;
+    return h ^ h >> 32;
+}
+
+// the same constant: its type and value, or the same global or function
+static bool same_key(astn a, astn b) {
+    if (a->type == ASTN_SYMPTR && b->type == ASTN_SYMPTR)
+        return a->Symptr.e == b->Symptr.e;
+
+    if (a->type != ASTN_NUM || b->type != ASTN_NUM)
+        return a == b;
+
+    return a->Num.number.integer == b->Num.number.integer &&
+           a->Num.number.aux_type == b->Num.number.aux_type &&
+           a->Num.number.is_signed == b->Num.number.is_signed;
+}
+
+static void index_put(qval *index, unsigned cap, const struct qtab *t, qval v) {
+    unsigned i = key_hash(qa(t, v)) & (cap - 1);
+    while (index[i])
+        i = (i + 1) & (cap - 1);
+
+    index[i] = v;
 }
 
+// a's handle if an equal constant or global is in t already, else a new one
+static qval qtab_intern(struct qtab *t, qv_kind_E kind, astn a) {
+    if (t->nindex * 4 >= t->index_cap * 3) {
+        unsigned cap = t->index_cap ? t->index_cap * 2 : 16;
+        qval *index = arena_alloc(ir_arena(), cap * sizeof(qval));
+        mem_note(MEM_VALUES, cap * sizeof(qval));
+
+        for (unsigned i = 0; i < t->index_cap; i++)
+            if (t->index[i])
+                index_put(index, cap, t, t->index[i]);
+
+        t->index = index;
+        t->index_cap = cap;
+    }
+
+    unsigned i = key_hash(a) & (t->index_cap - 1);
+    for (; t->index[i]; i = (i + 1) & (t->index_cap - 1)) {
+        qval v = t->index[i];
+        if (QV_KIND(v) == kind && same_key(qa(t, v), a))
+            return v;
+    }
+
+    qval v = qtab_add(t, kind, a);
+    t->index[i] = v;
+    t->nindex++;
+    return v;
+}
+
+/**
+ * Get the handle for operand a in table t, adding it if necessary. Local
+ * temps and blocks remember their handle, and integer constants, globals
+ * and the functions called are interned, so they're only stored once.
+ */
+qval qval_of(struct qtab *t, astn a) {
+    if (!a)
+        return QV_NONE;
+
+    switch (a->type) {
+        case ASTN_QTEMP:
+            if (a->Qtemp.name)
+                return qtab_intern(t, QV_GLOBAL, a);
+
+            if (!a->Qtemp.handle)
+                a->Qtemp.handle = qtab_add(t, QV_TEMP, a);
+
+            return a->Qtemp.handle;
+
+        case ASTN_NUM:
+            if (!is_int_num(a))
+                return qtab_add(t, QV_CONST, a);
+
+            return qtab_intern(t, QV_CONST, a);
+
+        case ASTN_SYMPTR: // a function called
+            return qtab_intern(t, QV_OTHER, a);
+
+        case ASTN_QBB:;
+            BB bb = a->Qbb.bb;
+            if (!bb->handle)
+                bb->handle = qtab_add(t, QV_BB, a);
+
+            return bb->handle;
+
+        default:
+            return qtab_add(t, QV_OTHER, a);
+    }
+}
+
+/**
+ * Get the astn behind handle v in table t.
+ */
+astn qa(const struct qtab *t, qval v) {
+    if (!v)
+        return NULL;
+
+    if (QV_INDEX(v) >= t->count)
+        die("Bad qval.");
+
+    return t->vals[QV_INDEX(v)];
+}
+
+/**
+ * The IR type of handle v's value in table t, without going to its astn:
+ * IR_TYPE_UNDEF for blocks and the other operands.
+ */
+ir_type_E qv_type(const struct qtab *t, qval v) {
+    if (!v)
+        return IR_TYPE_UNDEF;
+
+    if (QV_INDEX(v) >= t->count)
+        die("Bad qval.");
+
+    return t->types[QV_INDEX(v)];
+}
+
+/**
+ * Append a quad to the current block. The returned pointer is only good until
+ * the next quad is emitted into the same block.
+ */
 quad emit4(ir_op_E op, astn target, astn src1, astn src2, astn src3) {
-    quad q = safe_calloc(1, sizeof(struct quad));
+    struct qtab *t = ir_qtab();
+    BB bb = irst.bb;
+
+    if (bb->nquads == bb->cap) {
+        unsigned cap = bb->cap ? bb->cap * 2 : 8;
+        quad quads = ir_alloc(cap * sizeof(struct quad));
+        mem_note(MEM_QUADS, cap * sizeof(struct quad));
+
+        if (bb->nquads)
+            memcpy(quads, bb->quads, bb->nquads * sizeof(struct quad));
+
+        bb->quads = quads;
+        bb->cap = cap;
+    }
+
+    quad q = &bb->quads[bb->nquads++];
 
     *q = (struct quad){
         .op = op,
-        .prev = 0,
-        .next = 0,
-        .target = target,
-        .src1 = src1,
-        .src2 = src2,
-        .src3 = src3,
+        .target = qval_of(t, target),
+        .src1 = qval_of(t, src1),
+        .src2 = qval_of(t, src2),
+        .src3 = qval_of(t, src3),
     };
 
-    if (!irst.bb->first) {
-        irst.bb->first = q;
-        irst.bb->current = q;
-    } else {
-        irst.bb->current->next = q;
-        q->prev = irst.bb->current;
-        irst.bb->current = q;
-    }
-
     return q;
 }
 
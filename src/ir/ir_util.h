@@ -2,10 +2,16 @@
 #define IR_UTIL_H
 
 #include "ast.h"
+#include "compilation.h"
 #include "ir.h"
 
 #include <stdio.h>
 
+struct arena *ir_arena(void);
+void *ir_alloc(size_t size);
+void ir_note_fn_arena(void);
+void ir_arena_report(FILE *f);
+
 BB bb_alloc(void);
 BBL bbl_next(const BBL bbl);
 BB bbl_this(const BBL bbl);
@@ -15,6 +21,11 @@ astn new_qtemp(astn qtype);
 astn qprepare_target(astn target, astn qtype);
 quad last_in_bb(BB bb);
 
+struct qtab *ir_qtab(void);
+astn qa(const struct qtab *t, qval v);
+qval qval_of(struct qtab *t, astn a);
+ir_type_E qv_type(const struct qtab *t, qval v);
+
 quad emit(ir_op_E op, astn target, astn src1, astn src2);
 quad emit4(ir_op_E op, astn target, astn src1, astn src2, astn src4);
 
@@ -23,7 +34,7 @@ quad emit4(ir_op_E op, astn target, astn src1, astn src2, astn src4);
         fprintf(stderr, "\n\n!!! Near %s:%d -", context.filename, context.lineno);  \
     }
 
-#define qwarn(...)  fprintf(stderr, "\n" __VA_ARGS__);
+#define qwarn(...)  (dcc_cc->warnings++, fprintf(stderr, "\n" __VA_ARGS__));
 
 #define qunimpl(node, msg)  \
     {                       \
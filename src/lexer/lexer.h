@@ -2,19 +2,25 @@
 #define LEXER_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
 
 #include "location.h"
 
-#define FRIENDLYFN context.filename ? context.filename : "<stdin>"
+#define FRIENDLYFN(loc) ((loc).filename ? (loc).filename : "<stdin>")
 
-int yylex(void);
-void print_context(bool warn);
+// the scanner is reentrant; its state is opaque outside of lexer.l
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void *yyscan_t;
+#endif
 
-struct context {
-    char* filename;
-    int lineno;
-};
+struct dcc_compilation;
 
-extern YYLTYPE context;
+yyscan_t lexer_open_buffer(struct dcc_compilation *cc, const char *src, size_t len);
+yyscan_t lexer_open_file(struct dcc_compilation *cc, FILE *in);
+void lexer_close(yyscan_t scanner);
+
+void print_context(bool warn);
 
 #endif
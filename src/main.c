@@ -1,42 +1,84 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // copy_file_range()
+#endif
+
 #include <errno.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
 #include <sys/utsname.h>
+#include <time.h>
 #include <unistd.h>
 
-#include "debug.h"
-#include "ir_print.h"
-#include "parser.tab.h"
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#include "cache.h"
+#include "compilation.h"
+#include "dcc.h"
+#include "ppcache.h"
+#include "server.h"
 #include "util.h"
 
 #define DCC_VERSION "1.0.2"
 #define DCC_ARCHITECTURE "x86_64"
 
-FILE *tmp, *tmp2;
-
 static struct opt {
     int debug;
+    bool dump_ir;
     bool asm_out;
+    enum {
+        BACKEND_LLVM,       // LLVM IR, through llc or the LLVM API
+        BACKEND_NATIVE,     // our own x86-64 assembly
+    } backend;
+    bool external_as;       // have gcc assemble the native backend's output
+    bool time_report;
+    bool mem_report;
+    const char *time_trace; // file for the Chrome trace, if any
+    int opt_level;
+    bool pass_stats;
+    const char *dump_after; // pass to print the IR after, if any
     bool link;
+    long jobs;
     const char* out_file;
-    const char* in_file;
+    const char** in_files;
+    int in_count;
 } opt = {
     .debug = 0,
     .asm_out = false,
     .out_file = NULL,
     .link = 1,
+    .opt_level = 1,
+};
+
+// one input file and what we make of it
+struct unit {
+    const char *in_file;
+    const char *out_file;
+    bool link;          // assemble and link straight into out_file
+
+    pid_t pid;          // worker compiling it, if any
+    FILE *diag;         // the worker's stderr, shown once it's done
+    FILE *trace;        // and its trace events, added to ours
+    double start;
+    double secs;
+    int status;
 };
 
 static struct {
     struct utsname uname_data;
-    bool is_darwin;
 } host_info;
 
+// -ftime-trace's output, a JSON array of trace events
+static FILE *trace;
+
 static void print_usage_additional(void) {
     eprintf(
         "\n Pragmas:"
@@ -54,26 +96,79 @@ static void print_usage_additional(void) {
 }
 
 static void print_usage(void) {
-    eprintf("Usage: ./dcc [OPTIONS] input_file"
+    eprintf("Usage: ./dcc [OPTIONS] input_file..."
+        "\n        ./dcc --server socket"
+        "\n        ./dcc --client socket [OPTIONS] input_file..."
+        "\n        ./dcc --cache-stats"
         "\n Options:"
         "\n   -h              show extended usage"
         "\n   -c              do not link"
         "\n   -o output_file  specify output file"
+        "\n   -j jobs         compile up to this many files at once (default: one per CPU)"
         "\n   -S              output assembly only"
         "\n   -v              debug mode:"
-        "\n                         -v: enable INFO messages"
+        "\n                         -v: enable INFO messages, report arena, symtab, intern, type usage"
         "\n                        -vv: enable VERBOSE messages"
         "\n                       -vvv: enable DEBUG messages"
         "\n"
         "\n                     Note that this overrides any in-source directives."
         "\n   -V              print version information"
+        "\n   -O<level>       optimization level: 0 (none), 1 (the default: locals to SSA temps) or 2"
+        "\n                   (-O alone is -O1)"
+        "\n   -fdump-ir       also print the generated LLVM IR to stderr"
+        "\n   -fbackend=name  code generator: llvm (default) or native (x86-64 assembly)"
+        "\n   -fno-integrated-as  assemble the native backend's output with gcc rather than dcc"
+        "\n   -ftime-report   print the time spent in each compiler phase and stage"
+        "\n   -ftime-trace=file   write a Chrome trace of the stages, phases and functions to file"
+        "\n   -fmem-report    print what the compiler allocated, by category, and each stage's peak RSS"
+        "\n   -fpass-stats    print each pass's runs, time, and quads removed and added"
+        "\n   -fdump-after=pass   print each function to stderr after that pass (e.g. mem2reg)"
+        "\n                   (these turn off the cache, like -v)"
+        "\n"
+        "\n   --server socket           stay up, compiling for clients connecting to socket"
+        "\n   --client socket [...]     have the server on socket compile, with the usual options"
+        "\n                             (compiles here if there's no server)"
+        "\n   --cache-stats             show how the cache in $DCC_CACHE_DIR is doing"
+        "\n"
+        "\n Environment:"
+        "\n   DCC_CACHE_DIR   keep outputs here, and reuse them for the same preprocessed input"
+        "\n   DCC_CACHE_SIZE  cap on the cache's size, e.g. 500M (default: 1G)"
         "\n");
 }
 
+static void get_f_option(const char *f) {
+    if (!strcmp(f, "dump-ir")) {
+        opt.dump_ir = true;
+    } else if (!strcmp(f, "backend=llvm")) {
+        opt.backend = BACKEND_LLVM;
+    } else if (!strcmp(f, "backend=native")) {
+        opt.backend = BACKEND_NATIVE;
+    } else if (!strcmp(f, "integrated-as")) {
+        opt.external_as = false;
+    } else if (!strcmp(f, "no-integrated-as")) {
+        opt.external_as = true;
+    } else if (!strcmp(f, "pass-stats")) {
+        opt.pass_stats = true;
+    } else if (!strncmp(f, "dump-after=", strlen("dump-after=")) && f[strlen("dump-after=")]) {
+        opt.dump_after = f + strlen("dump-after=");
+        if (!pass_exists(opt.dump_after))
+            RED_ERROR("\nNo pass named '%s' to dump after", opt.dump_after);
+    } else if (!strcmp(f, "time-report")) {
+        opt.time_report = true;
+    } else if (!strcmp(f, "mem-report")) {
+        opt.mem_report = true;
+    } else if (!strncmp(f, "time-trace=", strlen("time-trace=")) && f[strlen("time-trace=")]) {
+        opt.time_trace = f + strlen("time-trace=");
+    } else {
+        print_usage();
+        RED_ERROR("\nUnknown option '-f%s'", f);
+    }
+}
+
 static void get_options(int argc, char** argv) {
     int a;
     opterr = 0;
-    while ((a = getopt(argc, argv, "hvcVSo:")) != -1) {
+    while ((a = getopt(argc, argv, "hvcVSo:f:j:O::")) != -1) {
         switch (a) {
             case 'h':
                 print_usage();
@@ -99,6 +194,24 @@ static void get_options(int argc, char** argv) {
             case 'c':
                 opt.link = false;
                 break;
+            case 'f':
+                get_f_option(optarg);
+                break;
+            case 'j':;
+                char *end;
+                opt.jobs = strtol(optarg, &end, 10);
+                if (*end || opt.jobs < 1)
+                    RED_ERROR("\nInvalid job count '%s'", optarg);
+                break;
+            case 'O':
+                // -O alone is -O1, as with gcc
+                if (!optarg)
+                    opt.opt_level = 1;
+                else if (optarg[0] >= '0' && optarg[0] <= '2' && !optarg[1])
+                    opt.opt_level = optarg[0] - '0';
+                else
+                    RED_ERROR("\nInvalid optimization level '%s' (dcc has -O0, -O1 and -O2)", optarg);
+                break;
             case '?':
                 print_usage();
                 RED_ERROR("\nUnknown option '%c'", optopt);
@@ -107,34 +220,32 @@ static void get_options(int argc, char** argv) {
         }
     }
 
-    switch (opt.debug) {
-        case 0:
-            break;
-        case 1:
-            debug_setlevel_INFO();
-            break;
-        case 2:
-            debug_setlevel_VERBOSE();
-            break;
-        case 3:
-        default:
-            debug_setlevel_DEBUG();
+    if (optind >= argc) {
+        RED_ERROR("No input file specified!");
     }
 
-    if (!opt.out_file) {
+    opt.in_files = (const char**)&argv[optind];
+    opt.in_count = argc - optind;
+
+    // -S and -c with several inputs give one output per input, named after it
+    bool per_file_out = opt.in_count > 1 && (opt.asm_out || !opt.link);
+    if (per_file_out && opt.out_file)
+        RED_ERROR("Cannot specify -o with -c or -S and multiple input files");
+
+    if (!opt.out_file && !per_file_out) {
         if (opt.asm_out)
-            opt.out_file = "out.ll";
+            opt.out_file = opt.backend == BACKEND_NATIVE ? "out.s" : "out.ll";
         else
             opt.out_file = opt.link ? "out.out" : "a.o";
     }
         //opt.out_file = opt.asm_out ? "a.S" : "a.out";
         //opt.out_file = "out.IR";
 
-    if (optind >= argc) {
-        RED_ERROR("No input file specified!");
+    if (!opt.jobs) {
+        opt.jobs = sysconf(_SC_NPROCESSORS_ONLN);
+        if (opt.jobs < 1)
+            opt.jobs = 1;
     }
-
-    opt.in_file = argv[optind];
 }
 
 static FILE* new_tmpfile(void) {
@@ -145,141 +256,740 @@ static FILE* new_tmpfile(void) {
     return f;
 }
 
-static void preprocess(void) {
-    FILE* f = new_tmpfile();
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double cpu_secs(const struct rusage *ru) {
+    return ru->ru_utime.tv_sec + ru->ru_utime.tv_usec / 1e6 +
+           ru->ru_stime.tv_sec + ru->ru_stime.tv_usec / 1e6;
+}
+
+// ru_maxrss is in kilobytes, except on macOS
+static long rss_kb(const struct rusage *ru) {
+    return dcc_is_host_darwin() ? ru->ru_maxrss / 1024 : ru->ru_maxrss;
+}
+
+/*
+ * A pipe whose ends don't leak into the other stages - otherwise a stage
+ * holding a stray write end would never see EOF.
+ */
+static void make_pipe(int fds[2]) {
+    if (pipe(fds))
+        RED_ERROR("Error creating pipe: %s", strerror(errno));
+
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+}
+
+// s as a JSON string
+static void trace_str(const char *s) {
+    fputc('"', trace);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fprintf(trace, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(trace, "\\u%04x", *s);
+        else
+            fputc(*s, trace);
+    }
+    fputc('"', trace);
+}
+
+// something process pid did, from start to end
+static void trace_span(const char *name, const char *cat, pid_t pid, double start, double end) {
+    fprintf(trace, "{\"name\":");
+    trace_str(name);
+    fprintf(trace, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d},\n",
+            cat, start * 1e6, (end - start) * 1e6, (int)pid, (int)pid);
+}
+
+// what to call process pid; the last event ends the array
+static void trace_name(pid_t pid, const char *name, bool last) {
+    fprintf(trace, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":", (int)pid);
+    trace_str(name);
+    fprintf(trace, "}}%s\n", last ? "\n]" : ",");
+}
+
+/*
+ * Copy the whole of file in_fd to out_fd, letting the kernel move the bytes
+ * where it can instead of bouncing them through a buffer of ours.
+ */
+static void copy_fd(int in_fd, int out_fd) {
+    struct stat st;
+    if (fstat(in_fd, &st))
+        RED_ERROR("Error copying output: %s", strerror(errno));
+
+    off_t off = 0;
+
+#ifdef __linux__
+    // file to file first, then file to anything
+    while (off < st.st_size && copy_file_range(in_fd, &off, out_fd, NULL, st.st_size - off, 0) > 0)
+        ;
+    while (off < st.st_size && sendfile(out_fd, in_fd, &off, st.st_size - off) > 0)
+        ;
+#endif
+
+    char buf[64 * 1024];
+    while (off < st.st_size) {
+        ssize_t n = pread(in_fd, buf, sizeof(buf), off);
+        if (n <= 0)
+            RED_ERROR("Error copying output: %s", n ? strerror(errno) : "short read");
+
+        for (ssize_t done = 0; done < n; ) {
+            ssize_t w = write(out_fd, buf + done, n - done);
+            if (w < 0 && errno != EINTR)
+                RED_ERROR("Error copying output: %s", strerror(errno));
+            done += w > 0 ? w : 0;
+        }
+        off += n;
+    }
+}
+
+// one process in the pipeline
+struct stage {
+    const char *name;
+    pid_t pid;
+    double start, end;
+    double cpu;
+    long rss_kb;        // peak
+};
+
+/*
+ * Start argv as stage s, reading in_fd and writing out_fd and err_fd (-1 to
+ * inherit ours). Doesn't wait for it.
+ */
+static void stage_start(struct stage *s, const char **argv, int in_fd, int out_fd, int err_fd) {
+    s->start = now();
+    fflush(NULL); // or a failed exec would flush our buffers a second time
 
-    switch (fork()) {
+    switch ((s->pid = fork())) {
         case -1:
-            RED_ERROR("Error forking for preprocessing: %s", strerror(errno));
+            RED_ERROR("Error forking for %s: %s", s->name, strerror(errno));
 
         case 0:
-            dup2(fileno(f), STDOUT_FILENO);
+            signal(SIGPIPE, SIG_DFL);
 
-            const char* gcc_argv[] = {"gcc", "-E", opt.in_file, NULL};
-            execvp(gcc_argv[0], (char**)gcc_argv);
+            if (in_fd >= 0)
+                dup2(in_fd, STDIN_FILENO);
+            if (out_fd >= 0)
+                dup2(out_fd, STDOUT_FILENO);
+            if (err_fd >= 0)
+                dup2(err_fd, STDERR_FILENO);
 
-            RED_ERROR("Error execing for preprocessing: %s", strerror(errno));
+            execvp(argv[0], (char**)argv);
 
-        default:;
-            int status;
-            wait(&status);
-            if (WIFEXITED(status) && WEXITSTATUS(status)) {
-                RED_ERROR("Error during preprocessing");
-            }
-            fseek(f, 0, SEEK_SET);
-            dup2(fileno(f), STDIN_FILENO);
+            RED_ERROR("Error execing for %s: %s", s->name, strerror(errno));
+
+        default:
             break;
     }
 }
 
-static void assemble(void) {
-    switch (fork()) {
-        case -1:
-            RED_ERROR("Error forking for assembly: %s", strerror(errno));
+// wait for stage s, returning true if it succeeded
+static bool stage_wait(struct stage *s) {
+    int status;
+    struct rusage ru;
 
-        case 0:
-            dup2(fileno(tmp2), STDIN_FILENO);
+    while (wait4(s->pid, &status, 0, &ru) < 0) {
+        if (errno != EINTR)
+            RED_ERROR("Error waiting for %s: %s", s->name, strerror(errno));
+    }
 
-            const char *link_cmd = opt.link ? "" : "-c";
+    s->end = now();
+    s->cpu = cpu_secs(&ru);
+    s->rss_kb = rss_kb(&ru);
 
-            if (dcc_is_host_darwin()) {
-                const char* gcc_argv[] = {"clang", "-x", "assembler", link_cmd, "-", "-o", opt.out_file, /*"-mmacosx-version-min=10.15",*/ "-arch", "x86_64", "-Og", NULL};
-                execvp(gcc_argv[0], (char**)gcc_argv);
-            } else {
-                const char* gcc_argv[] = {"gcc", "-x", "assembler", link_cmd, "-fPIC", "-", "-o", opt.out_file, NULL};
-                execvp(gcc_argv[0], (char**)gcc_argv);
-            }
+    if (trace) {
+        trace_span(s->name, "stage", s->pid, s->start, s->end);
+        trace_name(s->pid, s->name, false);
+    }
+    s->pid = 0;
 
-            RED_ERROR("Error execing for assembly: %s", strerror(errno))
+    return WIFEXITED(status) && !WEXITSTATUS(status);
+}
 
-        default:;
-            int status;
-            wait(&status);
-            if (WIFEXITED(status) && WEXITSTATUS(status)) {
-                RED_ERROR("Error during assembly");
-            }
+// something upstream failed - don't let this stage produce anything
+static void stage_kill(struct stage *s) {
+    if (!s->pid)
+        return;
+
+    kill(s->pid, SIGTERM);
+    stage_wait(s);
+}
+
+static void stage_report(const struct stage *stages, int n, double start) {
+    eprintf("stage          start      end      cpu   max rss\n");
+    for (int i = 0; i < n; i++) {
+        if (!stages[i].end)
+            continue;
+        eprintf("%-12s %7.3fs %7.3fs %7.3fs %7ldKB\n", stages[i].name,
+                stages[i].start - start, stages[i].end - start, stages[i].cpu, stages[i].rss_kb);
     }
 }
 
-static void llvm_convert(void) {
-    tmp2 = new_tmpfile();
+// foo/bar.c -> bar.<ext>
+static const char *output_name(const char *in_file, const char *ext) {
+    const char *base = strrchr(in_file, '/');
+    base = base ? base + 1 : in_file;
 
-    switch(fork()) {
-        case -1:
-            RED_ERROR("Error forking for llcing: %s", strerror(errno));
+    const char *dot = strrchr(base, '.');
+    int len = dot ? (int)(dot - base) : (int)strlen(base);
 
-        case 0:
-            dup2(fileno(tmp), STDIN_FILENO);
-            dup2(fileno(tmp2), STDOUT_FILENO);
+    char *name = safe_malloc(len + strlen(ext) + 2);
+    sprintf(name, "%.*s.%s", len, base, ext);
+    return name;
+}
+
+// somewhere for a file that only lives until we're done with it (an object, until we link)
+static const char *temp_file(const char *suffix) {
+    const char *dir = getenv("TMPDIR");
+    char *name = safe_malloc(strlen(dir ? dir : "/tmp") + strlen(suffix) + 16);
+    sprintf(name, "%s/dccXXXXXX%s", dir ? dir : "/tmp", suffix);
+
+    int fd = mkstemps(name, strlen(suffix));
+    if (fd < 0)
+        RED_ERROR("Error creating temporary file: %s", strerror(errno));
+
+    close(fd);
+    return name;
+}
+
+/*
+ * Link objects into out, as stage ld.
+ */
+static void link_objects(const char **objs, int n, const char *out, struct stage *ld) {
+    const char **argv = safe_calloc(n + 8, sizeof(char*));
+    int a = 0;
+
+    if (dcc_is_host_darwin()) {
+        argv[a++] = "clang";
+        argv[a++] = "-arch";
+        argv[a++] = "x86_64";
+    } else {
+        argv[a++] = "gcc";
+    }
+
+    for (int i = 0; i < n; i++)
+        argv[a++] = objs[i];
+
+    argv[a++] = "-o";
+    argv[a++] = out;
+    argv[a] = NULL;
+
+    stage_start(ld, argv, -1, -1, -1);
+    free(argv);
+
+    if (!stage_wait(ld))
+        RED_ERROR("Error during linking");
+}
+
+/*
+ * Link all the units' objects into opt.out_file in one go.
+ */
+static void link_units(const struct unit *units, int n) {
+    const char **objs = safe_calloc(n, sizeof(char*));
+    for (int i = 0; i < n; i++)
+        objs[i] = units[i].out_file;
+
+    struct stage ld = {.name = "linking"};
+    link_objects(objs, n, opt.out_file, &ld);
+    free(objs);
+}
+
+/*
+ * Start preprocessing u, returning where to read the result. Normally that's
+ * gcc -E, running as stage cpp and piping into us. When the output is needed
+ * as a whole - for the compilation cache's key, or so a compile server can
+ * keep it if gcc -E had nothing to say - gcc -E runs to completion first
+ * instead, unless the server already has it. Returns NULL if preprocessing
+ * failed.
+ */
+static FILE *preprocess(const struct unit *u, struct stage *cpp) {
+    FILE *in;
+
+    if (!ppcache_enabled() && !cache_enabled()) {
+        int cpp_pipe[2];
+        make_pipe(cpp_pipe);
+
+        const char* cpp_argv[] = {"gcc", "-E", u->in_file, NULL};
+        stage_start(cpp, cpp_argv, -1, cpp_pipe[1], -1);
+        close(cpp_pipe[1]);
+
+        if (!(in = fdopen(cpp_pipe[0], "r")))
+            RED_ERROR("Error reading preprocessor output: %s", strerror(errno));
+
+        return in;
+    }
+
+    if (ppcache_enabled() && (in = ppcache_lookup(u->in_file)))
+        return in;
+
+    const char *text = temp_file(".i");
+    const char *deps = temp_file(".d");
+    FILE *diag = new_tmpfile();
+
+    const char* cpp_argv[] = {"gcc", "-E", "-MD", "-MF", deps, "-o", text, u->in_file, NULL};
+    stage_start(cpp, cpp_argv, -1, -1, fileno(diag));
+
+    bool ok = stage_wait(cpp);
+    bool quiet = lseek(fileno(diag), 0, SEEK_END) == 0;
+
+    copy_fd(fileno(diag), STDERR_FILENO);
+    fclose(diag);
+
+    if (ok && quiet && ppcache_enabled())
+        ppcache_store(u->in_file, text, deps);
+
+    in = ok ? fopen(text, "r") : NULL;
+    if (ok && !in)
+        RED_ERROR("Error reading preprocessor output: %s", strerror(errno));
+
+    unlink(text); // we're still reading it
+    unlink(deps);
+    free((char*)text);
+    free((char*)deps);
+
+    return in;
+}
+
+// everything besides the input that decides a unit's output, for the cache key
+static char *cache_config(enum dcc_output output) {
+    bool assembles = !opt.asm_out && (output == DCC_OUTPUT_IR || output == DCC_OUTPUT_ASM);
+    char *llc = !opt.asm_out && output == DCC_OUTPUT_IR ? cache_tool_id("llc") : NULL;
+    char *as = assembles ? cache_tool_id(dcc_is_host_darwin() ? "clang" : "gcc") : NULL;
+
+    char *config;
+    if (asprintf(&config, "dcc " DCC_VERSION " " DCC_ARCHITECTURE " %s output %d asm %d backend %d O %d dump-ir %d llc %s as %s",
+                 host_info.uname_data.sysname, output, opt.asm_out, opt.backend, opt.opt_level, opt.dump_ir,
+                 llc ? llc : "-", as ? as : "-") < 0)
+        die("Error allocating memory (asprintf)");
+
+    free(llc);
+    free(as);
+    return config;
+}
+
+// so that a unit that does have to be compiled only compiles the functions that changed
+static const struct dcc_fn_store fn_store = {
+    .fetch = cache_fn_fetch,
+    .store = cache_fn_store,
+};
+
+static int compile_unit(const struct unit *u);
+
+/*
+ * With the cache on, a unit we'd otherwise compile and link in one go is
+ * compiled to an object first, which is what gets cached, then linked.
+ */
+static int compile_then_link(const struct unit *u) {
+    struct unit obj = *u;
+    obj.out_file = temp_file(".o");
+    obj.link = false;
+
+    int status = compile_unit(&obj);
+    if (!status) {
+        struct stage ld = {.name = "linking"};
+        link_objects(&obj.out_file, 1, u->out_file, &ld);
+    }
+
+    unlink(obj.out_file);
+    free((char*)obj.out_file);
+    return status;
+}
+
+/*
+ * Take one input file all the way to its output. The stages run at the same
+ * time, connected by pipes:
+ *
+ *   gcc -E | dcc | llc | gcc -x assembler
+ *
+ * The native backend writes assembly itself, so llc drops out, and on ELF
+ * hosts its integrated assembler writes the object too. With -S the IR or
+ * assembly goes straight into the output file instead. Built with the LLVM
+ * API backend, dcc writes the object itself and there's no llc or assembler.
+ * Whenever dcc writes the object, a separate link follows if we're linking. Returns nonzero if the compiler
+ * proper failed; anything else going wrong ends the process.
+ */
+static int compile_unit(const struct unit *u) {
+    enum { CPP, DCC, LLC, AS, LD, STAGES };
+    struct stage stages[STAGES] = {
+        [CPP] = {.name = "preprocess"},
+        [DCC] = {.name = "compile"},
+        [LLC] = {.name = "llc"},
+        [AS]  = {.name = "assemble"},
+        [LD]  = {.name = "linking"},
+    };
+    double start = now();
+
+    if (cache_enabled() && u->link && !opt.asm_out)
+        return compile_then_link(u);
+
+    enum dcc_output output = DCC_OUTPUT_IR;
+    if (opt.backend == BACKEND_NATIVE && !opt.asm_out && !opt.external_as && !dcc_is_host_darwin())
+        output = DCC_OUTPUT_ELF;
+    else if (opt.backend == BACKEND_NATIVE)
+        output = DCC_OUTPUT_ASM;
+#ifdef DCC_LLVM_API
+    else if (!opt.asm_out)
+        output = DCC_OUTPUT_OBJ;
+#endif
+
+    // gcc -E | us
+    FILE *in = preprocess(u, &stages[CPP]);
+    if (!in) {
+        eprintf(BRED "Error during preprocessing" RESET "\n");
+        return -1;
+    }
+
+    // or we may have compiled this before
+    const bool caching = cache_enabled() && !opt.debug && !opt.time_report && !opt.time_trace && !opt.mem_report &&
+                         !opt.pass_stats && !opt.dump_after;
+    struct cache_key key;
+    if (caching) {
+        char *config = cache_config(output);
+        cache_key(&key, in, config);
+        free(config);
+
+        if (cache_fetch(&key, u->out_file)) {
+            fclose(in);
+            return 0;
+        }
+    }
+
+    // us | llc | as, us | as, or us > the IR, assembly or object file
+    const bool writes_obj = output == DCC_OUTPUT_OBJ || output == DCC_OUTPUT_ELF;
+    const char *written = NULL;
+    if (opt.asm_out)
+        written = u->out_file;
+    else if (writes_obj)
+        written = u->link ? temp_file(".o") : u->out_file;
+
+    int out_fd;
+    if (written) {
+        out_fd = open(written, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (out_fd < 0)
+            RED_ERROR("Error opening output file: %s", strerror(errno));
+    } else {
+        int asm_pipe[2];
+        make_pipe(asm_pipe);
+
+        if (output == DCC_OUTPUT_IR) {
+            int ir_pipe[2];
+            make_pipe(ir_pipe);
 
             const char* llc_argv[] = {"llc", "--march", "x86-64", "-opaque-pointers", "-relocation-model=pic", "-", "-o", "-", NULL};
-            execvp(llc_argv[0], (char**)llc_argv);
+            stage_start(&stages[LLC], llc_argv, ir_pipe[0], asm_pipe[1], -1);
+            close(ir_pipe[0]);
+            close(asm_pipe[1]);
 
-            RED_ERROR("Error execing for llcing: %s", strerror(errno));
+            out_fd = ir_pipe[1];
+        } else {
+            out_fd = asm_pipe[1];
+        }
 
-        default:;
-            int status;
-            wait(&status);
-            if (WIFEXITED(status) && WEXITSTATUS(status)) {
-                RED_ERROR("Error during llcing");
-            }
+        const char *link_cmd = u->link ? "" : "-c";
+
+        if (dcc_is_host_darwin()) {
+            const char* as_argv[] = {"clang", "-x", "assembler", link_cmd, "-", "-o", u->out_file, /*"-mmacosx-version-min=10.15",*/ "-arch", "x86_64", "-Og", NULL};
+            stage_start(&stages[AS], as_argv, asm_pipe[0], -1, -1);
+        } else {
+            const char* as_argv[] = {"gcc", "-x", "assembler", link_cmd, "-fPIC", "-", "-o", u->out_file, NULL};
+            stage_start(&stages[AS], as_argv, asm_pipe[0], -1, -1);
+        }
+        close(asm_pipe[0]);
+    }
+
+    struct dcc_options dopts = {
+        .debug = opt.debug,
+        .output = output,
+        .out_fd = out_fd,
+        .mirror_fd = opt.dump_ir ? STDERR_FILENO : -1,
+        .fn_store = caching ? &fn_store : NULL,
+        .time_report = opt.time_report,
+        .mem_report = opt.mem_report,
+        .time_trace = trace,
+        .opt_level = opt.opt_level,
+        .pass_stats = opt.pass_stats,
+        .dump_after = opt.dump_after,
+    };
+
+
+    struct rusage ru0, ru1;
+    getrusage(RUSAGE_SELF, &ru0);
+    stages[DCC].start = now();
+
+    // what we have to say is kept along with the output
+    FILE *diag = NULL;
+    int saved_stderr = -1;
+    if (caching) {
+        diag = new_tmpfile();
+        fflush(stderr);
+        saved_stderr = dup(STDERR_FILENO);
+        dup2(fileno(diag), STDERR_FILENO);
+    }
 
-            fseek(tmp2, 0, SEEK_SET);
-            dup2(fileno(tmp2), STDIN_FILENO);
+    int status = dcc_compile_file(in, &dopts);
+
+    if (caching) {
+        fflush(stderr);
+        dup2(saved_stderr, STDERR_FILENO);
+        close(saved_stderr);
+        copy_fd(fileno(diag), STDERR_FILENO);
+        cache_fn_done();
+    }
+
+    stages[DCC].end = now();
+    getrusage(RUSAGE_SELF, &ru1);
+    stages[DCC].cpu = cpu_secs(&ru1) - cpu_secs(&ru0);
+    stages[DCC].rss_kb = rss_kb(&ru1);
+
+    fclose(in);
+    close(out_fd); // llc or the assembler sees EOF
+
+    // a failed preprocessor just looks like a short file to us
+    if (stages[CPP].pid && !stage_wait(&stages[CPP])) {
+        eprintf(BRED "Error during preprocessing" RESET "\n");
+        status = -1;
+    }
+
+    if (status) {
+        stage_kill(&stages[LLC]);
+        stage_kill(&stages[AS]);
+        if (written)
+            unlink(written);
+        if (written != u->out_file)
+            free((char*)written);
+        if (diag)
+            fclose(diag);
+        return status;
+    }
+
+    if (writes_obj && u->link) {
+        link_objects(&written, 1, u->out_file, &stages[LD]);
+        unlink(written);
+        free((char*)written);
+    } else if (!written) {
+        if (output == DCC_OUTPUT_IR && !stage_wait(&stages[LLC])) {
+            stage_kill(&stages[AS]);
+            RED_ERROR("Error during llcing");
+        }
+        if (!stage_wait(&stages[AS]))
+            RED_ERROR("Error during assembly");
+    }
+
+    if (caching) {
+        cache_store(&key, u->out_file, diag);
+        fclose(diag);
     }
+
+    if (opt.debug || opt.time_report || opt.mem_report)
+        stage_report(stages, STAGES, start);
+
+    return 0;
 }
 
-static void write_tmp_to_out(void) {
-    FILE* out = fopen(opt.out_file, "w");
-    if (!out) {
-        RED_ERROR("Error opening output file: %s", strerror(errno));
+/*
+ * Compile a unit in a worker process. Its stderr goes to a tmpfile, so
+ * diagnostics from different files never interleave.
+ */
+static void start_unit(struct unit *u) {
+    u->diag = new_tmpfile();
+    u->trace = trace ? new_tmpfile() : NULL;
+    u->start = now();
+
+    fflush(NULL); // don't let the worker flush our buffers a second time
+
+    switch ((u->pid = fork())) {
+        case -1:
+            RED_ERROR("Error forking worker for %s: %s", u->in_file, strerror(errno));
+
+        case 0:
+            dup2(fileno(u->diag), STDERR_FILENO);
+            if (trace)
+                trace = u->trace;
+            exit(compile_unit(u));
+
+        default:
+            break;
     }
+}
 
-    char buf[512];
-    size_t read;
-    while ((read = fread(buf, 1, sizeof(buf), tmp)) > 0) {
-        if (fwrite(buf, 1, read, out) != read) { // incomplete handling
-            RED_ERROR("Error while writing output file");
+// a worker is done - show what it had to say in one piece
+static void finish_unit(struct unit *u, int wstatus) {
+    u->secs = now() - u->start;
+
+    if (WIFEXITED(wstatus))
+        u->status = WEXITSTATUS(wstatus);
+    else
+        u->status = 128 + WTERMSIG(wstatus);
+
+    copy_fd(fileno(u->diag), STDERR_FILENO);
+    fclose(u->diag);
+
+    if (trace) {
+        fflush(trace);
+        copy_fd(fileno(u->trace), fileno(trace));
+        fclose(u->trace);
+        trace_span(u->in_file, "unit", u->pid, u->start, u->start + u->secs);
+        trace_name(u->pid, u->in_file, false);
+    }
+
+    u->pid = 0;
+}
+
+/*
+ * Compile all units, at most opt.jobs at a time. Returns the status of the
+ * first unit that failed, or 0.
+ */
+static int run_units(struct unit *units, int n) {
+    int next = 0, running = 0, failed = 0;
+
+    while (next < n || running) {
+        if (running < opt.jobs && next < n) {
+            start_unit(&units[next++]);
+            running++;
+            continue;
+        }
+
+        int wstatus;
+        pid_t pid = wait(&wstatus);
+        if (pid < 0) {
+            if (errno == EINTR)
+                continue;
+            RED_ERROR("Error waiting for workers: %s", strerror(errno));
+        }
+
+        for (int i = 0; i < n; i++) {
+            if (units[i].pid == pid) {
+                finish_unit(&units[i], wstatus);
+                running--;
+                if (units[i].status && !failed)
+                    failed = units[i].status;
+                break;
+            }
         }
     }
-    fclose(out);
+
+    return failed;
 }
 
-int main(int argc, char** argv) {
-    if (uname(&host_info.uname_data))
-        RED_ERROR("Error calling uname() for host information.");
+static void print_times(const struct unit *units, int n, double secs) {
+    eprintf("dcc: %d files, %ld jobs, %.3fs wall\n", n, opt.jobs, secs);
 
-    host_info.is_darwin = !strcmp(host_info.uname_data.sysname, "Darwin");
+    for (int i = 0; i < n; i++) {
+        eprintf("  %8.3fs  %s", units[i].secs, units[i].in_file);
+        if (units[i].status)
+            eprintf("  (failed, status %d)", units[i].status);
+        eprintf("\n");
+    }
+}
 
+/*
+ * Several input files: each is compiled to its own output by a worker, and
+ * they're linked at the end if we're linking.
+ */
+static int compile_units(struct unit *units, int n) {
+    for (int i = 0; i < n; i++) {
+        const char *out;
+        if (opt.asm_out)
+            out = output_name(opt.in_files[i], opt.backend == BACKEND_NATIVE ? "s" : "ll");
+        else if (!opt.link)
+            out = output_name(opt.in_files[i], "o");
+        else
+            out = temp_file(".o");
+
+        units[i] = (struct unit){
+            .in_file = opt.in_files[i],
+            .out_file = out,
+            .link = false,
+        };
+    }
+
+    double start = now();
+    int status = run_units(units, n);
+
+    if (opt.debug || opt.time_report)
+        print_times(units, n, now() - start);
+
+    if (!status && opt.link && !opt.asm_out)
+        link_units(units, n);
+
+    for (int i = 0; i < n; i++) {
+        if (opt.link && !opt.asm_out)
+            unlink(units[i].out_file);
+        free((char*)units[i].out_file);
+    }
+
+    return status;
+}
+
+/*
+ * Everything dcc does for one command line. Runs once per process, either
+ * here or in a compile server's worker.
+ */
+static int driver(int argc, char** argv) {
     get_options(argc, argv);
-    preprocess(); // now stdin is the preprocessed file
 
-    // keep the assembly output in a tmpfile
-    tmp = new_tmpfile();
+    if (opt.time_trace) {
+        // O_APPEND, since the workers' traces are copied in behind the stream's back
+        int fd = open(opt.time_trace, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0 || !(trace = fdopen(fd, "w")))
+            RED_ERROR("Error opening %s: %s", opt.time_trace, strerror(errno));
+        fprintf(trace, "[\n");
+    }
 
-    yydebug = 0;
-    if (yyparse()) // <- entry to the rest of the compiler
-        RED_ERROR("\n");
+    // a stage dying early should be an error we report, not a silent death
+    signal(SIGPIPE, SIG_IGN);
 
-    fseek(tmp, 0, SEEK_SET);
+    int n = opt.in_count;
+    struct unit *units = safe_calloc(n, sizeof(struct unit));
+    int status;
 
-    if (!opt.asm_out) {
-        llvm_convert();
-        assemble();
+    // one file goes straight through, as it always has
+    if (n == 1) {
+        units[0] = (struct unit){
+            .in_file = opt.in_files[0],
+            .out_file = opt.out_file,
+            .link = opt.link,
+        };
+
+        status = compile_unit(&units[0]);
     } else {
-        write_tmp_to_out();
+        status = compile_units(units, n);
     }
+    free(units);
 
-    fclose(tmp);
-    (void)assemble;
-}
+    if (trace) {
+        trace_name(getpid(), "dcc", true);
+        fclose(trace);
+    }
 
-bool dcc_is_host_darwin(void) {
-    return host_info.is_darwin;
+    return status;
 }
 
-void parse_done_cb(void) {
-    fprintf(stderr, "Parse done!\n");
-    quads_dump_llvm(stderr);
-    quads_dump_llvm(tmp);
+int main(int argc, char** argv) {
+    if (uname(&host_info.uname_data))
+        RED_ERROR("Error calling uname() for host information.");
+
+    if (argc == 3 && !strcmp(argv[1], "--server"))
+        server_run(argv[2], driver);
+
+    if (argc == 2 && !strcmp(argv[1], "--cache-stats")) {
+        cache_print_stats();
+        return 0;
+    }
+
+    // dcc --client socket ... is dcc ... run by the server
+    if (argc >= 3 && !strcmp(argv[1], "--client")) {
+        const char *socket = argv[2];
+        argv[2] = argv[0];
+
+        int status = client_run(socket, argc - 2, argv + 2);
+        return status >= 0 ? status : driver(argc - 2, argv + 2);
+    }
+
+    return driver(argc, argv);
 }
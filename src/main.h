@@ -1,10 +0,0 @@
-#ifndef MAIN_H
-#define MAIN_H
-
-#include <stdbool.h>
-
-bool dcc_is_host_darwin(void);
-void parse_done_cb(void);
-
-
-#endif
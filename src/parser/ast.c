@@ -11,19 +11,23 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "arena.h"
+#include "compilation.h"
 #include "ir_defs.h"
 #include "lexer.h"
+#include "memstat.h"
 #include "symtab.h"
 #include "util.h"
 
 /*
- * Allocate single astn safely.
+ * Allocate single astn safely, from the current astn arena.
  * The entire compiler relies on the astn type being set, so we must do that.
  */
 astn astn_alloc(enum astn_types type) {
-    astn n = safe_calloc(1, sizeof(struct astn));
+    astn n = arena_alloc(astn_arena, sizeof(struct astn));
+    mem_note_astn(type);
     n->type = type;
-    n->context = context;
+    n->context = dcc_cc->loc;
     return n;
 }
 
@@ -39,11 +43,18 @@ const char *astn_kind_str(astn a) {
         die("Passed invalid astn kind to astn_kind_str!");
     }
 
+    return astn_type_str(a->type);
+}
+
+/*
+ * The same, for a kind that's not attached to an astn
+ */
+const char *astn_type_str(enum astn_types type) {
     static const char *astn_kinds_str[] = {
         FOREACH_ASTN_KIND(GENERATE_STRING)
     };
 
-    return astn_kinds_str[a->type];
+    return astn_kinds_str[type];
 }
 
 /*
@@ -168,6 +168,7 @@ struct astn_type {
     bool is_const;
     bool is_restrict;
     bool is_atomic;
+    struct type_info *info; // set once the type has been interned
 };
 
 // as described in parser.y @ decl
@@ -248,6 +249,7 @@ struct astn_qtemp {
     struct astn *global;
     struct astn *qtype;
     char *name;
+    qval handle; // in the function's value table, once it's been used
 };
 
 struct astn_qbb {
@@ -310,8 +312,13 @@ struct astn {
 typedef struct astn* astn;
 typedef const struct astn* const_astn;
 
+// where new nodes come from is the compilation's astn_arena (see
+// compilation.h); the IR points it at a function's arena while it generates
+// that function, so its temps go away with it
+
 astn astn_alloc(enum astn_types type);
 const char *astn_kind_str(astn a);
+const char *astn_type_str(enum astn_types type);
 
 astn simple_constant_alloc(int num);
 
@@ -4,15 +4,18 @@
 
 #include "ast.h"
 #include "charutil.h"
+#include "compilation.h"
 #include "ir_print.h"
 #include "parser.tab.h"
 #include "symtab.h"
 
+// indentation depth of print_ast(), two spaces a level
+#define tabs (dcc_cc->ast_print_depth)
+
 /*
  * Recursively dump AST, starting at n and ending when we can't go any deeper.
  */
 void print_ast(astn n) {
-    static int tabs = 0;     //     -> __ <- two spaces
     for (int i=0; i<tabs-1; i++) eprintf("  ");
     if (tabs > 0) eprintf(" `");
     if (!n) return; // if we just want to print tabs, pass NULL
@@ -439,10 +442,14 @@ void print_ast(astn n) {
         print_ast(n->Case.statement);
         break;
     case ASTN_QTEMP:
-        eprintf("%%%d %s\n", n->Qtemp.tempno, qoneword(n->Qtemp.qtype));
+        eprintf("%%%d ", n->Qtemp.tempno);
+        qoneword_eprint(n->Qtemp.qtype);
+        eprintf("\n");
         break;
     case ASTN_QTYPE:
-        eprintf("QTYPE: %s\n", qoneword(n));
+        eprintf("QTYPE: ");
+        qoneword_eprint(n);
+        eprintf("\n");
         break;
     case ASTN_QBB:
         eprintf("label %%%s", n->Qbb.bb->name);
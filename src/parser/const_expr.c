@@ -0,0 +1,385 @@
+/*
+ * const_expr.c
+ *
+ * Evaluating integer constant expressions (see const_expr.h).
+ */
+
+#include "const_expr.h"
+
+#include "ast.h"
+#include "parser.tab.h"
+#include "symtab_util.h"
+#include "util.h"
+
+static unsigned width(enum int_types t) {
+    switch (t) {
+        case s_CHARLIT:     return 8;
+        case s_INT:         return 32;
+        case s_LONG:        return 64;
+        case s_LONGLONG:    return 64;
+        default:            return 0;
+    }
+}
+
+static unsigned rank(enum int_types t) {
+    switch (t) {
+        case s_LONG:        return 2;
+        case s_LONGLONG:    return 3;
+        default:            return 1; // the promotions made it an int
+    }
+}
+
+void const_convert(struct number *n, unsigned bits, bool is_signed) {
+    unsigned long long v = n->integer;
+
+    if (bits < 64) {
+        v &= (1ull << bits) - 1;
+        if (is_signed && v >> (bits - 1))
+            v |= ~0ull << bits;
+    }
+
+    n->integer = v;
+    n->is_signed = is_signed;
+    n->aux_type = bits == 8 ? s_CHARLIT : bits == 64 ? s_LONG : s_INT;
+}
+
+void const_literal(struct number *n) {
+    if (n->aux_type == s_CHARLIT) {
+        const_convert(n, 8, true); // char is signed
+        const_convert(n, 32, true);
+        return;
+    }
+
+    unsigned long long v = n->integer;
+
+    // the first of the types the suffix allows that holds the value
+    if (n->aux_type == s_INT) {
+        if (n->is_signed && v <= 0x7fffffffull)
+            return;
+
+        if (v <= 0xffffffffull && (!n->is_signed || !n->is_decimal)) {
+            n->is_signed = false;
+            return;
+        }
+
+        n->aux_type = s_LONG;
+    }
+
+    // too big for a long: only hex and octal may be unsigned without a U,
+    // but a decimal one doesn't fit anything else either
+    if (n->is_signed && v > 0x7fffffffffffffffull)
+        n->is_signed = false;
+}
+
+// 6.3.1.1 - everything here smaller than an int fits in one
+static void promote(struct number *n) {
+    if (n->aux_type == s_CHARLIT)
+        const_convert(n, 32, true);
+}
+
+// 6.3.1.8 - the type both operands are converted to
+static const struct number *common_type(const struct number *a, const struct number *b, bool *is_signed) {
+    *is_signed = a->is_signed && b->is_signed;
+
+    if (a->is_signed == b->is_signed)
+        return rank(a->aux_type) >= rank(b->aux_type) ? a : b;
+
+    const struct number *s = a->is_signed ? a : b;
+    const struct number *u = a->is_signed ? b : a;
+
+    if (rank(u->aux_type) >= rank(s->aux_type))
+        return u;
+
+    // the signed one's type, signed if it holds every value of the other
+    *is_signed = width(s->aux_type) > width(u->aux_type);
+    return s;
+}
+
+static void convert_both(struct number *a, struct number *b) {
+    bool is_signed;
+    unsigned bits = width(common_type(a, b, &is_signed)->aux_type);
+
+    const_convert(a, bits, is_signed);
+    const_convert(b, bits, is_signed);
+}
+
+static void normalize(struct number *n) {
+    const_convert(n, width(n->aux_type), n->is_signed);
+}
+
+static void int_result(struct number *out, bool v) {
+    out->integer = v;
+    out->aux_type = s_INT;
+    out->is_signed = true;
+}
+
+// n is the most negative value of its (signed) type
+static bool is_min(const struct number *n) {
+    return n->integer == ~0ull << (width(n->aux_type) - 1);
+}
+
+// the signed result of x op y doesn't fit in that many bits (6.5p5)
+static bool overflows(int op, long long x, long long y, unsigned bits) {
+    long long r;
+    bool o;
+
+    switch (op) {
+        case '+':   o = __builtin_add_overflow(x, y, &r);   break;
+        case '-':   o = __builtin_sub_overflow(x, y, &r);   break;
+        default:    o = __builtin_mul_overflow(x, y, &r);   break;
+    }
+
+    return o || (bits < 64 && (r < -(1ll << (bits - 1)) || r >= 1ll << (bits - 1)));
+}
+
+static bool eval(astn a, struct number *out, bool live);
+
+/*
+ * live is false in a subexpression that wouldn't be evaluated, like the
+ * other side of a ?: - it still has to be constant, but what would be
+ * undefined there just gives 0.
+ */
+static bool eval_binop(astn a, struct number *out, bool live) {
+    struct number l, r;
+    int op = a->Binop.op;
+
+    if (op == ',') // 6.6p3
+        return false;
+
+    if (!eval(a->Binop.left, &l, live))
+        return false;
+
+    bool right_live = live;
+    if (op == LOGAND)
+        right_live = live && l.integer;
+    else if (op == LOGOR)
+        right_live = live && !l.integer;
+
+    if (!eval(a->Binop.right, &r, right_live))
+        return false;
+
+    promote(&l);
+    promote(&r);
+
+    switch (op) {
+        case LOGAND:
+            int_result(out, l.integer && r.integer);
+            return true;
+
+        case LOGOR:
+            int_result(out, l.integer || r.integer);
+            return true;
+
+        case SHL:
+        case SHR:
+            // the type is the left operand's; the right one only says how far
+            if ((r.is_signed && (long long)r.integer < 0) || r.integer >= width(l.aux_type)) {
+                if (live)
+                    return false;
+
+                r.integer = 0;
+            }
+
+            if (op == SHL)
+                l.integer <<= r.integer;
+            else if (l.is_signed)
+                l.integer = (unsigned long long)((long long)l.integer >> r.integer);
+            else
+                l.integer >>= r.integer;
+
+            normalize(&l);
+            *out = l;
+            return true;
+
+        default:
+            break;
+    }
+
+    convert_both(&l, &r);
+
+    unsigned long long x = l.integer, y = r.integer;
+    long long sx = (long long)x, sy = (long long)y;
+    bool s = l.is_signed;
+
+    if ((op == '+' || op == '-' || op == '*') && s && live && overflows(op, sx, sy, width(l.aux_type)))
+        return false;
+
+    *out = l;
+    switch (op) {
+        case '+':   out->integer = x + y;   break;
+        case '-':   out->integer = x - y;   break;
+        case '*':   out->integer = x * y;   break;
+        case '&':   out->integer = x & y;   break;
+        case '^':   out->integer = x ^ y;   break;
+        case '|':   out->integer = x | y;   break;
+
+        case '/':
+        case '%':
+            if (!y || (s && sy == -1 && is_min(&l))) {
+                if (live)
+                    return false;
+
+                out->integer = 0;
+                break;
+            }
+
+            if (op == '/')
+                out->integer = s ? (unsigned long long)(sx / sy) : x / y;
+            else
+                out->integer = s ? (unsigned long long)(sx % sy) : x % y;
+            break;
+
+        case '<':   int_result(out, s ? sx < sy : x < y);       return true;
+        case '>':   int_result(out, s ? sx > sy : x > y);       return true;
+        case LTEQ:  int_result(out, s ? sx <= sy : x <= y);     return true;
+        case GTEQ:  int_result(out, s ? sx >= sy : x >= y);     return true;
+        case EQEQ:  int_result(out, x == y);                    return true;
+        case NOTEQ: int_result(out, x != y);                    return true;
+
+        default:
+            return false;
+    }
+
+    normalize(out);
+    return true;
+}
+
+static bool eval_unop(astn a, struct number *out, bool live) {
+    switch (a->Unop.op) {
+        case '+':
+        case '-':
+        case '~':
+        case '!':
+            break;
+
+        default:
+            return false; // & and * make addresses, the rest assign
+    }
+
+    if (!eval(a->Unop.target, out, live))
+        return false;
+
+    promote(out);
+
+    if (a->Unop.op == '-' && out->is_signed && live && is_min(out))
+        return false; // it overflows
+
+    switch (a->Unop.op) {
+        case '-':   out->integer = -out->integer;   break;
+        case '~':   out->integer = ~out->integer;   break;
+        case '!':   int_result(out, !out->integer); return true;
+        default:    break;
+    }
+
+    normalize(out);
+    return true;
+}
+
+static bool eval_tern(astn a, struct number *out, bool live) {
+    struct number c, t, e;
+
+    if (!eval(a->Tern.cond, &c, live))
+        return false;
+
+    if (!eval(a->Tern.t_then, &t, live && c.integer) || !eval(a->Tern.t_else, &e, live && !c.integer))
+        return false;
+
+    promote(&t);
+    promote(&e);
+    convert_both(&t, &e);
+
+    *out = c.integer ? t : e;
+    return true;
+}
+
+static bool eval(astn a, struct number *out, bool live) {
+    switch (a->type) {
+        case ASTN_NUM:
+            if (!width(a->Num.number.aux_type))
+                return false; // floating
+
+            *out = a->Num.number;
+            normalize(out);
+            return true;
+
+        case ASTN_BINOP:
+            return eval_binop(a, out, live);
+
+        case ASTN_UNOP:
+            return eval_unop(a, out, live);
+
+        case ASTN_TERN:
+            return eval_tern(a, out, live);
+
+        default:
+            return false;
+    }
+}
+
+bool const_eval(astn a, struct number *out) {
+    return eval(a, out, true);
+}
+
+static bool is_num(astn a) {
+    return a->type == ASTN_NUM;
+}
+
+astn const_fold(astn a) {
+    struct number n;
+    bool operands;
+
+    switch (a->type) {
+        case ASTN_BINOP:
+            operands = is_num(a->Binop.left) && is_num(a->Binop.right);
+            if (a->Binop.op == LOGAND || a->Binop.op == LOGOR)
+                operands = is_num(a->Binop.left); // the right may not be evaluated
+            break;
+
+        case ASTN_UNOP:
+            operands = is_num(a->Unop.target);
+            break;
+
+        case ASTN_TERN:
+            operands = is_num(a->Tern.cond); // nor one of the arms
+            break;
+
+        default:
+            return a;
+    }
+
+    if (!operands || !const_eval(a, &n))
+        return a;
+
+    astn f = astn_alloc(ASTN_NUM);
+    f->context = a->context;
+    f->Num.number = n;
+    return f;
+}
+
+void const_static_init(sym e, astn init) {
+    astn t = e->type;
+    bool is_ptr = t->Type.is_derived && t->Type.derived.type == t_PTR;
+    bool is_int = !t->Type.is_derived && !t->Type.is_tagtype &&
+                  t->Type.scalar.type != t_VOID && t->Type.scalar.type < t_REAL;
+
+    if (!is_ptr && !is_int) {
+        st_error("sorry, can't yet initialize '%s' with static storage: only integers and pointers\n", e->ident);
+    }
+
+    if (is_ptr && init->type == ASTN_STRLIT) {
+        e->strinit = init->Strlit.strlit;
+        e->init_is_str = true;
+        e->has_init = true;
+        return;
+    }
+
+    if (!const_eval(init, &e->numinit)) {
+        st_error("initializer of '%s' with static storage is not an integer constant expression\n", e->ident);
+    }
+
+    if (is_ptr && e->numinit.integer) {
+        st_error("sorry, can't yet initialize pointer '%s' with static storage to anything but 0 or a string\n", e->ident);
+    }
+
+    e->has_init = true;
+}
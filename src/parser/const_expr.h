@@ -0,0 +1,64 @@
+/*
+ * const_expr.h
+ *
+ * Integer constant expressions (C99 6.6): what array sizes, case labels and
+ * the initializers of objects with static storage have to be, and what the
+ * grammar folds to a number as it builds each expression.
+ *
+ * They're made of integer and character constants (sizeof is one of those
+ * by the time we see it, see the grammar, with size_t an unsigned long)
+ * with the arithmetic, bitwise, shift, relational, equality, logical and
+ * conditional operators. Casts would be allowed too, but the grammar
+ * doesn't have them yet. The value has the type C gives it - the integer
+ * promotions and the usual arithmetic conversions, int 32 bits, long and
+ * long long 64 - and a number holds it the way the lexer does: in the low
+ * bits, sign-extended if it's signed.
+ *
+ * Anything that would be undefined when it ran - signed +, - or * that
+ * overflows, dividing by zero, INT_MIN / -1, shifting by a negative amount
+ * or the width or more - isn't constant, so it's left to happen at run
+ * time; unless it's somewhere that wouldn't run, like the arm of a ?: that
+ * isn't taken. (Shifting a 1 into the sign bit, as in 1 << 31, is folded
+ * the way gcc does it: there's no run-time shift to leave it to yet.)
+ */
+
+#ifndef CONST_EXPR_H
+#define CONST_EXPR_H
+
+#include <stdbool.h>
+
+#include "ast.h"
+#include "semval.h"
+#include "symtab.h"
+
+// the value of a, if it's an integer constant expression
+bool const_eval(astn a, struct number *out);
+
+/*
+ * A new ASTN_NUM with a's value, or a itself if it isn't constant. This
+ * only goes down past a's operands, which the grammar has folded already,
+ * where one of them might not be evaluated - the right of && and ||, the
+ * arms of ?: - so folding each node as it's made stays linear.
+ */
+astn const_fold(astn a);
+
+/*
+ * The type of an integer constant (6.4.4.1): the lexer goes by the suffix,
+ * so one too big for the type it names is given the next one that holds
+ * it here - int, long for a decimal one; int, unsigned int, long, unsigned
+ * long for hex and octal. A character constant is an int too (6.4.4.4),
+ * with its value as a char.
+ */
+void const_literal(struct number *n);
+
+// convert n to an integer of that many bits (8, 16, 32 or 64)
+void const_convert(struct number *n, unsigned bits, bool is_signed);
+
+/*
+ * Check init, the initializer of e with static storage, and keep its value
+ * in e for gen_global(): it has to be constant - for now, an integer one,
+ * or for a pointer 0 or a string literal.
+ */
+void const_static_init(sym e, astn init);
+
+#endif
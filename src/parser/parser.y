@@ -10,7 +10,7 @@
     #include "debug.h"
     #include "ir.h"
     #include "location.h"
-    #include "main.h"
+    #include "memstat.h"
     #include "semval.h"
     #include "symtab.h"
     #include "symtab_print.h"
@@ -22,20 +22,30 @@
 %define parse.trace
 %define parse.error verbose
 
+// reentrant: everything the parser touches belongs to cc
+%define api.pure full
+%locations
+%lex-param {yyscan_t scanner}
+%parse-param {yyscan_t scanner} {struct dcc_compilation *cc}
+
 %code {
     #include <stdio.h>
     #include <stdlib.h>
     #include <string.h>
-    int yylex(void);
+
+    #include "compilation.h"
+    #include "const_expr.h"
+
+    int yylex(YYSTYPE *lval, YYLTYPE *lloc, yyscan_t scanner);
     #define ps_error(context, ...) do { \
         eprintf("Error near %s:%d: ", context.filename, context.lineno); \
         eprintf(__VA_ARGS__); \
         eprintf("\n"); \
         YYABORT; \
     } while(0)
-    void yyerror (const char *s) { eprintf("Error near %s:%d - %s\n",
-                                           context.filename, context.lineno,
-                                           s); }
+    void yyerror (YYLTYPE *lloc, yyscan_t scanner, struct dcc_compilation *cc, const char *s) {
+        eprintf("Error near %s:%d - %s\n", cc->loc.filename, cc->loc.lineno, s);
+    }
 }
 
 // this trash broken for the global scope, whatever
@@ -45,7 +55,7 @@
 {
     struct number number;
     struct strlit strlit;
-    char* ident;
+    const char* ident;
     astn astn_p;
     sym st_entry;
 }
@@ -95,7 +105,7 @@
 %%
 
 done:
-    translation_unit                    {  fprintf(stderr, "Translation unit done parsing.\n"); parse_done_cb();  }
+    translation_unit                    {  if (cc->opts.debug) fprintf(stderr, "Translation unit done parsing.\n"); dcc_parse_done();  }
 ;
 
 // maybe make quads here one day if you dont mind that would be good no rush
@@ -112,7 +122,7 @@ external_decln:                             // kludge ish for structs/unions //
                                                 gen_global($$);
                                             }
                                         }
-|   fn_def                              {   gen_fn($1);  }
+|   fn_def                              {   dcc_fn_done($1);  }
 |   internal                            {   $$=(sym)NULL;   }
 ;
 
@@ -245,14 +255,16 @@ ident:
 constant:
     NUMBER                      {   $$=astn_alloc(ASTN_NUM);
                                     $$->Num.number=$1;
+                                    const_literal(&$$->Num.number);
                                 }
 ;
 
 stringlit:
     stringlit STRING            {   $$=$1;
-                                    char *s = safe_calloc(strlen($$->Strlit.strlit.str) + strlen($2.str), sizeof(char));
-                                    strcpy(s, $$->Strlit.strlit.str);
-                                    strcat(s, $2.str);
+                                    char *s = arena_alloc(&tu_arena, $$->Strlit.strlit.len + $2.len + 1);
+                                    mem_note(MEM_STRINGS, $$->Strlit.strlit.len + $2.len + 1);
+                                    memcpy(s, $$->Strlit.strlit.str, $$->Strlit.strlit.len);
+                                    memcpy(s + $$->Strlit.strlit.len, $2.str, $2.len);
                                     $$->Strlit.strlit.str = s;
                                     $$->Strlit.strlit.len += $2.len;
                                 }
@@ -333,19 +345,19 @@ unary_expr:
 unops:
     '&' cast_expr               {   $$=unop_alloc('&', $2); }
 |   '*' cast_expr               {   $$=unop_alloc('*', $2); }
-|   '+' cast_expr               {   $$=unop_alloc('+', $2); }
-|   '-' cast_expr               {   $$=unop_alloc('-', $2); }
-|   '!' cast_expr               {   $$=unop_alloc('!', $2); }
-|   '~' cast_expr               {   $$=unop_alloc('~', $2); }
+|   '+' cast_expr               {   $$=const_fold(unop_alloc('+', $2)); }
+|   '-' cast_expr               {   $$=const_fold(unop_alloc('-', $2)); }
+|   '!' cast_expr               {   $$=const_fold(unop_alloc('!', $2)); }
+|   '~' cast_expr               {   $$=const_fold(unop_alloc('~', $2)); }
 ;
 
 sizeof:
     SIZEOF unary_expr           {   $$=astn_alloc(ASTN_NUM); $$->Num.number.integer=get_sizeof($2);
-                                    $$->Num.number.is_signed=false; $$->Num.number.aux_type=s_INT;
+                                    $$->Num.number.is_signed=false; $$->Num.number.aux_type=s_LONG; // size_t
                                     $$->context = @1;
                                 }
 |   SIZEOF '(' type_name ')'    {   $$=astn_alloc(ASTN_NUM); $$->Num.number.integer=get_sizeof($3);
-                                    $$->Num.number.is_signed=false; $$->Num.number.aux_type=s_INT;
+                                    $$->Num.number.is_signed=false; $$->Num.number.aux_type=s_LONG; // size_t
                                     $$->context = @1;
                                 }
 ;
@@ -359,51 +371,51 @@ cast_expr:
 // 6.5.5-14 Binary (two-arg) operators
 mult_expr:
     cast_expr
-|   mult_expr '*' cast_expr         {   $$=binop_alloc('*', $1, $3);    }
-|   mult_expr '/' cast_expr         {   $$=binop_alloc('/', $1, $3);    }
-|   mult_expr '%' cast_expr         {   $$=binop_alloc('%', $1, $3);    }
+|   mult_expr '*' cast_expr         {   $$=const_fold(binop_alloc('*', $1, $3)); }
+|   mult_expr '/' cast_expr         {   $$=const_fold(binop_alloc('/', $1, $3)); }
+|   mult_expr '%' cast_expr         {   $$=const_fold(binop_alloc('%', $1, $3)); }
 ;
 addit_expr:
     mult_expr
-|   addit_expr '+' mult_expr        {   $$=binop_alloc('+', $1, $3);    }
-|   addit_expr '-' mult_expr        {   $$=binop_alloc('-', $1, $3);    }
+|   addit_expr '+' mult_expr        {   $$=const_fold(binop_alloc('+', $1, $3)); }
+|   addit_expr '-' mult_expr        {   $$=const_fold(binop_alloc('-', $1, $3)); }
 ;
 shift_expr:
     addit_expr
-|   shift_expr SHL addit_expr       {   $$=binop_alloc(SHL, $1, $3);    }
-|   shift_expr SHR addit_expr       {   $$=binop_alloc(SHR, $1, $3);    }
+|   shift_expr SHL addit_expr       {   $$=const_fold(binop_alloc(SHL, $1, $3)); }
+|   shift_expr SHR addit_expr       {   $$=const_fold(binop_alloc(SHR, $1, $3)); }
 ;
 relat_expr:
     shift_expr
-|   relat_expr '<' shift_expr       {   $$=binop_alloc('<', $1, $3);    }
-|   relat_expr '>' shift_expr       {   $$=binop_alloc('>', $1, $3);    }
-|   relat_expr LTEQ shift_expr      {   $$=binop_alloc(LTEQ, $1, $3);   }
-|   relat_expr GTEQ shift_expr      {   $$=binop_alloc(GTEQ, $1, $3);   }
+|   relat_expr '<' shift_expr       {   $$=const_fold(binop_alloc('<', $1, $3)); }
+|   relat_expr '>' shift_expr       {   $$=const_fold(binop_alloc('>', $1, $3)); }
+|   relat_expr LTEQ shift_expr      {   $$=const_fold(binop_alloc(LTEQ, $1, $3)); }
+|   relat_expr GTEQ shift_expr      {   $$=const_fold(binop_alloc(GTEQ, $1, $3)); }
 ;
 eqlty_expr:
     relat_expr
-|   eqlty_expr EQEQ relat_expr      {   $$=binop_alloc(EQEQ, $1, $3);   }
-|   eqlty_expr NOTEQ relat_expr     {   $$=binop_alloc(NOTEQ, $1, $3);  }
+|   eqlty_expr EQEQ relat_expr      {   $$=const_fold(binop_alloc(EQEQ, $1, $3)); }
+|   eqlty_expr NOTEQ relat_expr     {   $$=const_fold(binop_alloc(NOTEQ, $1, $3)); }
 ;
 bwand_expr:
     eqlty_expr
-|   bwand_expr '&' eqlty_expr       {   $$=binop_alloc('&', $1, $3);    }
+|   bwand_expr '&' eqlty_expr       {   $$=const_fold(binop_alloc('&', $1, $3)); }
 ;
 bwxor_expr:
     bwand_expr
-|   bwxor_expr '^' bwand_expr       {   $$=binop_alloc('^', $1, $3);    }
+|   bwxor_expr '^' bwand_expr       {   $$=const_fold(binop_alloc('^', $1, $3)); }
 ;
 bwor_expr:
     bwxor_expr
-|   bwor_expr '|' bwxor_expr        {   $$=binop_alloc('|', $1, $3);    }
+|   bwor_expr '|' bwxor_expr        {   $$=const_fold(binop_alloc('|', $1, $3)); }
 ;
 logand_expr:
     bwor_expr
-|   logand_expr LOGAND bwor_expr    {   $$=binop_alloc(LOGAND, $1, $3); }
+|   logand_expr LOGAND bwor_expr    {   $$=const_fold(binop_alloc(LOGAND, $1, $3)); }
 ;
 logor_expr:
     logand_expr
-|   logor_expr LOGOR logand_expr    {   $$=binop_alloc(LOGOR, $1, $3);  }
+|   logor_expr LOGOR logand_expr    {   $$=const_fold(binop_alloc(LOGOR, $1, $3)); }
 ;
 // ----------------------------------------------------------------------------
 // 6.5.15 Conditional (ternary) operator
@@ -413,6 +425,7 @@ tern_expr:
                                             $$->Tern.cond=$1;
                                             $$->Tern.t_then=$3;
                                             $$->Tern.t_else=$5;
+                                            $$=const_fold($$);
                                         }
 ;
 // ----------------------------------------------------------------------------
@@ -443,7 +456,10 @@ expr:
 
 // 6.6 const expr
 const_expr:
-    tern_expr
+    tern_expr                       {   $$=const_fold($1);
+                                        if ($$->type != ASTN_NUM)
+                                            ps_error(@1, "expected an integer constant expression");
+                                    }
 ;
 
 // ----------------------------------------------------------------------------
@@ -556,8 +572,8 @@ abstract_decl:
 
 direct_abstract_decl:
     '(' abstract_decl ')'                   { $$=$2; }
-|   '[' assign ']'                          { $$=dtype_alloc(NULL, t_ARRAY); $$->Type.derived.size = $2;}
-|   direct_abstract_decl '[' assign ']'     {   astn n=dtype_alloc(NULL, t_ARRAY);
+|   '[' arr_size ']'                        { $$=dtype_alloc(NULL, t_ARRAY); $$->Type.derived.size = $2;}
+|   direct_abstract_decl '[' arr_size ']'   {   astn n=dtype_alloc(NULL, t_ARRAY);
                                                 n->Type.derived.size = $3;
                                                 set_dtypechain_target($1, n);
                                                 $$=$1;
@@ -655,7 +671,12 @@ direct_decl_arr:
 
 arr_size:
     %empty                          {   $$=NULL;    }
-|   assign
+|   assign                          {   $$=const_fold($1);
+                                        if ($$->type != ASTN_NUM)
+                                            ps_error(@1, "array size is not an integer constant expression");
+                                        if ($$->Num.number.is_signed && (long long)$$->Num.number.integer < 0)
+                                            ps_error(@1, "array size is negative");
+                                    }
 ;
 
 // qualifiers: yes
@@ -2,7 +2,7 @@
  * symtab.c
  *
  * This file contains the interfaces for the symbol table.
- * It also maintains a static reference to the current scope in the scope stack.
+ * The current scope in the scope stack belongs to the compilation.
  */
 
 #include "symtab.h"
@@ -11,28 +11,22 @@
 #include <stdio.h>
 
 #include "ast.h"
+#include "compilation.h"
+#include "const_expr.h"
 #include "location.h"
 #include "symtab_util.h"
+#include "timer.h"
 #include "types.h"
+#include "typetab.h"
 #include "util.h"
 
 static void st_check_linkage(sym e);
 static sym real_begin_st_entry(astn decl, enum namespaces ns, YYLTYPE context);
 
-// symtab for this translation unit
-symtab root_symtab = {
-    .scope_type = SCOPE_FILE,
-    .parent     = NULL,
-    .first      = NULL,
-    .last       = NULL,
-    .context    = {0} // must set with %initial-action
-};
-
-symtab *current_scope = &root_symtab;
-
 sym st_define_function(astn fndef, astn block, YYLTYPE context) {
     ast_check(fndef, ASTN_DECL, "Expected decl.");
     ast_check(block, ASTN_LIST, "Expected list for fn body.");
+    timer_push(TIMER_SYMBOLS, NULL);
 
     // get the name
     const char *name = get_dtypechain_ident(fndef->Decl.type);
@@ -57,6 +51,7 @@ sym st_define_function(astn fndef, astn block, YYLTYPE context) {
     fn->fn_defined = true;
     fn->fn_scope->context = context;
 
+    timer_pop();
     return fn;
 }
 
@@ -109,12 +104,14 @@ sym st_declare_function(astn decl, YYLTYPE context) {
  *  Declare (optionally permissively) a struct in the current scope without defining.
  */
 sym st_declare_struct(const char* ident, bool strict, YYLTYPE context) {
+    timer_push(TIMER_SYMBOLS, NULL);
     sym n = st_lookup(ident, NS_TAGS);
     if (n) {
         if (strict && n->members) {
             eprintf("Error: attempted redeclaration of complete tag");
-            exit(-5);
+            dcc_fail(-5);
         } else {
+            timer_pop();
             return n; // "redeclared"
         }
     } else {
@@ -133,6 +130,7 @@ sym st_declare_struct(const char* ident, bool strict, YYLTYPE context) {
 
         current_scope = save; // restore scope stack
         st_insert_given(new);
+        timer_pop();
         return new;
     }
 }
@@ -145,6 +143,7 @@ sym st_declare_struct(const char* ident, bool strict, YYLTYPE context) {
  */
 sym st_define_struct(const char *ident, astn decl_list,
                            YYLTYPE name_context, YYLTYPE closebrace_context, YYLTYPE openbrace_context) {
+    timer_push(TIMER_SYMBOLS, NULL);
     sym strunion;
     strunion = st_declare_struct(ident, true, name_context); // strict bc we're about to define!
 
@@ -162,6 +161,7 @@ sym st_define_struct(const char *ident, astn decl_list,
     }
     strunion->def_context = closebrace_context;
     st_pop_scope();
+    timer_pop();
     return strunion;
 }
 
@@ -281,6 +281,9 @@ static sym real_begin_st_entry(astn decl, enum namespaces ns, YYLTYPE context) {
         new->type = type_chain; // because otherwise it's just an IDENT
     }
 
+    // the type is complete now; share it with everything else of that type
+    new->type = type_intern(new->type);
+
     // attempt to insert the new entry, check for permitted redeclaration
     if (!st_insert_given(new)) {
         if (new->scope == &root_symtab) {
@@ -310,13 +313,22 @@ static sym real_begin_st_entry(astn decl, enum namespaces ns, YYLTYPE context) {
 
 
 sym begin_st_entry(astn decl, enum namespaces ns, YYLTYPE context) {
+    sym new;
+    timer_push(TIMER_SYMBOLS, NULL);
+
     if (decl->Decl.type->type == ASTN_TYPE && decl->Decl.type->Type.derived.type == t_FN) {
-        sym newfn = st_declare_function(decl, context);
-        newfn->fn_defined = false;
-        newfn->def_context = (YYLTYPE){NULL, 0}; // it's not defined
-        return newfn;
+        new = st_declare_function(decl, context);
+        new->fn_defined = false;
+        new->def_context = (YYLTYPE){NULL, 0}; // it's not defined
     } else {
-        return real_begin_st_entry(decl, ns, context);
+        new = real_begin_st_entry(decl, ns, context);
+
+        // static storage gets its value in the object file, so it has to be a constant
+        if (decl->Decl.init && (new->scope == &root_symtab || new->storspec == SS_STATIC))
+            const_static_init(new, decl->Decl.init);
     }
+
+    timer_pop();
+    return new;
 }
 
@@ -63,6 +63,7 @@ typedef struct st_entry {
     enum storspec storspec;
     bool is_param;
     bool has_init;
+    bool init_is_str;   // strinit, rather than numinit
     union { // yeah we'll just copy initializers - avoids entangling us with the AST
         struct number numinit;
         struct strlit strinit;
@@ -124,6 +125,11 @@ typedef const st_entry* const_sym;
  *
  * When we pop a scope we're setting current_scope to its parent, but we don't just lose
  * the popped scope/symtab - the AST still points to it.
+ *
+ * The first/last list keeps declaration order (struct member layout, dumps). Lookups
+ * go through a per-scope open-addressed hash of the same entries, keyed on
+ * (ident, namespace), so a root scope full of libc prototypes doesn't make every
+ * lookup a linear scan.
  */
 typedef struct symtab {
     enum scope_types scope_type;
@@ -134,10 +140,19 @@ typedef struct symtab {
     sym first, last;
 
     astn all_syms;
+
+    sym *hash;
+    unsigned hash_cap, hash_count;
 } symtab;
 
-extern symtab root_symtab;
-extern symtab* current_scope;
+// symbol table counters, reported with -v
+struct st_counters {
+    unsigned long lookups;  // single-scope lookups
+    unsigned long probes;   // hash slots examined by those lookups
+    unsigned long inserts;
+};
+
+// root_symtab, current_scope and st_stats belong to the compilation - see compilation.h
 
 sym st_define_function(astn fndef, astn block, YYLTYPE openbrace_context);
 sym st_declare_function(astn fndef, YYLTYPE openbrace_context);
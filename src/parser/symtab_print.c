@@ -3,6 +3,7 @@
 #include <stdio.h>
 
 #include "ast_print.h"
+#include "compilation.h"
 #include "symtab.h"
 #include "symtab_util.h"
 #include "util.h"
@@ -6,17 +6,60 @@
 
 #include "symtab_util.h"
 
+#include <stdint.h>
 #include <stdlib.h>
-#include <string.h>
 
+#include "arena.h"
+#include "compilation.h"
+#include "memstat.h"
 #include "symtab.h"
 #include "util.h"
 
+#define ST_HASH_INITIAL 16 // power of two
+
+// idents are interned, so the pointer itself is the key
+static unsigned st_hash(const char *ident, enum namespaces ns) {
+    uintptr_t p = (uintptr_t)ident;
+    p ^= p >> 17;
+    return (unsigned)(p * 0x9e3779b97f4a7c15u >> 32) ^ (ns * 0x9e3779b9u);
+}
+
+/*
+ *  Put an entry into the scope's hash table, growing it past 3/4 full.
+ *  The entry must not already be in the table. Tables live in the translation
+ *  unit arena like the scopes themselves, so a grown-out-of table is simply
+ *  left behind.
+ */
+static void st_hash_put(symtab *s, sym e) {
+    if ((s->hash_count + 1) * 4 > s->hash_cap * 3) {
+        sym *old = s->hash;
+        unsigned old_cap = s->hash_cap;
+
+        s->hash_cap = old_cap ? old_cap * 2 : ST_HASH_INITIAL;
+        s->hash = arena_alloc(&tu_arena, s->hash_cap * sizeof(sym));
+        mem_note(MEM_SYMTABS, s->hash_cap * sizeof(sym));
+        s->hash_count = 0;
+
+        for (unsigned i = 0; i < old_cap; i++)
+            if (old[i])
+                st_hash_put(s, old[i]);
+    }
+
+    unsigned mask = s->hash_cap - 1;
+    unsigned i = st_hash(e->ident, e->ns) & mask;
+    while (s->hash[i])
+        i = (i + 1) & mask;
+
+    s->hash[i] = e;
+    s->hash_count++;
+}
+
 /* 
  *  Just allocate; we're not checking any kind of context for redeclarations, etc
  */
 sym stentry_alloc(const char *ident) {
-    sym n = safe_calloc(1, sizeof(st_entry));
+    sym n = arena_alloc(&tu_arena, sizeof(st_entry));
+    mem_note(MEM_ST_ENTRY, sizeof(st_entry));
     n->type = astn_alloc(ASTN_TYPE);
     n->ident = ident;
     return n;
@@ -39,6 +82,8 @@ bool st_insert_given(sym new) {
         current_scope->last->next = new; // previous past will point to new last
         current_scope->last = new;
     }
+    st_hash_put(current_scope, new);
+    st_stats.inserts++;
     return true;
 }
 
@@ -70,13 +115,21 @@ sym st_lookup_ns(const char* ident, enum namespaces ns) {
 
 /*
  *  Fully-qualified lookup; give me symtab to check and namespace
+ *  ident must be interned (everything from the lexer is).
  */
 sym st_lookup_fq(const char* ident, const symtab* s, enum namespaces ns) {
-    sym cur = s->first;
-    while (cur) {
-        if (cur->ns == ns && !strcmp(ident, cur->ident))
+    st_stats.lookups++;
+    if (!s->hash)
+        return NULL;
+
+    unsigned mask = s->hash_cap - 1;
+    unsigned i = st_hash(ident, ns) & mask;
+    sym cur;
+    while ((cur = s->hash[i])) {
+        st_stats.probes++;
+        if (cur->ns == ns && cur->ident == ident)
             return cur;
-        cur = cur->next;
+        i = (i + 1) & mask;
     }
     return NULL;
 }
@@ -86,7 +139,8 @@ sym st_lookup_fq(const char* ident, const symtab* s, enum namespaces ns) {
  *  Create new scope/symtab and set it as current
  */
 void st_new_scope(enum scope_types scope_type, YYLTYPE context) {
-    symtab *new = safe_malloc(sizeof(symtab));
+    symtab *new = arena_alloc(&tu_arena, sizeof(symtab));
+    mem_note(MEM_SYMTABS, sizeof(symtab));
     *new = (symtab){
         .scope_type = scope_type,
         .stack_total= 8, // crime
@@ -116,22 +170,22 @@ void st_pop_scope(void) {
 
 
 /*
- *  Destroy symbol table, freeing all st_entry, but not their .type or .ident members
- *  If root scope, just free the entries (since symtab itself is static)
+ *  Destroy symbol table. The st_entry, symtab and hash table memory belongs to
+ *  the translation unit arena, so all we can do here is forget the entries.
  */
 void st_destroy(symtab* target) {
-    // free all the entries first
-    sym next = target->first->next;
-    for (sym e=target->first; e!=NULL; e=next) {
-        next = e->next;
-        free(e);
-    }
-    if (target == &root_symtab) { // in case you accidentally reuse root_symtab after this
-        target->first = NULL;     //                            but seriously please don't
-        target->last = NULL;
-    } else {
-        free(target);
-        free(target++);
-    }
+    target->first = NULL; // in case you accidentally reuse the symtab after this
+    target->last = NULL;  //                          but seriously please don't
+
+    target->hash = NULL;
+    target->hash_cap = 0;
+    target->hash_count = 0;
+}
+
+void st_report(FILE *f) {
+    fprintf(f, "symtab: %lu lookups, %lu probes (%.2f/lookup), %lu inserts\n",
+            st_stats.lookups, st_stats.probes,
+            st_stats.lookups ? (double)st_stats.probes / st_stats.lookups : 0.0,
+            st_stats.inserts);
 }
 
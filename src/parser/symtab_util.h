@@ -12,7 +12,7 @@
 
 #define st_error(...) \
     eprintf("Error declaring symbol: " __VA_ARGS__); \
-    exit(-5);
+    dcc_fail(-5);
 
 sym stentry_alloc(const char *ident);
 
@@ -26,4 +26,6 @@ void st_new_scope(enum scope_types scope_type, YYLTYPE openbrace_context);
 void st_pop_scope(void);
 void st_destroy(symtab* target);
 
+void st_report(FILE *f);
+
 #endif
@@ -12,6 +12,7 @@
 #include "ast.h"
 #include "symtab.h"
 #include "symtab_util.h"
+#include "typetab.h"
 #include "util.h"
 
 const char* storspec_str[] = {
@@ -31,8 +32,7 @@ const char* der_types_str[] = {
 };
 
 // sizeof!
-// currently, array sizes are hardcoded to only support regular numbers,
-// we need a bit more machinery, specifically a function to evaluate compile-time constants.
+// sizes are cached on the interned type, see typetab.c.
 int get_sizeof(astn type) {
     //printf("getting size of:\n");
     //print_ast(type);
@@ -40,22 +40,59 @@ int get_sizeof(astn type) {
 
     ast_check(type, ASTN_TYPE, "sizeof was given a non-type astn.");
 
-    if (!type->Type.is_derived)
-        return target_size[type->Type.scalar.type];
-    else {
-        if (type->Type.derived.type == t_PTR) {
-            return target_size[t_PTR];
-        }
-        // add t_FN stuff
-        else {
-            if (!type->Type.derived.size) {
-                return 0;
-            }
-            if (type->Type.derived.size->type != ASTN_NUM) {
-                eprintf("Sorry, can't yet evaluate compile-time constants other than plain numbers\n");
+    return type_size(type);
+}
+
+static int round_up(int n, int align) {
+    return (n + align - 1) / align * align;
+}
+
+// array sizes are numbers by now; the grammar folds them (see const_expr.h)
+void type_layout(astn type, int *size, int *align) {
+    ast_check(type, ASTN_TYPE, "type_layout was given a non-type astn.");
+
+    if (type->Type.is_tagtype) {
+        sym tag = type->Type.tagtype.symbol;
+        *size = 0;
+        *align = 1;
+
+        if (!tag->members) // incomplete
+            return;
+
+        for (sym m = tag->members->first; m; m = m->next) {
+            int m_size = type_size(m->type);
+            int m_align = type_align(m->type);
+
+            if (m_align > *align)
+                *align = m_align;
+
+            if (tag->is_union) {
+                if (m_size > *size)
+                    *size = m_size;
+            } else {
+                *size = round_up(*size, m_align) + m_size;
             }
-            return type->Type.derived.size->Num.number.integer * get_sizeof(type->Type.derived.target);
         }
+
+        *size = round_up(*size, *align);
+    } else if (!type->Type.is_derived) {
+        *size = target_size[type->Type.scalar.type];
+        *align = *size ? *size : 1;
+    } else if (type->Type.derived.type == t_PTR) {
+        *size = *align = target_size[t_PTR];
+    } else {
+        // add t_FN stuff
+        *size = 0;
+        *align = 1;
+
+        if (!type->Type.derived.size)
+            return;
+
+        if (type->Type.derived.size->type != ASTN_NUM)
+            die("Array size wasn't folded to a number.");
+
+        *size = type->Type.derived.size->Num.number.integer * type_size(type->Type.derived.target);
+        *align = type_align(type->Type.derived.target);
     }
 }
 
@@ -94,9 +131,7 @@ enum storspec describe_type(astn spec, struct astn_type *t) {
             if (spec->Typespec.is_tagtype) {
                 t->is_tagtype = true;
                 t->tagtype.symbol = spec->Typespec.symbol;
-                astn old = spec;
                 spec = spec->Typespec.next;
-                free(old);
                 tagtypes++;
             } else {
                 switch (spec->Typespec.spec) {
@@ -114,9 +149,7 @@ enum storspec describe_type(astn spec, struct astn_type *t) {
                     default:    die("invalid typespec");
                 }
                 total_typespecs++;
-                astn old = spec;
                 spec = spec->Typespec.next;
-                free(old); // maybe a little memory management
             }
         } else if (spec->type == ASTN_TYPEQUAL) { // specifying multiple times is valid
             spec = qualify_single(spec, t);
@@ -127,9 +160,7 @@ enum storspec describe_type(astn spec, struct astn_type *t) {
             storspec = spec->Storspec.spec;
             //printf("dbg - storspec astn has %d, so %s", spec->Storspec.spec, storspec_str[t->scalar.storspec]);
             storspec_set = true;
-            astn old = spec;
             spec = spec->Storspec.next;
-            free(old);
         } else {
             die("Invalid astn type in spec chain");
         }
@@ -267,7 +298,6 @@ void strict_qualify_type(astn qual, struct astn_type *t) {
 }
 
 // qualify a type from a single astn qual and return the next node
-// destroys qual!
 static astn qualify_single(astn qual, struct astn_type *t) {
     switch (qual->Typequal.qual) {
         case TQ_CONST:      t->is_const = true;       break;
@@ -275,8 +305,5 @@ static astn qualify_single(astn qual, struct astn_type *t) {
         case TQ_VOLATILE:   t->is_volatile = true;    break;
         default:    die("invalid typequal");
     }
-    astn old = qual;
-    qual = qual->Typequal.next;
-    free(old);
-    return qual;
+    return qual->Typequal.next;
 }
@@ -10,6 +10,7 @@ enum storspec describe_type(astn spec, struct astn_type *t);
 void strict_qualify_type(astn qual, struct astn_type *t);
 
 int get_sizeof(astn type);
+void type_layout(astn type, int *size, int *align);
 astn descend_array(astn type);
 
 #endif
@@ -0,0 +1,288 @@
+/*
+ * typetab.c
+ *
+ * Hash-consing of C and IR types. Interned nodes live in the translation
+ * unit arena and must not be modified once interned - build a fresh one with
+ * dtype_alloc()/qtype_alloc() if you need to change something.
+ *
+ * Function types aren't interned (each declaration carries its own parameter
+ * list and scope), and neither are arrays without a plain numeric size; both
+ * are still usable as targets of interned types, keyed by their address.
+ */
+#include "typetab.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "compilation.h"
+#include "memstat.h"
+#include "symtab.h"
+#include "types.h"
+#include "util.h"
+
+#define TYPETAB_INITIAL 256 // power of two
+
+#define types (dcc_cc->typetab.ctypes)
+#define qtypes (dcc_cc->typetab.irtypes)
+
+static unsigned hash_ptr(const void *p) {
+    uintptr_t v = (uintptr_t)p;
+    v ^= v >> 17;
+    return (unsigned)(v * 0x9e3779b97f4a7c15u >> 32);
+}
+
+static unsigned hash_mix(unsigned h, unsigned v) {
+    return (h ^ v) * 16777619u; // FNV-1a step
+}
+
+static bool type_internable(astn t) {
+    if (!t->Type.is_derived)
+        return true;
+
+    switch (t->Type.derived.type) {
+        case t_PTR:
+            return true;
+        case t_ARRAY:
+            return t->Type.derived.size && t->Type.derived.size->type == ASTN_NUM;
+        default:
+            return false;
+    }
+}
+
+static unsigned type_quals(astn t) {
+    return t->Type.is_const | t->Type.is_volatile << 1 | t->Type.is_restrict << 2 | t->Type.is_atomic << 3;
+}
+
+// t's target, if any, is already interned
+static unsigned type_hash(astn t) {
+    unsigned h = hash_mix(2166136261u, type_quals(t));
+
+    if (t->Type.is_derived) {
+        h = hash_mix(h, t->Type.derived.type);
+        h = hash_mix(h, hash_ptr(t->Type.derived.target));
+        if (t->Type.derived.type == t_ARRAY)
+            h = hash_mix(h, (unsigned)t->Type.derived.size->Num.number.integer);
+    } else if (t->Type.is_tagtype) {
+        h = hash_mix(h, hash_ptr(t->Type.tagtype.symbol));
+    } else {
+        h = hash_mix(h, t->Type.scalar.type);
+        h = hash_mix(h, t->Type.scalar.is_unsigned);
+    }
+
+    return h;
+}
+
+static bool type_equal(astn a, astn b) {
+    if (type_quals(a) != type_quals(b) ||
+        a->Type.is_derived != b->Type.is_derived ||
+        a->Type.is_tagtype != b->Type.is_tagtype)
+        return false;
+
+    if (a->Type.is_derived)
+        return a->Type.derived.type == b->Type.derived.type &&
+               a->Type.derived.target == b->Type.derived.target &&
+               (a->Type.derived.type != t_ARRAY ||
+                a->Type.derived.size->Num.number.integer == b->Type.derived.size->Num.number.integer);
+
+    if (a->Type.is_tagtype)
+        return a->Type.tagtype.symbol == b->Type.tagtype.symbol;
+
+    return a->Type.scalar.type == b->Type.scalar.type &&
+           a->Type.scalar.is_unsigned == b->Type.scalar.is_unsigned;
+}
+
+static void types_put(struct type_info *i) {
+    if ((types.count + 1) * 4 > types.cap * 3) {
+        struct type_info **old = types.slots;
+        unsigned old_cap = types.cap;
+
+        types.cap = old_cap ? old_cap * 2 : TYPETAB_INITIAL;
+        types.slots = safe_calloc(types.cap, sizeof(struct type_info *));
+        mem_note(MEM_TYPES, types.cap * sizeof(struct type_info *));
+        types.count = 0;
+
+        for (unsigned s = 0; s < old_cap; s++)
+            if (old[s])
+                types_put(old[s]);
+
+        free(old);
+    }
+
+    unsigned mask = types.cap - 1;
+    unsigned s = i->hash & mask;
+    while (types.slots[s])
+        s = (s + 1) & mask;
+
+    types.slots[s] = i;
+    types.count++;
+}
+
+/*
+ * Return the canonical node for the (complete) type t. Anything that isn't an
+ * internable ASTN_TYPE is returned as-is.
+ */
+astn type_intern(astn t) {
+    if (!t || t->type != ASTN_TYPE)
+        return t;
+
+    if (t->Type.info)
+        return t->Type.info->type;
+
+    if (!type_internable(t))
+        return t;
+
+    types.lookups++;
+
+    // the target is an equal type either way, so just point at the canonical one
+    if (t->Type.is_derived)
+        t->Type.derived.target = type_intern(t->Type.derived.target);
+
+    unsigned h = type_hash(t);
+
+    if (types.cap) {
+        unsigned mask = types.cap - 1;
+        for (unsigned s = h & mask; types.slots[s]; s = (s + 1) & mask) {
+            struct type_info *i = types.slots[s];
+            if (i->hash == h && type_equal(i->type, t)) {
+                t->Type.info = i;
+                return i->type;
+            }
+        }
+    }
+
+    // t becomes the canonical node
+    struct type_info *i = arena_alloc(&tu_arena, sizeof(struct type_info));
+    mem_note(MEM_TYPES, sizeof(struct type_info));
+    *i = (struct type_info){
+        .type = t,
+        .size = -1,
+        .align = -1,
+        .hash = h,
+    };
+
+    t->Type.info = i;
+    types_put(i);
+
+    return t;
+}
+
+// is the layout of t fixed yet? only struct tags can still be completed later
+static bool type_layout_final(astn t) {
+    while (t->Type.is_derived) {
+        if (t->Type.derived.type == t_PTR)
+            return true;
+        t = t->Type.derived.target;
+    }
+
+    if (t->Type.is_tagtype)
+        return t->Type.tagtype.symbol->members && t->Type.tagtype.symbol->def_context.filename;
+
+    return true;
+}
+
+static void type_laid_out(astn t, int *size, int *align) {
+    t = type_intern(t);
+
+    struct type_info *i = t->Type.info;
+    if (i && i->size >= 0) {
+        *size = i->size;
+        *align = i->align;
+        return;
+    }
+
+    type_layout(t, size, align);
+
+    if (i && type_layout_final(t)) {
+        i->size = *size;
+        i->align = *align;
+    }
+}
+
+int type_size(astn t) {
+    int size, align;
+    type_laid_out(t, &size, &align);
+    return size;
+}
+
+int type_align(astn t) {
+    int size, align;
+    type_laid_out(t, &size, &align);
+    return align;
+}
+
+static void qtypes_put(ir_type_E t, astn derived, astn qtype) {
+    if ((qtypes.count + 1) * 4 > qtypes.cap * 3) {
+        struct qtype_slot *old = qtypes.slots;
+        unsigned old_cap = qtypes.cap;
+
+        qtypes.cap = old_cap ? old_cap * 2 : TYPETAB_INITIAL;
+        qtypes.slots = safe_calloc(qtypes.cap, sizeof(struct qtype_slot));
+        mem_note(MEM_TYPES, qtypes.cap * sizeof(struct qtype_slot));
+        qtypes.count = 0;
+
+        for (unsigned s = 0; s < old_cap; s++)
+            if (old[s].qtype)
+                qtypes_put(old[s].t, old[s].derived, old[s].qtype);
+
+        free(old);
+    }
+
+    unsigned mask = qtypes.cap - 1;
+    unsigned s = hash_mix(hash_ptr(derived), t) & mask;
+    while (qtypes.slots[s].qtype)
+        s = (s + 1) & mask;
+
+    qtypes.slots[s] = (struct qtype_slot){t, derived, qtype};
+    qtypes.count++;
+}
+
+static astn qtype_new(ir_type_E t, astn derived) {
+    struct arena *save = astn_arena;
+    astn_arena = &tu_arena;
+
+    astn q = qtype_alloc(t);
+    q->Qtype.derived_type = derived;
+
+    astn_arena = save;
+    return q;
+}
+
+/*
+ * Get the canonical ASTN_QTYPE for IR type t with the given derived type.
+ * derived must live as long as the translation unit. The result is shared,
+ * so it must not be modified.
+ */
+astn qtype_get(ir_type_E t, astn derived) {
+    qtypes.lookups++;
+
+    if (!derived) {
+        if (!qtypes.plain[t])
+            qtypes.plain[t] = qtype_new(t, NULL);
+
+        return qtypes.plain[t];
+    }
+
+    if (qtypes.cap) {
+        unsigned mask = qtypes.cap - 1;
+        for (unsigned s = hash_mix(hash_ptr(derived), t) & mask; qtypes.slots[s].qtype; s = (s + 1) & mask)
+            if (qtypes.slots[s].t == t && qtypes.slots[s].derived == derived)
+                return qtypes.slots[s].qtype;
+    }
+
+    astn q = qtype_new(t, derived);
+    qtypes_put(t, derived, q);
+
+    return q;
+}
+
+void typetab_report(FILE *f) {
+    fprintf(f, "types: %u C types from %lu lookups, %u derived IR types from %lu lookups\n",
+            types.count, types.lookups, qtypes.count, qtypes.lookups);
+}
+
+void typetab_free(struct typetab *t) {
+    free(t->ctypes.slots);
+    free(t->irtypes.slots);
+    *t = (struct typetab){0};
+}
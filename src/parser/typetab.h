@@ -0,0 +1,57 @@
+/*
+ * typetab.h
+ *
+ * Interned types. Each distinct complete C type (ASTN_TYPE) and IR type
+ * (ASTN_QTYPE) exists once, so equal types are the same pointer and their
+ * size, alignment and IR type are only worked out once.
+ */
+
+#ifndef TYPETAB_H
+#define TYPETAB_H
+
+#include <stdio.h>
+
+#include "ast.h"
+#include "ir_defs.h"
+
+// hangs off an interned ASTN_TYPE
+struct type_info {
+    astn type;      // the canonical node
+    astn qtype;     // its IR type, once someone asks
+    int size;       // -1 until known
+    int align;
+    unsigned hash;
+};
+
+struct qtype_slot {
+    ir_type_E t;
+    astn derived;
+    astn qtype;
+};
+
+// the interned types of one compilation
+struct typetab {
+    struct {
+        struct type_info **slots;
+        unsigned cap, count;
+        unsigned long lookups;
+    } ctypes;
+
+    struct {
+        struct qtype_slot *slots;
+        unsigned cap, count;
+        astn plain[IR_TYPE_COUNT];  // no derived type
+        unsigned long lookups;
+    } irtypes;
+};
+
+astn type_intern(astn t);
+int type_size(astn t);
+int type_align(astn t);
+
+astn qtype_get(ir_type_E t, astn derived);
+
+void typetab_report(FILE *f);
+void typetab_free(struct typetab *t);
+
+#endif
@@ -0,0 +1,362 @@
+/*
+ * ppcache.c
+ *
+ * Each entry is a file in the cache directory, named for a hash of its key:
+ * the working directory, the input file's name as given, and the environment
+ * gcc -E looks at. It holds
+ *
+ *   dcc-ppcache <key length>\n<key>\n
+ *   <number of files>\n
+ *   <mtime s ns> <ctime s ns> <size> <inode> <name length> <name>\n  for each file gcc -E read
+ *   <the preprocessed text>
+ *
+ * and it's good for as long as all of those files look the same. Entries are
+ * written under a temporary name and renamed into place, so the server's
+ * workers only ever see whole ones.
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // memmem()
+#endif
+
+#include "ppcache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "util.h"
+
+#ifdef __APPLE__
+#define st_mtim st_mtimespec
+#define st_ctim st_ctimespec
+#endif
+
+static const char *cache_dir;
+
+// what gcc -E looks at besides the files themselves
+static const char *const key_env[] = {
+    "PATH",
+    "CPATH",
+    "C_INCLUDE_PATH",
+    "GCC_EXEC_PREFIX",
+    "COMPILER_PATH",
+    "SOURCE_DATE_EPOCH",
+};
+
+// what we check to see if a file has changed
+struct stamp {
+    long long mtime_s, mtime_ns;
+    long long ctime_s, ctime_ns;
+    long long size;
+    unsigned long long ino;
+};
+
+void ppcache_init(const char *dir) {
+    cache_dir = dir;
+}
+
+bool ppcache_enabled(void) {
+    return cache_dir;
+}
+
+static bool get_stamp(const char *path, struct stamp *s) {
+    struct stat st;
+    if (stat(path, &st))
+        return false;
+
+    *s = (struct stamp){
+        .mtime_s = st.st_mtim.tv_sec,
+        .mtime_ns = st.st_mtim.tv_nsec,
+        .ctime_s = st.st_ctim.tv_sec,
+        .ctime_ns = st.st_ctim.tv_nsec,
+        .size = st.st_size,
+        .ino = st.st_ino,
+    };
+    return true;
+}
+
+static bool same_stamp(const struct stamp *a, const struct stamp *b) {
+    return a->mtime_s == b->mtime_s && a->mtime_ns == b->mtime_ns &&
+           a->ctime_s == b->ctime_s && a->ctime_ns == b->ctime_ns &&
+           a->size == b->size && a->ino == b->ino;
+}
+
+// a string being built
+struct buf {
+    char *p;
+    size_t len, cap;
+};
+
+static void buf_add(struct buf *b, const char *s, size_t n) {
+    if (b->len + n > b->cap) {
+        b->cap = (b->len + n) * 2;
+        b->p = safe_realloc(b->p, b->cap);
+    }
+
+    memcpy(b->p + b->len, s, n);
+    b->len += n;
+}
+
+// with the NUL
+static void buf_add_str(struct buf *b, const char *s) {
+    buf_add(b, s, strlen(s) + 1);
+}
+
+static char *entry_key(const char *in_file, size_t *len) {
+    char *cwd = getcwd(NULL, 0);
+    if (!cwd)
+        RED_ERROR("Error getting the working directory: %s", strerror(errno));
+
+    struct buf b = {0};
+    buf_add_str(&b, cwd);
+    buf_add_str(&b, in_file);
+
+    for (size_t i = 0; i < sizeof(key_env) / sizeof(*key_env); i++) {
+        const char *v = getenv(key_env[i]);
+        buf_add(&b, key_env[i], strlen(key_env[i]));
+        buf_add_str(&b, v ? "=" : "");
+        if (v)
+            buf_add_str(&b, v);
+    }
+
+    free(cwd);
+
+    *len = b.len;
+    return b.p;
+}
+
+// FNV-1a of the key
+static char *entry_path(const char *key, size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)key[i];
+        h *= 1099511628211ULL;
+    }
+
+    char *path = safe_malloc(strlen(cache_dir) + 18);
+    sprintf(path, "%s/%016llx", cache_dir, (unsigned long long)h);
+    return path;
+}
+
+// read past the header, making sure the entry is for key and still good
+static bool entry_valid(FILE *f, const char *key, size_t key_len) {
+    size_t len;
+    if (fscanf(f, "dcc-ppcache %zu", &len) != 1 || len != key_len || fgetc(f) != '\n')
+        return false;
+
+    char *k = safe_malloc(len);
+    bool same = fread(k, 1, len, f) == len && !memcmp(k, key, len) && fgetc(f) == '\n';
+    free(k);
+
+    unsigned long n;
+    if (!same || fscanf(f, "%lu", &n) != 1 || fgetc(f) != '\n')
+        return false;
+
+    for (unsigned long i = 0; i < n; i++) {
+        struct stamp then, now;
+        size_t name_len;
+
+        if (fscanf(f, "%lld %lld %lld %lld %lld %llu %zu", &then.mtime_s, &then.mtime_ns,
+                   &then.ctime_s, &then.ctime_ns, &then.size, &then.ino, &name_len) != 7 ||
+            fgetc(f) != ' ')
+            return false;
+
+        char *name = safe_malloc(name_len + 1);
+        bool good = fread(name, 1, name_len, f) == name_len && fgetc(f) == '\n';
+        name[name_len] = '\0';
+
+        good = good && get_stamp(name, &now) && same_stamp(&then, &now);
+        free(name);
+
+        if (!good)
+            return false;
+    }
+
+    return true;
+}
+
+FILE *ppcache_lookup(const char *in_file) {
+    size_t key_len;
+    char *key = entry_key(in_file, &key_len);
+    char *path = entry_path(key, key_len);
+
+    FILE *f = fopen(path, "r");
+    if (f && !entry_valid(f, key, key_len)) {
+        fclose(f);
+        f = NULL;
+    }
+
+    free(path);
+    free(key);
+    return f;
+}
+
+static char *read_file(const char *path, size_t *len) {
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return NULL;
+
+    struct buf b = {0};
+    char chunk[64 * 1024];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+        buf_add(&b, chunk, n);
+
+    buf_add(&b, "", 1);
+    fclose(f);
+
+    *len = b.len - 1;
+    return b.p;
+}
+
+static bool is_dep_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/*
+ * The prerequisites of the make rule gcc -MD wrote to path: names separated
+ * by whitespace and backslash-newlines, with '\ ', '\#' and '$$' escaped.
+ */
+static char **read_deps(const char *path, size_t *n) {
+    size_t len;
+    char *text = read_file(path, &len);
+    if (!text)
+        return NULL;
+
+    char *p = memchr(text, ':', len); // the target is one of our temporaries
+    char *end = text + len;
+    char **names = NULL;
+    size_t cap = 0;
+
+    *n = 0;
+    for (p = p ? p + 1 : end; p < end; ) {
+        if (is_dep_space(*p) || (p[0] == '\\' && (p[1] == '\n' || p[1] == '\r'))) {
+            p++;
+            continue;
+        }
+
+        char *start = p;
+        while (p < end && !is_dep_space(*p) && !(p[0] == '\\' && (p[1] == '\n' || p[1] == '\r')))
+            p += (p[0] == '\\' && p[1] == ' ') ? 2 : 1;
+
+        char *name = safe_malloc(p - start + 1), *w = name;
+        for (char *r = start; r < p; r++) {
+            if ((r[0] == '\\' && (r[1] == ' ' || r[1] == '#')) || (r[0] == '$' && r[1] == '$'))
+                r++;
+            *w++ = *r;
+        }
+        *w = '\0';
+
+        if (*n == cap) {
+            cap = cap ? cap * 2 : 64;
+            names = safe_realloc(names, cap * sizeof(char *));
+        }
+        names[(*n)++] = name;
+    }
+
+    free(text);
+    return names;
+}
+
+// __DATE__ and friends would be frozen at whenever we preprocessed
+static bool uses_time(const char *path) {
+    static const char *const macros[] = {"__DATE__", "__TIME__", "__TIMESTAMP__"};
+
+    size_t len;
+    char *text = read_file(path, &len);
+    if (!text)
+        return true;
+
+    bool found = false;
+    for (size_t i = 0; i < sizeof(macros) / sizeof(*macros); i++)
+        found = found || memmem(text, len, macros[i], strlen(macros[i]));
+
+    free(text);
+    return found;
+}
+
+static void write_entry(const char *in_file, const char *text,
+                        char **names, const struct stamp *stamps, size_t n) {
+    size_t key_len;
+    char *key = entry_key(in_file, &key_len);
+    char *path = entry_path(key, key_len);
+
+    char *tmp = safe_malloc(strlen(path) + 24);
+    sprintf(tmp, "%s.%ld", path, (long)getpid());
+
+    FILE *src = fopen(text, "r");
+    FILE *out = src ? fopen(tmp, "w") : NULL;
+
+    if (out) {
+        fprintf(out, "dcc-ppcache %zu\n", key_len);
+        fwrite(key, 1, key_len, out);
+        fprintf(out, "\n%zu\n", n);
+
+        for (size_t i = 0; i < n; i++) {
+            const struct stamp *s = &stamps[i];
+            fprintf(out, "%lld %lld %lld %lld %lld %llu %zu %s\n", s->mtime_s, s->mtime_ns,
+                    s->ctime_s, s->ctime_ns, s->size, s->ino, strlen(names[i]), names[i]);
+        }
+
+        char chunk[64 * 1024];
+        size_t got;
+        while ((got = fread(chunk, 1, sizeof(chunk), src)) > 0)
+            fwrite(chunk, 1, got, out);
+
+        bool ok = !ferror(src) && !ferror(out);
+        if (fclose(out) || !ok || rename(tmp, path))
+            unlink(tmp);
+    }
+
+    if (src)
+        fclose(src);
+
+    free(tmp);
+    free(path);
+    free(key);
+}
+
+void ppcache_store(const char *in_file, const char *text, const char *deps) {
+    size_t n;
+    char **names = read_deps(deps, &n);
+    if (!names)
+        return;
+
+    struct stamp *stamps = safe_calloc(n ? n : 1, sizeof(struct stamp));
+    bool keep = true;
+
+    for (size_t i = 0; i < n && keep; i++)
+        keep = get_stamp(names[i], &stamps[i]) && !uses_time(names[i]);
+
+    if (keep)
+        write_entry(in_file, text, names, stamps, n);
+
+    for (size_t i = 0; i < n; i++)
+        free(names[i]);
+    free(names);
+    free(stamps);
+}
+
+void ppcache_remove(void) {
+    DIR *d = opendir(cache_dir);
+    if (d) {
+        struct dirent *e;
+        while ((e = readdir(d))) {
+            if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, ".."))
+                continue;
+
+            char *path = safe_malloc(strlen(cache_dir) + strlen(e->d_name) + 2);
+            sprintf(path, "%s/%s", cache_dir, e->d_name);
+            unlink(path);
+            free(path);
+        }
+        closedir(d);
+    }
+
+    rmdir(cache_dir);
+    cache_dir = NULL;
+}
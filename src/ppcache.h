@@ -0,0 +1,31 @@
+/*
+ * ppcache.h
+ *
+ * The compile server's preprocessor cache: what gcc -E made of an input
+ * file, kept until the file or anything it included changes. Only a server
+ * turns it on - a one-off dcc would never see the same input twice.
+ */
+
+#ifndef PPCACHE_H
+#define PPCACHE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+// keep entries in dir, which must exist; the cache is off until this is called
+void ppcache_init(const char *dir);
+bool ppcache_enabled(void);
+
+// in_file as preprocessed before, open at the start of the text, or NULL
+FILE *ppcache_lookup(const char *in_file);
+
+/*
+ * Keep text, the output of gcc -E -MD -MF deps in_file, as in_file's entry -
+ * unless something in there uses the time of day, which we can't keep.
+ */
+void ppcache_store(const char *in_file, const char *text, const char *deps);
+
+// throw away the entries and the directory
+void ppcache_remove(void);
+
+#endif
@@ -0,0 +1,475 @@
+/*
+ * server.c
+ *
+ * The compile server. A client connects to the server's Unix domain socket
+ * and sends one request: its stdin, stdout and stderr (as SCM_RIGHTS), then
+ *
+ *   u32 length | u32 umask | u32 argc | u32 envc | cwd | argv... | environ...
+ *
+ * with the strings NUL-terminated. The server answers with the driver's exit
+ * status as an i32 once it's done.
+ *
+ * Each request is run by a worker forked from the server: it starts out
+ * already loaded and set up, and whatever the compilation does to memory goes
+ * away with it, so the server itself never accumulates anything. The worker
+ * takes on the client's directory, environment and umask, so diagnostics go
+ * straight to the client's terminal and outputs land where they would have
+ * without the server.
+ *
+ * Since a worker acts with the server's rights, the socket is only
+ * accessible to its owner, and anyone else who connects anyway (say, through
+ * a directory the socket was moved into) is turned away.
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // struct ucred
+#endif
+
+#include "server.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ppcache.h"
+#include "util.h"
+
+extern char **environ;
+
+#define REQUEST_MAX (16 * 1024 * 1024)
+#define REQUEST_FDS 3 // stdin, stdout, stderr
+
+static int unix_socket(const char *path, struct sockaddr_un *addr) {
+    if (strlen(path) >= sizeof(addr->sun_path))
+        RED_ERROR("Socket path too long: %s", path);
+
+    *addr = (struct sockaddr_un){.sun_family = AF_UNIX};
+    strcpy(addr->sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        RED_ERROR("Error creating socket: %s", strerror(errno));
+
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+}
+
+static bool write_all(int fd, const void *p, size_t n) {
+    while (n) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return false;
+
+        p = (const char *)p + w;
+        n -= w;
+    }
+
+    return true;
+}
+
+static bool read_all(int fd, void *p, size_t n) {
+    while (n) {
+        ssize_t r = read(fd, p, n);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return false;
+
+        p = (char *)p + r;
+        n -= r;
+    }
+
+    return true;
+}
+
+union fd_cmsg {
+    char buf[CMSG_SPACE(sizeof(int) * REQUEST_FDS)];
+    struct cmsghdr align;
+};
+
+static void put_u32(char **p, uint32_t v) {
+    memcpy(*p, &v, sizeof(v));
+    *p += sizeof(v);
+}
+
+static void put_str(char **p, const char *s) {
+    size_t n = strlen(s) + 1;
+    memcpy(*p, s, n);
+    *p += n;
+}
+
+int client_run(const char *path, int argc, char **argv) {
+    struct sockaddr_un addr;
+    int sock = unix_socket(path, &addr);
+
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr))) {
+        close(sock);
+        return -1;
+    }
+
+    char *cwd = getcwd(NULL, 0);
+    if (!cwd)
+        RED_ERROR("Error getting the working directory: %s", strerror(errno));
+
+    mode_t mask = umask(0);
+    umask(mask);
+
+    uint32_t envc = 0;
+    size_t len = 4 * sizeof(uint32_t) + strlen(cwd) + 1;
+    for (int i = 0; i < argc; i++)
+        len += strlen(argv[i]) + 1;
+    for (; environ[envc]; envc++)
+        len += strlen(environ[envc]) + 1;
+
+    if (len > REQUEST_MAX)
+        RED_ERROR("Command line and environment too big for the compile server");
+
+    char *req = safe_malloc(len), *p = req;
+    put_u32(&p, (uint32_t)(len - sizeof(uint32_t)));
+    put_u32(&p, mask);
+    put_u32(&p, (uint32_t)argc);
+    put_u32(&p, envc);
+    put_str(&p, cwd);
+    for (int i = 0; i < argc; i++)
+        put_str(&p, argv[i]);
+    for (uint32_t i = 0; i < envc; i++)
+        put_str(&p, environ[i]);
+
+    // the length goes out along with our standard streams, then the rest
+    union fd_cmsg ctl = {0};
+    struct iovec iov = {.iov_base = req, .iov_len = sizeof(uint32_t)};
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = ctl.buf,
+        .msg_controllen = sizeof(ctl.buf),
+    };
+
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(int) * REQUEST_FDS);
+    memcpy(CMSG_DATA(c), (int[REQUEST_FDS]){STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO},
+           sizeof(int) * REQUEST_FDS);
+
+    ssize_t sent;
+    while ((sent = sendmsg(sock, &msg, 0)) < 0 && errno == EINTR)
+        ;
+
+    // (with a standard stream closed, say) - we'll just do it ourselves
+    bool ok = sent == sizeof(uint32_t) && write_all(sock, req + sent, len - sent);
+
+    free(req);
+    free(cwd);
+
+    if (!ok) {
+        close(sock);
+        return -1;
+    }
+
+    int32_t status;
+    if (!read_all(sock, &status, sizeof(status)))
+        RED_ERROR("Lost the compile server on %s", path);
+
+    close(sock);
+    return status;
+}
+
+// a request being taken apart
+struct reader {
+    char *p, *end;
+};
+
+static uint32_t get_u32(struct reader *r) {
+    uint32_t v;
+    if (r->end - r->p < (ptrdiff_t)sizeof(v))
+        RED_ERROR("Malformed request from client");
+
+    memcpy(&v, r->p, sizeof(v));
+    r->p += sizeof(v);
+    return v;
+}
+
+static char *get_str(struct reader *r) {
+    char *s = r->p;
+    char *nul = memchr(s, '\0', r->end - s);
+    if (!nul)
+        RED_ERROR("Malformed request from client");
+
+    r->p = nul + 1;
+    return s;
+}
+
+/*
+ * In a fresh worker: take the request from conn, become the client, and run
+ * the driver for it. Returns the driver's status.
+ */
+static int serve_request(int conn, dcc_driver driver) {
+    uint32_t len;
+    union fd_cmsg ctl;
+    struct iovec iov = {.iov_base = &len, .iov_len = sizeof(len)};
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = ctl.buf,
+        .msg_controllen = sizeof(ctl.buf),
+    };
+
+    ssize_t got;
+    while ((got = recvmsg(conn, &msg, 0)) < 0 && errno == EINTR)
+        ;
+
+    // another server checking whether we're here
+    if (!got)
+        return 0;
+
+    struct cmsghdr *c = got > 0 ? CMSG_FIRSTHDR(&msg) : NULL;
+    if (!c || c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS ||
+        c->cmsg_len != CMSG_LEN(sizeof(int) * REQUEST_FDS))
+        RED_ERROR("Malformed request from client");
+
+    int fds[REQUEST_FDS];
+    memcpy(fds, CMSG_DATA(c), sizeof(fds));
+
+    if (!read_all(conn, (char *)&len + got, sizeof(len) - got) || len > REQUEST_MAX)
+        RED_ERROR("Malformed request from client");
+
+    char *req = safe_malloc(len ? len : 1);
+    if (!read_all(conn, req, len))
+        RED_ERROR("Malformed request from client");
+
+    close(conn);
+
+    // from here on, complaints go to the client
+    for (int i = 0; i < REQUEST_FDS; i++)
+        dup2(fds[i], i);
+    for (int i = 0; i < REQUEST_FDS; i++)
+        close(fds[i]);
+
+    struct reader r = {.p = req, .end = req + len};
+    mode_t mask = get_u32(&r);
+    uint32_t argc = get_u32(&r);
+    uint32_t envc = get_u32(&r);
+    const char *cwd = get_str(&r);
+
+    if (argc < 1 || argc > len || envc > len)
+        RED_ERROR("Malformed request from client");
+
+    char **argv = safe_calloc(argc + 1, sizeof(char *));
+    for (uint32_t i = 0; i < argc; i++)
+        argv[i] = get_str(&r);
+
+    char **env = safe_calloc(envc + 1, sizeof(char *));
+    for (uint32_t i = 0; i < envc; i++)
+        env[i] = get_str(&r);
+
+    umask(mask);
+    if (chdir(cwd))
+        RED_ERROR("Error changing to %s: %s", cwd, strerror(errno));
+    environ = env;
+
+    // argv, env and req live as long as we do
+    return driver((int)argc, argv);
+}
+
+// SIGCHLD, SIGTERM and SIGINT all wake the server through here
+static int wake_pipe[2];
+static volatile sig_atomic_t stopping;
+
+static void on_signal(int sig) {
+    int saved = errno;
+
+    if (sig != SIGCHLD)
+        stopping = 1;
+
+    ssize_t w = write(wake_pipe[1], "", 1);
+    (void)w; // if the pipe's full, a wakeup is already pending
+
+    errno = saved;
+}
+
+struct worker {
+    pid_t pid;
+    int conn;       // the client, waiting for the status
+};
+
+// tell the clients of finished workers how it went; with block, wait for all of them
+static void reap_workers(struct worker *workers, int *n, bool block) {
+    while (*n) {
+        int wstatus;
+        pid_t pid = waitpid(-1, &wstatus, block ? 0 : WNOHANG);
+        if (pid < 0 && errno == EINTR)
+            continue;
+        if (pid <= 0)
+            return;
+
+        for (int i = 0; i < *n; i++) {
+            if (workers[i].pid != pid)
+                continue;
+
+            int32_t status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 128 + WTERMSIG(wstatus);
+            write_all(workers[i].conn, &status, sizeof(status)); // the client may be gone
+            close(workers[i].conn);
+
+            workers[i] = workers[--*n];
+            break;
+        }
+    }
+}
+
+// whether the client on the other end of conn runs as our effective user
+static bool peer_is_us(int conn) {
+#ifdef SO_PEERCRED
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) || len != sizeof(cred))
+        return false;
+
+    return cred.uid == geteuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    if (getpeereid(conn, &uid, &gid))
+        return false;
+
+    return uid == geteuid();
+#endif
+}
+
+_Noreturn void server_run(const char *path, dcc_driver driver) {
+    struct sockaddr_un addr;
+    int listener = unix_socket(path, &addr);
+
+    // a socket nobody answers on is left over from a server that's gone
+    struct stat st;
+    if (!lstat(path, &st) && S_ISSOCK(st.st_mode)) {
+        int probe = unix_socket(path, &addr);
+        if (!connect(probe, (struct sockaddr *)&addr, sizeof(addr)))
+            RED_ERROR("A compile server is already listening on %s", path);
+        close(probe);
+        unlink(path);
+    }
+
+    // the socket is created owner-only, so nobody can connect in between
+    mode_t mask = umask(077);
+    int bound = bind(listener, (struct sockaddr *)&addr, sizeof(addr));
+    umask(mask);
+
+    if (bound || listen(listener, SOMAXCONN))
+        RED_ERROR("Error listening on %s: %s", path, strerror(errno));
+
+    if (pipe(wake_pipe))
+        RED_ERROR("Error creating pipe: %s", strerror(errno));
+
+    for (int i = 0; i < 2; i++) {
+        fcntl(wake_pipe[i], F_SETFD, FD_CLOEXEC);
+        fcntl(wake_pipe[i], F_SETFL, O_NONBLOCK);
+    }
+
+    struct sigaction sa = {.sa_handler = on_signal, .sa_flags = SA_RESTART};
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGCHLD, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    // workers share the preprocessor cache, which goes away with us
+    const char *tmpdir = getenv("TMPDIR");
+    char *cache = safe_malloc(strlen(tmpdir ? tmpdir : "/tmp") + 24);
+    sprintf(cache, "%s/dcc-server-XXXXXX", tmpdir ? tmpdir : "/tmp");
+    if (!mkdtemp(cache))
+        RED_ERROR("Error creating the preprocessor cache: %s", strerror(errno));
+
+    ppcache_init(cache);
+
+    eprintf("dcc: serving on %s\n", path);
+
+    struct worker *workers = NULL;
+    int nworkers = 0, cap = 0;
+
+    while (!stopping) {
+        struct pollfd pfds[2] = {
+            {.fd = listener, .events = POLLIN},
+            {.fd = wake_pipe[0], .events = POLLIN},
+        };
+
+        if (poll(pfds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            RED_ERROR("Error waiting for clients: %s", strerror(errno));
+        }
+
+        char drain[64];
+        while (read(wake_pipe[0], drain, sizeof(drain)) > 0)
+            ;
+
+        reap_workers(workers, &nworkers, false);
+
+        if (!(pfds[0].revents & POLLIN))
+            continue;
+
+        int conn = accept(listener, NULL, NULL);
+        if (conn < 0)
+            continue; // interrupted, or the client already gave up
+
+        if (!peer_is_us(conn)) {
+            eprintf(BRED "Turned away a client running as another user" RESET "\n");
+            close(conn);
+            continue;
+        }
+
+        fcntl(conn, F_SETFD, FD_CLOEXEC);
+
+        if (nworkers == cap) {
+            cap = cap ? cap * 2 : 16;
+            workers = safe_realloc(workers, cap * sizeof(struct worker));
+        }
+
+        fflush(NULL); // don't let the worker flush our buffers a second time
+
+        pid_t pid = fork();
+        if (pid < 0) {
+            eprintf(BRED "Error forking worker: %s" RESET "\n", strerror(errno));
+            close(conn);
+            continue;
+        }
+
+        if (!pid) {
+            signal(SIGCHLD, SIG_DFL);
+            signal(SIGTERM, SIG_DFL);
+            signal(SIGINT, SIG_DFL);
+            close(listener);
+            close(wake_pipe[0]);
+            close(wake_pipe[1]);
+            for (int i = 0; i < nworkers; i++)
+                close(workers[i].conn);
+            free(workers);
+
+            exit(serve_request(conn, driver));
+        }
+
+        workers[nworkers++] = (struct worker){.pid = pid, .conn = conn};
+    }
+
+    // stop taking requests, but see the running ones through
+    close(listener);
+    unlink(path);
+
+    reap_workers(workers, &nworkers, true);
+    free(workers);
+
+    ppcache_remove();
+    free(cache);
+
+    exit(0);
+}
@@ -0,0 +1,24 @@
+/*
+ * server.h
+ *
+ * dcc --server and dcc --client: a long-lived dcc that runs the driver on
+ * behalf of thin clients, over a Unix domain socket.
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+// the driver's main(), minus everything that only needs doing once
+typedef int (*dcc_driver)(int argc, char **argv);
+
+// listen on path and run driver for each client that connects; never returns
+_Noreturn void server_run(const char *path, dcc_driver driver);
+
+/*
+ * Have the server on path run the driver with our arguments, directory,
+ * environment, umask and standard streams. Returns its exit status, or -1 if
+ * there's no server there.
+ */
+int client_run(const char *path, int argc, char **argv);
+
+#endif
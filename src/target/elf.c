@@ -0,0 +1,287 @@
+/*
+ * elf.c
+ *
+ * ELF64 relocatable object writer. The file is laid out as
+ *
+ *   ELF header | section contents | .rela.* | .symtab | .strtab | .shstrtab | section headers
+ *
+ * The section header table has the caller's sections in the order they were
+ * given, each followed by its .rela section if it has one (as gas orders
+ * them), then the three tables.
+ */
+#include "elf.h"
+
+#include <string.h>
+
+#include "memstat.h"
+#include "util.h"
+
+#define EHDR_SIZE 64
+#define SHDR_SIZE 64
+#define SYM_SIZE 24
+#define RELA_SIZE 24
+
+// a string table being built
+struct strtab {
+    char *buf;
+    size_t len, cap;
+};
+
+static uint32_t strtab_add(struct strtab *t, const char *s) {
+    size_t n = strlen(s) + 1;
+
+    if (t->len + n > t->cap) {
+        t->cap = (t->len + n) * 2;
+        t->buf = safe_realloc(t->buf, t->cap);
+        mem_note(MEM_ASSEMBLER, t->cap);
+    }
+
+    memcpy(t->buf + t->len, s, n);
+    t->len += n;
+
+    return (uint32_t)(t->len - n);
+}
+
+// the output, and how far into it we are
+struct writer {
+    struct outbuf *o;
+    uint64_t pos;
+};
+
+static void put(struct writer *w, uint64_t v, unsigned bytes) {
+    unsigned char b[8];
+    for (unsigned i = 0; i < bytes; i++)
+        b[i] = (unsigned char)(v >> (8 * i));
+
+    outbuf_write(w->o, (const char *)b, bytes);
+    w->pos += bytes;
+}
+
+static void put_bytes(struct writer *w, const void *p, uint64_t n) {
+    outbuf_write(w->o, p, n);
+    w->pos += n;
+}
+
+static void pad_to(struct writer *w, uint64_t off) {
+    while (w->pos < off)
+        put(w, 0, 1);
+}
+
+static void put_zeros(struct writer *w, uint64_t n) {
+    pad_to(w, w->pos + n);
+}
+
+static uint64_t align_up(uint64_t v, uint64_t align) {
+    return align > 1 ? (v + align - 1) / align * align : v;
+}
+
+static void put_shdr(struct writer *w, uint32_t name, uint32_t type, uint64_t flags,
+                     uint64_t off, uint64_t size, uint32_t link, uint32_t info,
+                     uint64_t align, uint64_t entsize) {
+    put(w, name, 4);
+    put(w, type, 4);
+    put(w, flags, 8);
+    put(w, 0, 8);           // sh_addr
+    put(w, off, 8);
+    put(w, size, 8);
+    put(w, link, 4);
+    put(w, info, 4);
+    put(w, align, 8);
+    put(w, entsize, 8);
+}
+
+void elf_write(struct outbuf *o,
+               const struct elf_section *sections, unsigned nsections,
+               const struct elf_symbol *syms, unsigned nsyms) {
+    struct strtab strs = {0}, shstrs = {0};
+    strtab_add(&strs, "");
+    strtab_add(&shstrs, "");
+
+    // locals have to come first in .symtab; sym_index[i] is where syms[i] goes
+    unsigned *sym_index = safe_calloc(nsyms ? nsyms : 1, sizeof(unsigned));
+    unsigned *order = safe_calloc(nsyms ? nsyms : 1, sizeof(unsigned));
+    mem_note(MEM_ASSEMBLER, 2 * (nsyms ? nsyms : 1) * sizeof(unsigned));
+    unsigned nlocal = 0, n = 0;
+
+    for (unsigned pass = 0; pass < 2; pass++) {
+        for (unsigned i = 0; i < nsyms; i++) {
+            if ((syms[i].bind == ELF_STB_LOCAL) != !pass)
+                continue;
+
+            order[n] = i;
+            sym_index[i] = ++n; // 0 is the null symbol
+        }
+
+        if (!pass)
+            nlocal = n;
+    }
+
+    // section header indices: each of ours, then its .rela if it needs one
+    unsigned *sec_idx = safe_calloc(nsections ? nsections : 1, sizeof(unsigned));
+    mem_note(MEM_ASSEMBLER, (nsections ? nsections : 1) * sizeof(unsigned));
+    unsigned idx = 1;
+    for (unsigned i = 0; i < nsections; i++) {
+        sec_idx[i] = idx++;
+        if (sections[i].nrelas)
+            idx++;
+    }
+
+    unsigned symtab_idx = idx;
+    unsigned strtab_idx = symtab_idx + 1;
+    unsigned shstrtab_idx = strtab_idx + 1;
+    unsigned nheaders = shstrtab_idx + 1;
+
+    // where everything goes
+    uint64_t *sec_off = safe_calloc(nsections ? nsections : 1, sizeof(uint64_t));
+    uint64_t *rela_off = safe_calloc(nsections ? nsections : 1, sizeof(uint64_t));
+    uint32_t *sec_name = safe_calloc(nsections ? nsections : 1, sizeof(uint32_t));
+    uint32_t *rela_name = safe_calloc(nsections ? nsections : 1, sizeof(uint32_t));
+    mem_note(MEM_ASSEMBLER, (nsections ? nsections : 1) * 2 * (sizeof(uint64_t) + sizeof(uint32_t)));
+
+    uint64_t off = EHDR_SIZE;
+    for (unsigned i = 0; i < nsections; i++) {
+        const struct elf_section *s = &sections[i];
+        off = align_up(off, s->align);
+        sec_off[i] = off;
+        if (s->type != ELF_SHT_NOBITS)
+            off += s->size;
+    }
+
+    for (unsigned i = 0; i < nsections; i++) {
+        if (!sections[i].nrelas)
+            continue;
+
+        off = align_up(off, 8);
+        rela_off[i] = off;
+        off += (uint64_t)sections[i].nrelas * RELA_SIZE;
+    }
+
+    // names, in section header order
+    for (unsigned i = 0; i < nsections; i++)
+        sec_name[i] = strtab_add(&shstrs, sections[i].name);
+
+    for (unsigned i = 0; i < nsections; i++) {
+        if (!sections[i].nrelas)
+            continue;
+
+        char *name = safe_malloc(strlen(sections[i].name) + sizeof(".rela"));
+        mem_note(MEM_ASSEMBLER, strlen(sections[i].name) + sizeof(".rela"));
+        strcpy(name, ".rela");
+        strcat(name, sections[i].name);
+        rela_name[i] = strtab_add(&shstrs, name);
+        free(name);
+    }
+
+    uint32_t symtab_name = strtab_add(&shstrs, ".symtab");
+    uint32_t strtab_name = strtab_add(&shstrs, ".strtab");
+    uint32_t shstrtab_name = strtab_add(&shstrs, ".shstrtab");
+
+    uint32_t *sym_name = safe_calloc(nsyms ? nsyms : 1, sizeof(uint32_t));
+    mem_note(MEM_ASSEMBLER, (nsyms ? nsyms : 1) * sizeof(uint32_t));
+    for (unsigned i = 0; i < nsyms; i++)
+        sym_name[i] = *syms[i].name ? strtab_add(&strs, syms[i].name) : 0;
+
+    off = align_up(off, 8);
+    uint64_t symtab_off = off;
+    off += (uint64_t)(nsyms + 1) * SYM_SIZE;
+
+    uint64_t strtab_off = off;
+    off += strs.len;
+
+    uint64_t shstrtab_off = off;
+    off += shstrs.len;
+
+    uint64_t shoff = align_up(off, 8);
+
+    // now write it all out, in that order
+    struct writer w = {.o = o};
+
+    static const unsigned char ident[16] = {
+        0x7f, 'E', 'L', 'F',
+        2,      // ELFCLASS64
+        1,      // ELFDATA2LSB
+        1,      // EV_CURRENT
+        0,      // ELFOSABI_NONE
+    };
+    put_bytes(&w, ident, sizeof(ident));
+    put(&w, 1, 2);          // ET_REL
+    put(&w, 62, 2);         // EM_X86_64
+    put(&w, 1, 4);          // EV_CURRENT
+    put(&w, 0, 8);          // e_entry
+    put(&w, 0, 8);          // e_phoff
+    put(&w, shoff, 8);
+    put(&w, 0, 4);          // e_flags
+    put(&w, EHDR_SIZE, 2);
+    put(&w, 0, 2);          // e_phentsize
+    put(&w, 0, 2);          // e_phnum
+    put(&w, SHDR_SIZE, 2);
+    put(&w, nheaders, 2);
+    put(&w, shstrtab_idx, 2);
+
+    for (unsigned i = 0; i < nsections; i++) {
+        const struct elf_section *s = &sections[i];
+        if (s->type == ELF_SHT_NOBITS)
+            continue;
+
+        pad_to(&w, sec_off[i]);
+        put_bytes(&w, s->data, s->size);
+    }
+
+    for (unsigned i = 0; i < nsections; i++) {
+        const struct elf_section *s = &sections[i];
+        if (!s->nrelas)
+            continue;
+
+        pad_to(&w, rela_off[i]);
+        for (unsigned r = 0; r < s->nrelas; r++) {
+            const struct elf_rela *rel = &s->relas[r];
+            put(&w, rel->offset, 8);
+            put(&w, (uint64_t)sym_index[rel->sym] << 32 | rel->type, 8);
+            put(&w, (uint64_t)rel->addend, 8);
+        }
+    }
+
+    pad_to(&w, symtab_off);
+    put_zeros(&w, SYM_SIZE);
+    for (unsigned k = 0; k < nsyms; k++) {
+        const struct elf_symbol *s = &syms[order[k]];
+        put(&w, sym_name[order[k]], 4);
+        put(&w, (unsigned)(s->bind << 4 | s->type), 1);
+        put(&w, 0, 1);      // STV_DEFAULT
+        put(&w, s->section ? sec_idx[s->section - 1] : 0, 2);
+        put(&w, s->value, 8);
+        put(&w, 0, 8);      // st_size
+    }
+
+    put_bytes(&w, strs.buf, strs.len);
+    put_bytes(&w, shstrs.buf, shstrs.len);
+
+    pad_to(&w, shoff);
+    put_zeros(&w, SHDR_SIZE);
+
+    for (unsigned i = 0; i < nsections; i++) {
+        const struct elf_section *s = &sections[i];
+        put_shdr(&w, sec_name[i], s->type, s->flags, sec_off[i], s->size,
+                 0, 0, s->align ? s->align : 1, s->entsize);
+
+        if (s->nrelas)
+            put_shdr(&w, rela_name[i], ELF_SHT_RELA, ELF_SHF_INFO_LINK, rela_off[i],
+                     (uint64_t)s->nrelas * RELA_SIZE, symtab_idx, sec_idx[i], 8, RELA_SIZE);
+    }
+
+    put_shdr(&w, symtab_name, ELF_SHT_SYMTAB, 0, symtab_off, (uint64_t)(nsyms + 1) * SYM_SIZE,
+             strtab_idx, 1 + nlocal, 8, SYM_SIZE);
+    put_shdr(&w, strtab_name, ELF_SHT_STRTAB, 0, strtab_off, strs.len, 0, 0, 1, 0);
+    put_shdr(&w, shstrtab_name, ELF_SHT_STRTAB, 0, shstrtab_off, shstrs.len, 0, 0, 1, 0);
+
+    free(sec_idx);
+    free(sym_name);
+    free(rela_name);
+    free(sec_name);
+    free(rela_off);
+    free(sec_off);
+    free(order);
+    free(sym_index);
+    free(shstrs.buf);
+    free(strs.buf);
+}
@@ -0,0 +1,88 @@
+/*
+ * elf.h
+ *
+ * Writing ELF64 relocatable objects for x86-64. The caller hands over
+ * finished sections, symbols and relocations; this only lays them out in a
+ * file. Everything is written byte by byte, little-endian, so it doesn't
+ * need the host's <elf.h> (macOS has none).
+ */
+
+#ifndef ELF_H
+#define ELF_H
+
+#include <stdint.h>
+
+#include "outbuf.h"
+
+// the few ELF constants we need, named as in the spec
+enum {
+    ELF_SHT_PROGBITS = 1,
+    ELF_SHT_SYMTAB = 2,
+    ELF_SHT_STRTAB = 3,
+    ELF_SHT_RELA = 4,
+    ELF_SHT_NOTE = 7,
+    ELF_SHT_NOBITS = 8,
+};
+
+enum {
+    ELF_SHF_WRITE = 0x1,
+    ELF_SHF_ALLOC = 0x2,
+    ELF_SHF_EXECINSTR = 0x4,
+    ELF_SHF_MERGE = 0x10,
+    ELF_SHF_STRINGS = 0x20,
+    ELF_SHF_INFO_LINK = 0x40,
+};
+
+enum {
+    ELF_STB_LOCAL = 0,
+    ELF_STB_GLOBAL = 1,
+};
+
+enum {
+    ELF_STT_NOTYPE = 0,
+    ELF_STT_OBJECT = 1,
+    ELF_STT_FUNC = 2,
+    ELF_STT_SECTION = 3,
+};
+
+enum elf_reloc {
+    R_X86_64_64 = 1,
+    R_X86_64_PC32 = 2,
+    R_X86_64_PLT32 = 4,
+    R_X86_64_GOTPCREL = 9,
+};
+
+struct elf_rela {
+    uint64_t offset;        // into the section
+    unsigned sym;           // index into the symbols handed to elf_write()
+    enum elf_reloc type;
+    int64_t addend;
+};
+
+struct elf_section {
+    const char *name;
+    uint32_t type;          // ELF_SHT_*
+    uint64_t flags;         // ELF_SHF_*
+    uint64_t align;
+    uint64_t entsize;
+
+    const unsigned char *data; // NULL for ELF_SHT_NOBITS
+    uint64_t size;
+
+    const struct elf_rela *relas;
+    unsigned nrelas;
+};
+
+struct elf_symbol {
+    const char *name;       // "" for section symbols
+    unsigned section;       // 1 + index into the sections, 0 if undefined
+    uint64_t value;
+    unsigned char bind;     // ELF_STB_*
+    unsigned char type;     // ELF_STT_*
+};
+
+void elf_write(struct outbuf *o,
+               const struct elf_section *sections, unsigned nsections,
+               const struct elf_symbol *syms, unsigned nsyms);
+
+#endif
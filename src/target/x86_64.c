@@ -0,0 +1,869 @@
+/*
+ * x86_64.c
+ *
+ * Native backend: quads straight to x86-64 assembly (AT&T syntax, SysV ABI),
+ * for when compile latency matters more than the code we get. There's no
+ * register allocation - every temp gets its own stack slot, and each quad
+ * loads its operands into scratch registers, does its thing and stores the
+ * result back. Temps that are the address of an alloca aren't stored at all;
+ * they're just that offset from %rbp.
+ *
+ * Values are always loaded into full 64-bit registers, extended according to
+ * their type, so arithmetic and compares only ever need the 32- and 64-bit
+ * forms. Results are stored back at their own width.
+ */
+#include "x86_64.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ir.h"
+#include "ir_pass.h"
+#include "ir_state.h"
+#include "ir_types.h"
+#include "ir_util.h"
+
+#include "ast.h"
+#include "compilation.h"
+#include "memstat.h"
+#include "symtab.h"
+#include "util.h"
+
+// the sink we're writing into right now
+#define out (dcc_cc->print_out)
+
+enum reg { RAX, RCX, RDX, RSI, RDI, R8, R9, REG_COUNT };
+
+static const char *const reg_names[REG_COUNT][4] = {
+    [RAX] = {"%al", "%ax", "%eax", "%rax"},
+    [RCX] = {"%cl", "%cx", "%ecx", "%rcx"},
+    [RDX] = {"%dl", "%dx", "%edx", "%rdx"},
+    [RSI] = {"%sil", "%si", "%esi", "%rsi"},
+    [RDI] = {"%dil", "%di", "%edi", "%rdi"},
+    [R8]  = {"%r8b", "%r8w", "%r8d", "%r8"},
+    [R9]  = {"%r9b", "%r9w", "%r9d", "%r9"},
+};
+
+static const enum reg arg_regs[] = {RDI, RSI, RDX, RCX, R8, R9};
+#define ARG_REGS (sizeof(arg_regs) / sizeof(arg_regs[0]))
+
+// the function being generated
+struct frame {
+    const char *fn;
+    long *slot;         // %rbp offset of each temp, by tempno
+    bool *is_addr;      // the temp is %rbp + slot itself (an alloca)
+    long *shadow;       // for phis: where the predecessors leave its value, by tempno
+    unsigned ntemps;
+    long size;          // bytes below %rbp
+
+    // switch being generated
+    const char *sw_default;
+    astn sw_type;
+};
+
+// object file conventions differ a little between Linux and macOS
+static const char *sym_prefix(void) {
+    return dcc_is_host_darwin() ? "_" : "";
+}
+
+static const char *label_prefix(void) {
+    return dcc_is_host_darwin() ? "L" : ".L";
+}
+
+static void asmf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+static void asmf(const char *fmt, ...) {
+    char buf[512];
+
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+
+    if (n < 0 || (size_t)n >= sizeof(buf))
+        die("Assembly line too long.");
+
+    outbuf_write(out, buf, (size_t)n);
+}
+
+static unsigned size_index(long size) {
+    switch (size) {
+        case 1: return 0;
+        case 2: return 1;
+        case 4: return 2;
+        case 8: return 3;
+        default: die("No register of that size.");
+    }
+}
+
+static const char *reg(enum reg r, long size) {
+    return reg_names[r][size_index(size)];
+}
+
+static char suffix(long size) {
+    return "bwlq"[size_index(size)];
+}
+
+/*
+ * Size and alignment of anything get_qtype() takes, laid out the way LLVM
+ * would (natural alignment).
+ */
+static void layout(astn a, long *size, long *align) {
+    astn q = get_qtype(a);
+    ir_type_E t = ir_type(q);
+
+    switch (t) {
+        case IR_ptr:
+            *size = *align = 8;
+            return;
+
+        case IR_i1:
+            *size = *align = 1;
+            return;
+
+        case IR_arr:;
+            astn arr = ir_dtype(q);
+            layout(arr->Type.derived.target, size, align);
+            *size *= (long)arr->Type.derived.size->Num.number.integer;
+            return;
+
+        case IR_struct:;
+            long off = 0, max = 1;
+
+            for (sym m = ir_dtype(q)->Type.tagtype.symbol->members->first; m; m = m->next) {
+                long s, al;
+                layout(m->type, &s, &al);
+                off = (off + al - 1) / al * al + s;
+                if (al > max)
+                    max = al;
+            }
+
+            *size = (off + max - 1) / max * max;
+            *align = max;
+            return;
+
+        default:
+            if (is_integer(q)) {
+                *size = *align = (long)ir_type_size[t];
+                return;
+            }
+
+            qunimpl(a, "Native backend can't lay this type out :(");
+    }
+}
+
+static long size_of(astn a) {
+    long size, align;
+    layout(a, &size, &align);
+    return size;
+}
+
+static long field_offset(astn strct, long index) {
+    long off = 0;
+
+    for (sym m = ir_dtype(get_qtype(strct))->Type.tagtype.symbol->members->first; m; m = m->next) {
+        long s, al;
+        layout(m->type, &s, &al);
+        off = (off + al - 1) / al * al;
+
+        if (!index--)
+            return off;
+
+        off += s;
+    }
+
+    qunimpl(strct, "Struct member index out of range!");
+}
+
+static bool is_signed(astn a) {
+    return is_integer(a) && type_is_signed(ir_type(a));
+}
+
+// s is a temporary of the function's, for -fmem-report
+static const char *noted(const char *s) {
+    mem_note(MEM_PRINTER, strlen(s) + 1);
+    return s;
+}
+
+static const char *bb_label(const struct frame *f, BB bb) {
+    return noted(arena_sprintf(&irst.current_bbl->arena, "%s%s.%s", label_prefix(), f->fn, bb->name));
+}
+
+static const char *label(const struct frame *f, astn a) {
+    ast_check(a, ASTN_QBB, "");
+    return bb_label(f, a->Qbb.bb);
+}
+
+static const char *global_name(astn a) {
+    if (a->type == ASTN_QTEMP && a->Qtemp.name)
+        return a->Qtemp.name;
+
+    if (a->type == ASTN_SYMPTR)
+        return a->Symptr.e->ident;
+
+    if (a->type == ASTN_DECLREC)
+        return a->Declrec.e->ident;
+
+    return NULL;
+}
+
+static void check_temp(const struct frame *f, astn a) {
+    if (a->Qtemp.tempno >= f->ntemps)
+        qunimpl(a, "Temp out of range!");
+}
+
+// constant a as a value of IR type t, extended to 64 bits
+static long long const_value(astn a, astn t, bool sign) {
+    unsigned long long v = a->Num.number.integer;
+    long size = size_of(t);
+
+    if (size < 8) {
+        unsigned bits = (unsigned)size * 8;
+        v &= (1ull << bits) - 1;
+        if (sign && v >> (bits - 1))
+            v |= ~0ull << bits;
+    }
+
+    return (long long)v;
+}
+
+/*
+ * Load operand a into r, as a value of IR type t (constants are truncated to
+ * it), extended to 64 bits - sign-extended if sign.
+ */
+static void load(const struct frame *f, astn a, enum reg r, astn t, bool sign) {
+    if (a->type == ASTN_LIST)
+        a = list_data(a);
+
+    const char *r64 = reg(r, 8);
+
+    if (a->type == ASTN_NUM) {
+        long long v = const_value(a, t, sign);
+
+        if (v >= INT32_MIN && v <= INT32_MAX)
+            asmf("    movq $%lld, %s\n", v, r64);
+        else
+            asmf("    movabsq $%lld, %s\n", v, r64);
+        return;
+    }
+
+    const char *g = global_name(a);
+    if (g) {
+        asmf("    leaq %s%s(%%rip), %s\n", sym_prefix(), g, r64);
+        return;
+    }
+
+    ast_check(a, ASTN_QTEMP, "");
+    check_temp(f, a);
+
+    long off = f->slot[a->Qtemp.tempno];
+    if (f->is_addr[a->Qtemp.tempno]) {
+        asmf("    leaq %ld(%%rbp), %s\n", off, r64);
+        return;
+    }
+
+    switch (size_of(t)) {
+        case 1:
+            asmf("    %s %ld(%%rbp), %s\n", sign ? "movsbq" : "movzbl", off, sign ? r64 : reg(r, 4));
+            break;
+        case 2:
+            asmf("    %s %ld(%%rbp), %s\n", sign ? "movswq" : "movzwl", off, sign ? r64 : reg(r, 4));
+            break;
+        case 4:
+            asmf("    %s %ld(%%rbp), %s\n", sign ? "movslq" : "movl", off, sign ? r64 : reg(r, 4));
+            break;
+        case 8:
+            asmf("    movq %ld(%%rbp), %s\n", off, r64);
+            break;
+        default:
+            qunimpl(a, "Native backend can't hold this value in a register :(");
+    }
+}
+
+// load a as a value of its own type
+static void load_own(const struct frame *f, astn a, enum reg r) {
+    load(f, a, r, a, is_signed(a));
+}
+
+static void store(const struct frame *f, astn target, enum reg r) {
+    ast_check(target, ASTN_QTEMP, "");
+    check_temp(f, target);
+
+    long size = size_of(target);
+    asmf("    mov%c %s, %ld(%%rbp)\n", suffix(size), reg(r, size), f->slot[target->Qtemp.tempno]);
+}
+
+/*
+ * The memory operand for what pointer p points at. Pointers we can't name
+ * directly go through %rcx.
+ */
+static const char *deref(const struct frame *f, astn p) {
+    const char *g = global_name(p);
+    if (g)
+        return noted(arena_sprintf(&irst.current_bbl->arena, "%s%s(%%rip)", sym_prefix(), g));
+
+    if (p->type == ASTN_QTEMP) {
+        check_temp(f, p);
+        if (f->is_addr[p->Qtemp.tempno])
+            return noted(arena_sprintf(&irst.current_bbl->arena, "%ld(%%rbp)", f->slot[p->Qtemp.tempno]));
+    }
+
+    load_own(f, p, RCX);
+    return "(%rcx)";
+}
+
+static void gen_binop(const struct frame *f, ir_op_E op, astn target, astn src1, astn src2) {
+    long w = size_of(target) > 4 ? 8 : 4;
+    bool sign = is_signed(target);
+
+    load(f, src1, RAX, target, sign);
+    load(f, src2, RCX, target, sign);
+
+    const char *a = reg(RAX, w), *c = reg(RCX, w);
+    char s = suffix(w);
+
+    switch (op) {
+        case IR_OP_ADD:
+            asmf("    add%c %s, %s\n", s, c, a);
+            break;
+        case IR_OP_SUB:
+            asmf("    sub%c %s, %s\n", s, c, a);
+            break;
+        case IR_OP_MUL:
+            asmf("    imul%c %s, %s\n", s, c, a);
+            break;
+        case IR_OP_SDIV:
+        case IR_OP_SMOD:
+            asmf("    %s\n    idiv%c %s\n", w == 8 ? "cqto" : "cltd", s, c);
+            break;
+        case IR_OP_UDIV:
+        case IR_OP_UMOD:
+            asmf("    xorl %%edx, %%edx\n    div%c %s\n", s, c);
+            break;
+        default:
+            die("Not a binop.");
+    }
+
+    store(f, target, op == IR_OP_SMOD || op == IR_OP_UMOD ? RDX : RAX);
+}
+
+static void gen_cmp(const struct frame *f, ir_op_E op, astn target, astn src1, astn src2) {
+    long w = size_of(src1) > 4 ? 8 : 4;
+    bool sign = is_signed(src1);
+
+    load(f, src1, RAX, src1, sign);
+    load(f, src2, RCX, src1, sign);
+
+    static const char *const cc[IR_OP_COUNT] = {
+        [IR_OP_CMPEQ] = "e",
+        [IR_OP_CMPNE] = "ne",
+        [IR_OP_CMPLT] = "l",
+        [IR_OP_CMPLTEQ] = "le",
+    };
+
+    asmf("    cmp%c %s, %s\n    set%s %%al\n", suffix(w), reg(RCX, w), reg(RAX, w), cc[op]);
+    store(f, target, RAX);
+}
+
+static void gen_gep(const struct frame *f, astn target, astn src1, astn src2, astn src3) {
+    astn t = ir_dtype(src1);
+
+    load_own(f, src1, RAX);
+
+    // the first index steps over whole ts, the second goes into one
+    long scale = size_of(t);
+    astn idx = src2;
+
+    // indices are signed, whatever their type says
+    for (int i = 0; idx; i++) {
+        if (idx->type == ASTN_NUM) {
+            long long k = const_value(idx, idx, true);
+
+            if (k)
+                asmf("    addq $%lld, %%rax\n", k * scale);
+        } else {
+            load(f, idx, RCX, idx, true);
+            asmf("    imulq $%ld, %%rcx\n    addq %%rcx, %%rax\n", scale);
+        }
+
+        if (i || !src3)
+            break;
+
+        idx = src3;
+
+        if (ir_type_matches(t, IR_arr)) {
+            t = ir_dtype(t)->Type.derived.target;
+            scale = size_of(t);
+        } else if (ir_type_matches(t, IR_struct)) {
+            if (idx->type != ASTN_NUM)
+                qunimpl(idx, "Struct member index isn't constant!");
+
+            long off = field_offset(t, (long)idx->Num.number.integer);
+            if (off)
+                asmf("    addq $%ld, %%rax\n", off);
+            break;
+        } else {
+            qunimpl(src1, "Native backend can't index into this :(");
+        }
+    }
+
+    store(f, target, RAX);
+}
+
+static void gen_call(const struct frame *f, astn target, astn fn, astn args) {
+    ast_check(fn, ASTN_SYMPTR, "");
+
+    unsigned n = 0;
+    for (astn a = args; a && list_data(a); a = list_next(a))
+        n++;
+
+    astn *argv = arena_alloc(&irst.current_bbl->arena, (n ? n : 1) * sizeof(astn));
+    mem_note(MEM_PRINTER, (n ? n : 1) * sizeof(astn));
+    n = 0;
+    for (astn a = args; a && list_data(a); a = list_next(a))
+        argv[n++] = list_data(a);
+
+    // the rest go on the stack, right to left, keeping %rsp 16-byte aligned
+    unsigned on_stack = n > ARG_REGS ? n - (unsigned)ARG_REGS : 0;
+    if (on_stack % 2)
+        asmf("    subq $8, %%rsp\n");
+
+    for (unsigned i = n; i-- > ARG_REGS; ) {
+        load_own(f, argv[i], RAX);
+        asmf("    pushq %%rax\n");
+    }
+
+    for (unsigned i = 0; i < n && i < ARG_REGS; i++)
+        load_own(f, argv[i], arg_regs[i]);
+
+    // no vector registers, in case it's variadic
+    asmf("    xorl %%eax, %%eax\n");
+    asmf("    call %s%s%s\n", sym_prefix(), fn->Symptr.e->ident, dcc_is_host_darwin() ? "" : "@PLT");
+
+    if (on_stack)
+        asmf("    addq $%u, %%rsp\n", (on_stack + on_stack % 2) * 8);
+
+    if (!ir_type_matches(ir_dtype(fn)->Type.derived.target, IR_void))
+        store(f, target, RAX);
+}
+
+static void gen_quad(struct frame *f, const struct qtab *t, const_quad q) {
+    astn target = qa(t, q->target);
+    astn src1 = qa(t, q->src1);
+    astn src2 = qa(t, q->src2);
+    astn src3 = qa(t, q->src3);
+
+    const char *mem;
+
+    switch (q->op) {
+        case IR_OP_ALLOCA:
+            break; // it's just a frame offset
+
+        case IR_OP_RETURN:
+            if (src1) {
+                astn ret = get_active_fn_target();
+                load(f, src1, RAX, ret, is_signed(ret));
+            }
+            asmf("    leave\n    ret\n");
+            break;
+
+        case IR_OP_LOAD:
+            mem = deref(f, src1);
+            switch (size_of(target)) {
+                case 1:
+                    asmf("    movb %s, %%al\n", mem);
+                    break;
+                case 2:
+                    asmf("    movw %s, %%ax\n", mem);
+                    break;
+                case 4:
+                    asmf("    movl %s, %%eax\n", mem);
+                    break;
+                case 8:
+                    asmf("    movq %s, %%rax\n", mem);
+                    break;
+                default:
+                    qunimpl(target, "Native backend can't load this :(");
+            }
+            store(f, target, RAX);
+            break;
+
+        case IR_OP_STORE:;
+            astn ty = get_qtype(ir_dtype(target));
+            long size = size_of(ty);
+            if (size > 8)
+                qunimpl(target, "Native backend can't store this :(");
+
+            load(f, src1, RAX, ty, is_signed(ty));
+            mem = deref(f, target);
+            asmf("    mov%c %s, %s\n", suffix(size), reg(RAX, size), mem);
+            break;
+
+        case IR_OP_ADD:
+        case IR_OP_SUB:
+        case IR_OP_MUL:
+        case IR_OP_SDIV:
+        case IR_OP_UDIV:
+        case IR_OP_SMOD:
+        case IR_OP_UMOD:
+            gen_binop(f, q->op, target, src1, src2);
+            break;
+
+        case IR_OP_GEP:
+            gen_gep(f, target, src1, src2, src3);
+            break;
+
+        case IR_OP_SEXT:
+            load(f, src1, RAX, src1, true);
+            if (ir_type_matches(src1, IR_i1))
+                asmf("    andq $1, %%rax\n    negq %%rax\n");
+            store(f, target, RAX);
+            break;
+
+        case IR_OP_ZEXT:
+        case IR_OP_INTTOPTR:
+            load(f, src1, RAX, src1, false);
+            store(f, target, RAX);
+            break;
+
+        case IR_OP_TRUNC:
+        case IR_OP_PTRTOINT:
+            load_own(f, src1, RAX);
+            if (ir_type_matches(target, IR_i1))
+                asmf("    andl $1, %%eax\n");
+            store(f, target, RAX);
+            break;
+
+        case IR_OP_FNCALL:
+            gen_call(f, target, src1, src2);
+            break;
+
+        case IR_OP_PHI:
+            asmf("    movq %ld(%%rbp), %%rax\n", f->shadow[target->Qtemp.tempno]);
+            store(f, target, RAX);
+            break;
+
+        case IR_OP_BR:
+            asmf("    jmp %s\n", label(f, target));
+            break;
+
+        case IR_OP_CONDBR:
+            load(f, target, RAX, target, false);
+            asmf("    testb $1, %%al\n    jne %s\n    jmp %s\n", label(f, src1), label(f, src2));
+            break;
+
+        case IR_OP_CMPEQ:
+        case IR_OP_CMPNE:
+        case IR_OP_CMPLT:
+        case IR_OP_CMPLTEQ:
+            gen_cmp(f, q->op, target, src1, src2);
+            break;
+
+        case IR_OP_SWITCHBEGIN:
+            f->sw_type = get_qtype(src1);
+            f->sw_default = label(f, target);
+            load_own(f, src1, RAX);
+            break;
+
+        case IR_OP_SWITCHCASE:
+            if (!f->sw_type)
+                die("Switch case outside of a switch.");
+
+            load(f, target, RCX, f->sw_type, is_signed(f->sw_type));
+            asmf("    cmpq %%rcx, %%rax\n    je %s\n", label(f, src1));
+            break;
+
+        case IR_OP_SWITCHEND:
+            asmf("    jmp %s\n", f->sw_default);
+            f->sw_type = NULL;
+            break;
+
+        default:
+            die("Unhandled quad in the native backend");
+    }
+}
+
+// before leaving bb for to: what to's phis get from bb, into their shadows
+static void gen_phi_copies_to(struct frame *f, const struct qtab *t, const_BB bb, astn to) {
+    const_BB succ = to->Qbb.bb;
+
+    for (unsigned i = 0; i < succ->nquads && succ->quads[i].op == IR_OP_PHI; i++) {
+        astn phi = qa(t, succ->quads[i].target);
+        astn from = qa(t, succ->quads[i].src2);
+
+        for (astn val = qa(t, succ->quads[i].src1); val; val = list_next(val), from = list_next(from)) {
+            if (list_data(from)->Qbb.bb != bb)
+                continue;
+
+            load(f, list_data(val), RAX, phi, is_signed(phi));
+            asmf("    movq %%rax, %ld(%%rbp)\n", f->shadow[phi->Qtemp.tempno]);
+            break;
+        }
+    }
+}
+
+/*
+ * The successors' phis all read from shadows, written before the branch
+ * out of bb at n, so copies that swap values can't step on each other.
+ */
+static void gen_phi_copies(struct frame *f, const struct qtab *t, const_BB bb, unsigned n) {
+    const_quad q = &bb->quads[n];
+
+    switch (q->op) {
+        case IR_OP_BR:
+            gen_phi_copies_to(f, t, bb, qa(t, q->target));
+            break;
+
+        case IR_OP_CONDBR:
+            gen_phi_copies_to(f, t, bb, qa(t, q->src1));
+            gen_phi_copies_to(f, t, bb, qa(t, q->src2));
+            break;
+
+        case IR_OP_SWITCHBEGIN:
+            gen_phi_copies_to(f, t, bb, qa(t, q->target));
+            for (unsigned i = n + 1; i < bb->nquads && bb->quads[i].op == IR_OP_SWITCHCASE; i++)
+                gen_phi_copies_to(f, t, bb, qa(t, bb->quads[i].src1));
+            break;
+
+        default:
+            break;
+    }
+}
+
+// does q write a new value into its target?
+static long frame_alloc(struct frame *f, long size, long align) {
+    f->size = (f->size + size + align - 1) / align * align;
+    return -f->size;
+}
+
+// give every temp in the function somewhere to live
+static void frame_layout(struct frame *f, const struct qtab *t, BB first) {
+    for (BB bb = first; bb; bb = bb->next) {
+        for (unsigned i = 0; i < bb->nquads; i++) {
+            const_quad q = &bb->quads[i];
+            if (!quad_defines(q))
+                continue;
+
+            astn target = qa(t, q->target);
+            ast_check(target, ASTN_QTEMP, "");
+            check_temp(f, target);
+
+            unsigned n = target->Qtemp.tempno;
+            if (f->slot[n])
+                continue;
+
+            long size, align;
+            if (q->op == IR_OP_ALLOCA) {
+                layout(ir_dtype(target), &size, &align);
+                f->is_addr[n] = true;
+            } else {
+                size = align = 8;
+            }
+
+            f->slot[n] = frame_alloc(f, size, align);
+            if (q->op == IR_OP_PHI)
+                f->shadow[n] = frame_alloc(f, 8, 8);
+        }
+    }
+
+    f->size = (f->size + 15) / 16 * 16;
+}
+
+static void gen_prologue(const struct frame *f, sym fn) {
+    asmf("    .text\n");
+    if (fn->linkage != L_INTERNAL)
+        asmf("    .globl %s%s\n", sym_prefix(), fn->ident);
+    if (!dcc_is_host_darwin())
+        asmf("    .type %s, @function\n", fn->ident);
+
+    asmf("%s%s:\n", sym_prefix(), fn->ident);
+    asmf("    pushq %%rbp\n    movq %%rsp, %%rbp\n");
+
+    if (f->size)
+        asmf("    subq $%ld, %%rsp\n", f->size);
+
+    // parameters come in registers (or above the return address) and go
+    // into their temps' slots
+    unsigned i = 0;
+    for (astn p = fn->param_list_q; p; p = list_next(p), i++) {
+        astn e = list_data(p);
+        if (e->type == ASTN_ELLIPSIS)
+            break;
+
+        if (i < ARG_REGS) {
+            store(f, e, arg_regs[i]);
+        } else {
+            asmf("    movq %ld(%%rbp), %%rax\n", 16 + 8 * (long)(i - ARG_REGS));
+            store(f, e, RAX);
+        }
+    }
+}
+
+static void emit_strlit(astn s) {
+    asmf("    .asciz \"");
+
+    for (size_t i = 0; i < s->Strlit.strlit.len; i++) {
+        unsigned char c = (unsigned char)s->Strlit.strlit.str[i];
+
+        if (c != '"' && c != '\\' && c >= 32 && c <= 126)
+            outbuf_putc(out, (char)c);
+        else
+            asmf("\\%03o", c);
+    }
+
+    asmf("\"\n");
+}
+
+static void emit_global(const struct qtab *t, const_quad q) {
+    if (q->op != IR_OP_DEFGLOBAL)
+        die("Unexpected quad at file scope in the native backend");
+
+    astn target = qa(t, q->target);
+    astn src1 = qa(t, q->src1);
+
+    if (ir_type_matches(target, IR_fn)) {
+        ast_check(target->Qtemp.global, ASTN_SYMPTR, "");
+
+        sym fn = target->Qtemp.global->Symptr.e;
+        if (!fn->fn_defined && fn->linkage == L_INTERNAL)
+            qerrorl(fn->type, "static function never defined");
+
+        return; // the assembler takes care of undefined symbols
+    }
+
+    if (ir_type_matches(target, IR_struct))
+        return; // we only need its layout
+
+    long size, align;
+    layout(ir_dtype(target), &size, &align);
+
+    const char *name = target->Qtemp.name;
+    bool is_strlit = target->Qtemp.global->type == ASTN_STRLIT;
+
+    if (is_strlit)
+        asmf("    %s\n", dcc_is_host_darwin() ? ".section __TEXT,__const" : ".section .rodata");
+    else
+        asmf("    .data\n");
+
+    if (*name != '.')
+        asmf("    .globl %s%s\n", sym_prefix(), name);
+
+    asmf("    .p2align %d\n", __builtin_ctzl((unsigned long)align));
+    asmf("%s%s:\n", sym_prefix(), name);
+
+    if (!src1) {
+        asmf("    .zero %ld\n", size);
+    } else if (src1->type == ASTN_STRLIT) {
+        emit_strlit(src1);
+    } else if (src1->type == ASTN_NUM) {
+        static const char *const dir[] = {".byte", ".short", ".long", ".quad"};
+        asmf("    %s %lld\n", dir[size_index(size)], (long long)src1->Num.number.integer);
+    } else if (src1->type == ASTN_QTEMP && src1->Qtemp.name) {
+        asmf("    .quad %s%s\n", sym_prefix(), src1->Qtemp.name);
+    } else {
+        qunimpl(src1, "Native backend can't initialize a global with this :(");
+    }
+}
+
+static bool quad_is_fn_decl(const struct qtab *t, const_quad q) {
+    return q->op == IR_OP_DEFGLOBAL && ir_type_matches(qa(t, q->target), IR_fn);
+}
+
+// the same order quads_dump_root_pending() prints them in
+static void quads_asm_root_pending(bool decls) {
+    const struct qtab *t = &irst.root_bbl->tab;
+    BB root = irst.root_bbl->me;
+
+    for (unsigned i = irst.root_flushed; i < root->nquads; i++) {
+        struct quad g = root->quads[i];
+        if (!quad_is_fn_decl(t, &g))
+            emit_global(t, &g);
+    }
+
+    if (!decls)
+        return;
+
+    for (unsigned i = 0; i < root->nquads; i++) {
+        struct quad g = root->quads[i];
+        if (quad_is_fn_decl(t, &g))
+            emit_global(t, &g);
+    }
+}
+
+// like quads_dump_pending()
+void quads_asm_pending(struct outbuf *o) {
+    out = o;
+
+    quads_asm_root_pending(false);
+    irst.root_flushed = irst.root_bbl->me->nquads;
+}
+
+/*
+ * Generate the function we just finished. Like quads_dump_fn(), this runs
+ * once per function, before it's thrown away.
+ */
+void quads_asm_fn(struct outbuf *o) {
+    out = o;
+
+    BBL bbl = irst.current_bbl;
+    if (bbl == irst.root_bbl)
+        die("quads_asm_fn called without a function.");
+
+    struct arena *save = astn_arena;
+    astn_arena = &bbl->arena;
+
+    quads_asm_root_pending(false);
+
+    BB first = bbl->me;
+    struct frame frame = {
+        .fn = first->fn->ident,
+        .ntemps = (unsigned)irst.tempno + 1,
+    };
+    struct frame *f = &frame;
+
+    f->slot = arena_alloc(&bbl->arena, f->ntemps * sizeof(long));
+    f->is_addr = arena_alloc(&bbl->arena, f->ntemps * sizeof(bool));
+    f->shadow = arena_alloc(&bbl->arena, f->ntemps * sizeof(long));
+    mem_note(MEM_PRINTER, f->ntemps * (2 * sizeof(long) + sizeof(bool)));
+
+    unsigned i = 0;
+    for (astn p = first->fn->param_list_q; p; p = list_next(p), i++) {
+        astn e = list_data(p);
+        if (e->type == ASTN_ELLIPSIS)
+            break;
+
+        check_temp(f, e);
+        f->slot[e->Qtemp.tempno] = i < ARG_REGS ? frame_alloc(f, 8, 8) : 16 + 8 * (long)(i - ARG_REGS);
+    }
+
+    frame_layout(f, &bbl->tab, first);
+    gen_prologue(f, first->fn);
+
+    for (BB bb = first; bb; bb = bb->next) {
+        if (bb->name)
+            asmf("%s:\n", bb_label(f, bb));
+
+        for (unsigned n = 0; n < bb->nquads; n++) {
+            gen_phi_copies(f, &bbl->tab, bb, n);
+            gen_quad(f, &bbl->tab, &bb->quads[n]);
+        }
+    }
+
+    astn_arena = save;
+}
+
+/*
+ * Generate what's left of the root block. Functions that were only declared
+ * need nothing from us.
+ */
+void quads_asm_root(struct outbuf *o) {
+    out = o;
+
+    quads_asm_root_pending(true);
+
+    if (!dcc_is_host_darwin())
+        asmf("    .section .note.GNU-stack,\"\",@progbits\n");
+}
@@ -0,0 +1,10 @@
+#ifndef X86_64_H
+#define X86_64_H
+
+#include "outbuf.h"
+
+void quads_asm_pending(struct outbuf *o);
+void quads_asm_fn(struct outbuf *o);
+void quads_asm_root(struct outbuf *o);
+
+#endif
@@ -0,0 +1,1900 @@
+/*
+ * x86_64_as.c
+ *
+ * Integrated assembler: AT&T-syntax x86-64 to an ELF relocatable object,
+ * so the native backend doesn't need an external assembler for -c. It knows
+ * the integer subset of the instruction set and the directives the native
+ * backend uses, and picks the same encodings gas does, so the objects come
+ * out byte for byte the same as `gcc -c` makes from the same text.
+ *
+ * Each line becomes an item in its section: encoded bytes (with at most one
+ * symbolic field to fix up), zero fill, alignment padding, or a branch to a
+ * label. Branches start short and are grown to rel32 until everything is in
+ * range, the way gas relaxes them. Only then are label addresses known, and
+ * fields are either resolved or turned into relocations.
+ */
+#include "x86_64_as.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "elf.h"
+#include "memstat.h"
+#include "util.h"
+
+enum item_kind {
+    ITEM_BYTES,     // encoded bytes
+    ITEM_ZERO,      // that many zeros, not stored
+    ITEM_ALIGN,     // padding up to the next multiple of align
+    ITEM_BRANCH,    // jmp or jcc to a symbol
+};
+
+enum fixup {
+    FIX_NONE,
+    FIX_PC32,       // sym(%rip)
+    FIX_PLT32,      // call sym@PLT
+    FIX_GOTPCREL,   // sym@GOTPCREL(%rip)
+    FIX_ABS64,      // .quad sym
+};
+
+struct item {
+    enum item_kind kind;
+    unsigned len;
+    uint64_t addr;          // once laid out
+
+    size_t data;            // ITEM_BYTES: where they start in the section's bytes
+
+    // ITEM_BYTES: the symbolic field, if any
+    enum fixup fix;
+    unsigned char fix_at;
+    unsigned fix_sym;
+    int64_t fix_addend;
+
+    // ITEM_BRANCH
+    int cc;                 // condition code, -1 for jmp
+    unsigned target;
+    bool is_long;
+
+    // ITEM_ALIGN
+    uint64_t align;
+};
+
+struct as_section {
+    char *name;
+    uint32_t type;
+    uint64_t flags;
+    uint64_t align;
+    uint64_t entsize;
+
+    unsigned char *bytes;
+    size_t nbytes, bytes_cap;
+
+    struct item *items;
+    unsigned nitems, items_cap;
+    bool can_extend;        // the last item is plain bytes, with no label after it
+
+    uint64_t size;          // once laid out
+
+    struct elf_rela *relas;
+    unsigned nrelas, relas_cap;
+};
+
+struct as_sym {
+    char *name;
+    int section;            // -1 while undefined
+    unsigned item;          // defined just before this item
+    bool global;
+    bool func;
+    bool used;              // something refers to it
+    bool in_symtab;         // a relocation needs it there, whatever it is
+};
+
+struct x86_asm {
+    struct as_section *sections;
+    unsigned nsections;
+    unsigned cur;
+
+    struct as_sym *syms;
+    unsigned nsyms, syms_cap;
+    unsigned *hash;         // 1 + symbol index, 0 for empty
+    unsigned hash_cap;
+
+    // the line being put together from what we've been fed
+    char *line;
+    size_t line_len, line_cap;
+    unsigned lineno;
+
+    unsigned char *scratch; // for decoding strings
+    size_t scratch_cap;
+};
+
+__attribute__((format(printf, 2, 3)))
+static _Noreturn void as_error(const struct x86_asm *a, const char *fmt, ...) {
+    char msg[256];
+
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+
+    RED_ERROR("Assembler error on line %u: %s", a->lineno, msg);
+}
+
+static char *dup_n(const char *s, size_t n) {
+    char *d = safe_malloc(n + 1);
+    mem_note(MEM_ASSEMBLER, n + 1);
+    memcpy(d, s, n);
+    d[n] = '\0';
+    return d;
+}
+
+// ---- symbols ----
+
+static unsigned hash_name(const char *s, size_t n) {
+    unsigned h = 2166136261u;
+    for (size_t i = 0; i < n; i++)
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+    return h;
+}
+
+static void hash_insert(struct x86_asm *a, unsigned idx) {
+    const char *name = a->syms[idx].name;
+    unsigned i = hash_name(name, strlen(name)) & (a->hash_cap - 1);
+
+    while (a->hash[i])
+        i = (i + 1) & (a->hash_cap - 1);
+
+    a->hash[i] = idx + 1;
+}
+
+static unsigned sym_get(struct x86_asm *a, const char *name, size_t n) {
+    if (a->hash_cap) {
+        unsigned i = hash_name(name, n) & (a->hash_cap - 1);
+
+        for (; a->hash[i]; i = (i + 1) & (a->hash_cap - 1)) {
+            const char *s = a->syms[a->hash[i] - 1].name;
+            if (!strncmp(s, name, n) && !s[n])
+                return a->hash[i] - 1;
+        }
+    }
+
+    if (a->nsyms == a->syms_cap) {
+        a->syms_cap = a->syms_cap ? a->syms_cap * 2 : 64;
+        a->syms = safe_realloc(a->syms, a->syms_cap * sizeof(struct as_sym));
+        mem_note(MEM_ASSEMBLER, a->syms_cap * sizeof(struct as_sym));
+    }
+
+    // keep the table at most half full
+    if (2 * (a->nsyms + 1) > a->hash_cap) {
+        free(a->hash);
+        a->hash_cap = a->hash_cap ? a->hash_cap * 2 : 128;
+        a->hash = safe_calloc(a->hash_cap, sizeof(unsigned));
+        mem_note(MEM_ASSEMBLER, a->hash_cap * sizeof(unsigned));
+
+        for (unsigned k = 0; k < a->nsyms; k++)
+            hash_insert(a, k);
+    }
+
+    unsigned idx = a->nsyms++;
+    a->syms[idx] = (struct as_sym){
+        .name = dup_n(name, n),
+        .section = -1,
+    };
+    hash_insert(a, idx);
+
+    return idx;
+}
+
+// assembler-local labels never make it into the object
+static bool sym_is_temp(const struct as_sym *s) {
+    return s->name[0] == '.' && s->name[1] == 'L';
+}
+
+// ---- sections ----
+
+static unsigned section_get(struct x86_asm *a, const char *name, uint32_t type, uint64_t flags) {
+    for (unsigned i = 0; i < a->nsections; i++)
+        if (!strcmp(a->sections[i].name, name))
+            return i;
+
+    a->sections = safe_realloc(a->sections, (a->nsections + 1) * sizeof(struct as_section));
+    mem_note(MEM_ASSEMBLER, (a->nsections + 1) * sizeof(struct as_section));
+    a->sections[a->nsections] = (struct as_section){
+        .name = dup_n(name, strlen(name)),
+        .type = type,
+        .flags = flags,
+        .align = 1,
+    };
+
+    return a->nsections++;
+}
+
+static struct as_section *cur(struct x86_asm *a) {
+    return &a->sections[a->cur];
+}
+
+static struct item *item_add(struct x86_asm *a, enum item_kind kind, unsigned len) {
+    struct as_section *s = cur(a);
+
+    if (s->nitems == s->items_cap) {
+        s->items_cap = s->items_cap ? s->items_cap * 2 : 256;
+        s->items = safe_realloc(s->items, s->items_cap * sizeof(struct item));
+        mem_note(MEM_ASSEMBLER, s->items_cap * sizeof(struct item));
+    }
+
+    struct item *it = &s->items[s->nitems++];
+    *it = (struct item){
+        .kind = kind,
+        .len = len,
+    };
+
+    s->can_extend = false;
+    return it;
+}
+
+static size_t bytes_add(struct as_section *s, const unsigned char *b, size_t n) {
+    if (s->nbytes + n > s->bytes_cap) {
+        s->bytes_cap = s->bytes_cap ? s->bytes_cap * 2 : 4096;
+        while (s->nbytes + n > s->bytes_cap)
+            s->bytes_cap *= 2;
+        s->bytes = safe_realloc(s->bytes, s->bytes_cap);
+        mem_note(MEM_ASSEMBLER, s->bytes_cap);
+    }
+
+    memcpy(s->bytes + s->nbytes, b, n);
+    s->nbytes += n;
+
+    return s->nbytes - n;
+}
+
+/*
+ * Append bytes with no symbolic field. Runs of them share an item, as long
+ * as no label lands in between.
+ */
+static void emit_plain(struct x86_asm *a, const unsigned char *b, size_t n) {
+    struct as_section *s = cur(a);
+
+    if (!n)
+        return;
+
+    if (s->type == ELF_SHT_NOBITS)
+        as_error(a, "Can't put data in %s", s->name);
+
+    if (s->can_extend) {
+        struct item *last = &s->items[s->nitems - 1];
+        bytes_add(s, b, n);
+        last->len += (unsigned)n;
+        return;
+    }
+
+    struct item *it = item_add(a, ITEM_BYTES, (unsigned)n);
+    it->data = bytes_add(s, b, n);
+    s->can_extend = true;
+}
+
+// ---- parsing ----
+
+static bool is_sym_start(char c) {
+    return isalpha((unsigned char)c) || c == '_' || c == '.' || c == '$';
+}
+
+static bool is_sym_char(char c) {
+    return isalnum((unsigned char)c) || c == '_' || c == '.' || c == '$';
+}
+
+static void skip_ws(const char **p) {
+    while (**p == ' ' || **p == '\t')
+        (*p)++;
+}
+
+static size_t sym_len(const char *p) {
+    if (!is_sym_start(*p))
+        return 0;
+
+    size_t n = 1;
+    while (is_sym_char(p[n]))
+        n++;
+    return n;
+}
+
+static bool parse_int(const char **p, int64_t *v) {
+    const char *s = *p;
+    bool neg = false;
+
+    if (*s == '-' || *s == '+')
+        neg = *s++ == '-';
+
+    if (!isdigit((unsigned char)*s))
+        return false;
+
+    char *end;
+    errno = 0;
+    unsigned long long u = strtoull(s, &end, 0);
+    if (errno)
+        return false;
+
+    *v = (int64_t)(neg ? -u : u);
+    *p = end;
+    return true;
+}
+
+enum { REG_RIP = 16 };
+
+struct reg {
+    int num;
+    unsigned size;
+    bool rex8;              // %spl, %bpl, %sil or %dil - only reachable with a REX prefix
+};
+
+// the eight legacy registers, by the two letters their names share
+static int legacy_reg(const char *s) {
+    static const char names[8][3] = {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di"};
+
+    for (int i = 0; i < 8; i++)
+        if (s[0] == names[i][0] && s[1] == names[i][1])
+            return i;
+    return -1;
+}
+
+// a register after its %, or false
+static bool parse_reg(const char **p, struct reg *r) {
+    const char *s = *p;
+    size_t n = 0;
+    while (isalnum((unsigned char)s[n]))
+        n++;
+
+    *r = (struct reg){.num = -1};
+
+    if (n == 3 && !strncmp(s, "rip", 3)) {
+        *r = (struct reg){.num = REG_RIP, .size = 8};
+    } else if (s[0] == 'r' && isdigit((unsigned char)s[1])) {
+        // r8-r15, with b, w or d for the narrower ones
+        size_t k = 1;
+        int num = 0;
+        while (k < n && isdigit((unsigned char)s[k]))
+            num = num * 10 + s[k++] - '0';
+
+        unsigned size = 0;
+        if (k == n)
+            size = 8;
+        else if (k + 1 == n)
+            size = s[k] == 'b' ? 1 : s[k] == 'w' ? 2 : s[k] == 'd' ? 4 : 0;
+
+        if (num >= 8 && num <= 15 && size)
+            *r = (struct reg){.num = num, .size = size};
+    } else if (n == 3 && (s[0] == 'r' || s[0] == 'e')) {
+        r->num = legacy_reg(s + 1);
+        r->size = s[0] == 'r' ? 8 : 4;
+    } else if (n == 3 && s[2] == 'l') {
+        // spl, bpl, sil, dil
+        r->num = legacy_reg(s);
+        r->size = 1;
+        r->rex8 = true;
+        if (r->num < 4)
+            r->num = -1;
+    } else if (n == 2 && (s[1] == 'l') && strchr("acdb", s[0])) {
+        r->num = legacy_reg((char[]){s[0], 'x'});
+        r->size = 1;
+    } else if (n == 2) {
+        r->num = legacy_reg(s);
+        r->size = 2;
+    }
+
+    if (r->num < 0)
+        return false;
+
+    *p += n;
+    return true;
+}
+
+enum operand_kind { OP_REG, OP_IMM, OP_MEM };
+
+struct operand {
+    enum operand_kind kind;
+    bool indirect;          // *%rax, *8(%rax)
+
+    struct reg reg;         // OP_REG
+    int64_t imm;            // OP_IMM
+
+    // OP_MEM: disp + sym(base, index, scale)
+    int base, index;        // -1 for none
+    unsigned scale;
+    int64_t disp;
+    int sym;                // -1 for none
+    enum fixup reloc;       // from @PLT or @GOTPCREL
+};
+
+static void parse_operand(struct x86_asm *a, const char *p, struct operand *o) {
+    *o = (struct operand){.base = -1, .index = -1, .sym = -1, .scale = 1};
+
+    skip_ws(&p);
+    if (*p == '*') {
+        o->indirect = true;
+        p++;
+    }
+
+    if (*p == '%') {
+        p++;
+        o->kind = OP_REG;
+        if (!parse_reg(&p, &o->reg) || o->reg.num == REG_RIP)
+            as_error(a, "Bad register");
+    } else if (*p == '$') {
+        p++;
+        o->kind = OP_IMM;
+        if (!parse_int(&p, &o->imm))
+            as_error(a, "Only constant immediates are supported");
+    } else {
+        o->kind = OP_MEM;
+
+        size_t n = sym_len(p);
+        if (n) {
+            o->sym = (int)sym_get(a, p, n);
+            a->syms[o->sym].used = true;
+            p += n;
+
+            if (!strncmp(p, "@PLT", 4)) {
+                o->reloc = FIX_PLT32;
+                p += 4;
+            } else if (!strncmp(p, "@GOTPCREL", 9)) {
+                o->reloc = FIX_GOTPCREL;
+                p += 9;
+            }
+
+            if ((*p == '+' || *p == '-') && !parse_int(&p, &o->disp))
+                as_error(a, "Bad offset");
+        } else if (*p != '(' && !parse_int(&p, &o->disp)) {
+            as_error(a, "Bad operand");
+        }
+
+        if (*p == '(') {
+            p++;
+            struct reg r;
+
+            skip_ws(&p);
+            if (*p == '%') {
+                p++;
+                if (!parse_reg(&p, &r) || r.size != 8)
+                    as_error(a, "Bad base register");
+                o->base = r.num;
+            }
+
+            skip_ws(&p);
+            if (*p == ',') {
+                p++;
+                skip_ws(&p);
+                if (*p++ != '%' || !parse_reg(&p, &r) || r.size != 8 || r.num == REG_RIP || r.num == 4)
+                    as_error(a, "Bad index register");
+                o->index = r.num;
+
+                skip_ws(&p);
+                if (*p == ',') {
+                    p++;
+                    int64_t scale;
+                    if (!parse_int(&p, &scale) || (scale != 1 && scale != 2 && scale != 4 && scale != 8))
+                        as_error(a, "Bad scale");
+                    o->scale = (unsigned)scale;
+                }
+            }
+
+            skip_ws(&p);
+            if (*p++ != ')')
+                as_error(a, "Expected ')'");
+        }
+
+        if (o->reloc == FIX_GOTPCREL && o->base != REG_RIP)
+            as_error(a, "@GOTPCREL needs (%%rip)");
+    }
+
+    skip_ws(&p);
+    if (*p)
+        as_error(a, "Junk after operand: '%s'", p);
+}
+
+// ---- encoding ----
+
+struct enc {
+    unsigned char b[16];
+    unsigned len;
+
+    enum fixup fix;
+    unsigned char fix_at;
+    unsigned fix_sym;
+    int64_t fix_addend;
+};
+
+static void put(struct enc *e, uint64_t v, unsigned bytes) {
+    for (unsigned i = 0; i < bytes; i++)
+        e->b[e->len++] = (unsigned char)(v >> (8 * i));
+}
+
+static bool fits8(int64_t v) {
+    return v >= INT8_MIN && v <= INT8_MAX;
+}
+
+static bool fits32(int64_t v) {
+    return v >= INT32_MIN && v <= INT32_MAX;
+}
+
+// the immediate field for an operand of size bytes: 1, 2, or 4 sign-extended
+static unsigned imm_size(unsigned size) {
+    return size < 4 ? size : 4;
+}
+
+static void check_imm(struct x86_asm *a, int64_t v, unsigned size) {
+    bool ok;
+    switch (size) {
+        case 1: ok = v >= INT8_MIN && v <= UINT8_MAX; break;
+        case 2: ok = v >= INT16_MIN && v <= UINT16_MAX; break;
+        case 4: ok = v >= INT32_MIN && v <= UINT32_MAX; break;
+        default: ok = fits32(v); break;
+    }
+
+    if (!ok)
+        as_error(a, "Immediate %lld out of range", (long long)v);
+}
+
+static bool is_byte_rex(const struct operand *o) {
+    return o && o->kind == OP_REG && o->reg.rex8;
+}
+
+/*
+ * Operand size and REX prefixes for an instruction whose ModRM reg field is
+ * reg and r/m field is rm (or whose opcode holds rm's register).
+ */
+static void prefixes(struct enc *e, unsigned size, int reg, const struct operand *rm, bool force_rex) {
+    if (size == 2)
+        put(e, 0x66, 1);
+
+    unsigned rex = (size == 8 ? 8 : 0) | (reg & 8 ? 4 : 0);
+
+    if (rm->kind == OP_REG) {
+        rex |= rm->reg.num & 8 ? 1 : 0;
+    } else {
+        if (rm->index >= 0 && rm->index & 8)
+            rex |= 2;
+        if (rm->base >= 0 && rm->base != REG_RIP && rm->base & 8)
+            rex |= 1;
+    }
+
+    if (rex || force_rex || is_byte_rex(rm))
+        put(e, 0x40 | rex, 1);
+}
+
+static void modrm(struct x86_asm *a, struct enc *e, int reg, const struct operand *rm) {
+    unsigned r = (unsigned)(reg & 7) << 3;
+
+    if (rm->kind == OP_REG) {
+        put(e, 0xc0 | r | (rm->reg.num & 7), 1);
+        return;
+    }
+
+    if (rm->kind != OP_MEM)
+        as_error(a, "Expected a register or memory operand");
+
+    if (rm->base == REG_RIP) {
+        if (rm->index >= 0)
+            as_error(a, "Can't index off %%rip");
+
+        put(e, 0x05 | r, 1);
+
+        if (rm->sym >= 0) {
+            e->fix = rm->reloc == FIX_GOTPCREL ? FIX_GOTPCREL : FIX_PC32;
+            e->fix_at = (unsigned char)e->len;
+            e->fix_sym = (unsigned)rm->sym;
+            e->fix_addend = rm->disp;
+            put(e, 0, 4);
+        } else {
+            put(e, (uint64_t)rm->disp, 4);
+        }
+        return;
+    }
+
+    if (rm->sym >= 0)
+        as_error(a, "Symbols only work %%rip-relative");
+
+    if (!fits32(rm->disp))
+        as_error(a, "Displacement out of range");
+
+    // no base: disp32 through a SIB with no base
+    if (rm->base < 0) {
+        unsigned idx = rm->index >= 0 ? (unsigned)rm->index & 7 : 4;
+        put(e, 0x04 | r, 1);
+        put(e, (unsigned)__builtin_ctz(rm->scale) << 6 | idx << 3 | 5, 1);
+        put(e, (uint64_t)rm->disp, 4);
+        return;
+    }
+
+    unsigned base = (unsigned)rm->base & 7;
+    unsigned mod;
+    if (!rm->disp && base != 5)
+        mod = 0;
+    else if (fits8(rm->disp))
+        mod = 1;
+    else
+        mod = 2;
+
+    if (rm->index >= 0 || base == 4) {
+        unsigned idx = rm->index >= 0 ? (unsigned)rm->index & 7 : 4;
+        put(e, mod << 6 | r | 4, 1);
+        put(e, (unsigned)__builtin_ctz(rm->scale) << 6 | idx << 3 | base, 1);
+    } else {
+        put(e, mod << 6 | r | base, 1);
+    }
+
+    if (mod == 1)
+        put(e, (uint64_t)rm->disp, 1);
+    else if (mod == 2)
+        put(e, (uint64_t)rm->disp, 4);
+}
+
+// the common case: prefixes, opcode, ModRM
+static void enc_rm(struct x86_asm *a, struct enc *e, unsigned size, const unsigned char *op, unsigned nop,
+                   int reg, const struct operand *rm, bool force_rex) {
+    prefixes(e, size, reg, rm, force_rex);
+    for (unsigned i = 0; i < nop; i++)
+        put(e, op[i], 1);
+    modrm(a, e, reg, rm);
+}
+
+static void enc_rm1(struct x86_asm *a, struct enc *e, unsigned size, unsigned char op,
+                    int reg, const struct operand *rm, bool force_rex) {
+    enc_rm(a, e, size, &op, 1, reg, rm, force_rex);
+}
+
+static bool is_acc(const struct operand *o) {
+    return o->kind == OP_REG && o->reg.num == 0;
+}
+
+// what an instruction does with its operands
+enum form {
+    F_ALU,          // add, or, adc, sbb, and, sub, xor, cmp: ext is the /digit
+    F_TEST,
+    F_MOV,
+    F_MOVABS,
+    F_LEA,
+    F_IMUL,
+    F_UNARY,        // not, neg, mul, div, idiv
+    F_INCDEC,
+    F_SHIFT,
+    F_PUSH,
+    F_POP,
+    F_FIXED,        // no operands, fixed bytes
+};
+
+struct mnemonic {
+    const char *name;
+    enum form form;
+    unsigned char ext;
+    unsigned char op[2];
+    unsigned nop;
+};
+
+static const struct mnemonic mnemonics[] = {
+    {.name = "add", .form = F_ALU},
+    {.name = "or", .form = F_ALU, .ext = 1},
+    {.name = "adc", .form = F_ALU, .ext = 2},
+    {.name = "sbb", .form = F_ALU, .ext = 3},
+    {.name = "and", .form = F_ALU, .ext = 4},
+    {.name = "sub", .form = F_ALU, .ext = 5},
+    {.name = "xor", .form = F_ALU, .ext = 6},
+    {.name = "cmp", .form = F_ALU, .ext = 7},
+    {.name = "test", .form = F_TEST},
+    {.name = "mov", .form = F_MOV},
+    {.name = "movabs", .form = F_MOVABS},
+    {.name = "lea", .form = F_LEA},
+    {.name = "imul", .form = F_IMUL},
+    {.name = "not", .form = F_UNARY, .ext = 2},
+    {.name = "neg", .form = F_UNARY, .ext = 3},
+    {.name = "mul", .form = F_UNARY, .ext = 4},
+    {.name = "div", .form = F_UNARY, .ext = 6},
+    {.name = "idiv", .form = F_UNARY, .ext = 7},
+    {.name = "inc", .form = F_INCDEC},
+    {.name = "dec", .form = F_INCDEC, .ext = 1},
+    {.name = "rol", .form = F_SHIFT},
+    {.name = "ror", .form = F_SHIFT, .ext = 1},
+    {.name = "shl", .form = F_SHIFT, .ext = 4},
+    {.name = "sal", .form = F_SHIFT, .ext = 4},
+    {.name = "shr", .form = F_SHIFT, .ext = 5},
+    {.name = "sar", .form = F_SHIFT, .ext = 7},
+    {.name = "push", .form = F_PUSH},
+    {.name = "pop", .form = F_POP},
+    {.name = "cltd", .form = F_FIXED, .op = {0x99}, .nop = 1},
+    {.name = "cqto", .form = F_FIXED, .op = {0x48, 0x99}, .nop = 2},
+    {.name = "cwtl", .form = F_FIXED, .op = {0x98}, .nop = 1},
+    {.name = "cltq", .form = F_FIXED, .op = {0x48, 0x98}, .nop = 2},
+    {.name = "leave", .form = F_FIXED, .op = {0xc9}, .nop = 1},
+    {.name = "ret", .form = F_FIXED, .op = {0xc3}, .nop = 1},
+    {.name = "nop", .form = F_FIXED, .op = {0x90}, .nop = 1},
+    {.name = "ud2", .form = F_FIXED, .op = {0x0f, 0x0b}, .nop = 2},
+};
+
+static const struct {
+    const char *name;
+    unsigned char cc;
+} conds[] = {
+    {"o", 0}, {"no", 1}, {"b", 2}, {"c", 2}, {"nae", 2}, {"ae", 3}, {"nb", 3}, {"nc", 3},
+    {"e", 4}, {"z", 4}, {"ne", 5}, {"nz", 5}, {"be", 6}, {"na", 6}, {"a", 7}, {"nbe", 7},
+    {"s", 8}, {"ns", 9}, {"p", 10}, {"pe", 10}, {"np", 11}, {"po", 11},
+    {"l", 12}, {"nge", 12}, {"ge", 13}, {"nl", 13}, {"le", 14}, {"ng", 14}, {"g", 15}, {"nle", 15},
+};
+
+static int cond_code(const char *s) {
+    for (size_t i = 0; i < sizeof(conds) / sizeof(conds[0]); i++)
+        if (!strcmp(conds[i].name, s))
+            return conds[i].cc;
+    return -1;
+}
+
+static unsigned suffix_size(char c) {
+    switch (c) {
+        case 'b': return 1;
+        case 'w': return 2;
+        case 'l': return 4;
+        case 'q': return 8;
+        default: return 0;
+    }
+}
+
+// the size the suffix didn't give us, from the last register operand
+static unsigned operand_size(struct x86_asm *a, unsigned size, const struct operand *ops, unsigned nops) {
+    if (size)
+        return size;
+
+    for (unsigned i = nops; i-- > 0; )
+        if (ops[i].kind == OP_REG)
+            return ops[i].reg.size;
+
+    as_error(a, "Can't tell the operand size");
+}
+
+static void need_ops(struct x86_asm *a, unsigned nops, unsigned want) {
+    if (nops != want)
+        as_error(a, "Expected %u operand%s", want, want == 1 ? "" : "s");
+}
+
+static void need_reg(struct x86_asm *a, const struct operand *o) {
+    if (o->kind != OP_REG)
+        as_error(a, "Expected a register");
+}
+
+static void enc_alu(struct x86_asm *a, struct enc *e, unsigned ext, unsigned size,
+                    const struct operand *src, const struct operand *dst) {
+    if (dst->kind == OP_IMM)
+        as_error(a, "Can't write to an immediate");
+
+    if (src->kind == OP_IMM) {
+        check_imm(a, src->imm, size);
+
+        if (size == 1 && is_acc(dst)) {
+            put(e, ext << 3 | 4, 1);
+            put(e, (uint64_t)src->imm, 1);
+        } else if (size == 1) {
+            enc_rm1(a, e, 1, 0x80, ext, dst, false);
+            put(e, (uint64_t)src->imm, 1);
+        } else if (fits8(src->imm)) {
+            enc_rm1(a, e, size, 0x83, ext, dst, false);
+            put(e, (uint64_t)src->imm, 1);
+        } else if (is_acc(dst)) {
+            prefixes(e, size, 0, dst, false);
+            put(e, ext << 3 | 5, 1);
+            put(e, (uint64_t)src->imm, imm_size(size));
+        } else {
+            enc_rm1(a, e, size, 0x81, ext, dst, false);
+            put(e, (uint64_t)src->imm, imm_size(size));
+        }
+    } else if (src->kind == OP_REG) {
+        enc_rm1(a, e, size, (unsigned char)(ext << 3 | (size == 1 ? 0 : 1)), src->reg.num, dst, is_byte_rex(src));
+    } else {
+        need_reg(a, dst);
+        enc_rm1(a, e, size, (unsigned char)(ext << 3 | (size == 1 ? 2 : 3)), dst->reg.num, src, is_byte_rex(dst));
+    }
+}
+
+static void enc_test(struct x86_asm *a, struct enc *e, unsigned size,
+                     const struct operand *src, const struct operand *dst) {
+    if (src->kind == OP_IMM) {
+        check_imm(a, src->imm, size);
+
+        if (is_acc(dst)) {
+            prefixes(e, size, 0, dst, false);
+            put(e, size == 1 ? 0xa8 : 0xa9, 1);
+        } else {
+            enc_rm1(a, e, size, size == 1 ? 0xf6 : 0xf7, 0, dst, false);
+        }
+        put(e, (uint64_t)src->imm, imm_size(size));
+        return;
+    }
+
+    // either way round, the register goes in the reg field
+    if (src->kind != OP_REG) {
+        const struct operand *t = src;
+        src = dst;
+        dst = t;
+    }
+
+    need_reg(a, src);
+    enc_rm1(a, e, size, size == 1 ? 0x84 : 0x85, src->reg.num, dst, is_byte_rex(src));
+}
+
+static void enc_mov(struct x86_asm *a, struct enc *e, unsigned size,
+                    const struct operand *src, const struct operand *dst) {
+    if (src->kind == OP_IMM && dst->kind == OP_REG) {
+        // movq only gets the full 64 bits if it has to
+        if (size == 8 && fits32(src->imm)) {
+            enc_rm1(a, e, 8, 0xc7, 0, dst, false);
+            put(e, (uint64_t)src->imm, 4);
+            return;
+        }
+
+        if (size != 8)
+            check_imm(a, src->imm, size);
+
+        prefixes(e, size, 0, dst, false);
+        put(e, (size == 1 ? 0xb0 : 0xb8) | (dst->reg.num & 7), 1);
+        put(e, (uint64_t)src->imm, size);
+    } else if (src->kind == OP_IMM) {
+        check_imm(a, src->imm, size);
+        enc_rm1(a, e, size, size == 1 ? 0xc6 : 0xc7, 0, dst, false);
+        put(e, (uint64_t)src->imm, imm_size(size));
+    } else if (src->kind == OP_REG) {
+        enc_rm1(a, e, size, size == 1 ? 0x88 : 0x89, src->reg.num, dst, is_byte_rex(src));
+    } else {
+        need_reg(a, dst);
+        enc_rm1(a, e, size, size == 1 ? 0x8a : 0x8b, dst->reg.num, src, is_byte_rex(dst));
+    }
+}
+
+static void enc_imul(struct x86_asm *a, struct enc *e, unsigned size, const struct operand *ops, unsigned nops) {
+    static const unsigned char op2[] = {0x0f, 0xaf};
+
+    if (nops == 1) {
+        enc_rm1(a, e, size, size == 1 ? 0xf6 : 0xf7, 5, &ops[0], false);
+        return;
+    }
+
+    const struct operand *dst = &ops[nops - 1];
+    need_reg(a, dst);
+
+    if (ops[0].kind != OP_IMM) {
+        need_ops(a, nops, 2);
+        enc_rm(a, e, size, op2, 2, dst->reg.num, &ops[0], false);
+        return;
+    }
+
+    // imul $k, %r is imul $k, %r, %r
+    const struct operand *src = nops == 3 ? &ops[1] : dst;
+    check_imm(a, ops[0].imm, size);
+
+    if (fits8(ops[0].imm)) {
+        enc_rm1(a, e, size, 0x6b, dst->reg.num, src, false);
+        put(e, (uint64_t)ops[0].imm, 1);
+    } else {
+        enc_rm1(a, e, size, 0x69, dst->reg.num, src, false);
+        put(e, (uint64_t)ops[0].imm, imm_size(size));
+    }
+}
+
+static void enc_shift(struct x86_asm *a, struct enc *e, unsigned ext, unsigned size,
+                      const struct operand *ops, unsigned nops) {
+    const struct operand *dst = &ops[nops - 1];
+    unsigned char op = size == 1 ? 0xd0 : 0xd1;
+
+    if (nops == 1 || (ops[0].kind == OP_IMM && ops[0].imm == 1)) {
+        enc_rm1(a, e, size, op, ext, dst, false);
+    } else if (ops[0].kind == OP_IMM) {
+        enc_rm1(a, e, size, op - 0x10, ext, dst, false);
+        put(e, (uint64_t)ops[0].imm, 1);
+    } else if (ops[0].kind == OP_REG && ops[0].reg.num == 1 && ops[0].reg.size == 1) {
+        enc_rm1(a, e, size, op + 2, ext, dst, false);
+    } else {
+        as_error(a, "Shift count must be an immediate or %%cl");
+    }
+}
+
+// push and pop: 64-bit only, no REX.W needed
+static void enc_stack(struct x86_asm *a, struct enc *e, bool push, const struct operand *o) {
+    if (o->kind == OP_REG) {
+        if (o->reg.size != 8)
+            as_error(a, "Only 64-bit registers go on the stack");
+        if (o->reg.num & 8)
+            put(e, 0x41, 1);
+        put(e, (push ? 0x50 : 0x58) | (o->reg.num & 7), 1);
+    } else if (o->kind == OP_IMM) {
+        if (!push)
+            as_error(a, "Can't pop into an immediate");
+        check_imm(a, o->imm, 8);
+        put(e, fits8(o->imm) ? 0x6a : 0x68, 1);
+        put(e, (uint64_t)o->imm, fits8(o->imm) ? 1 : 4);
+    } else {
+        enc_rm1(a, e, 4, push ? 0xff : 0x8f, push ? 6 : 0, o, false);
+    }
+}
+
+static void item_from_enc(struct x86_asm *a, const struct enc *e) {
+    if (e->fix == FIX_NONE) {
+        emit_plain(a, e->b, e->len);
+        return;
+    }
+
+    struct as_section *s = cur(a);
+    struct item *it = item_add(a, ITEM_BYTES, e->len);
+    it->data = bytes_add(s, e->b, e->len);
+    it->fix = e->fix;
+    it->fix_at = e->fix_at;
+    it->fix_sym = e->fix_sym;
+    it->fix_addend = e->fix_addend;
+}
+
+// a bare symbol, as a branch target
+static bool is_label_operand(const struct operand *o) {
+    return o->kind == OP_MEM && !o->indirect && o->sym >= 0 && o->base < 0 && o->index < 0;
+}
+
+static void assemble_branch(struct x86_asm *a, int cc, bool call, const struct operand *o) {
+    struct enc e = {0};
+
+    if (o->indirect) {
+        // through a register or memory: FF /2 or FF /4
+        if (o->kind == OP_REG && o->reg.size != 8)
+            as_error(a, "Only 64-bit registers hold branch targets");
+        if (cc >= 0)
+            as_error(a, "Conditional branches can't be indirect");
+
+        enc_rm1(a, &e, 4, 0xff, call ? 2 : 4, o, false);
+        item_from_enc(a, &e);
+        return;
+    }
+
+    if (!is_label_operand(o))
+        as_error(a, "Expected a branch target");
+
+    // calls and jumps through the PLT are always rel32
+    if (call || o->reloc == FIX_PLT32) {
+        if (cc >= 0)
+            as_error(a, "Conditional branches can't go through the PLT");
+
+        put(&e, call ? 0xe8 : 0xe9, 1);
+        e.fix = FIX_PLT32;
+        e.fix_at = 1;
+        e.fix_sym = (unsigned)o->sym;
+        e.fix_addend = o->disp;
+        put(&e, 0, 4);
+        item_from_enc(a, &e);
+        return;
+    }
+
+    if (o->disp)
+        as_error(a, "Can't branch to an offset from a label");
+
+    struct item *it = item_add(a, ITEM_BRANCH, 2);
+    it->cc = cc;
+    it->target = (unsigned)o->sym;
+}
+
+// split "op a, b(c, d), e" into operands, ignoring commas in parentheses
+static unsigned split_operands(struct x86_asm *a, char *p, char **ops, unsigned max) {
+    unsigned n = 0;
+
+    skip_ws((const char **)&p);
+    if (!*p)
+        return 0;
+
+    ops[n++] = p;
+    for (int depth = 0; *p; p++) {
+        if (*p == '(') {
+            depth++;
+        } else if (*p == ')') {
+            depth--;
+        } else if (*p == ',' && !depth) {
+            if (n == max)
+                as_error(a, "Too many operands");
+            *p = '\0';
+            ops[n++] = p + 1;
+        }
+    }
+
+    return n;
+}
+
+static void assemble_insn(struct x86_asm *a, char *p) {
+    const char *start = p;
+    char mn[16];
+    size_t n = 0;
+
+    while (isalnum((unsigned char)p[n]))
+        n++;
+    if (!n || n >= sizeof(mn))
+        as_error(a, "Bad instruction");
+
+    memcpy(mn, p, n);
+    mn[n] = '\0';
+    p += n;
+
+    char *text[3];
+    struct operand ops[3];
+    unsigned nops = split_operands(a, p, text, 3);
+    for (unsigned i = 0; i < nops; i++)
+        parse_operand(a, text[i], &ops[i]);
+
+    // branches, setcc and cmovcc, where a trailing letter is a condition
+    // rather than a size
+    int cc;
+    if (!strcmp(mn, "jmp") || !strcmp(mn, "jmpq")) {
+        need_ops(a, nops, 1);
+        assemble_branch(a, -1, false, &ops[0]);
+        return;
+    }
+    if (!strcmp(mn, "call") || !strcmp(mn, "callq")) {
+        need_ops(a, nops, 1);
+        assemble_branch(a, -1, true, &ops[0]);
+        return;
+    }
+    if (mn[0] == 'j' && (cc = cond_code(mn + 1)) >= 0) {
+        need_ops(a, nops, 1);
+        assemble_branch(a, cc, false, &ops[0]);
+        return;
+    }
+
+    struct enc e = {0};
+
+    if (!strncmp(mn, "set", 3) && (cc = cond_code(mn + 3)) >= 0) {
+        unsigned char op[] = {0x0f, (unsigned char)(0x90 + cc)};
+        need_ops(a, nops, 1);
+        if (ops[0].kind == OP_REG && ops[0].reg.size != 1)
+            as_error(a, "set%s writes a byte register", mn + 3);
+
+        enc_rm(a, &e, 1, op, 2, 0, &ops[0], false);
+        item_from_enc(a, &e);
+        return;
+    }
+
+    if (!strncmp(mn, "cmov", 4) && (cc = cond_code(mn + 4)) >= 0) {
+        unsigned char op[] = {0x0f, (unsigned char)(0x40 + cc)};
+        need_ops(a, nops, 2);
+        need_reg(a, &ops[1]);
+        enc_rm(a, &e, ops[1].reg.size, op, 2, ops[1].reg.num, &ops[0], false);
+        item_from_enc(a, &e);
+        return;
+    }
+
+    // movs and movz with both sizes spelled out: movsbq, movzwl, movslq...
+    if ((!strncmp(mn, "movs", 4) || !strncmp(mn, "movz", 4)) && n == 6 &&
+        suffix_size(mn[4]) && suffix_size(mn[5]) > suffix_size(mn[4])) {
+        bool sign = mn[3] == 's';
+        unsigned from = suffix_size(mn[4]), to = suffix_size(mn[5]);
+
+        need_ops(a, nops, 2);
+        need_reg(a, &ops[1]);
+        if (ops[1].reg.size != to || (ops[0].kind == OP_REG && ops[0].reg.size != from))
+            as_error(a, "Operand sizes don't match %s", mn);
+
+        if (from == 4) {
+            if (!sign)
+                as_error(a, "There's no movzlq; movl zero-extends");
+            enc_rm1(a, &e, to, 0x63, ops[1].reg.num, &ops[0], false);
+        } else {
+            unsigned char op[] = {0x0f, (unsigned char)((sign ? 0xbe : 0xb6) | (from == 2))};
+            enc_rm(a, &e, to, op, 2, ops[1].reg.num, &ops[0], is_byte_rex(&ops[0]));
+        }
+
+        item_from_enc(a, &e);
+        return;
+    }
+
+    // everything else: a stem, maybe with a size suffix
+    const struct mnemonic *m = NULL;
+    unsigned size = 0;
+
+    for (int strip = 0; strip < 2 && !m; strip++) {
+        if (strip) {
+            size = suffix_size(mn[n - 1]);
+            if (!size)
+                break;
+            mn[n - 1] = '\0';
+        }
+
+        for (size_t i = 0; i < sizeof(mnemonics) / sizeof(mnemonics[0]); i++) {
+            if (!strcmp(mnemonics[i].name, mn)) {
+                m = &mnemonics[i];
+                break;
+            }
+        }
+    }
+
+    if (!m)
+        as_error(a, "Unknown instruction '%.*s'", (int)n, start);
+
+    switch (m->form) {
+        case F_FIXED:
+            need_ops(a, nops, 0);
+            put(&e, m->op[0], 1);
+            if (m->nop > 1)
+                put(&e, m->op[1], 1);
+            break;
+
+        case F_ALU:
+            need_ops(a, nops, 2);
+            enc_alu(a, &e, m->ext, operand_size(a, size, ops, nops), &ops[0], &ops[1]);
+            break;
+
+        case F_TEST:
+            need_ops(a, nops, 2);
+            enc_test(a, &e, operand_size(a, size, ops, nops), &ops[0], &ops[1]);
+            break;
+
+        case F_MOV:
+            need_ops(a, nops, 2);
+            enc_mov(a, &e, operand_size(a, size, ops, nops), &ops[0], &ops[1]);
+            break;
+
+        case F_MOVABS:
+            need_ops(a, nops, 2);
+            need_reg(a, &ops[1]);
+            if (ops[0].kind != OP_IMM || ops[1].reg.size != 8)
+                as_error(a, "movabs loads an immediate into a 64-bit register");
+
+            prefixes(&e, 8, 0, &ops[1], false);
+            put(&e, 0xb8 | (ops[1].reg.num & 7), 1);
+            put(&e, (uint64_t)ops[0].imm, 8);
+            break;
+
+        case F_LEA:
+            need_ops(a, nops, 2);
+            need_reg(a, &ops[1]);
+            if (ops[0].kind != OP_MEM)
+                as_error(a, "lea takes a memory operand");
+            enc_rm1(a, &e, operand_size(a, size, ops, nops), 0x8d, ops[1].reg.num, &ops[0], false);
+            break;
+
+        case F_IMUL:
+            if (!nops)
+                need_ops(a, nops, 1);
+            enc_imul(a, &e, operand_size(a, size, ops, nops), ops, nops);
+            break;
+
+        case F_UNARY:;
+            need_ops(a, nops, 1);
+            unsigned usize = operand_size(a, size, ops, nops);
+            enc_rm1(a, &e, usize, usize == 1 ? 0xf6 : 0xf7, m->ext, &ops[0], false);
+            break;
+
+        case F_INCDEC:;
+            need_ops(a, nops, 1);
+            unsigned isize = operand_size(a, size, ops, nops);
+            enc_rm1(a, &e, isize, isize == 1 ? 0xfe : 0xff, m->ext, &ops[0], false);
+            break;
+
+        case F_SHIFT:
+            if (!nops || nops > 2)
+                need_ops(a, nops, 2);
+            enc_shift(a, &e, m->ext, operand_size(a, size, &ops[nops - 1], 1), ops, nops);
+            break;
+
+        case F_PUSH:
+        case F_POP:
+            need_ops(a, nops, 1);
+            if (size && size != 8)
+                as_error(a, "Only 64-bit values go on the stack");
+            enc_stack(a, &e, m->form == F_PUSH, &ops[0]);
+            break;
+    }
+
+    item_from_enc(a, &e);
+}
+
+// ---- directives ----
+
+static void expect_end(struct x86_asm *a, const char *p) {
+    skip_ws(&p);
+    if (*p)
+        as_error(a, "Junk at end of line: '%s'", p);
+}
+
+static int64_t directive_int(struct x86_asm *a, const char **p) {
+    int64_t v;
+    skip_ws(p);
+    if (!parse_int(p, &v))
+        as_error(a, "Expected a number");
+    return v;
+}
+
+static unsigned directive_sym(struct x86_asm *a, const char **p) {
+    skip_ws(p);
+    size_t n = sym_len(*p);
+    if (!n)
+        as_error(a, "Expected a symbol");
+
+    unsigned s = sym_get(a, *p, n);
+    *p += n;
+    return s;
+}
+
+// a "string", with C escapes; the bytes go in out, which is long enough
+static size_t parse_string(struct x86_asm *a, const char **pp, unsigned char *out) {
+    const char *p = *pp;
+    size_t n = 0;
+
+    skip_ws(&p);
+    if (*p++ != '"')
+        as_error(a, "Expected a string");
+
+    while (*p != '"') {
+        if (!*p)
+            as_error(a, "Unterminated string");
+
+        if (*p != '\\') {
+            out[n++] = (unsigned char)*p++;
+            continue;
+        }
+
+        p++;
+        if (*p >= '0' && *p <= '7') {
+            unsigned v = 0;
+            for (int i = 0; i < 3 && *p >= '0' && *p <= '7'; i++)
+                v = v * 8 + (unsigned)(*p++ - '0');
+            out[n++] = (unsigned char)v;
+            continue;
+        }
+
+        switch (*p++) {
+            case 'n': out[n++] = '\n'; break;
+            case 't': out[n++] = '\t'; break;
+            case 'r': out[n++] = '\r'; break;
+            case 'b': out[n++] = '\b'; break;
+            case 'f': out[n++] = '\f'; break;
+            case '\\': out[n++] = '\\'; break;
+            case '"': out[n++] = '"'; break;
+            case 'x': {
+                unsigned v = 0;
+                while (isxdigit((unsigned char)*p)) {
+                    char c = (char)tolower((unsigned char)*p++);
+                    v = v * 16 + (unsigned)(isdigit((unsigned char)c) ? c - '0' : c - 'a' + 10);
+                }
+                out[n++] = (unsigned char)v;
+                break;
+            }
+            default:
+                as_error(a, "Unknown escape in string");
+        }
+    }
+
+    *pp = p + 1;
+    return n;
+}
+
+static void directive_section(struct x86_asm *a, const char *p) {
+    skip_ws(&p);
+    size_t n = 0;
+    while (p[n] && p[n] != ',' && p[n] != ' ' && p[n] != '\t')
+        n++;
+    if (!n)
+        as_error(a, "Expected a section name");
+
+    char name[128];
+    if (n >= sizeof(name))
+        as_error(a, "Section name too long");
+
+    memcpy(name, p, n);
+    name[n] = '\0';
+    p += n;
+
+    // defaults for the usual names, overridden by "flags",@type
+    uint32_t type = ELF_SHT_PROGBITS;
+    uint64_t flags = 0, entsize = 0;
+
+    if (!strncmp(name, ".text", 5))
+        flags = ELF_SHF_ALLOC | ELF_SHF_EXECINSTR;
+    else if (!strncmp(name, ".data", 5))
+        flags = ELF_SHF_ALLOC | ELF_SHF_WRITE;
+    else if (!strncmp(name, ".bss", 4))
+        flags = ELF_SHF_ALLOC | ELF_SHF_WRITE, type = ELF_SHT_NOBITS;
+    else if (!strncmp(name, ".rodata", 7))
+        flags = ELF_SHF_ALLOC;
+
+    skip_ws(&p);
+    if (*p == ',') {
+        p++;
+        skip_ws(&p);
+        if (*p++ != '"')
+            as_error(a, "Expected section flags");
+
+        flags = 0;
+        for (; *p != '"'; p++) {
+            switch (*p) {
+                case 'a': flags |= ELF_SHF_ALLOC; break;
+                case 'w': flags |= ELF_SHF_WRITE; break;
+                case 'x': flags |= ELF_SHF_EXECINSTR; break;
+                case 'M': flags |= ELF_SHF_MERGE; break;
+                case 'S': flags |= ELF_SHF_STRINGS; break;
+                default: as_error(a, "Unknown section flag '%c'", *p);
+            }
+        }
+        p++;
+
+        skip_ws(&p);
+        if (*p == ',') {
+            p++;
+            skip_ws(&p);
+            if (!strncmp(p, "@progbits", 9))
+                type = ELF_SHT_PROGBITS, p += 9;
+            else if (!strncmp(p, "@nobits", 7))
+                type = ELF_SHT_NOBITS, p += 7;
+            else if (!strncmp(p, "@note", 5))
+                type = ELF_SHT_NOTE, p += 5;
+            else
+                as_error(a, "Unknown section type");
+
+            skip_ws(&p);
+            if (*p == ',') {
+                p++;
+                entsize = (uint64_t)directive_int(a, &p);
+            }
+        }
+    }
+
+    expect_end(a, p);
+
+    a->cur = section_get(a, name, type, flags);
+    if (entsize)
+        cur(a)->entsize = entsize;
+}
+
+static void directive_align(struct x86_asm *a, uint64_t align) {
+    if (!align || align & (align - 1))
+        as_error(a, "Alignment must be a power of two");
+
+    struct as_section *s = cur(a);
+    if (align > s->align)
+        s->align = align;
+
+    if (align > 1)
+        item_add(a, ITEM_ALIGN, 0)->align = align;
+}
+
+static void directive_data(struct x86_asm *a, const char *p, unsigned size) {
+    do {
+        skip_ws(&p);
+
+        size_t n = sym_len(p);
+        if (n) {
+            if (size != 8)
+                as_error(a, "Only .quad can hold a symbol");
+
+            struct enc e = {0};
+            e.fix = FIX_ABS64;
+            e.fix_sym = sym_get(a, p, n);
+            a->syms[e.fix_sym].used = true;
+            p += n;
+            if ((*p == '+' || *p == '-') && !parse_int(&p, &e.fix_addend))
+                as_error(a, "Bad offset");
+
+            put(&e, 0, 8);
+            item_from_enc(a, &e);
+        } else {
+            int64_t v = directive_int(a, &p);
+            if (size < 8)
+                check_imm(a, v, size);
+
+            unsigned char b[8];
+            for (unsigned i = 0; i < size; i++)
+                b[i] = (unsigned char)((uint64_t)v >> (8 * i));
+            emit_plain(a, b, size);
+        }
+
+        skip_ws(&p);
+    } while (*p++ == ',');
+
+    expect_end(a, p - 1);
+}
+
+static void assemble_directive(struct x86_asm *a, const char *p) {
+    char d[16];
+    size_t n = sym_len(p);
+    if (n >= sizeof(d))
+        as_error(a, "Unsupported directive '%s'", p);
+
+    memcpy(d, p, n);
+    d[n] = '\0';
+    p += n;
+
+    if (!strcmp(d, ".text")) {
+        expect_end(a, p);
+        a->cur = section_get(a, ".text", ELF_SHT_PROGBITS, ELF_SHF_ALLOC | ELF_SHF_EXECINSTR);
+    } else if (!strcmp(d, ".data")) {
+        expect_end(a, p);
+        a->cur = section_get(a, ".data", ELF_SHT_PROGBITS, ELF_SHF_ALLOC | ELF_SHF_WRITE);
+    } else if (!strcmp(d, ".bss")) {
+        expect_end(a, p);
+        a->cur = section_get(a, ".bss", ELF_SHT_NOBITS, ELF_SHF_ALLOC | ELF_SHF_WRITE);
+    } else if (!strcmp(d, ".section")) {
+        directive_section(a, p);
+    } else if (!strcmp(d, ".globl") || !strcmp(d, ".global")) {
+        unsigned s = directive_sym(a, &p);
+        expect_end(a, p);
+        a->syms[s].global = true;
+    } else if (!strcmp(d, ".type")) {
+        unsigned s = directive_sym(a, &p);
+        skip_ws(&p);
+        if (*p++ != ',')
+            as_error(a, "Expected ','");
+        skip_ws(&p);
+        if (!strcmp(p, "@function"))
+            a->syms[s].func = true;
+        else if (strcmp(p, "@object") && strcmp(p, "@notype"))
+            as_error(a, "Unknown symbol type '%s'", p);
+    } else if (!strcmp(d, ".p2align")) {
+        int64_t v = directive_int(a, &p);
+        expect_end(a, p);
+        if (v < 0 || v > 16)
+            as_error(a, "Bad alignment");
+        directive_align(a, (uint64_t)1 << v);
+    } else if (!strcmp(d, ".balign")) {
+        int64_t v = directive_int(a, &p);
+        expect_end(a, p);
+        directive_align(a, (uint64_t)v);
+    } else if (!strcmp(d, ".zero") || !strcmp(d, ".skip") || !strcmp(d, ".space")) {
+        int64_t v = directive_int(a, &p);
+        expect_end(a, p);
+        if (v < 0 || v > UINT32_MAX)
+            as_error(a, "Bad size");
+        if (v)
+            item_add(a, ITEM_ZERO, (unsigned)v);
+    } else if (!strcmp(d, ".byte")) {
+        directive_data(a, p, 1);
+    } else if (!strcmp(d, ".short") || !strcmp(d, ".value") || !strcmp(d, ".word")) {
+        directive_data(a, p, 2);
+    } else if (!strcmp(d, ".long") || !strcmp(d, ".int")) {
+        directive_data(a, p, 4);
+    } else if (!strcmp(d, ".quad")) {
+        directive_data(a, p, 8);
+    } else if (!strcmp(d, ".ascii") || !strcmp(d, ".asciz") || !strcmp(d, ".string")) {
+        // escapes only ever shrink a string
+        size_t need = strlen(p) + 1;
+        if (need > a->scratch_cap) {
+            a->scratch_cap = need * 2;
+            a->scratch = safe_realloc(a->scratch, a->scratch_cap);
+            mem_note(MEM_ASSEMBLER, a->scratch_cap);
+        }
+
+        size_t len = parse_string(a, &p, a->scratch);
+        if (strcmp(d, ".ascii"))
+            a->scratch[len++] = '\0';
+        expect_end(a, p);
+
+        emit_plain(a, a->scratch, len);
+    } else if (!strcmp(d, ".file") || !strcmp(d, ".ident") || !strcmp(d, ".size")) {
+        // nothing we keep
+    } else {
+        as_error(a, "Unsupported directive '%s'", d);
+    }
+}
+
+static void define_label(struct x86_asm *a, const char *name, size_t n) {
+    unsigned idx = sym_get(a, name, n);
+    struct as_sym *s = &a->syms[idx];
+    if (s->section >= 0)
+        as_error(a, "Symbol '%s' is already defined", s->name);
+
+    s->section = (int)a->cur;
+    s->item = cur(a)->nitems;
+
+    // later bytes can't join an item the label is past
+    cur(a)->can_extend = false;
+}
+
+static void assemble_line(struct x86_asm *a, char *line) {
+    a->lineno++;
+
+    // comments start at a # that isn't in a string
+    bool quoted = false;
+    for (char *c = line; *c; c++) {
+        if (*c == '"' && (c == line || c[-1] != '\\'))
+            quoted = !quoted;
+        else if (*c == '#' && !quoted)
+            *c = '\0';
+    }
+
+    // trailing whitespace, so the parsers can just check for the end
+    size_t len = strlen(line);
+    while (len && isspace((unsigned char)line[len - 1]))
+        line[--len] = '\0';
+
+    char *p = line;
+    for (;;) {
+        skip_ws((const char **)&p);
+
+        size_t n = sym_len(p);
+        if (!n || p[n] != ':')
+            break;
+
+        define_label(a, p, n);
+        p += n + 1;
+    }
+
+    if (!*p)
+        return;
+
+    if (*p == '.')
+        assemble_directive(a, p);
+    else
+        assemble_insn(a, p);
+}
+
+struct x86_asm *x86_asm_new(void) {
+    struct x86_asm *a = safe_calloc(1, sizeof(struct x86_asm));
+    mem_note(MEM_ASSEMBLER, sizeof(struct x86_asm));
+
+    // the same three gas always has
+    section_get(a, ".text", ELF_SHT_PROGBITS, ELF_SHF_ALLOC | ELF_SHF_EXECINSTR);
+    section_get(a, ".data", ELF_SHT_PROGBITS, ELF_SHF_ALLOC | ELF_SHF_WRITE);
+    section_get(a, ".bss", ELF_SHT_NOBITS, ELF_SHF_ALLOC | ELF_SHF_WRITE);
+
+    return a;
+}
+
+void x86_asm_feed(void *ctx, const char *text, size_t len) {
+    struct x86_asm *a = ctx;
+
+    while (len) {
+        const char *nl = memchr(text, '\n', len);
+        size_t n = nl ? (size_t)(nl - text) : len;
+
+        if (a->line_len + n + 1 > a->line_cap) {
+            a->line_cap = (a->line_len + n + 1) * 2;
+            a->line = safe_realloc(a->line, a->line_cap);
+            mem_note(MEM_ASSEMBLER, a->line_cap);
+        }
+
+        memcpy(a->line + a->line_len, text, n);
+        a->line_len += n;
+
+        if (!nl)
+            return;
+
+        a->line[a->line_len] = '\0';
+        assemble_line(a, a->line);
+        a->line_len = 0;
+
+        text += n + 1;
+        len -= n + 1;
+    }
+}
+
+// ---- layout and output ----
+
+static uint64_t sym_value(const struct x86_asm *a, const struct as_sym *s) {
+    const struct as_section *sec = &a->sections[s->section];
+    return s->item < sec->nitems ? sec->items[s->item].addr : sec->size;
+}
+
+// can we get to sym from section sec without a relocation?
+static bool sym_is_near(const struct x86_asm *a, unsigned sec, unsigned sym) {
+    const struct as_sym *s = &a->syms[sym];
+    return s->section == (int)sec && !s->global;
+}
+
+static unsigned branch_len(const struct item *it) {
+    if (!it->is_long)
+        return 2;
+    return it->cc < 0 ? 5 : 6;
+}
+
+/*
+ * Give every item in section sec an address. Branches that can't reach
+ * their target in a byte become rel32 and we go round again, since that
+ * moves everything after them.
+ */
+static void layout_section(struct x86_asm *a, unsigned sec) {
+    struct as_section *s = &a->sections[sec];
+
+    bool changed;
+    do {
+        uint64_t addr = 0;
+        for (unsigned i = 0; i < s->nitems; i++) {
+            struct item *it = &s->items[i];
+            it->addr = addr;
+
+            if (it->kind == ITEM_ALIGN)
+                it->len = (unsigned)((it->align - addr % it->align) % it->align);
+            else if (it->kind == ITEM_BRANCH)
+                it->len = branch_len(it);
+
+            addr += it->len;
+        }
+        s->size = addr;
+
+        changed = false;
+        for (unsigned i = 0; i < s->nitems; i++) {
+            struct item *it = &s->items[i];
+            if (it->kind != ITEM_BRANCH || it->is_long)
+                continue;
+
+            const struct as_sym *t = &a->syms[it->target];
+            bool in_range = false;
+            if (sym_is_near(a, sec, it->target)) {
+                int64_t d = (int64_t)(sym_value(a, t) - (it->addr + 2));
+                in_range = fits8(d);
+            }
+
+            if (!in_range) {
+                it->is_long = true;
+                changed = true;
+            }
+        }
+    } while (changed);
+}
+
+// symbol sym as a relocation target: sections' own symbols come after ours
+static void add_rela(struct as_section *s, uint64_t offset, unsigned sym,
+                     enum elf_reloc type, int64_t addend) {
+    if (s->nrelas == s->relas_cap) {
+        s->relas_cap = s->relas_cap ? s->relas_cap * 2 : 64;
+        s->relas = safe_realloc(s->relas, s->relas_cap * sizeof(struct elf_rela));
+        mem_note(MEM_ASSEMBLER, s->relas_cap * sizeof(struct elf_rela));
+    }
+
+    s->relas[s->nrelas++] = (struct elf_rela){
+        .offset = offset,
+        .sym = sym,
+        .type = type,
+        .addend = addend,
+    };
+}
+
+/*
+ * A relocation against symbol sym. Like gas, we point data references to
+ * local symbols at their section instead; PLT and GOT ones keep the symbol.
+ */
+static void relocate(struct x86_asm *a, struct as_section *s, uint64_t offset, unsigned sym,
+                     enum elf_reloc type, int64_t addend) {
+    struct as_sym *t = &a->syms[sym];
+
+    if (t->section >= 0 && !t->global && (type == R_X86_64_PC32 || type == R_X86_64_64)) {
+        add_rela(s, offset, a->nsyms + (unsigned)t->section, type, addend + (int64_t)sym_value(a, t));
+        return;
+    }
+
+    t->in_symtab = true;
+    add_rela(s, offset, sym, type, addend);
+}
+
+static void put_le(unsigned char *p, uint64_t v, unsigned bytes) {
+    for (unsigned i = 0; i < bytes; i++)
+        p[i] = (unsigned char)(v >> (8 * i));
+}
+
+// gas's padding for code: the longest nops it can, largest first
+static void fill_nops(unsigned char *p, unsigned n) {
+    static const unsigned char nops[11][11] = {
+        {0x90},
+        {0x66, 0x90},
+        {0x0f, 0x1f, 0x00},
+        {0x0f, 0x1f, 0x40, 0x00},
+        {0x0f, 0x1f, 0x44, 0x00, 0x00},
+        {0x66, 0x0f, 0x1f, 0x44, 0x00, 0x00},
+        {0x0f, 0x1f, 0x80, 0x00, 0x00, 0x00, 0x00},
+        {0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+        {0x66, 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+        {0x66, 0x2e, 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+        {0x66, 0x66, 0x2e, 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+    };
+
+    while (n) {
+        unsigned k = n > 11 ? 11 : n;
+        memcpy(p, nops[k - 1], k);
+        p += k;
+        n -= k;
+    }
+}
+
+// the section's final bytes, with everything we can resolve resolved
+static unsigned char *finish_section(struct x86_asm *a, unsigned sec) {
+    struct as_section *s = &a->sections[sec];
+    if (s->type == ELF_SHT_NOBITS)
+        return NULL;
+
+    unsigned char *out = safe_calloc(s->size ? s->size : 1, 1);
+    mem_note(MEM_ASSEMBLER, s->size ? s->size : 1);
+
+    for (unsigned i = 0; i < s->nitems; i++) {
+        struct item *it = &s->items[i];
+        unsigned char *p = out + it->addr;
+
+        switch (it->kind) {
+            case ITEM_ZERO:
+                break;
+
+            case ITEM_ALIGN:
+                if (s->flags & ELF_SHF_EXECINSTR)
+                    fill_nops(p, it->len);
+                break;
+
+            case ITEM_BRANCH: {
+                const struct as_sym *t = &a->syms[it->target];
+                bool near = sym_is_near(a, sec, it->target);
+                int64_t d = near ? (int64_t)(sym_value(a, t) - (it->addr + it->len)) : 0;
+
+                if (!it->is_long) {
+                    p[0] = (unsigned char)(it->cc < 0 ? 0xeb : 0x70 + it->cc);
+                    p[1] = (unsigned char)d;
+                    break;
+                }
+
+                unsigned at = 1;
+                if (it->cc < 0) {
+                    p[0] = 0xe9;
+                } else {
+                    p[0] = 0x0f;
+                    p[1] = (unsigned char)(0x80 + it->cc);
+                    at = 2;
+                }
+
+                put_le(p + at, (uint64_t)d, 4);
+                if (!near)
+                    relocate(a, s, it->addr + at, it->target, R_X86_64_PLT32, -4);
+                break;
+            }
+
+            case ITEM_BYTES: {
+                memcpy(p, s->bytes + it->data, it->len);
+                if (it->fix == FIX_NONE)
+                    break;
+
+                uint64_t at = it->addr + it->fix_at;
+                int64_t from_end = (int64_t)(it->len - it->fix_at);
+                const struct as_sym *t = &a->syms[it->fix_sym];
+
+                switch (it->fix) {
+                    case FIX_PC32:
+                    case FIX_PLT32:
+                        if (sym_is_near(a, sec, it->fix_sym)) {
+                            int64_t d = (int64_t)sym_value(a, t) + it->fix_addend - (int64_t)(it->addr + it->len);
+                            put_le(p + it->fix_at, (uint64_t)d, 4);
+                        } else {
+                            relocate(a, s, at, it->fix_sym,
+                                     it->fix == FIX_PC32 ? R_X86_64_PC32 : R_X86_64_PLT32,
+                                     it->fix_addend - from_end);
+                        }
+                        break;
+                    case FIX_GOTPCREL:
+                        relocate(a, s, at, it->fix_sym, R_X86_64_GOTPCREL, it->fix_addend - from_end);
+                        break;
+                    case FIX_ABS64:
+                        relocate(a, s, at, it->fix_sym, R_X86_64_64, it->fix_addend);
+                        break;
+                    default:
+                        die("Unhandled fixup");
+                }
+                break;
+            }
+        }
+    }
+
+    return out;
+}
+
+void x86_asm_finish(struct x86_asm *a, struct outbuf *obj) {
+    // whatever didn't end in a newline
+    if (a->line_len) {
+        a->line[a->line_len] = '\0';
+        assemble_line(a, a->line);
+        a->line_len = 0;
+    }
+
+    // local labels have to be defined here; anything else can be elsewhere
+    for (unsigned i = 0; i < a->nsyms; i++) {
+        const struct as_sym *s = &a->syms[i];
+        if (s->used && s->section < 0 && sym_is_temp(s))
+            as_error(a, "Undefined label '%s'", s->name);
+    }
+
+    for (unsigned i = 0; i < a->nsections; i++)
+        layout_section(a, i);
+
+    unsigned char **data = safe_calloc(a->nsections, sizeof(unsigned char *));
+    for (unsigned i = 0; i < a->nsections; i++)
+        data[i] = finish_section(a, i);
+
+    // which symbols make it into the object, and where; relocations refer to
+    // our symbols by index, and to sections' symbols after those
+    unsigned nmap = a->nsyms + a->nsections;
+    unsigned *map = safe_calloc(nmap, sizeof(unsigned));
+    bool *section_used = safe_calloc(a->nsections, sizeof(bool));
+    mem_note(MEM_ASSEMBLER, a->nsections * (sizeof(unsigned char *) + sizeof(bool)) + nmap * sizeof(unsigned));
+
+    for (unsigned i = 0; i < a->nsections; i++)
+        for (unsigned r = 0; r < a->sections[i].nrelas; r++)
+            if (a->sections[i].relas[r].sym >= a->nsyms)
+                section_used[a->sections[i].relas[r].sym - a->nsyms] = true;
+
+    struct elf_symbol *syms = safe_calloc(nmap ? nmap : 1, sizeof(struct elf_symbol));
+    mem_note(MEM_ASSEMBLER, (nmap ? nmap : 1) * sizeof(struct elf_symbol));
+    unsigned nsyms = 0;
+
+    for (unsigned i = 0; i < a->nsyms; i++) {
+        const struct as_sym *s = &a->syms[i];
+        bool defined = s->section >= 0;
+
+        if (!s->global && !s->in_symtab) {
+            if (defined ? sym_is_temp(s) : !s->used)
+                continue;
+        }
+
+        map[i] = nsyms;
+        syms[nsyms++] = (struct elf_symbol){
+            .name = s->name,
+            .section = defined ? (unsigned)s->section + 1 : 0,
+            .value = defined ? sym_value(a, s) : 0,
+            .bind = defined && !s->global ? ELF_STB_LOCAL : ELF_STB_GLOBAL,
+            .type = s->func ? ELF_STT_FUNC : ELF_STT_NOTYPE,
+        };
+    }
+
+    for (unsigned i = 0; i < a->nsections; i++) {
+        if (!section_used[i])
+            continue;
+
+        map[a->nsyms + i] = nsyms;
+        syms[nsyms++] = (struct elf_symbol){
+            .name = "",
+            .section = i + 1,
+            .bind = ELF_STB_LOCAL,
+            .type = ELF_STT_SECTION,
+        };
+    }
+
+    struct elf_section *sections = safe_calloc(a->nsections, sizeof(struct elf_section));
+    mem_note(MEM_ASSEMBLER, a->nsections * sizeof(struct elf_section));
+    for (unsigned i = 0; i < a->nsections; i++) {
+        struct as_section *s = &a->sections[i];
+
+        for (unsigned r = 0; r < s->nrelas; r++)
+            s->relas[r].sym = map[s->relas[r].sym];
+
+        sections[i] = (struct elf_section){
+            .name = s->name,
+            .type = s->type,
+            .flags = s->flags,
+            .align = s->align,
+            .entsize = s->entsize,
+            .data = data[i],
+            .size = s->size,
+            .relas = s->relas,
+            .nrelas = s->nrelas,
+        };
+    }
+
+    elf_write(obj, sections, a->nsections, syms, nsyms);
+
+    for (unsigned i = 0; i < a->nsections; i++)
+        free(data[i]);
+    free(data);
+    free(sections);
+    free(syms);
+    free(section_used);
+    free(map);
+}
+
+void x86_asm_free(struct x86_asm *a) {
+    for (unsigned i = 0; i < a->nsections; i++) {
+        struct as_section *s = &a->sections[i];
+        free(s->name);
+        free(s->bytes);
+        free(s->items);
+        free(s->relas);
+    }
+
+    for (unsigned i = 0; i < a->nsyms; i++)
+        free(a->syms[i].name);
+
+    free(a->sections);
+    free(a->syms);
+    free(a->hash);
+    free(a->line);
+    free(a->scratch);
+    free(a);
+}
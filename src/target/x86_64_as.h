@@ -0,0 +1,19 @@
+#ifndef X86_64_AS_H
+#define X86_64_AS_H
+
+#include <stddef.h>
+
+#include "outbuf.h"
+
+struct x86_asm;
+
+struct x86_asm *x86_asm_new(void);
+void x86_asm_free(struct x86_asm *a);
+
+// assemble text, which needn't end on a line boundary - an outbuf sink
+void x86_asm_feed(void *a, const char *text, size_t len);
+
+// lay out what we have and write it to obj as an ELF relocatable object
+void x86_asm_finish(struct x86_asm *a, struct outbuf *obj);
+
+#endif
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+
+# Checks dcc's integrated assembler against gcc's: every test case goes
+# through the native backend to assembly, which is then assembled both ways.
+# The two objects must disassemble (objdump -d) to exactly the same thing.
+
+import os, sys
+import shlex
+import subprocess
+import tempfile
+
+class bcolors:
+    OKCYAN = '\033[96m'
+    OKGREEN = '\033[92m'
+    OKBLUE = '\033[94m'
+    WARNING = '\033[93m'
+    FAIL = '\033[91m'
+    ENDC = '\033[0m'
+    BOLD = '\033[1m'
+
+def case_sources(path):
+    sources = [path]
+    skipped = False
+
+    with open(path) as f:
+        for line in f:
+            tok = shlex.split(line)
+            if len(tok) < 2 or tok[0] != "//!dtest":
+                break
+            if tok[1] == "skip":
+                skipped = True
+            if tok[1] == "with":
+                sources.append(os.path.join(os.path.dirname(path), tok[2]))
+
+    return sources, skipped
+
+def disassemble(obj):
+    out = subprocess.run(['objdump', '-d', obj], capture_output=True, text=True, check=True).stdout
+    # the first lines name the file
+    return out.split('\n', 2)[2]
+
+def check(src, tmp):
+    base = os.path.join(tmp, os.path.basename(src)[:-2])
+    asm, ours, gas = base + '.s', base + '.dcc.o', base + '.gas.o'
+
+    steps = [
+        ['../dcc', '-fbackend=native', '-S', '-o', asm, src],
+        ['../dcc', '-fbackend=native', '-c', '-o', ours, src],
+        ['gcc', '-c', '-o', gas, asm],
+    ]
+    for cmd in steps:
+        if subprocess.run(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL).returncode:
+            return f"Error: '{' '.join(cmd)}' failed"
+
+    if disassemble(ours) != disassemble(gas):
+        return f"Error: objdump -d differs for {os.path.basename(src)} (run objdump -d on {ours} and {gas})"
+
+    return None
+
+os.chdir(sys.path[0])
+tests_path = os.path.abspath('cases')
+
+print(bcolors.BOLD + "Checking the integrated assembler against gcc..." + bcolors.ENDC)
+print()
+
+fails = 0
+tmp = tempfile.mkdtemp(prefix='dcc-ascheck-')
+
+for name in sorted(os.listdir(tests_path)):
+    path = os.path.join(tests_path, name)
+    if not name.endswith('.c') or not os.path.isfile(path):
+        continue
+
+    sources, skipped = case_sources(path)
+    if skipped:
+        continue
+
+    print(f"{'Case: ' + name[:-2]:<50}", end='')
+
+    errors = [e for e in (check(s, tmp) for s in sources) if e]
+    if errors:
+        print(bcolors.WARNING + bcolors.BOLD + '[FAIL]' + bcolors.ENDC)
+        for e in errors:
+            print(f"\t{e}")
+        fails += 1
+    else:
+        print(bcolors.OKCYAN + bcolors.BOLD + '[SAME]' + bcolors.ENDC)
+
+print('')
+
+if fails:
+    print(bcolors.FAIL + bcolors.BOLD + f"[ ASCHECK FAIL ]: {fails} cases differ; objects kept in {tmp}" + bcolors.ENDC)
+    exit(-9)
+
+subprocess.run(['rm', '-rf', tmp])
+print(bcolors.OKGREEN + bcolors.BOLD + "[ ASCHECK PASS ]: Every case assembles to the same code as with gcc." + bcolors.ENDC)
@@ -0,0 +1,34 @@
+//!dtest description Functions are emitted one at a time; globals, types and declarations must still line up.
+//!dtest expect returncode 39
+
+int strlen(char *s);
+int later(int a);
+
+int first() {
+    static int calls;
+    calls = calls + 1;
+    return calls + strlen("abc");
+}
+
+int g;
+
+int second() {
+    struct pt {
+        int x;
+        int y;
+    } p;
+
+    p.x = 3;
+    p.y = later(4);
+    return p.x + p.y;
+}
+
+int later(int a) {
+    return a * 2 + g;
+}
+
+int main() {
+    g = 1;
+    first();
+    return first() + second() + strlen("hello, world") + 10;
+}
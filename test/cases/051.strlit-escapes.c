@@ -0,0 +1,17 @@
+//!dtest description String literals with quotes, backslashes and non-printables.
+//!dtest expect returncode 92
+
+#include "../dcc_assert.h"
+
+int strlen(char *s);
+
+int main() {
+    char *s = "a\\b\"c\n\x7f";
+
+    dcc_assert(strlen(s) == 7);
+    dcc_assert(s[3] == 34);
+    dcc_assert(s[5] == 10);
+    dcc_assert(s[6] == 127);
+
+    return s[1];
+}
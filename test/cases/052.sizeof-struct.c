@@ -0,0 +1,29 @@
+//!dtest description sizeof of structs, and of arrays and pointers built from the same types.
+//!dtest expect returncode 0
+
+#include "../dcc_assert.h"
+
+struct pair {
+    long a;
+    char b;
+};
+
+struct outer {
+    char c;
+    struct pair p;
+};
+
+int main() {
+    struct pair x;
+    struct pair arr[3];
+    struct pair *p1;
+    struct pair *p2;
+
+    dcc_assert(sizeof(struct pair) == 16);
+    dcc_assert(sizeof(x) == 16);
+    dcc_assert(sizeof(arr) == 48);
+    dcc_assert(sizeof(struct outer) == 24);
+    dcc_assert(sizeof(p1) == sizeof(p2));
+
+    return 0;
+}
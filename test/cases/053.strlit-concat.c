@@ -0,0 +1,18 @@
+//!dtest description Adjacent string literals are joined.
+//!dtest expect returncode 12
+
+#include "../dcc_assert.h"
+
+int strlen(char *s);
+
+int main() {
+    char *s = "ab" "c\n" "" "defgh" "\x7f";
+
+    dcc_assert(s[2] == 99);
+    dcc_assert(s[3] == 10);
+    dcc_assert(s[4] == 100);
+    dcc_assert(s[9] == 127);
+    dcc_assert(s[10] == 0);
+
+    return strlen(s) + strlen("x" "y");
+}
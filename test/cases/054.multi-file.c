@@ -0,0 +1,13 @@
+//!dtest description Several translation units compiled in parallel and linked together.
+//!dtest with with/054.counter.c
+//!dtest with with/054.scale.c
+//!dtest expect returncode 57
+
+int counter_bump(int by);
+int scale(int x);
+
+int main() {
+    counter_bump(3);
+    counter_bump(4);
+    return scale(counter_bump(0)) + 1;
+}
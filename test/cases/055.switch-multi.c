@@ -0,0 +1,33 @@
+//!dtest description switch/case with several statements under a label.
+//!dtest expect returncode 61
+
+int classify(int op) {
+    int a;
+    int b;
+
+    a = 0;
+    b = 0;
+    switch (op) {
+        case 0:
+            a = 1;
+            b = 2;
+            break;
+        case 1:
+            a = 10;
+            b = 20;
+        case 2:
+            a = a + 3;
+            b = b + 4;
+            break;
+        default:
+            a = 7;
+            b = 7;
+    }
+
+    return a + b;
+}
+
+int main() {
+    // 3 + 37 + 7 + 14
+    return classify(0) + classify(1) + classify(2) + classify(9);
+}
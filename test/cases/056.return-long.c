@@ -0,0 +1,13 @@
+//!dtest description Returning a long.
+//!dtest expect returncode 42
+
+long big;
+
+long get() {
+    return big;
+}
+
+int main() {
+    big = 4294967338;
+    return get() - 4294967296;
+}
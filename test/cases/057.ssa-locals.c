@@ -0,0 +1,93 @@
+//!dtest description Scalar locals promoted to temps, across loops, swaps, early returns and branches.
+//!dtest expect returncode 152
+
+int fib(int n) {
+    int a;
+    int b;
+    int t;
+
+    a = 0;
+    b = 1;
+    while (n > 0) {
+        t = a + b;
+        a = b;
+        b = t;
+        n = n - 1;
+    }
+
+    return a;
+}
+
+// the phis for x and y swap on every trip around
+int swaps(int n) {
+    int x = 1;
+    int y = 2;
+    int t;
+
+    while (n > 0) {
+        t = x;
+        x = y;
+        y = t;
+        n = n - 1;
+    }
+
+    return x * 10 + y;
+}
+
+int triangle(int n) {
+    int i;
+    int j;
+    int sum;
+
+    sum = 0;
+    for (i = 0; i < n; i++)
+        for (j = 0; j <= i; j++)
+            sum = sum + 1;
+
+    return sum;
+}
+
+int narrow(int n) {
+    short s;
+    char c;
+
+    s = 0;
+    c = 0;
+    while (n > 0) {
+        s = s + 300;
+        c = n > 2 ? c + 1 : c;
+        n = n - 1;
+    }
+
+    return s / 100 + c;
+}
+
+int find(int n) {
+    int i;
+
+    i = 0;
+    while (i < 100) {
+        if (i * i >= n)
+            return i;
+        i = i + 1;
+    }
+
+    return 0;
+}
+
+// v has its address taken, so it stays in memory; p doesn't
+int through(int n) {
+    int v;
+    int *p;
+
+    v = n;
+    p = &v;
+    *p = *p + 1;
+
+    return v;
+}
+
+int main() {
+    // 89 + 21 + 15 + 14 + 8 + 5
+    return fib(11) + swaps(3) + triangle(5) + narrow(4) + find(50) + through(4);
+}
@@ -0,0 +1,68 @@
+//!dtest description Constant expressions: array sizes, case labels, static initializers, and folding.
+//!dtest expect returncode 62
+
+int table[2 * 3 + 1];
+int g = (1 << 4) | 3;               // 19
+long big = 1L << 40;
+unsigned u = -1;
+char c = 300;                       // 44
+int neg = -7 / 2 + (-7 % 2);        // -4
+char *name = "dcc";
+int *none = 0;
+
+int classify(int n) {
+    switch (n) {
+        case 1 + 1:
+            return 10;
+        case 'a' - 'A' + 1:         // 33
+            return 20;
+        case sizeof(int[4]) / sizeof(int):
+            return 30;
+        default:
+            return 0;
+    }
+}
+
+int counter() {
+    static int calls = 10 * 10;
+    calls = calls + 1;
+    return calls;
+}
+
+int main() {
+    int local[sizeof(table) / sizeof(int) - 2];
+    int r;
+
+    r = 0;
+    if (sizeof(local) / sizeof(int) != 5)
+        return 1;
+    if (g != 19)
+        return 2;
+    if (big / 1024 / 1024 / 1024 != 1024)
+        return 3;
+    if (u != 4294967295u)
+        return 4;
+    if (c != 44)
+        return 5;
+    if (neg != -4)
+        return 6;
+    if (counter() != 101 || counter() != 102)
+        return 7;
+    if (name[2] != 'c' || none != 0)
+        return 8;
+
+    // an unsuffixed hex constant too big for an int is an unsigned int
+    long m = ~0xFFFFFFFF;
+    if (!(0xFFFFFFFF == -1) || m != 0 || 4294967295 == -1)
+        return 9;
+
+    // sizeof gives a size_t, 64 bits
+    if (!(sizeof(char) - 2 > 4294967295))
+        return 10;
+
+    // folded, with no quads: operators that don't have any yet
+    r = r + (~0 & 0xf) + (5 ^ 3) + (0x100 >> 4) + !0;      // 15 + 6 + 16 + 1
+    r = r + (2 > 1 ? 3 : 4) + (0u - 1 > 0) + (-1 < 0u);     // 3 + 1 + 0
+
+    return r + classify(2) - classify(33) + classify(4) + classify(5);
+}
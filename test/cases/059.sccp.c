@@ -0,0 +1,75 @@
+//!dtest description Constants propagated through temps, phis and const globals, with the branches they decide pruned.
+//!dtest flags -O2
+//!dtest expect returncode 84
+
+static const int DEBUG = 0;
+const int LEVEL = 3;
+const char SHIFT = -2;
+int trace;
+
+int log_level(int x) {
+    if (DEBUG)
+        trace = trace + x;
+
+    if (LEVEL > 2)
+        return x + LEVEL;
+
+    return x;
+}
+
+// the divisions by zero are on branches that never run
+int guarded(int x) {
+    int zero = 0;
+    int r = 1;
+
+    if (zero)
+        r = x / zero;
+    else
+        r = r + 4;
+
+    return zero ? x % zero : r;
+}
+
+int mode_switch(int x) {
+    int mode = LEVEL * 2 - 1;
+    int r;
+
+    switch (mode) {
+        case 1:     r = x / (mode - 1); break;
+        case 5:     r = x + 20; break;
+        default:    r = 0;
+    }
+
+    return r;
+}
+
+// the same value on every way around the loop, and one that isn't
+int loop(int n) {
+    int k = 7;
+    int sum = 0;
+    int i = 0;
+
+    while (i < n) {
+        if (k != 7)
+            k = 100;
+        sum = sum + k;
+        i = i + 1;
+    }
+
+    return sum + k;
+}
+
+int main() {
+    int wide = 2147483647;
+    long w = wide + 1L;
+    char c = SHIFT;
+
+    if (w != 2147483648)
+        return 1;
+    if (c + 2)
+        return 2;
+    if (trace)
+        return 3;
+
+    return log_level(4) + guarded(9) + mode_switch(1) + loop(6) - c;
+}
@@ -0,0 +1,31 @@
+//!dtest description Functions that can reach their closing brace without a return.
+//!dtest expect returncode 23
+
+int count;
+
+// called for its side effect; the value is never used
+int bump(int n) {
+    count = count + n;
+}
+
+long sign(int x) {
+    if (x < 0)
+        return -1;
+    if (x > 0)
+        return 1;
+}
+
+// every case returns, so nothing comes after the switch
+int pick(int k) {
+    switch (k) {
+        case 0:     return 10;
+        default:    return 3;
+    }
+}
+
+int main() {
+    bump(4);
+    bump(6);
+
+    return count + sign(-5) + sign(9) + pick(0) + pick(7);
+}
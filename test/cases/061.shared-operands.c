@@ -0,0 +1,39 @@
+//!dtest description Constants, globals and callees used many times, sharing value table entries.
+//!dtest expect returncode 56
+
+int total;
+int arr[8];
+
+int twice(int x) {
+    return x + x;
+}
+
+int main() {
+    long l = 5;
+    unsigned u = 5;
+    char c = 5;
+    int *p;
+    int i;
+
+    // the same 5 as an int, a long, an unsigned and a char
+    total = 5 + l + u + c;                          // 20
+
+    i = 0;
+    while (i < 8) {
+        arr[i] = i;
+        i = i + 2;
+    }
+
+    // 2 used as an index and then taken off a pointer, which negates it
+    p = &arr[6];
+    p = p - 2;
+    total = total + *p + arr[2];                    // 4 + 2
+
+    total = total + twice(3) + twice(3) + twice(2); // 6 + 6 + 4
+    total = total - 1 + 1;
+
+    if (l - 5 != 0 || u - 5 != 0)
+        return 1;
+
+    return total + (arr[4] == 4) + (total == 42) * 13;
+}
@@ -0,0 +1,6 @@
+static int count;
+
+int counter_bump(int by) {
+    count = count + by;
+    return count;
+}
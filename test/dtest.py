@@ -1,5 +1,6 @@
 #!/usr/bin/env python3
 
+import argparse
 import os, sys
 import shlex
 import subprocess
@@ -25,13 +26,17 @@ class Test:
                  program_path: str,
                  expect_returncode: int,
                  skipped: bool,
-                 complete: bool):
+                 complete: bool,
+                 extra_sources: list,
+                 extra_flags: list):
         self.name = name
         self.description = description
         self.program_path = program_path
         self.expect_returncode = expect_returncode
         self.skipped = skipped
         self.complete = complete
+        self.extra_sources = extra_sources
+        self.extra_flags = extra_flags
 
 def get_test_cfg(p):
     name = p[:-2] # remove '.c'
@@ -39,6 +44,8 @@ def get_test_cfg(p):
     program_path = os.path.join(tests_path, p)
     expect_returncode = 0
     skipped = False
+    extra_sources = []
+    extra_flags = []
     f = open(os.path.join(tests_path, p), "r")
 
     for line in f:
@@ -50,6 +57,12 @@ def get_test_cfg(p):
             if tok[1] == "description":
                 description = tok[2]
 
+            if tok[1] == "with": # compile and link these too
+                extra_sources.append(os.path.join(tests_path, tok[2]))
+
+            if tok[1] == "flags": # compile with these too
+                extra_flags.extend(tok[2:])
+
             if tok[1] == "expect":
                 #ignore tok[2] / test type for time being
                 expect_returncode = int(tok[3])
@@ -58,10 +71,22 @@ def get_test_cfg(p):
 
     complete = not (name is None or description is None or program_path is None)
     
-    return Test(name, description, program_path, expect_returncode, skipped, complete)
+    return Test(name, description, program_path, expect_returncode, skipped, complete, extra_sources, extra_flags)
 
 # ------
 
+parser = argparse.ArgumentParser(description="Run the dcc test cases.")
+parser.add_argument('--backend', action='append', metavar='NAME',
+                    help="compile with -fbackend=NAME; repeat to run every case through each backend")
+parser.add_argument('--opt', action='append', metavar='LEVEL',
+                    help="compile with -OLEVEL; repeat to run every case at each level "
+                         "(a case's own flags still win)")
+args = parser.parse_args()
+
+# None: dcc's default, with no flag at all
+backends = args.backend or [None]
+levels = args.opt or [None]
+
 fails = 0
 skips = 0
 passes = 0
@@ -77,9 +102,12 @@ print()
 
 tests = [get_test_cfg(f) for f in sorted(os.listdir(tests_path)) if os.path.isfile(os.path.join(tests_path, f))]
 
-for test in tests:
+for test, backend, level in [(t, b, o) for t in tests for b in backends for o in levels]:
+    tags = ([] if backend is None else [backend]) + ([] if level is None else [f"-O{level}"])
+    label = test.name if not tags else f"{test.name} [{' '.join(tags)}]"
+
     if test.skipped:
-        print(bcolors.BOLD + bcolors.OKCYAN + f"[SKIP] Skipping test {test.name}" + bcolors.ENDC)
+        print(bcolors.BOLD + bcolors.OKCYAN + f"[SKIP] Skipping test {label}" + bcolors.ENDC)
         skips += 1
         continue
 
@@ -88,15 +116,17 @@ for test in tests:
         fails += 1
         continue
 
-    print(f"{'Test: ' + test.name:<40}", end='')
+    print(f"{'Test: ' + label:<50}", end='')
 
-    command = projinfo['exec_prep'].replace(
-        "[SOURCE]", test.program_path)
+    flags = ' '.join(([] if level is None else [f"-O{level}"]) + test.extra_flags +
+                     ([] if backend is None else [f"-fbackend={backend}"]))
+    command = projinfo['exec_prep'].replace("[FLAGS]", flags).replace(
+        "[SOURCE]", ' '.join([test.program_path] + test.extra_sources))
 
     compile = subprocess.run(command, shell=True)
     if compile.returncode:
         print(bcolors.WARNING + bcolors.BOLD + '[FAIL]' + bcolors.ENDC)
-        print(f'Error: Failed compiling test {test.name}!')
+        print(f'Error: Failed compiling test {label}!')
         fails += 1
         continue
 
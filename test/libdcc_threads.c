@@ -0,0 +1,156 @@
+/*
+ * libdcc_threads.c
+ *
+ * dcc.h says several threads may compile independent inputs at the same
+ * time. This compiles each file it's given to IR and to assembly, at -O0,
+ * -O1 or -O2, first one after another and then all at once, each on its
+ * own thread, and checks that every output and status is the same both
+ * ways. A few inputs dcc can't compile are thrown in, to check that their
+ * failure stays with their own compilation.
+ *
+ * Usage: libdcc_threads file.c... (each run through gcc -E first)
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dcc.h"
+
+struct job {
+    const char *name;
+    char *src;
+    size_t len;
+    struct dcc_options opts;
+
+    // what compiling it gave
+    int status;
+    char *out;
+    size_t out_len;
+};
+
+// a syntax error, and something that gets to an internal error
+static const char *bad[] = {
+    "int main() { return 1 +; }\n",
+    "int main() { int x; x = 1; return x << 2; }\n",
+};
+
+static char *slurp(FILE *f, size_t *len) {
+    size_t cap = 4096, n = 0;
+    char *buf = malloc(cap);
+
+    size_t got;
+    while ((got = fread(buf + n, 1, cap - n, f)) > 0) {
+        n += got;
+        if (n == cap)
+            buf = realloc(buf, cap *= 2);
+    }
+
+    *len = n;
+    return buf;
+}
+
+static char *preprocess(const char *path, size_t *len) {
+    char *cmd = malloc(strlen(path) + 32);
+    sprintf(cmd, "gcc -E '%s'", path);
+
+    FILE *p = popen(cmd, "r");
+    if (!p) {
+        perror("popen");
+        exit(1);
+    }
+
+    char *src = slurp(p, len);
+    if (pclose(p)) {
+        fprintf(stderr, "libdcc_threads: can't preprocess %s\n", path);
+        exit(1);
+    }
+
+    free(cmd);
+    return src;
+}
+
+static void *compile(void *arg) {
+    struct job *j = arg;
+
+    FILE *out = tmpfile();
+    if (!out) {
+        perror("tmpfile");
+        exit(1);
+    }
+
+    j->opts.out_fd = fileno(out);
+    j->status = dcc_compile_buffer(j->src, j->len, &j->opts);
+
+    rewind(out);
+    j->out = slurp(out, &j->out_len);
+    fclose(out);
+
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    int nsrc = argc - 1 + (int)(sizeof(bad) / sizeof(*bad));
+    int n = nsrc * 2;
+
+    struct job *serial = calloc(n, sizeof(struct job));
+    struct job *threaded = calloc(n, sizeof(struct job));
+
+    for (int i = 0; i < n; i++) {
+        struct job *j = &serial[i];
+        int s = i / 2;
+
+        if (s < argc - 1) {
+            j->name = argv[s + 1];
+            j->src = preprocess(j->name, &j->len);
+        } else {
+            j->name = "(bad input)";
+            j->src = strdup(bad[s - (argc - 1)]);
+            j->len = strlen(j->src);
+        }
+
+        j->opts = (struct dcc_options){
+            .output = i % 2 ? DCC_OUTPUT_ASM : DCC_OUTPUT_IR,
+            .mirror_fd = -1,
+            .opt_level = s % 3,
+        };
+
+        threaded[i] = *j;
+    }
+
+    for (int i = 0; i < n; i++)
+        compile(&serial[i]);
+
+    pthread_t *threads = calloc(n, sizeof(pthread_t));
+    for (int i = 0; i < n; i++) {
+        if (pthread_create(&threads[i], NULL, compile, &threaded[i])) {
+            perror("pthread_create");
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < n; i++)
+        pthread_join(threads[i], NULL);
+
+    int fails = 0;
+    for (int i = 0; i < n; i++) {
+        const struct job *a = &serial[i], *b = &threaded[i];
+        const char *kind = i % 2 ? "asm" : "IR";
+
+        if (a->status != b->status) {
+            fprintf(stderr, "FAIL %s (%s): status %d alone, %d on a thread\n", a->name, kind, a->status, b->status);
+            fails++;
+        } else if (a->out_len != b->out_len || memcmp(a->out, b->out, a->out_len)) {
+            fprintf(stderr, "FAIL %s (%s): different output on a thread\n", a->name, kind);
+            fails++;
+        } else if (i / 2 >= argc - 1 && !a->status) {
+            fprintf(stderr, "FAIL %s (%s): compiled\n", a->name, kind);
+            fails++;
+        }
+    }
+
+    printf("%d compilations on %d threads: %s\n", n, n, fails ? "FAIL" : "PASS");
+    return fails != 0;
+}